@@ -0,0 +1,34 @@
+/**
+ * LEGO Master - Módulo de Balanceo de Carga
+ * 
+ * Componente independiente que decide qué brazo suspender en cada
+ * celda según una política configurable, fuera del ciclo del dispensador.
+ */
+
+#ifndef BALANCEADOR_H
+#define BALANCEADOR_H
+
+#include "common.h"
+
+// Muestras por brazo para la política de ventana deslizante
+#define MUESTRAS_VENTANA    33
+
+// Nombre legible de una política
+const char* nombre_politica_balanceo(PoliticaBalanceo politica);
+
+// Interpreta "max", "ventana" o "turno" (false si no es válida)
+bool parsear_politica_balanceo(const char* texto, PoliticaBalanceo *politica);
+
+// El dispensador avisa cuántas piezas soltó; cada Y piezas se balancea
+void notificar_piezas_dispensadas(int n);
+
+// Despierta al balanceador para que observe la terminación
+void despertar_balanceador(void);
+
+// Hilo que aplica la política de balanceo
+void* thread_balanceador(void* arg);
+
+// Imprime la utilización de cada brazo durante duracion_us
+void imprimir_utilizacion_brazos(uint64_t duracion_us);
+
+#endif // BALANCEADOR_H
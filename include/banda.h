@@ -16,7 +16,9 @@ void inicializar_banda(BandaTransportadora *banda, int longitud, int velocidad);
 // Destruye los recursos de la banda
 void destruir_banda(BandaTransportadora *banda);
 
-// Función del hilo de la banda
+// Función del hilo de la banda. Con config.tramos_banda > 1 la banda se
+// divide en tramos contiguos; el hilo de la banda avanza el primero y lanza
+// un trabajador por cada uno de los demás, sincronizados por una barrera
 void* thread_banda(void* arg);
 
 // Agregar pieza a una posición
@@ -25,4 +27,8 @@ int agregar_pieza_posicion(PosicionBanda *pos, Pieza pieza);
 // Retirar pieza de una posición (retorna el índice o -1)
 int retirar_pieza_posicion(PosicionBanda *pos, int tipo_buscado);
 
+// Cuenta una pieza como caída al tacho (estadísticas y traza); retorna el total del tacho.
+// El llamador descuenta la pieza de su ubicación.
+int pieza_al_tacho(const Pieza *pieza, int celda_id, int brazo_id);
+
 #endif // BANDA_H
@@ -9,6 +9,7 @@
 #define BRAZO_H
 
 #include "common.h"
+#include "pool_brazos.h"
 
 // Estructura para pasar argumentos al hilo del brazo
 typedef struct {
@@ -16,7 +17,24 @@ typedef struct {
     int brazo_id;
 } ArgsBrazo;
 
-// Función del hilo de un brazo robótico
+// Cambia el estado acumulando el tiempo pasado en el anterior (requiere brazo->mutex)
+void cambiar_estado_brazo(BrazoRobotico *brazo, EstadoBrazo nuevo);
+
+// Tiempos ocupado y suspendido hasta `ahora`, incluido el estado en curso (toma brazo->mutex)
+void tiempos_brazo(BrazoRobotico *brazo, uint64_t ahora, uint64_t *ocupado, uint64_t *suspendido);
+
+// Suspende un brazo ocioso por delta_ms; el temporizador lo reanuda al vencer
+bool suspender_brazo(BrazoRobotico *brazo, int delta_ms);
+
+// Despierta a los brazos suspendidos para que observen la terminación
+void despertar_brazos_suspendidos(void);
+
+// Un paso de la máquina de estados del brazo: retoma su etapa y avanza
+// hasta la próxima espera, que retorna en lugar de dormirla. Lo ejecuta
+// thread_brazo o, con --pool-brazos, un hilo cualquiera del pool
+Espera paso_brazo(int celda_id, int brazo_id);
+
+// Función del hilo de un brazo robótico (sin --pool-brazos)
 void* thread_brazo(void* arg);
 
 #endif // BRAZO_H
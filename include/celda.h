@@ -8,18 +8,55 @@
 #define CELDA_H
 
 #include "common.h"
+#include <stdatomic.h>
+
+// Faltantes empaquetados: el tipo t (1..num_tipos) ocupa los bits
+// 8*((t-1) % 8) de la palabra (t-1) / 8. Leerlos y consumirlos no
+// requiere caja->mutex; con los 4 tipos por defecto todo cabe en una palabra
+#define BITS_POR_TIPO       8
+#define MASCARA_TIPO        0xFFull
+
+_Static_assert(MAX_PIEZAS_CAJA <= MASCARA_TIPO, "un tipo no puede faltar más de 255 veces");
+_Static_assert(MAX_TIPOS_PIEZA % TIPOS_POR_PALABRA == 0,
+               "MAX_TIPOS_PIEZA debe ser múltiplo de TIPOS_POR_PALABRA");
+
+// Piezas del tipo que aún le faltan a la caja (lectura atómica, sin mutex)
+static inline int caja_faltan(CajaEmpaquetado *caja, int tipo) {
+    int t = tipo - 1;
+    uint64_t palabra = atomic_load_explicit(&caja->faltan[t / TIPOS_POR_PALABRA], memory_order_acquire);
+    return (int)((palabra >> (t % TIPOS_POR_PALABRA * BITS_POR_TIPO)) & MASCARA_TIPO);
+}
 
 // Inicializa una celda de empaquetado
 void inicializar_celda(CeldaEmpaquetado *celda, int id, int posicion, 
                        int piezas_por_tipo[MAX_TIPOS_PIEZA]);
 
+// Cambia el estado de la celda (requiere celda->mutex)
+void cambiar_estado_celda(CeldaEmpaquetado *celda, EstadoCelda nuevo);
+
 // Destruye los recursos de una celda
 void destruir_celda(CeldaEmpaquetado *celda);
 
-// Verifica si la caja tiene todas las piezas necesarias
+// Descuenta un faltante del tipo con un CAS; false si ya no falta ninguno
+bool caja_tomar_faltante(CajaEmpaquetado *caja, int tipo);
+
+// Recalcula los faltantes desde los conteos (requiere caja->mutex; tras
+// cambiar las piezas necesarias)
+void caja_recalcular_faltantes(CajaEmpaquetado *caja);
+
+// Coloca una pieza cuyo faltante ya se tomó (requiere caja->mutex)
+void caja_agregar_pieza(CajaEmpaquetado *caja, Pieza pieza);
+
+// Saca de la caja una pieza del tipo dado (requiere caja->mutex)
+bool caja_sacar_pieza(CajaEmpaquetado *caja, int tipo, Pieza *pieza);
+
+// Vacía la caja para el siguiente SET (requiere caja->mutex)
+void caja_vaciar(CajaEmpaquetado *caja);
+
+// Verifica si a la caja ya no le falta ninguna pieza (sin mutex)
 bool verificar_caja_completa(CajaEmpaquetado *caja);
 
-// Verifica si se necesita una pieza de cierto tipo
+// Verifica si se necesita una pieza de cierto tipo (sin mutex)
 bool necesita_pieza_tipo(CajaEmpaquetado *caja, int tipo);
 
 // Devuelve las piezas de la caja/buffer a la banda para que otra celda las use
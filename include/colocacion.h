@@ -0,0 +1,32 @@
+/**
+ * LEGO Master - Módulo de Colocación de Celdas
+ * 
+ * Elige las posiciones de las celdas en la banda. Además de la
+ * distribución uniforme, puede buscar la distribución que maximiza
+ * los SETs completados (y minimiza el tacho) evaluando muchos
+ * candidatos con un modelo de flujo simplificado en paralelo.
+ */
+
+#ifndef COLOCACION_H
+#define COLOCACION_H
+
+#include "common.h"
+
+// Máximo de distintas posiciones por celda en la rejilla de búsqueda
+#define COLOCACION_REJILLA      16
+// Repeticiones (semillas) por candidato en el modelo
+#define COLOCACION_REPETICIONES 4
+
+// Calcula la distribución uniforme
+void colocacion_uniforme(ConfiguracionSistema *config);
+
+// Interpreta "a,b,c" como posiciones explícitas (false si no es válida)
+bool parsear_posiciones(const char* texto, int posiciones[MAX_CELDAS], int *num_posiciones);
+
+// Valida posiciones explícitas contra la configuración
+bool validar_posiciones(ConfiguracionSistema *config, const char **error);
+
+// Busca la mejor distribución y la deja en config->posiciones_celdas
+void colocacion_optimizada(ConfiguracionSistema *config);
+
+#endif // COLOCACION_H
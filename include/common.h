@@ -14,17 +14,32 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
+#include "perfil_locks.h"
+
 // Configuración del sistema
-#define MAX_TIPOS_PIEZA     4       // Tipos de piezas: A, B, C, D
-#define MAX_POSICIONES      100     // Posiciones en la banda
+#define MAX_TIPOS_PIEZA     64      // Capacidad de tipos de pieza (en uso: config.num_tipos)
+#define TIPOS_PIEZA_DEFECTO 4       // Tipos A, B, C, D de los parámetros posicionales
+#define TIPOS_POR_PALABRA   8       // Faltantes de la caja: 8 bits por tipo en 64 bits
+#define PALABRAS_FALTAN     (MAX_TIPOS_PIEZA / TIPOS_POR_PALABRA)
+#define MAX_POSICIONES      400     // Posiciones en la banda (todas las bandas de la planta)
 #define MAX_PIEZAS_POS      10      // Máximo de piezas por posición
-#define MAX_CELDAS          4       // Máximo de celdas de empaquetado
+#define MAX_CELDAS          64      // Máximo de celdas de empaquetado (toda la planta)
+#define MAX_CELDAS_PARAMETRO 4      // Máximo del parámetro <celdas> (una sola banda)
 #define BRAZOS_POR_CELDA    4       // Brazos robóticos por celda
 #define MAX_BRAZOS_ACTIVOS  2       // Máx brazos retirando piezas simultáneamente
 #define MAX_BUFFER_CELDA    20      // Buffer de piezas esperando en celda
+#define MAX_PIEZAS_CAJA     64      // Máximo de piezas en un SET
+#define MAX_VUELTAS         16      // Vueltas máximas en la banda circular
+#define VUELTAS_DEFECTO     3       // Vueltas por defecto de --banda-circular
+#define MAX_TRAMOS_BANDA    16      // Hilos que pueden avanzar la banda por tramos
+#define MAX_BANDAS          8       // Bandas de la planta (--topologia)
+#define MAX_NOMBRE_BANDA    16
+#define MAX_PUNTOS_INYECCION 8      // Puntos de inyección a mitad de banda (--inyeccion)
 
 // Keys para memoria compartida
 #define SHM_KEY_BANDA       2222
@@ -55,8 +70,11 @@ typedef enum {
 
 // Representación de una pieza
 typedef struct {
-    int tipo;               // Tipo de pieza (1-4, 0 = vacío)
+    int tipo;               // Tipo de pieza (1..num_tipos, 0 = vacío)
     int id_unico;           // ID único para tracking
+    uint64_t dispensada_us; // Cuándo fue dispensada (µs monotónico)
+    int vueltas;            // Veces que recirculó al inicio de la banda
+    int reservada_para;     // Celda que la reservó (-1 = libre)
 } Pieza;
 
 // Posición en la banda transportadora
@@ -70,11 +88,17 @@ typedef struct {
 typedef struct {
     PosicionBanda posiciones[MAX_POSICIONES];
     int longitud;                    // N - longitud real de la banda
-    int velocidad;                   // v - pasos por segundo
+    atomic_int velocidad;            // v - pasos por segundo (la ajusta el control adaptativo)
     bool activa;                     // Si la banda está en operación
-    pthread_mutex_t mutex_global;    // Para operaciones globales
+    pthread_mutex_t mutex_global[MAX_BANDAS];   // Para operaciones globales, uno por banda de la planta
 } BandaTransportadora;
 
+// Etapa de la máquina de estados de un brazo (ver paso_brazo)
+typedef enum {
+    ETAPA_BUSCAR,           // Buscando pieza en la banda o el buffer
+    ETAPA_EN_MANO           // Trasladando la pieza retirada hacia la caja
+} EtapaBrazo;
+
 // Brazo robótico
 typedef struct {
     int id;
@@ -83,13 +107,27 @@ typedef struct {
     int piezas_movidas;              // Total de piezas movidas
     Pieza pieza_actual;              // Pieza que está manipulando
     pthread_mutex_t mutex;
-    time_t tiempo_suspension;        // Cuándo fue suspendido
+    uint64_t tiempo_suspension;      // Cuándo fue suspendido (µs monotónico)
+    pthread_cond_t cond_reanudar;    // Señalada por el temporizador al vencer Δt2
+    int temporizador_id;             // Temporizador de reanudación pendiente
+    // Utilización (tiempo acumulado por estado)
+    uint64_t ultimo_cambio_us;       // Instante del último cambio de estado
+    uint64_t tiempo_ocupado_us;      // En RETIRANDO o COLOCANDO
+    uint64_t tiempo_suspendido_us;   // En SUSPENDIDO
+    // Máquina de estados (la retoma el paso siguiente, en cualquier hilo)
+    EtapaBrazo etapa;
+    uint64_t listo_us;               // Fin del traslado de la pieza en mano
 } BrazoRobotico;
 
 // Caja de empaquetado
 typedef struct {
     int piezas_por_tipo[MAX_TIPOS_PIEZA];   // Piezas actuales por tipo
     int piezas_necesarias[MAX_TIPOS_PIEZA]; // Piezas requeridas por tipo
+    _Atomic uint64_t faltan[PALABRAS_FALTAN]; // Piezas que faltan por tipo, empaquetadas
+    int receta;                              // Receta del pedido en curso (-1 = ninguna)
+    int celda_id;                            // Celda dueña de la caja
+    Pieza contenido[MAX_PIEZAS_CAJA];        // Piezas colocadas (conservan su ID)
+    int num_contenido;
     bool completa;                           // Si el SET está completo
     pthread_mutex_t mutex;                   // Mutex para acceso a la caja
     sem_t sem_acceso;                        // Solo 1 brazo coloca a la vez
@@ -99,7 +137,9 @@ typedef struct {
 typedef struct {
     int id;
     int posicion_banda;              // xi - posición en la banda
+    int banda;                       // Banda de la planta en la que está la posición
     EstadoCelda estado;
+    uint64_t estado_desde_us;        // Último cambio de estado (línea de tiempo)
     BrazoRobotico brazos[BRAZOS_POR_CELDA];
     CajaEmpaquetado caja;
     sem_t sem_brazos_retirando;      // Controla máx 2 brazos retirando
@@ -115,20 +155,104 @@ typedef struct {
     // Control de tiempo sin progreso (para devolución de piezas)
     time_t ultimo_progreso;          // Última vez que se colocó una pieza
     int ciclos_sin_progreso;         // Contador de ciclos sin avance
+    uint64_t inicio_set_us;          // Cuándo empezó el SET actual (latencia de caja)
 } CeldaEmpaquetado;
 
+// Políticas de balanceo de carga entre brazos
+typedef enum {
+    BALANCEO_MAX_HISTORICO,  // Suspende al que más piezas movió en total
+    BALANCEO_VENTANA,        // Suspende al de mayor tasa en la ventana reciente
+    BALANCEO_TURNO           // Suspende por turnos rotativos (round-robin)
+} PoliticaBalanceo;
+
+// Modos de colocación de celdas en la banda
+typedef enum {
+    COLOCACION_UNIFORME,     // (i + 1) * longitud / (celdas + 1)
+    COLOCACION_EXPLICITA,    // Posiciones dadas con --posiciones
+    COLOCACION_OPTIMIZADA    // Búsqueda por simulación de candidatos
+} ModoColocacion;
+
+// Banda de la planta: ocupa las posiciones [inicio, inicio + longitud) de
+// BandaTransportadora. Lo que llega a su final pasa a las bandas destino
+// (por turnos) o, si no tiene, cae al tacho
+typedef struct {
+    char nombre[MAX_NOMBRE_BANDA];
+    int inicio;
+    int longitud;
+    int dispensadores;               // Dispensadores al inicio (0 = solo recibe de otras bandas)
+    int destinos[MAX_BANDAS];
+    int num_destinos;
+} DescripcionBanda;
+
+// Cómo se mezcla lo inyectado con lo que ya trae la banda
+typedef enum {
+    MEZCLA_COMPLETA,         // Llena los huecos de la posición hasta el cupo
+    MEZCLA_CEDE              // Solo inyecta si la posición llega vacía
+} PoliticaMezcla;
+
+// Punto de inyección a mitad de banda: sus dispensadores sueltan los tipos
+// que piden las celdas de más adelante y las celdas anteriores devuelven
+// ahí cuando su lugar habitual está lleno
+typedef struct {
+    int posicion;
+    int cupo;                        // Piezas por ciclo y máximo en la posición
+    PoliticaMezcla politica;
+} PuntoInyeccion;
+
+// Formatos del reporte final legible por máquina
+typedef enum {
+    REPORTE_NINGUNO,
+    REPORTE_JSON,
+    REPORTE_CSV
+} FormatoReporte;
+
 // Configuración del sistema
 typedef struct {
     int num_dispensadores;
     int num_celdas;
     int num_sets;
+    int num_tipos;                   // Tipos de pieza en uso (1..MAX_TIPOS_PIEZA)
     int piezas_por_tipo[MAX_TIPOS_PIEZA];   // Ci - piezas de cada tipo por SET
     int longitud_banda;              // N
     int velocidad_banda;             // v (pasos/segundo)
+    int tramos_banda;                // Hilos que avanzan la banda, uno por tramo (1 = un solo hilo)
+    bool topologia;                  // Varias bandas descritas en un archivo (ignora <celdas> y N)
+    char archivo_topologia[256];
+    DescripcionBanda bandas[MAX_BANDAS];    // Sin --topologia, una sola banda con toda la longitud
+    int num_bandas;
+    bool velocidad_adaptativa;       // Ajustar v en marcha dentro de [min, max]
+    int velocidad_min;
+    int velocidad_max;
+    char log_velocidad[256];         // Archivo CSV de la velocidad en el tiempo ("" = ninguno)
+    bool contrapresion;              // Retener piezas en el alimentador si las celdas no dan abasto
+    double umbral_contrapresion;     // Presión (0-1) desde la que se retiene
+    bool reservas;                   // Reservar las piezas en la banda para una celda
+    bool asignacion_optima;          // Repartir las reservas con el optimizador global
+    bool pedidos;                    // Recetas de una cola de pedidos (ignora <sets> y Ci)
+    char archivo_pedidos[256];
+    PuntoInyeccion puntos_inyeccion[MAX_PUNTOS_INYECCION];  // Ordenados por posición
+    int num_puntos_inyeccion;
     int delta_t1_max;                // Máx tiempo operador (ms)
     int delta_t2;                    // Tiempo suspensión brazo (ms)
     int Y;                           // Piezas para trigger de balanceo
+    PoliticaBalanceo politica_balanceo;
+    int ventana_balanceo_ms;         // Ventana de la política BALANCEO_VENTANA
+    int hilos_pool_brazos;           // Hilos del pool de brazos (0 = un hilo por brazo)
     int posiciones_celdas[MAX_CELDAS];      // Posiciones xi
+    ModoColocacion modo_colocacion;
+    int intervalo_gestor_ms;         // Periodo de muestreo del gestor de celdas
+    double objetivo_sets_min;        // Throughput objetivo (SETs/min, 0 = sin objetivo)
+    char log_gestor[256];            // Archivo CSV de decisiones del gestor ("" = ninguno)
+    char socket_metricas[108];       // Socket Unix de métricas en vivo ("" = ninguno)
+    FormatoReporte formato_reporte;  // Reporte final legible por máquina
+    char archivo_reporte[256];       // Destino del reporte ("" = reporte.<formato>)
+    bool modo_continuo;              // Producción sin límite de SETs
+    int duracion_s;                  // Duración en modo continuo (0 = hasta señal)
+    int ventana_metricas_s;          // Ventana de las métricas periódicas (0 = sin reporte)
+    bool banda_circular;             // Las piezas no recogidas vuelven a la posición 0
+    int max_vueltas;                 // Vueltas antes de caer al tacho (banda circular)
+    unsigned int semilla;            // Semilla de rand() (reproducir una corrida)
+    int verificar_invariantes_ms;    // Periodo del verificador de invariantes (0 = apagado)
     bool sistema_activo;
 } ConfiguracionSistema;
 
@@ -139,12 +263,56 @@ typedef struct {
     int total_piezas_tacho;
     int cajas_ok;
     int cajas_fail;
+    int piezas_confirmadas;          // Piezas que salieron en cajas OK
+    int piezas_rechazadas;           // Piezas descartadas con cajas FAIL
+    int piezas_pedidas_ok;           // Piezas que pedían las recetas de las cajas OK
+    int recirculaciones;             // Reingresos a la posición 0 (banda circular)
+    int piezas_devueltas;            // Piezas que las celdas devolvieron a la banda
+    int vueltas_confirmadas[MAX_VUELTAS + 1];   // Piezas confirmadas por vueltas dadas
+    int vueltas_tacho[MAX_VUELTAS + 1];         // Piezas al tacho por vueltas dadas
     int piezas_por_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
     pthread_mutex_t mutex;
     // Métricas para gestión dinámica
     int piezas_tacho_ultimo_ciclo;   // Piezas al tacho desde última revisión
 } Estadisticas;
 
+// Instantánea del fin de la corrida: contadores copiados y valores derivados
+typedef struct {
+    // Copia de Estadisticas
+    int total_piezas_dispensadas;
+    int piezas_en_tacho[MAX_TIPOS_PIEZA];
+    int total_piezas_tacho;
+    int cajas_ok;
+    int cajas_fail;
+    int piezas_confirmadas;
+    int piezas_rechazadas;
+    int recirculaciones;
+    int piezas_devueltas;
+    int vueltas_confirmadas[MAX_VUELTAS + 1];
+    int vueltas_tacho[MAX_VUELTAS + 1];
+    int piezas_por_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+    int piezas_tacho_ultimo_ciclo;
+    // Por celda y por brazo
+    int cajas_ok_celda[MAX_CELDAS];
+    int cajas_fail_celda[MAX_CELDAS];
+    int piezas_movidas[MAX_CELDAS][BRAZOS_POR_CELDA];
+    double ocupacion_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];   // Fracción del tiempo de pared
+    double suspension_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+    // Balance de piezas
+    int piezas_por_set;
+    int piezas_esperadas;
+    int piezas_en_cajas;
+    int piezas_perdidas;
+    // Tiempos y tasas
+    double tiempo_pared_s;
+    double tiempo_cpu_usuario_s;
+    double tiempo_cpu_sistema_s;
+    double sets_por_segundo;
+    double piezas_por_segundo;
+    double tacho_por_segundo;
+    double fraccion_tacho;           // Tacho / dispensadas
+} ResumenOperacion;
+
 // Estructura principal del sistema compartido
 typedef struct {
     ConfiguracionSistema config;
@@ -152,7 +320,7 @@ typedef struct {
     CeldaEmpaquetado celdas[MAX_CELDAS];
     Estadisticas stats;
     int piezas_dispensadas_ciclo;    // Para trigger de balanceo cada Y piezas
-    bool terminar;                   // Flag para terminar simulación
+    atomic_bool terminar;            // Flag para terminar simulación (lo leen todos los hilos)
     // Control de SETs completados
     int sets_en_proceso;             // SETs que están siendo llenados actualmente
     int sets_completados_total;      // Total de SETs completados (OK + pendientes de confirmar)
@@ -166,9 +334,12 @@ typedef struct {
     int ciclos_inactiva[MAX_CELDAS];      // Ciclos sin actividad por celda
 } SistemaLego;
 
+// SETs "esperados" en modo continuo (sin límite práctico)
+#define SETS_ILIMITADOS     (1 << 28)
+
 // Funciones de utilidad
 const char* nombre_tipo_pieza(int tipo);
-void imprimir_estadisticas(Estadisticas *stats, ConfiguracionSistema *config);
+void imprimir_estadisticas(const ResumenOperacion *r, const ConfiguracionSistema *config);
 void imprimir_estado_banda(BandaTransportadora *banda, int desde, int hasta);
 void imprimir_estado_celda(CeldaEmpaquetado *celda);
 
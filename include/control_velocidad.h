@@ -0,0 +1,49 @@
+/**
+ * LEGO Master - Módulo de Control Adaptativo de Velocidad
+ *
+ * Ajusta la velocidad de la banda (y con ella el ritmo del dispensador)
+ * entre un mínimo y un máximo configurados. Cada periodo toma una
+ * instantánea y observa:
+ *   - Densidad de piezas en las posiciones previas a cada celda activa
+ *   - Fracción de brazos ociosos en las celdas activas
+ *   - Ocupación de los buffers (celdas atrasadas)
+ *   - Piezas que llegan al tacho por segundo
+ * Acelera si la banda llega rala y los brazos esperan; frena si las
+ * celdas se atrasan o las piezas se pierden en el tacho.
+ */
+
+#ifndef CONTROL_VELOCIDAD_H
+#define CONTROL_VELOCIDAD_H
+
+#include "common.h"
+
+// Parámetros del controlador de velocidad
+#define VELOCIDAD_PERIODO_MS        500     // Periodo de muestreo
+#define VELOCIDAD_VENTANA_CELDA     3       // Posiciones observadas antes de cada celda
+#define VELOCIDAD_ALFA              0.5     // Suavizado exponencial de las señales
+#define VELOCIDAD_DENSIDAD_RALA     0.5     // Piezas por posición bajo las que la banda va rala
+#define VELOCIDAD_OCIOSOS_ALTO      0.5     // Fracción de brazos ociosos que pide acelerar
+#define VELOCIDAD_BUFFER_ALTO       0.5     // Ocupación de buffers que indica atraso
+#define VELOCIDAD_TACHO_ALTO        0.5     // Piezas/s al tacho que piden frenar
+#define VELOCIDAD_PASO              0.25    // Cambio relativo por decisión (mínimo 1 paso/s)
+#define VELOCIDAD_CICLOS_ESPERA     2       // Periodos mínimos entre cambios
+
+// Interpreta "MIN,MAX" (false si no es válido)
+bool parsear_rango_velocidad(const char *texto, int *minima, int *maxima);
+
+// Velocidad actual de la banda (pasos/segundo)
+int leer_velocidad_banda(void);
+
+// Velocidad con la que acotar plazos: la mínima si el control está activo
+int velocidad_banda_minima(void);
+
+// Despierta al controlador para que observe la terminación
+void despertar_control_velocidad(void);
+
+// Hilo que ajusta la velocidad
+void* thread_control_velocidad(void* arg);
+
+// Cambios realizados y velocidad media ponderada por tiempo
+void imprimir_resumen_velocidad(void);
+
+#endif // CONTROL_VELOCIDAD_H
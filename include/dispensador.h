@@ -2,6 +2,13 @@
  * LEGO Master - Módulo de Dispensadores
  * 
  * Genera piezas aleatorias y las coloca en el inicio de la banda.
+ * Tras la última pieza detecta el fin de la corrida por eventos
+ * (quiescencia.h): todos los SETs confirmados, piezas insuficientes
+ * para un SET más o sistema quieto sin celdas que liberar.
+ *
+ * Con contrapresión las piezas pasan por una cola de espera y solo
+ * entran a la banda si alguna celda puede absorberlas (posiciones
+ * previas, buffer y cola del operador).
  */
 
 #ifndef DISPENSADOR_H
@@ -9,10 +16,21 @@
 
 #include "common.h"
 
+#define ESPERA_MAX_PROGRESO_MS          1000    // Reevaluación del fin aunque no haya avisos
+#define MAX_LIBERACIONES_SIN_PROGRESO   3       // Rondas de devolución sin un SET confirmado
+
+// Contrapresión: con las celdas saturadas las piezas esperan en la cola del alimentador
+#define COLA_ALIMENTADOR_MAX            32      // Con la cola llena los dispensadores se detienen
+#define UMBRAL_CONTRAPRESION_DEFECTO    0.75    // Presión desde la que se retiene
+#define CONTRAPRESION_MAX_CICLOS        80      // Ciclos retenido antes de inyectar igual
+
 // Genera un ID único para cada pieza
 int generar_id_pieza(void);
 
 // Función del hilo de dispensadores
 void* thread_dispensador(void* arg);
 
+// Cola máxima y ciclos retenidos (si la contrapresión está activa)
+void imprimir_resumen_contrapresion(void);
+
 #endif // DISPENSADOR_H
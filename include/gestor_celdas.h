@@ -10,6 +10,16 @@
 
 #include "common.h"
 
+// Parámetros del controlador de celdas
+#define GESTOR_ALFA           0.5     // Suavizado exponencial de las señales
+#define GESTOR_KP             1.0     // Ganancia proporcional
+#define GESTOR_KI             0.2     // Ganancia integral (por segundo)
+#define GESTOR_K_TACHO        1.0     // Peso de la tasa de tacho (piezas/s)
+#define GESTOR_K_BACKLOG      0.5     // Peso de los SETs pendientes por celda
+#define GESTOR_INTEGRAL_MAX   5.0     // Anti-windup del término integral
+#define GESTOR_UMBRAL         0.5     // Banda muerta de la salida
+#define GESTOR_CICLOS_ESPERA  2       // Intervalos mínimos entre cambios
+
 // Verifica si una celda puede ser quitada de forma segura
 bool celda_puede_quitarse(CeldaEmpaquetado *celda);
 
@@ -19,7 +29,10 @@ bool quitar_celda_dinamica(int celda_id);
 // Agrega/reactiva una celda en el sistema
 bool agregar_celda_dinamica(int celda_id);
 
-// Hilo gestor que monitorea y gestiona celdas dinámicamente
+// Despierta al gestor para que observe la terminación
+void despertar_gestor_celdas(void);
+
+// Hilo gestor: controlador que activa/desactiva celdas según la carga
 void* thread_gestor_celdas(void* arg);
 
 #endif // GESTOR_CELDAS_H
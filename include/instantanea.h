@@ -0,0 +1,108 @@
+/**
+ * LEGO Master - Módulo de Instantáneas Consistentes
+ *
+ * Captura banda, celdas (caja, buffer, brazos) y contadores en un mismo
+ * instante sin detener los hilos. Cada sección que mueve piezas entre
+ * ubicaciones se marca con inicio_escritura()/fin_escritura(); el lector
+ * copia sin tomar locks y valida con los contadores de escrituras
+ * iniciadas/terminadas (seqlock con varios escritores).
+ *
+ * Si la validación falla INST_MAX_INTENTOS veces el lector cierra una
+ * compuerta: las escrituras nuevas se retiran y esperan, las en curso
+ * terminan y la copia se hace sin competencia. La espera del escritor es
+ * acotada (INST_ESPERA_COMPUERTA_US) porque puede estar reteniendo un
+ * mutex que necesita una escritura en curso; si entra igual, el lector
+ * lo detecta con el mismo contador y vuelve a copiar. La espera del lector
+ * también es acotada (INST_LIMITE_COMPUERTA_US): si los escritores no lo
+ * dejan copiar la instantánea se marca inválida y el llamador omite esa
+ * ronda o reintenta.
+ */
+
+#ifndef INSTANTANEA_H
+#define INSTANTANEA_H
+
+#include "common.h"
+#include <stdatomic.h>
+
+#define INST_MAX_INTENTOS       8       // Copias optimistas antes de cerrar la compuerta
+#define INST_ESPERA_COMPUERTA_US 1000   // Espera máxima de un escritor ante la compuerta
+#define INST_LIMITE_COMPUERTA_US 50000  // Espera máxima del lector con la compuerta cerrada
+
+// Estado de una celda en la instantánea
+typedef struct {
+    EstadoCelda estado;
+    bool trabajando_en_set;
+    bool devolviendo_piezas;
+    int posicion_banda;
+    int caja[MAX_TIPOS_PIEZA];               // Piezas en la caja por tipo
+    int necesarias[MAX_TIPOS_PIEZA];
+    int buffer_count;
+    int8_t buffer[MAX_BUFFER_CELDA];         // Tipos en el buffer
+    EstadoBrazo estado_brazo[BRAZOS_POR_CELDA];
+    int8_t en_mano[BRAZOS_POR_CELDA];        // Tipo que lleva cada brazo (0 = nada)
+} InstantaneaCelda;
+
+// Estado completo del sistema en un instante
+typedef struct {
+    unsigned long epoca;                     // Escrituras completadas antes de la copia
+    int intentos;                            // Copias necesarias (1 = sin competencia, 0 = inválida)
+    bool con_compuerta;                      // Se detuvo a los escritores
+    // Banda
+    int longitud;
+    int8_t num_piezas_pos[MAX_POSICIONES];
+    int8_t tipos_pos[MAX_POSICIONES][MAX_PIEZAS_POS];
+    // Celdas
+    int num_celdas;
+    InstantaneaCelda celdas[MAX_CELDAS];
+    // Contadores
+    int sets_completados;
+    int sets_en_proceso;
+    int total_piezas_dispensadas;
+    int total_piezas_tacho;
+    int cajas_ok;
+    int cajas_fail;
+    int piezas_confirmadas;
+    int piezas_rechazadas;
+    int piezas_pedidas_ok;
+    // Derivados: piezas por tipo en cada tipo de ubicación
+    int en_banda[MAX_TIPOS_PIEZA];
+    int en_buffers[MAX_TIPOS_PIEZA];
+    int en_cajas[MAX_TIPOS_PIEZA];
+    int en_brazos[MAX_TIPOS_PIEZA];
+} InstantaneaSistema;
+
+extern atomic_ulong escrituras_iniciadas;
+extern atomic_ulong escrituras_terminadas;
+extern atomic_bool compuerta_escrituras;
+extern __thread int profundidad_escritura;
+
+// Espera (acotada) a que el lector reabra la compuerta; uso interno de inicio_escritura
+void esperar_compuerta(void);
+
+// Marca el inicio de una sección que mueve piezas (anidable en el mismo hilo)
+static inline void inicio_escritura(void) {
+    if (profundidad_escritura++ > 0) return;
+    atomic_fetch_add(&escrituras_iniciadas, 1);
+    // Las escrituras de la sección no pueden adelantarse al contador
+    atomic_thread_fence(memory_order_release);
+    if (!atomic_load(&compuerta_escrituras)) return;
+    // Un lector cerró la compuerta: retirarse sin tocar nada, esperar y entrar
+    atomic_fetch_add(&escrituras_terminadas, 1);
+    esperar_compuerta();
+    atomic_fetch_add(&escrituras_iniciadas, 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void fin_escritura(void) {
+    if (--profundidad_escritura > 0) return;
+    atomic_fetch_add_explicit(&escrituras_terminadas, 1, memory_order_release);
+}
+
+// Captura un estado consistente (no toma ningún lock del sistema). Retorna
+// false si se agotó INST_LIMITE_COMPUERTA_US: la copia no es consistente
+bool capturar_instantanea(InstantaneaSistema *s);
+
+// Piezas en banda + buffers + cajas + brazos
+int instantanea_piezas_disponibles(const InstantaneaSistema *s);
+
+#endif // INSTANTANEA_H
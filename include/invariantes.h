@@ -0,0 +1,34 @@
+/**
+ * LEGO Master - Módulo de Verificación de Invariantes
+ *
+ * Un hilo captura instantáneas consistentes (instantanea.h) cada cierto
+ * periodo y comprueba, mientras los demás hilos trabajan:
+ *   - Conservación: dispensadas = banda + manos + buffers + cajas
+ *                                 + tacho + confirmadas + rechazadas
+ *   - SETs confirmados = cajas OK, y las piezas confirmadas coinciden
+ *   - SETs en proceso = celdas trabajando en un SET (y sin exceder el total)
+ *   - Ninguna caja con más piezas de un tipo que las necesarias
+ * Al final, tras contabilizar las piezas restantes, se exige que cada
+ * pieza dispensada esté en el tacho o haya salido en una caja.
+ *
+ * Pensado para correr muchas configuraciones con --semilla distintas.
+ */
+
+#ifndef INVARIANTES_H
+#define INVARIANTES_H
+
+#include "common.h"
+
+#define PERIODO_INVARIANTES_MS      50      // Periodo por defecto de --verificar-invariantes
+#define MAX_VIOLACIONES_IMPRESAS    20      // Luego solo se cuentan
+
+// Inicia el hilo verificador con el periodo dado
+void iniciar_verificador_invariantes(int periodo_ms);
+
+// Detiene el hilo (antes de contabilizar las piezas restantes)
+void terminar_verificador_invariantes(void);
+
+// Verificación de cierre; imprime el resultado y retorna el total de violaciones
+int verificar_invariantes_final(void);
+
+#endif // INVARIANTES_H
@@ -0,0 +1,45 @@
+/**
+ * LEGO Master - Módulo de Puntos de Inyección
+ *
+ * Además del inicio de cada banda, las piezas pueden entrar a mitad de
+ * banda por puntos de inyección (--inyeccion=POS[:CUPO[:POLITICA]],...).
+ * Cada punto tiene CUPO dispensadores, que en cada ciclo sueltan los tipos
+ * que más les faltan a las celdas de más adelante (descontando lo que ya
+ * viaja hacia ellas), del mismo total de piezas que el inicio. Las celdas
+ * anteriores devuelven ahí cuando su lugar habitual está lleno, en vez de
+ * esperar a que la banda avance.
+ *
+ * La política decide cómo se mezcla lo inyectado con lo que trae la banda:
+ * "completa" llena la posición hasta el cupo; "cede" solo inyecta si la
+ * posición llega vacía, para no frenar a las piezas que ya circulan.
+ */
+
+#ifndef INYECCION_H
+#define INYECCION_H
+
+#include "common.h"
+#include <stdio.h>
+
+// Lee la lista de puntos; falso si el texto es inválido
+bool parsear_inyeccion(const char *texto, ConfiguracionSistema *config);
+
+// Valida los puntos contra las bandas ya fijadas; NULL si son válidos
+const char *validar_inyeccion(const ConfiguracionSistema *config);
+
+// Si el punto admite otra pieza en su posición (requiere pos->mutex).
+// piezas_al_llegar: las que tenía la posición al tomar el mutex
+bool punto_admite(const PuntoInyeccion *punto, int piezas_al_llegar, int piezas_ahora);
+
+// Piezas de cada tipo que les faltan a las celdas alcanzables desde la
+// posición, menos las que ya viajan hacia ellas; retorna el total
+int necesidad_aguas_abajo(int posicion, int necesidad[MAX_TIPOS_PIEZA]);
+
+void contar_inyeccion(int punto, bool devuelta);
+
+// Resumen por punto (solo con --inyeccion)
+void imprimir_resumen_inyeccion(void);
+
+// Arreglo JSON "inyeccion" del reporte (sin coma final)
+void escribir_inyeccion_json(FILE *f);
+
+#endif // INYECCION_H
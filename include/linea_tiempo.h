@@ -0,0 +1,57 @@
+/**
+ * LEGO Master - Módulo de Línea de Tiempo
+ *
+ * Registra las transiciones de estado de brazos y celdas, los ticks
+ * de la banda, las revisiones del operador y las decisiones del gestor
+ * en búferes por hilo, y al terminar los vuelca en formato JSON de
+ * eventos de traza de Chrome (chrome://tracing, ui.perfetto.dev).
+ */
+
+#ifndef LINEA_TIEMPO_H
+#define LINEA_TIEMPO_H
+
+#include "common.h"
+
+#define LT_EVENTOS_BLOQUE   4096    // Eventos por bloque de un hilo
+#define LT_DETALLE          48      // Texto libre de un evento instantáneo
+
+// Pistas (una fila por actor en el visor)
+#define PISTA_BANDA         1
+#define PISTA_DISPENSADOR   2
+#define PISTA_OPERADOR      3
+#define PISTA_GESTOR        4
+#define PISTA_CELDA(c)      (10 + (c))
+#define PISTA_BRAZO(c, b)   (100 + (c) * BRAZOS_POR_CELDA + (b))
+
+// Activa la línea de tiempo (antes de crear los hilos)
+void iniciar_linea_tiempo(const char *ruta);
+
+// Intervalo [inicio_us, fin_us] en una pista; nombre debe ser un literal
+void registrar_intervalo(int pista, const char *nombre, uint64_t inicio_us, uint64_t fin_us);
+
+// Evento instantáneo con un detalle opcional (se copia)
+void registrar_instante(int pista, const char *nombre, const char *detalle);
+
+extern bool linea_tiempo_activa;
+
+// Puntos de instrumentación: no cuestan nada si la línea de tiempo está desactivada
+static inline void marcar_intervalo(int pista, const char *nombre, uint64_t inicio_us, uint64_t fin_us) {
+    if (linea_tiempo_activa) {
+        registrar_intervalo(pista, nombre, inicio_us, fin_us);
+    }
+}
+
+static inline void marcar_instante(int pista, const char *nombre, const char *detalle) {
+    if (linea_tiempo_activa) {
+        registrar_instante(pista, nombre, detalle);
+    }
+}
+
+// Nombres legibles de los estados
+const char* nombre_estado_brazo(EstadoBrazo estado);
+const char* nombre_estado_celda(EstadoCelda estado);
+
+// Cierra los estados en curso y escribe el JSON (requiere los hilos terminados)
+void escribir_linea_tiempo(void);
+
+#endif // LINEA_TIEMPO_H
@@ -0,0 +1,48 @@
+/**
+ * LEGO Master - Módulo de Métricas por Ventana Deslizante
+ * 
+ * Acumula eventos de producción (SETs confirmados, piezas al tacho,
+ * latencia de caja) en cubetas de un segundo y reporta tasas de
+ * régimen estacionario sobre una ventana deslizante.
+ */
+
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include "common.h"
+
+#define MAX_SEGUNDOS_VENTANA    600     // Ventana máxima (s)
+#define MAX_MUESTRAS_LATENCIA   4096    // Latencias de caja recordadas
+
+// Resumen de una ventana
+typedef struct {
+    double segundos;                 // Ancho efectivo de la ventana
+    double sets_por_s;
+    double tacho_por_s;
+    int sets;
+    int tacho;
+    int muestras_latencia;
+    double latencia_p50_ms;
+    double latencia_p95_ms;
+    double latencia_max_ms;
+} ResumenVentana;
+
+// Inicia el reloj de las métricas
+void iniciar_metricas(void);
+
+// Un SET fue confirmado; latencia desde que la celda lo inició
+void registrar_set_completado(uint64_t latencia_us);
+
+// n piezas cayeron al tacho
+void registrar_piezas_tacho(int n);
+
+// Calcula el resumen de los últimos ventana_s segundos
+void resumir_ventana(int ventana_s, ResumenVentana *resumen);
+
+// Imprime una línea con el resumen de la ventana
+void imprimir_resumen_ventana(const char *etiqueta, int ventana_s);
+
+// Programa el reporte periódico en la rueda de temporización
+void iniciar_reporte_periodico(int ventana_s);
+
+#endif // METRICAS_H
@@ -0,0 +1,59 @@
+/**
+ * LEGO Master - Módulo de Pedidos
+ *
+ * Cola de pedidos de recetas distintas cargada desde un archivo. Cada
+ * línea no vacía (salvo comentarios con '#') describe una receta, con
+ * una cantidad por cada tipo de pieza en uso (config.num_tipos):
+ *
+ *     # receta    cantidad  prioridad  A  B  C  D
+ *     castillo    3         2          2  1  1  0
+ *     nave        2         1          1  1  2  2
+ *
+ * Se atienden primero las prioridades más altas y, a igual prioridad,
+ * en el orden del archivo. Cada celda toma un pedido al iniciar y otro
+ * cada vez que el operador confirma su caja; una caja FAIL se vuelve a
+ * armar con la misma receta, y una celda que el gestor desactiva
+ * devuelve su pedido a la cola. El dispensador reparte la demanda
+ * agregada de todos los pedidos.
+ */
+
+#ifndef PEDIDOS_H
+#define PEDIDOS_H
+
+#include "common.h"
+#include <stdio.h>
+
+#define MAX_RECETAS             16
+#define MAX_NOMBRE_RECETA       32
+
+// Lee el archivo de pedidos; fija num_sets (total de pedidos) en la configuración
+bool cargar_pedidos(const char *archivo, ConfiguracionSistema *config);
+
+// Entrega a la celda el siguiente pedido de la cola, si queda (requiere caja.mutex)
+void asignar_pedido(CeldaEmpaquetado *celda);
+
+// Devuelve a la cola el pedido de la celda (requiere caja.mutex)
+void devolver_pedido(CeldaEmpaquetado *celda);
+
+// Registra el resultado de la caja de la celda para su receta
+void registrar_pedido_terminado(CeldaEmpaquetado *celda, bool ok, uint64_t latencia_us);
+
+// Piezas de cada tipo que piden todos los pedidos juntos
+void pedidos_demanda_total(int piezas[MAX_TIPOS_PIEZA]);
+
+// Piezas de cada tipo que piden los pedidos que ninguna celda tomó todavía
+void pedidos_demanda_en_cola(int piezas[MAX_TIPOS_PIEZA]);
+
+// Mínimo por tipo entre las recetas con pedidos sin confirmar (false si no queda ninguno)
+bool pedidos_minimo_por_tipo(int minimo[MAX_TIPOS_PIEZA]);
+
+// Total de piezas de todos los pedidos
+int pedidos_piezas_totales(void);
+
+// Resumen por receta: pedidos confirmados, cajas FAIL, latencia y SETs/minuto
+void imprimir_resumen_pedidos(double duracion_s);
+
+// Objeto JSON "pedidos" del reporte (sin coma final)
+void escribir_pedidos_json(FILE *f, double duracion_s);
+
+#endif // PEDIDOS_H
@@ -0,0 +1,64 @@
+/**
+ * LEGO Master - Perfilador de Contención de Locks
+ *
+ * Se activa al compilar con `make PERFIL_LOCKS=1` (-DPERFIL_LOCKS).
+ * Sustituye con macros las llamadas a pthread_mutex_* y sem_* de todos
+ * los módulos que incluyen common.h, y registra por clase de lock y por
+ * sitio de llamada: adquisiciones, adquisiciones con espera, histograma
+ * de espera e histograma de retención (log2 de nanosegundos).
+ *
+ * La clase de un lock es la expresión con la que se inicializó
+ * (p. ej. "celda->caja.mutex"); los locks estáticos toman la expresión
+ * de su primer uso. Sin PERFIL_LOCKS no hay ningún costo.
+ */
+
+#ifndef PERFIL_LOCKS_H
+#define PERFIL_LOCKS_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#ifdef PERFIL_LOCKS
+
+#define PL_MAX_CLASES       64      // Clases de lock distintas
+#define PL_MAX_SITIOS       512     // Pares (sitio de llamada, clase)
+#define PL_MAX_LOCKS        8192    // Direcciones de lock registradas
+#define PL_BUCKETS          40      // Buckets log2 de los histogramas (ns)
+#define PL_MAX_RETENIDOS    16      // Locks retenidos a la vez por un hilo
+
+int perfil_mutex_init(pthread_mutex_t *m, const pthread_mutexattr_t *attr,
+                      const char *expr, const char *archivo);
+int perfil_mutex_lock(pthread_mutex_t *m, const char *expr, const char *archivo, int linea);
+int perfil_mutex_trylock(pthread_mutex_t *m, const char *expr, const char *archivo, int linea);
+int perfil_mutex_unlock(pthread_mutex_t *m);
+int perfil_cond_wait(pthread_cond_t *c, pthread_mutex_t *m);
+int perfil_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m, const struct timespec *ts);
+int perfil_sem_init(sem_t *s, int compartido, unsigned int valor,
+                    const char *expr, const char *archivo);
+int perfil_sem_wait(sem_t *s, const char *expr, const char *archivo, int linea);
+int perfil_sem_trywait(sem_t *s, const char *expr, const char *archivo, int linea);
+int perfil_sem_post(sem_t *s);
+
+// Imprime el reporte de contención (requiere los hilos terminados)
+void imprimir_perfil_locks(void);
+
+#ifndef PERFIL_LOCKS_INTERNO
+#define pthread_mutex_init(m, a)        perfil_mutex_init((m), (a), #m, __FILE__)
+#define pthread_mutex_lock(m)           perfil_mutex_lock((m), #m, __FILE__, __LINE__)
+#define pthread_mutex_trylock(m)        perfil_mutex_trylock((m), #m, __FILE__, __LINE__)
+#define pthread_mutex_unlock(m)         perfil_mutex_unlock(m)
+#define pthread_cond_wait(c, m)         perfil_cond_wait((c), (m))
+#define pthread_cond_timedwait(c, m, t) perfil_cond_timedwait((c), (m), (t))
+#define sem_init(s, p, v)               perfil_sem_init((s), (p), (v), #s, __FILE__)
+#define sem_wait(s)                     perfil_sem_wait((s), #s, __FILE__, __LINE__)
+#define sem_trywait(s)                  perfil_sem_trywait((s), #s, __FILE__, __LINE__)
+#define sem_post(s)                     perfil_sem_post(s)
+#endif
+
+#else
+
+static inline void imprimir_perfil_locks(void) {}
+
+#endif // PERFIL_LOCKS
+
+#endif // PERFIL_LOCKS_H
@@ -0,0 +1,82 @@
+/**
+ * LEGO Master - Módulo del Pool de Brazos (M:N)
+ *
+ * Con --pool-brazos la lógica de cada brazo deja de tener un hilo propio:
+ * es una tarea (su máquina de estados, paso_brazo) que un pool de hilos
+ * ejecuta con robo de trabajo. Cada hilo tiene su cola; saca de la punta
+ * lo último que encoló y, si se queda sin tareas, roba de la base de las
+ * colas ajenas.
+ *
+ * Una tarea ejecuta un paso y se estaciona esperando un motivo; vuelve a
+ * la cola cuando ocurre:
+ *   - MOTIVO_CELDA: llegó una pieza a la posición de su celda (aviso de la
+ *     banda en cada paso) o la celda cambió de estado; con un plazo de
+ *     respaldo para lo que no se avisa
+ *   - MOTIVO_TIEMPO: venció un temporizador (el traslado de la pieza, la
+ *     revisión de progreso del brazo 0)
+ *   - MOTIVO_RETIRO / MOTIVO_COLOCADOR: se liberó un cupo de la celda
+ *   - MOTIVO_REANUDAR: el temporizador reanudó al brazo suspendido
+ *
+ * Los límites por celda (MAX_BRAZOS_ACTIVOS retirando, un solo brazo
+ * colocando en la caja) son cupos del pool en lugar de semáforos: una
+ * tarea sin cupo se estaciona y la despierta quien lo libera.
+ */
+
+#ifndef POOL_BRAZOS_H
+#define POOL_BRAZOS_H
+
+#include "common.h"
+
+#define MAX_HILOS_POOL          256     // Hilos del pool; las tareas se dimensionan según las celdas
+#define RESPALDO_POOL_MS        250     // Plazo de respaldo de MOTIVO_CELDA
+
+typedef enum {
+    MOTIVO_NINGUNO,          // Volver a ejecutar enseguida
+    MOTIVO_CELDA,
+    MOTIVO_TIEMPO,
+    MOTIVO_RETIRO,
+    MOTIVO_COLOCADOR,
+    MOTIVO_REANUDAR,
+    MOTIVO_FIN,              // El brazo terminó
+    NUM_MOTIVOS
+} MotivoEspera;
+
+// Resultado de un paso: qué esperar y, con MOTIVO_CELDA o MOTIVO_TIEMPO,
+// cuánto (con un hilo por brazo la espera es un usleep de retardo_ms)
+typedef struct {
+    MotivoEspera motivo;
+    int retardo_ms;
+} Espera;
+
+// Paso de la máquina de estados de un brazo
+typedef Espera (*PasoBrazo)(int celda_id, int brazo_id);
+
+// Si los brazos corren en el pool (y no en un hilo cada uno)
+bool pool_brazos_activo(void);
+
+// Crea los hilos y encola un paso de cada brazo de las celdas configuradas
+void iniciar_pool_brazos(int num_hilos, PasoBrazo paso);
+
+// Detiene los hilos (tras fijar sistema->terminar) y espera a que terminen
+void terminar_pool_brazos(void);
+
+// Libera tareas, colas y cupos; va después de terminar_temporizador, porque
+// un vencimiento pendiente todavía apunta a su tarea
+void liberar_pool_brazos(void);
+
+// Despierta a los brazos de la celda que esperan el motivo (sin efecto sin pool)
+void despertar_brazos_celda(int celda_id, MotivoEspera motivo);
+void despertar_brazo(int celda_id, int brazo_id, MotivoEspera motivo);
+
+// Cupos de la celda: sin bloquear para las tareas, con espera para las
+// devoluciones, que corren fuera de los pasos de los brazos
+bool pool_tomar_retiro(int celda_id);
+void pool_soltar_retiro(int celda_id);
+bool pool_tomar_colocador(int celda_id);
+void pool_esperar_colocador(int celda_id);
+void pool_soltar_colocador(int celda_id);
+
+// Resumen del pool (solo con --pool-brazos)
+void imprimir_resumen_pool_brazos(void);
+
+#endif // POOL_BRAZOS_H
@@ -0,0 +1,70 @@
+/**
+ * LEGO Master - Módulo de Detección de Quiescencia
+ *
+ * Contadores atómicos de piezas en vuelo por ubicación (banda, mano de
+ * los brazos, buffers y cajas) y tipo, mantenidos en cada movimiento, y
+ * un aviso de progreso que despierta al dispensador cuando algo cambia
+ * (SET confirmado, pieza al tacho, mano vacía, cambio de estado de celda).
+ *
+ * Los contadores no se leen de forma atómica entre ubicaciones: sirven
+ * para descartar rápido y sin locks; toda decisión de terminar se
+ * confirma con una instantánea consistente (instantanea.h).
+ */
+
+#ifndef QUIESCENCIA_H
+#define QUIESCENCIA_H
+
+#include "common.h"
+#include <stdatomic.h>
+
+// Ubicaciones en las que una pieza sigue en juego
+typedef enum {
+    UBIC_BANDA,
+    UBIC_MANO,
+    UBIC_BUFFER,
+    UBIC_CAJA,
+    NUM_UBICACIONES
+} UbicacionPieza;
+
+extern atomic_int piezas_en_vuelo[NUM_UBICACIONES][MAX_TIPOS_PIEZA];
+extern atomic_ulong generacion_progreso;
+extern atomic_int esperando_progreso;
+
+// Suma n piezas del tipo (1..MAX_TIPOS_PIEZA) a una ubicación
+static inline void vuelo_sumar(UbicacionPieza u, int tipo, int n) {
+    if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
+        atomic_fetch_add_explicit(&piezas_en_vuelo[u][tipo - 1], n, memory_order_relaxed);
+    }
+}
+
+static inline void vuelo_mover(UbicacionPieza desde, UbicacionPieza hacia, int tipo) {
+    vuelo_sumar(hacia, tipo, 1);
+    vuelo_sumar(desde, tipo, -1);
+}
+
+static inline int vuelo_leer(UbicacionPieza u, int tipo) {
+    return atomic_load_explicit(&piezas_en_vuelo[u][tipo - 1], memory_order_relaxed);
+}
+
+// Reinicia los contadores (al inicializar el sistema)
+void reiniciar_piezas_en_vuelo(void);
+
+// Despierta a quien espera progreso (solo toma el mutex si hay alguien esperando)
+void avisar_progreso_lento(void);
+
+static inline void avisar_progreso(void) {
+    atomic_fetch_add(&generacion_progreso, 1);
+    if (atomic_load(&esperando_progreso) > 0) {
+        avisar_progreso_lento();
+    }
+}
+
+// Generación actual: se pasa a esperar_progreso para no perder avisos
+static inline unsigned long leer_generacion_progreso(void) {
+    return atomic_load(&generacion_progreso);
+}
+
+// Espera hasta que la generación cambie o pasen espera_ms (false si venció)
+bool esperar_progreso(unsigned long generacion, int espera_ms);
+
+#endif // QUIESCENCIA_H
@@ -0,0 +1,25 @@
+/**
+ * LEGO Master - Módulo de Reporte Final
+ *
+ * Arma la instantánea de fin de corrida (ResumenOperacion) con los
+ * contadores de Estadisticas, las cajas por celda, las piezas y la
+ * utilización de cada brazo, los tiempos de pared y de CPU y las tasas
+ * derivadas. La tabla de imprimir_estadisticas y los reportes JSON/CSV
+ * son vistas de la misma instantánea.
+ */
+
+#ifndef REPORTE_H
+#define REPORTE_H
+
+#include "common.h"
+
+// Copia los contadores (stats.mutex solo durante la copia) y calcula los derivados
+void tomar_resumen(ResumenOperacion *r, uint64_t duracion_us);
+
+// Interpreta "json" o "csv" (REPORTE_NINGUNO si no es válido)
+FormatoReporte parsear_formato_reporte(const char *texto);
+
+// Escribe el reporte de forma atómica (archivo temporal + rename)
+bool escribir_reporte(const ResumenOperacion *r, FormatoReporte formato, const char *ruta);
+
+#endif // REPORTE_H
@@ -0,0 +1,55 @@
+/**
+ * LEGO Master - Módulo de Reservas de Piezas
+ *
+ * Al entrar a la banda (dispensada o devuelta) cada pieza se reserva
+ * para la celda aguas abajo cuyo déficit de ese tipo mejor cubre:
+ * primero las celdas que ya arman un SET (la más cercana a completarlo),
+ * y si ninguna lo necesita una celda ociosa que pueda iniciar un SET
+ * pendiente. Los brazos de las demás celdas la ignoran.
+ *
+ * La reserva vence cuando la pieza pasa la posición de su celda; desde
+ * ahí queda libre para cualquier celda posterior.
+ *
+ * Los déficits salen de una instantánea (instantanea.h) que se refresca
+ * fuera de las secciones de escritura: antes de cada ciclo del
+ * dispensador y al comenzar una devolución.
+ *
+ * Con la asignación óptima el dispensador, tras cada ciclo, vuelve a
+ * repartir todas las piezas de la banda: elige el conjunto de celdas que
+ * más SETs puede completar con las piezas que aún las alcanzan (una pieza
+ * solo llega a celdas en su posición o más adelante) y reparte el resto
+ * con la regla voraz. Cuenta los ticks en que cubre más celdas que la
+ * regla voraz aplicada a las mismas piezas.
+ */
+
+#ifndef RESERVAS_H
+#define RESERVAS_H
+
+#include "common.h"
+
+#define SIN_RESERVA     -1
+
+// Pone a cero reservas y contadores (antes de crear los hilos)
+void reiniciar_reservas(void);
+
+// Recalcula los déficits con una instantánea (no llamar dentro de inicio/fin_escritura)
+void actualizar_demanda_reservas(void);
+
+// Celda reservada para una pieza que entra en desde_posicion (SIN_RESERVA si ninguna)
+int reservar_pieza(int tipo, int desde_posicion);
+
+// Reparte de nuevo las piezas en la banda con el optimizador global (--asignacion=optima)
+void optimizar_asignacion(void);
+
+// Libera la reserva de la pieza: cumplida si la tomó su celda, vencida si no
+void liberar_reserva(Pieza *pieza, bool cumplida);
+
+// Una celda puede tomar la pieza si está libre o reservada para ella
+static inline bool pieza_disponible_para(const Pieza *pieza, int celda_id) {
+    return pieza->reservada_para == SIN_RESERVA || pieza->reservada_para == celda_id;
+}
+
+// Reservas hechas, cumplidas y vencidas, y piezas devueltas
+void imprimir_resumen_reservas(void);
+
+#endif // RESERVAS_H
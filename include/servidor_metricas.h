@@ -0,0 +1,65 @@
+/**
+ * LEGO Master - Módulo del Servidor de Métricas
+ *
+ * Contadores atómicos publicados por los hilos del sistema sin tomar
+ * locks, y un hilo que sirve una instantánea de ellos por un socket
+ * Unix en formato de texto de Prometheus o JSON.
+ *
+ * Protocolo: el cliente envía una línea opcional y lee la respuesta.
+ *   - "GET /metrics HTTP/1.x"  -> respuesta HTTP con texto Prometheus
+ *   - "GET /json HTTP/1.x"     -> respuesta HTTP con JSON
+ *   - "json"                   -> JSON sin encabezados
+ *   - cualquier otra cosa      -> texto Prometheus sin encabezados
+ */
+
+#ifndef SERVIDOR_METRICAS_H
+#define SERVIDOR_METRICAS_H
+
+#include "common.h"
+#include <stdatomic.h>
+
+#define POSICIONES_PREVIAS_CELDA    3       // Posiciones antes de una celda en ocupacion_previa
+
+// Contadores y medidores en vivo (todos con orden relajado)
+typedef struct {
+    atomic_long piezas_dispensadas;
+    atomic_long piezas_tacho;
+    atomic_long recirculaciones;             // Reingresos de la banda circular
+    atomic_long sets_ok;
+    atomic_long sets_fail;
+    atomic_int piezas_en_banda;              // Medido en cada tick de la banda
+    atomic_int posiciones_ocupadas;
+    atomic_long ticks_banda;
+    atomic_llong retraso_tick_total_us;      // Exceso sobre el periodo nominal
+    atomic_llong retraso_tick_max_us;
+    atomic_int cola_operador;
+    atomic_int cola_alimentador;             // Piezas retenidas por contrapresión
+    atomic_int ocupacion_previa[MAX_CELDAS]; // Piezas en la celda y las posiciones previas
+    atomic_int piezas_caja[MAX_CELDAS];
+    atomic_int necesarias_caja[MAX_CELDAS];  // Piezas de la receta en curso
+    atomic_int buffer_celda[MAX_CELDAS];
+    atomic_int estado_celda[MAX_CELDAS];
+    atomic_int estado_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+    atomic_long piezas_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+} ContadoresVivos;
+
+extern ContadoresVivos vivos;
+
+static inline void vivo_sumar(atomic_long *contador, long n) {
+    atomic_fetch_add_explicit(contador, n, memory_order_relaxed);
+}
+
+static inline void vivo_fijar(atomic_int *medidor, int valor) {
+    atomic_store_explicit(medidor, valor, memory_order_relaxed);
+}
+
+// Registra el retraso de un tick de la banda respecto a su periodo
+void vivo_registrar_tick(int64_t retraso_us);
+
+// Inicia el hilo que atiende el socket (false si no se pudo crear)
+bool iniciar_servidor_metricas(const char *ruta);
+
+// Detiene el hilo y elimina el socket
+void terminar_servidor_metricas(void);
+
+#endif // SERVIDOR_METRICAS_H
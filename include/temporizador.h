@@ -0,0 +1,39 @@
+/**
+ * LEGO Master - Módulo de Temporizadores
+ *
+ * Rueda de temporización (timing wheel) compartida por todos los
+ * eventos temporizados del sistema. Usa el reloj monotónico y un
+ * hilo dedicado que duerme exactamente hasta el próximo vencimiento.
+ */
+
+#ifndef TEMPORIZADOR_H
+#define TEMPORIZADOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Configuración de la rueda
+#define TW_RANURAS          256     // Ranuras de la rueda
+#define TW_RESOLUCION_US    1000    // Ancho de cada ranura (1 ms)
+#define MAX_TEMPORIZADORES  1024    // Temporizadores pendientes simultáneos
+
+// Función ejecutada por el hilo del temporizador al vencer
+typedef void (*CallbackTemporizador)(void *arg);
+
+// Tiempo actual del reloj monotónico en microsegundos
+uint64_t tiempo_monotonico_us(void);
+
+// Inicia el hilo de la rueda de temporización
+void iniciar_temporizador(void);
+
+// Termina el hilo (los temporizadores pendientes se descartan)
+void terminar_temporizador(void);
+
+// Programa un callback dentro de retardo_us microsegundos.
+// Retorna un identificador (>= 0) o -1 si no hay espacio.
+int programar_temporizador(uint64_t retardo_us, CallbackTemporizador cb, void *arg);
+
+// Cancela un temporizador pendiente (false si ya venció)
+bool cancelar_temporizador(int id);
+
+#endif // TEMPORIZADOR_H
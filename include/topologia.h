@@ -0,0 +1,65 @@
+/**
+ * LEGO Master - Módulo de Topología de la Planta
+ *
+ * Describe varias bandas, cada una con sus dispensadores y celdas, y cómo
+ * se conectan. Todas comparten el arreglo de posiciones de la banda: cada
+ * una ocupa un tramo contiguo, en el orden del archivo. Cada línea no
+ * vacía (salvo comentarios con '#') es una banda o un enlace:
+ *
+ *     # banda  nombre   longitud  dispensadores  celdas
+ *     banda    norte    30        3              10,20
+ *     banda    sur      30        3              -
+ *     banda    empaque  40        0              10,20,30
+ *     # enlace origen   destinos
+ *     enlace   norte    empaque
+ *     enlace   sur      empaque
+ *
+ * Las celdas se dan por su posición dentro de la banda ('-' si no tiene).
+ * Un enlace con varios destinos es una división: lo que llega al final del
+ * origen se reparte por turnos. Varios enlaces hacia la misma banda son una
+ * unión. Una banda sin enlace termina en el tacho. Los enlaces no pueden
+ * formar ciclos, y toda banda sin dispensadores debe recibir de otra.
+ *
+ * Sin --topologia la planta es una sola banda con toda la longitud y los
+ * dispensadores de la configuración.
+ */
+
+#ifndef TOPOLOGIA_H
+#define TOPOLOGIA_H
+
+#include "common.h"
+#include <stdio.h>
+
+// Contadores por banda del resumen
+typedef enum {
+    CONTADOR_DISPENSADAS,            // Soltadas por sus dispensadores
+    CONTADOR_RECIBIDAS,              // Llegadas desde el final de otra banda
+    CONTADOR_ENVIADAS,               // Pasadas a una banda destino
+    CONTADOR_TACHO,                  // Caídas al tacho desde su final
+    NUM_CONTADORES_BANDA
+} ContadorBanda;
+
+// Lee el archivo; fija bandas, celdas, sus posiciones y la longitud total en la configuración
+bool cargar_topologia(const char *archivo, ConfiguracionSistema *config);
+
+// Planta de una sola banda con la longitud y los dispensadores de la configuración
+void topologia_unica(ConfiguracionSistema *config);
+
+// Banda a la que pertenece una posición
+int banda_de_posicion(int posicion);
+
+// Si las piezas del final de la banda origen pueden llegar a la banda destino (o es la misma)
+bool banda_alcanza(int origen, int destino);
+
+// Si la celda es la última de una banda que termina en el tacho
+bool celda_al_final(int celda_id);
+
+void contar_banda(int banda, ContadorBanda contador, int n);
+
+// Resumen por banda (solo con --topologia)
+void imprimir_resumen_bandas(void);
+
+// Arreglo JSON "bandas" del reporte (sin coma final)
+void escribir_bandas_json(FILE *f);
+
+#endif // TOPOLOGIA_H
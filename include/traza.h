@@ -0,0 +1,62 @@
+/**
+ * LEGO Master - Módulo de Trazas de Piezas
+ * 
+ * Registra el ciclo de vida de cada pieza (dispensada, retirada,
+ * en buffer, devuelta, en caja, confirmada, tacho) en búferes por
+ * hilo sin bloqueo, y al final calcula percentiles de latencia por
+ * tipo de pieza y por celda.
+ */
+
+#ifndef TRAZA_H
+#define TRAZA_H
+
+#include "common.h"
+
+#define TRAZA_REGISTROS_BLOQUE  8192    // Registros por bloque de un hilo
+
+// Eventos del ciclo de vida de una pieza
+typedef enum {
+    EVT_DISPENSADA,
+    EVT_RETIRADA,            // Un brazo la sacó de la banda
+    EVT_EN_BUFFER,           // Quedó en el buffer de la celda
+    EVT_EN_CAJA,             // Colocada en la caja
+    EVT_DEVUELTA,            // Devuelta a la banda por una celda estancada
+    EVT_RECIRCULADA,         // Volvió al inicio de la banda circular
+    EVT_CONFIRMADA,          // El operador aprobó la caja que la contiene
+    EVT_RECHAZADA,           // El operador rechazó la caja que la contiene
+    EVT_TACHO                // Cayó al tacho
+} EventoPieza;
+
+// Registro de la traza (compacto para no ensuciar la caché)
+typedef struct {
+    uint64_t instante_us;
+    uint64_t dispensada_us;          // Copia del sello de la pieza
+    int32_t id;
+    uint8_t evento;
+    int8_t tipo;
+    int8_t celda;                    // -1 si no aplica
+    int8_t brazo;                    // -1 si no aplica
+} RegistroTraza;
+
+// Activa la traza de piezas (antes de crear los hilos)
+void iniciar_traza_piezas(void);
+
+// Registra un evento en el búfer del hilo actual
+void registrar_evento_pieza(EventoPieza evento, const Pieza *pieza, int celda, int brazo);
+
+extern bool traza_piezas_activa;
+
+// Punto de instrumentación: no cuesta nada si la traza está desactivada
+static inline void trazar_pieza(EventoPieza evento, const Pieza *pieza, int celda, int brazo) {
+    if (traza_piezas_activa) {
+        registrar_evento_pieza(evento, pieza, celda, brazo);
+    }
+}
+
+// Imprime los percentiles de latencia (requiere los hilos terminados)
+void imprimir_latencias_piezas(void);
+
+// Libera los búferes de todos los hilos
+void liberar_traza_piezas(void);
+
+#endif // TRAZA_H
@@ -0,0 +1,106 @@
+/**
+ * LEGO Master - Núcleos Vectoriales sobre Tipos de Pieza
+ *
+ * Los conteos y necesidades por tipo se guardan en arreglos contiguos de
+ * MAX_TIPOS_PIEZA enteros (múltiplo de TIPOS_POR_BLOQUE); de ellos se usan
+ * los primeros config.num_tipos. Estos núcleos los recorren por bloques de
+ * TIPOS_POR_BLOQUE con las extensiones vectoriales de GCC: 16 bytes, un
+ * registro SSE2 (la base de x86-64) y un solo bloque con los 4 tipos por
+ * defecto. El último bloque se enmascara, así que lo que haya más allá de
+ * n no importa (pero se lee: los arreglos deben tener la capacidad completa).
+ */
+
+#ifndef VECTOR_TIPOS_H
+#define VECTOR_TIPOS_H
+
+#include "common.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define TIPOS_POR_BLOQUE    4
+
+typedef int BloqueTipos __attribute__((vector_size(TIPOS_POR_BLOQUE * sizeof(int))));
+
+_Static_assert(MAX_TIPOS_PIEZA % TIPOS_POR_BLOQUE == 0,
+               "MAX_TIPOS_PIEZA debe ser múltiplo de TIPOS_POR_BLOQUE");
+
+static inline BloqueTipos bloque_cargar(const int *p) {
+    BloqueTipos v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void bloque_guardar(int *p, BloqueTipos v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// -1 en los carriles de tipos < n, 0 en el resto
+static inline BloqueTipos bloque_mascara(int desde, int n) {
+    const BloqueTipos carriles = {0, 1, 2, 3};
+    return (carriles + desde) < n;
+}
+
+static inline bool bloque_nulo(BloqueTipos v) {
+    int acumulado = 0;
+    for (int i = 0; i < TIPOS_POR_BLOQUE; i++) {
+        acumulado |= v[i];
+    }
+    return acumulado == 0;
+}
+
+static inline int bloque_suma(BloqueTipos v) {
+    int suma = 0;
+    for (int i = 0; i < TIPOS_POR_BLOQUE; i++) {
+        suma += v[i];
+    }
+    return suma;
+}
+
+// a[t] == b[t] para todo t < n (caja completa, verificación del operador)
+static inline bool tipos_iguales(const int *a, const int *b, int n) {
+    BloqueTipos distintos = {0};
+    for (int i = 0; i < n; i += TIPOS_POR_BLOQUE) {
+        distintos |= (bloque_cargar(a + i) != bloque_cargar(b + i)) & bloque_mascara(i, n);
+    }
+    return bloque_nulo(distintos);
+}
+
+// tiene[t] >= necesita[t] para todo t < n
+static inline bool tipos_cubiertos(const int *tiene, const int *necesita, int n) {
+    BloqueTipos faltan = {0};
+    for (int i = 0; i < n; i += TIPOS_POR_BLOQUE) {
+        faltan |= (bloque_cargar(tiene + i) < bloque_cargar(necesita + i)) & bloque_mascara(i, n);
+    }
+    return bloque_nulo(faltan);
+}
+
+// Déficit por tipo max(0, necesita - tiene) en faltan (si no es NULL); retorna el total
+static inline int tipos_faltantes(const int *tiene, const int *necesita, int *faltan, int n) {
+    BloqueTipos total = {0};
+    for (int i = 0; i < n; i += TIPOS_POR_BLOQUE) {
+        BloqueTipos d = bloque_cargar(necesita + i) - bloque_cargar(tiene + i);
+        d &= (d > 0) & bloque_mascara(i, n);
+        if (faltan) bloque_guardar(faltan + i, d);
+        total += d;
+    }
+    return bloque_suma(total);
+}
+
+// acumulado[t] += a[t] para t < n
+static inline void tipos_sumar(int *acumulado, const int *a, int n) {
+    for (int i = 0; i < n; i += TIPOS_POR_BLOQUE) {
+        BloqueTipos suma = bloque_cargar(acumulado + i) + (bloque_cargar(a + i) & bloque_mascara(i, n));
+        bloque_guardar(acumulado + i, suma);
+    }
+}
+
+// Suma de a[t] para t < n
+static inline int tipos_total(const int *a, int n) {
+    BloqueTipos total = {0};
+    for (int i = 0; i < n; i += TIPOS_POR_BLOQUE) {
+        total += bloque_cargar(a + i) & bloque_mascara(i, n);
+    }
+    return bloque_suma(total);
+}
+
+#endif // VECTOR_TIPOS_H
@@ -0,0 +1,260 @@
+/**
+ * LEGO Master - Implementación del Balanceo de Carga
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "balanceador.h"
+#include "brazo.h"
+#include "celda.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Muestra de piezas movidas por un brazo en un instante
+typedef struct {
+    uint64_t instante_us;
+    int piezas_movidas;
+} MuestraBrazo;
+
+// Historial circular por brazo (política de ventana)
+static MuestraBrazo historial[MAX_CELDAS][BRAZOS_POR_CELDA][MUESTRAS_VENTANA];
+static int historial_inicio = 0;
+static int historial_count = 0;
+
+// Próximo brazo a suspender por celda (política de turno)
+static int turno[MAX_CELDAS];
+
+static pthread_mutex_t mutex_balanceo = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_balanceo = PTHREAD_COND_INITIALIZER;
+static int balanceos_pendientes = 0;
+static int suspensiones_totales = 0;
+
+const char* nombre_politica_balanceo(PoliticaBalanceo politica) {
+    switch (politica) {
+        case BALANCEO_MAX_HISTORICO: return "max";
+        case BALANCEO_VENTANA:       return "ventana";
+        case BALANCEO_TURNO:         return "turno";
+    }
+    return "?";
+}
+
+bool parsear_politica_balanceo(const char* texto, PoliticaBalanceo *politica) {
+    if (strcmp(texto, "max") == 0) {
+        *politica = BALANCEO_MAX_HISTORICO;
+    } else if (strcmp(texto, "ventana") == 0) {
+        *politica = BALANCEO_VENTANA;
+    } else if (strcmp(texto, "turno") == 0) {
+        *politica = BALANCEO_TURNO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void notificar_piezas_dispensadas(int n) {
+    if (n <= 0) return;
+    
+    pthread_mutex_lock(&mutex_balanceo);
+    sistema->piezas_dispensadas_ciclo += n;
+    while (sistema->piezas_dispensadas_ciclo >= sistema->config.Y) {
+        sistema->piezas_dispensadas_ciclo -= sistema->config.Y;
+        balanceos_pendientes++;
+    }
+    if (balanceos_pendientes > 0) {
+        pthread_cond_signal(&cond_balanceo);
+    }
+    pthread_mutex_unlock(&mutex_balanceo);
+}
+
+void despertar_balanceador(void) {
+    pthread_mutex_lock(&mutex_balanceo);
+    pthread_cond_broadcast(&cond_balanceo);
+    pthread_mutex_unlock(&mutex_balanceo);
+}
+
+static int leer_piezas_movidas(BrazoRobotico *brazo) {
+    pthread_mutex_lock(&brazo->mutex);
+    int movidas = brazo->piezas_movidas;
+    pthread_mutex_unlock(&brazo->mutex);
+    return movidas;
+}
+
+// Registra una muestra de todos los brazos para la ventana deslizante
+static void tomar_muestra(uint64_t ahora) {
+    int idx = (historial_inicio + historial_count) % MUESTRAS_VENTANA;
+    if (historial_count == MUESTRAS_VENTANA) {
+        historial_inicio = (historial_inicio + 1) % MUESTRAS_VENTANA;
+    } else {
+        historial_count++;
+    }
+    
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            historial[c][b][idx].instante_us = ahora;
+            historial[c][b][idx].piezas_movidas = leer_piezas_movidas(&sistema->celdas[c].brazos[b]);
+        }
+    }
+}
+
+// Brazo con más piezas movidas dentro de la ventana reciente
+static int brazo_max_ventana(CeldaEmpaquetado *celda, uint64_t ahora) {
+    uint64_t ventana_us = (uint64_t)sistema->config.ventana_balanceo_ms * 1000ULL;
+    int c = celda->id;
+    
+    // Muestra más antigua que sigue dentro de la ventana
+    int base = -1;
+    for (int i = 0; i < historial_count; i++) {
+        int idx = (historial_inicio + i) % MUESTRAS_VENTANA;
+        if (ahora - historial[c][0][idx].instante_us <= ventana_us) {
+            base = idx;
+            break;
+        }
+    }
+    
+    int max_tasa = -1;
+    int brazo_max = -1;
+    for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+        BrazoRobotico *brazo = &celda->brazos[b];
+        pthread_mutex_lock(&brazo->mutex);
+        EstadoBrazo estado = brazo->estado;
+        int movidas = brazo->piezas_movidas;
+        pthread_mutex_unlock(&brazo->mutex);
+        
+        if (estado == BRAZO_SUSPENDIDO) continue;
+        
+        int tasa = (base >= 0) ? movidas - historial[c][b][base].piezas_movidas : movidas;
+        if (tasa > max_tasa) {
+            max_tasa = tasa;
+            brazo_max = b;
+        }
+    }
+    return brazo_max;
+}
+
+// Siguiente brazo ocioso en la rotación de la celda
+static int brazo_turno(CeldaEmpaquetado *celda) {
+    int c = celda->id;
+    for (int i = 0; i < BRAZOS_POR_CELDA; i++) {
+        int b = (turno[c] + i) % BRAZOS_POR_CELDA;
+        pthread_mutex_lock(&celda->brazos[b].mutex);
+        bool ocioso = celda->brazos[b].estado == BRAZO_IDLE;
+        pthread_mutex_unlock(&celda->brazos[b].mutex);
+        if (ocioso) {
+            turno[c] = (b + 1) % BRAZOS_POR_CELDA;
+            return b;
+        }
+    }
+    return -1;
+}
+
+// Aplica la política a todas las celdas habilitadas
+static void balancear(uint64_t ahora) {
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+        bool habilitada = sistema->celdas_habilitadas[c];
+        pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
+        if (!habilitada) continue;
+        
+        CeldaEmpaquetado *celda = &sistema->celdas[c];
+        int brazo = -1;
+        switch (sistema->config.politica_balanceo) {
+            case BALANCEO_MAX_HISTORICO: brazo = encontrar_brazo_max_piezas(celda); break;
+            case BALANCEO_VENTANA:       brazo = brazo_max_ventana(celda, ahora); break;
+            case BALANCEO_TURNO:         brazo = brazo_turno(celda); break;
+        }
+        
+        // Solo se suspende si está ocioso; el temporizador lo reanuda
+        if (brazo >= 0 && suspender_brazo(&celda->brazos[brazo], sistema->config.delta_t2)) {
+            suspensiones_totales++;
+        }
+    }
+}
+
+void* thread_balanceador(void* arg) {
+    (void)arg;
+    
+    // Periodo de muestreo: la ventana cubre todo el historial
+    long periodo_ms = sistema->config.ventana_balanceo_ms / (MUESTRAS_VENTANA - 1);
+    if (periodo_ms < 10) periodo_ms = 10;
+    
+    for (int c = 0; c < MAX_CELDAS; c++) {
+        turno[c] = 0;
+    }
+    tomar_muestra(tiempo_monotonico_us());
+    
+    pthread_mutex_lock(&mutex_balanceo);
+    while (!sistema->terminar) {
+        if (balanceos_pendientes == 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += periodo_ms * 1000000L;
+            while (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&cond_balanceo, &mutex_balanceo, &ts);
+        }
+        if (sistema->terminar) break;
+        
+        int pendientes = balanceos_pendientes;
+        balanceos_pendientes = 0;
+        pthread_mutex_unlock(&mutex_balanceo);
+        
+        uint64_t ahora = tiempo_monotonico_us();
+        if (sistema->config.politica_balanceo == BALANCEO_VENTANA) {
+            tomar_muestra(ahora);
+        }
+        
+        // Varios disparos acumulados equivalen a un único balanceo
+        if (pendientes > 0) {
+            balancear(ahora);
+        }
+        
+        pthread_mutex_lock(&mutex_balanceo);
+    }
+    pthread_mutex_unlock(&mutex_balanceo);
+    
+    return NULL;
+}
+
+void imprimir_utilizacion_brazos(uint64_t duracion_us) {
+    if (duracion_us == 0) duracion_us = 1;
+    uint64_t ahora = tiempo_monotonico_us();
+    
+    pthread_mutex_lock(&sistema->mutex_sets);
+    int sets = sistema->sets_completados_total;
+    pthread_mutex_unlock(&sistema->mutex_sets);
+    
+    double segundos = duracion_us / 1e6;
+    
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                 UTILIZACIÓN DE BRAZOS                             ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Política de balanceo: %-8s  Suspensiones: %5d              ║\n",
+           nombre_politica_balanceo(sistema->config.politica_balanceo), suspensiones_totales);
+    printf("║ Duración: %8.2f s   SETs/segundo: %8.4f                     ║\n",
+           segundos, sets / segundos);
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        printf("║ Celda %d:                                                          ║\n", c+1);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            BrazoRobotico *brazo = &sistema->celdas[c].brazos[b];
+            uint64_t ocupado, suspendido;
+            tiempos_brazo(brazo, ahora, &ocupado, &suspendido);
+            int movidas = brazo->piezas_movidas;
+            
+            printf("║   Brazo %d: ocupado %5.1f%%  suspendido %5.1f%%  piezas %4d       ║\n",
+                   b+1, 100.0 * ocupado / duracion_us, 100.0 * suspendido / duracion_us, movidas);
+        }
+    }
+    
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
@@ -3,19 +3,58 @@
  */
 
 #include "banda.h"
+#include "metricas.h"
+#include "traza.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "temporizador.h"
+#include "control_velocidad.h"
+#include "reservas.h"
+#include "topologia.h"
+#include "pool_brazos.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 // Variable externa del sistema (definida en lego_master.c)
 extern SistemaLego *sistema;
 
+// Tramo contiguo de la banda [desde, hasta) que avanza un solo hilo
+typedef struct {
+    int desde;
+    int hasta;
+    Pieza salida[MAX_PIEZAS_POS];    // Última posición del tramo, en camino al siguiente
+    int num_salida;
+    int piezas;                      // Piezas en el tramo tras el tick
+    int ocupadas;                    // Posiciones ocupadas del tramo tras el tick
+    pthread_t hilo;
+} TramoBanda;
+
+// Estado de una banda de la planta, propio de su hilo y sus trabajadores
+typedef struct {
+    TramoBanda tramos[MAX_TRAMOS_BANDA];
+    int num_tramos;
+    pthread_barrier_t barrera;
+    bool terminar;
+    int turno_destino;               // Próximo destino de la división
+    atomic_int piezas;               // Piezas en la banda tras su último tick
+    atomic_int ocupadas;             // Posiciones ocupadas tras su último tick
+} EstadoBanda;
+
+static EstadoBanda estados[MAX_BANDAS];
+static int piezas_pos[MAX_POSICIONES];    // Piezas por posición tras el tick
+
 void inicializar_banda(BandaTransportadora *banda, int longitud, int velocidad) {
     banda->longitud = longitud;
     banda->velocidad = velocidad;
     banda->activa = true;
-    pthread_mutex_init(&banda->mutex_global, NULL);
+    for (int b = 0; b < MAX_BANDAS; b++) {
+        pthread_mutex_init(&banda->mutex_global[b], NULL);
+    }
     
     for (int i = 0; i < longitud; i++) {
         banda->posiciones[i].num_piezas = 0;
@@ -28,7 +67,9 @@ void inicializar_banda(BandaTransportadora *banda, int longitud, int velocidad)
 }
 
 void destruir_banda(BandaTransportadora *banda) {
-    pthread_mutex_destroy(&banda->mutex_global);
+    for (int b = 0; b < MAX_BANDAS; b++) {
+        pthread_mutex_destroy(&banda->mutex_global[b]);
+    }
     for (int i = 0; i < banda->longitud; i++) {
         pthread_mutex_destroy(&banda->posiciones[i].mutex);
     }
@@ -62,62 +103,327 @@ int retirar_pieza_posicion(PosicionBanda *pos, int tipo_buscado) {
     return -1;  // No encontrada
 }
 
-void* thread_banda(void* arg) {
-    (void)arg;  // Suprimir warning de parámetro no usado
+int pieza_al_tacho(const Pieza *pieza, int celda_id, int brazo_id) {
+    trazar_pieza(EVT_TACHO, pieza, celda_id, brazo_id);
+    pthread_mutex_lock(&sistema->stats.mutex);
+    sistema->stats.piezas_en_tacho[pieza->tipo - 1]++;
+    sistema->stats.total_piezas_tacho++;
+    sistema->stats.vueltas_tacho[pieza->vueltas < MAX_VUELTAS ? pieza->vueltas : MAX_VUELTAS]++;
+    int total_tacho = sistema->stats.total_piezas_tacho;
+    pthread_mutex_unlock(&sistema->stats.mutex);
+    return total_tacho;
+}
+
+// Agrega a la posición i (con su mutex tomado) las piezas que llegan, detrás
+// de las que ya estén: una devolución o inyección pudo escribirla después de
+// vaciarse. Lo que no entra cae al tacho. La reserva vence cuando la pieza
+// pasa la posición de su celda
+static void recibir_piezas(int i, PosicionBanda *actual, const Pieza *piezas, int num) {
+    int al_tacho = 0;
+    for (int p = 0; p < num; p++) {
+        if (actual->num_piezas >= MAX_PIEZAS_POS) {
+            Pieza cae = piezas[p];
+            liberar_reserva(&cae, false);
+            vuelo_sumar(UBIC_BANDA, cae.tipo, -1);
+            pieza_al_tacho(&cae, -1, -1);
+            al_tacho++;
+            continue;
+        }
+        Pieza *llega = &actual->piezas[actual->num_piezas++];
+        *llega = piezas[p];
+        int reservada = llega->reservada_para;
+        if (reservada != SIN_RESERVA && i > sistema->celdas[reservada].posicion_banda) {
+            liberar_reserva(llega, false);
+        }
+    }
+    if (al_tacho > 0) {
+        contar_banda(banda_de_posicion(i), CONTADOR_TACHO, al_tacho);
+        registrar_piezas_tacho(al_tacho);
+        vivo_sumar(&vivos.piezas_tacho, al_tacho);
+    }
+}
+
+// Primera mitad del tick de un tramo: su última posición sale hacia el
+// tramo siguiente. El último tramo no la hace: su salida es el tacho
+static void sacar_salida_tramo(TramoBanda *tramo) {
+    PosicionBanda *ultima = &sistema->banda.posiciones[tramo->hasta - 1];
+    pthread_mutex_lock(&ultima->mutex);
+    tramo->num_salida = ultima->num_piezas;
+    memcpy(tramo->salida, ultima->piezas, sizeof(Pieza) * ultima->num_piezas);
+    ultima->num_piezas = 0;
+    pthread_mutex_unlock(&ultima->mutex);
+}
+
+// Segunda mitad: mueve las piezas del tramo una posición y recibe en la
+// primera la salida del tramo anterior (tras la barrera, ya nadie la escribe)
+static void avanzar_tramo(EstadoBanda *estado, int t) {
+    TramoBanda *tramo = &estado->tramos[t];
+    tramo->piezas = 0;
+    tramo->ocupadas = 0;
+    for (int i = tramo->hasta - 1; i > tramo->desde; i--) {
+        PosicionBanda *actual = &sistema->banda.posiciones[i];
+        PosicionBanda *anterior = &sistema->banda.posiciones[i - 1];
+        
+        pthread_mutex_lock(&actual->mutex);
+        pthread_mutex_lock(&anterior->mutex);
+        
+        recibir_piezas(i, actual, anterior->piezas, anterior->num_piezas);
+        anterior->num_piezas = 0;
+        piezas_pos[i] = actual->num_piezas;
+        tramo->piezas += actual->num_piezas;
+        tramo->ocupadas += actual->num_piezas > 0;
+        
+        pthread_mutex_unlock(&anterior->mutex);
+        pthread_mutex_unlock(&actual->mutex);
+    }
     
-    int intervalo_us = 1000000 / sistema->banda.velocidad;
+    if (t > 0) {
+        PosicionBanda *primera = &sistema->banda.posiciones[tramo->desde];
+        pthread_mutex_lock(&primera->mutex);
+        recibir_piezas(tramo->desde, primera, estado->tramos[t - 1].salida, estado->tramos[t - 1].num_salida);
+        piezas_pos[tramo->desde] = primera->num_piezas;
+        tramo->piezas += primera->num_piezas;
+        tramo->ocupadas += primera->num_piezas > 0;
+        pthread_mutex_unlock(&primera->mutex);
+    }
+}
+
+// Trabajador de los tramos 1..n-1 de una banda. Cada tick son tres barreras
+// junto al hilo de la banda: inicio (ya con su mutex_global), salidas y fin
+static void* thread_tramo(void* arg) {
+    int indice = (int)(intptr_t)arg;
+    EstadoBanda *estado = &estados[indice / MAX_TRAMOS_BANDA];
+    int t = indice % MAX_TRAMOS_BANDA;
+    while (true) {
+        pthread_barrier_wait(&estado->barrera);
+        if (estado->terminar) break;
+        if (t < estado->num_tramos - 1) sacar_salida_tramo(&estado->tramos[t]);
+        pthread_barrier_wait(&estado->barrera);
+        avanzar_tramo(estado, t);
+        pthread_barrier_wait(&estado->barrera);
+    }
+    return NULL;
+}
+
+// Reparte la banda en tramos de largo parejo y lanza sus trabajadores
+static void iniciar_tramos(int b) {
+    EstadoBanda *estado = &estados[b];
+    const DescripcionBanda *banda = &sistema->config.bandas[b];
+    int longitud = banda->longitud;
+    estado->num_tramos = sistema->config.tramos_banda > 1 ? sistema->config.tramos_banda : 1;
+    if (estado->num_tramos > longitud) estado->num_tramos = longitud;
+    for (int t = 0; t < estado->num_tramos; t++) {
+        estado->tramos[t].desde = banda->inicio + t * longitud / estado->num_tramos;
+        estado->tramos[t].hasta = banda->inicio + (t + 1) * longitud / estado->num_tramos;
+    }
+    if (estado->num_tramos == 1) return;
+    
+    estado->terminar = false;
+    pthread_barrier_init(&estado->barrera, NULL, estado->num_tramos);
+    for (int t = 1; t < estado->num_tramos; t++) {
+        if (pthread_create(&estado->tramos[t].hilo, NULL, thread_tramo,
+                           (void*)(intptr_t)(b * MAX_TRAMOS_BANDA + t)) != 0) {
+            perror("Error creando hilo de tramo de la banda");
+            exit(1);
+        }
+    }
+}
+
+static void detener_tramos(EstadoBanda *estado) {
+    if (estado->num_tramos == 1) return;
+    estado->terminar = true;
+    pthread_barrier_wait(&estado->barrera);
+    for (int t = 1; t < estado->num_tramos; t++) {
+        pthread_join(estado->tramos[t].hilo, NULL);
+    }
+    pthread_barrier_destroy(&estado->barrera);
+}
+
+// Pasa las piezas del final de la banda a sus destinos, por turnos; las que
+// no entran en ningún destino caen al tacho. Retorna cuántas cayeron
+static int pasar_a_destinos(int b, Pieza *salen, int num_salen) {
+    const DescripcionBanda *banda = &sistema->config.bandas[b];
+    EstadoBanda *estado = &estados[b];
+    int al_tacho = 0;
+    for (int p = 0; p < num_salen; p++) {
+        bool entregada = false;
+        for (int intento = 0; intento < banda->num_destinos && !entregada; intento++) {
+            int destino = banda->destinos[estado->turno_destino];
+            estado->turno_destino = (estado->turno_destino + 1) % banda->num_destinos;
+            PosicionBanda *inicio = &sistema->banda.posiciones[sistema->config.bandas[destino].inicio];
+            pthread_mutex_lock(&inicio->mutex);
+            if (inicio->num_piezas < MAX_PIEZAS_POS) {
+                inicio->piezas[inicio->num_piezas++] = salen[p];
+                entregada = true;
+            }
+            pthread_mutex_unlock(&inicio->mutex);
+            if (entregada) {
+                contar_banda(b, CONTADOR_ENVIADAS, 1);
+                contar_banda(destino, CONTADOR_RECIBIDAS, 1);
+            }
+        }
+        if (!entregada) {
+            vuelo_sumar(UBIC_BANDA, salen[p].tipo, -1);
+            pieza_al_tacho(&salen[p], -1, -1);
+            al_tacho++;
+        }
+    }
+    return al_tacho;
+}
+
+void* thread_banda(void* arg) {
+    int b = (int)(intptr_t)arg;
+    const DescripcionBanda *banda = &sistema->config.bandas[b];
+    EstadoBanda *estado = &estados[b];
+    pthread_mutex_t *mutex_global = &sistema->banda.mutex_global[b];
     
     // Mensaje de inicio eliminado para reducir ruido
     
+    iniciar_tramos(b);
+    uint64_t tick_anterior = tiempo_monotonico_us();
+    
     while (!sistema->terminar) {
+        // La velocidad puede cambiar en marcha (control adaptativo)
+        int intervalo_us = 1000000 / leer_velocidad_banda();
         usleep(intervalo_us);
         
-        pthread_mutex_lock(&sistema->banda.mutex_global);
+        uint64_t inicio_tick = tiempo_monotonico_us();
+        vivo_registrar_tick((int64_t)(inicio_tick - tick_anterior) - intervalo_us);
+        tick_anterior = inicio_tick;
+        pthread_mutex_lock(mutex_global);
+        inicio_escritura();
         
         // Mover piezas desde el final hacia el inicio
-        // Las piezas en la última posición caen al tacho
-        PosicionBanda *ultima = &sistema->banda.posiciones[sistema->banda.longitud - 1];
+        // Las piezas en la última posición pasan a las bandas destino o caen
+        // al tacho, salvo en la banda circular, donde vuelven a la posición 0
+        // mientras les queden vueltas
+        PosicionBanda *ultima = &sistema->banda.posiciones[banda->inicio + banda->longitud - 1];
+        Pieza recirculan[MAX_PIEZAS_POS];
+        int num_recirculan = 0;
+        Pieza salen[MAX_PIEZAS_POS];
+        int num_salen = 0;
+        int al_tacho = 0;
         pthread_mutex_lock(&ultima->mutex);
-        
         for (int p = 0; p < ultima->num_piezas; p++) {
-            if (ultima->piezas[p].tipo > 0) {
-                int tipo = ultima->piezas[p].tipo - 1;
-                pthread_mutex_lock(&sistema->stats.mutex);
-                sistema->stats.piezas_en_tacho[tipo]++;
-                sistema->stats.total_piezas_tacho++;
-                int total_tacho = sistema->stats.total_piezas_tacho;
-                pthread_mutex_unlock(&sistema->stats.mutex);
-                // Solo mostrar mensaje cada 5 piezas para reducir ruido
-                if (total_tacho % 5 == 0) {
-                    printf("[BANDA] %d piezas han caído al tacho\n", total_tacho);
-                }
+            if (ultima->piezas[p].tipo <= 0) continue;
+            liberar_reserva(&ultima->piezas[p], false);
+            if (banda->num_destinos > 0) {
+                salen[num_salen++] = ultima->piezas[p];
+                continue;
+            }
+            if (sistema->config.banda_circular &&
+                ultima->piezas[p].vueltas < sistema->config.max_vueltas) {
+                recirculan[num_recirculan++] = ultima->piezas[p];
+                continue;
+            }
+            vuelo_sumar(UBIC_BANDA, ultima->piezas[p].tipo, -1);
+            int total_tacho = pieza_al_tacho(&ultima->piezas[p], -1, -1);
+            al_tacho++;
+            contar_banda(b, CONTADOR_TACHO, 1);
+            // Solo mostrar mensaje cada 5 piezas para reducir ruido
+            if (total_tacho % 5 == 0) {
+                printf("[BANDA] %d piezas han caído al tacho\n", total_tacho);
             }
         }
         ultima->num_piezas = 0;
         pthread_mutex_unlock(&ultima->mutex);
         
-        // Mover todas las demás piezas una posición
-        for (int i = sistema->banda.longitud - 1; i > 0; i--) {
-            PosicionBanda *actual = &sistema->banda.posiciones[i];
-            PosicionBanda *anterior = &sistema->banda.posiciones[i - 1];
-            
-            pthread_mutex_lock(&actual->mutex);
-            pthread_mutex_lock(&anterior->mutex);
-            
-            // Copiar piezas de la posición anterior a la actual
-            actual->num_piezas = anterior->num_piezas;
-            for (int p = 0; p < anterior->num_piezas; p++) {
-                actual->piezas[p] = anterior->piezas[p];
+        // Mover todas las demás piezas una posición; con varios tramos, cada
+        // uno entrega primero su última posición al siguiente y, tras la
+        // barrera, todos avanzan a la vez. El resultado es el mismo desplazamiento
+        piezas_pos[banda->inicio] = 0;
+        if (estado->num_tramos > 1) {
+            pthread_barrier_wait(&estado->barrera);
+            sacar_salida_tramo(&estado->tramos[0]);
+            pthread_barrier_wait(&estado->barrera);
+        }
+        avanzar_tramo(estado, 0);
+        if (estado->num_tramos > 1) {
+            pthread_barrier_wait(&estado->barrera);
+        }
+        int piezas_en_banda = 0;
+        int posiciones_ocupadas = 0;
+        for (int t = 0; t < estado->num_tramos; t++) {
+            piezas_en_banda += estado->tramos[t].piezas;
+            posiciones_ocupadas += estado->tramos[t].ocupadas;
+        }
+        
+        // Reingreso a la posición 0 (vacía tras el desplazamiento). Comparte
+        // el cupo por posición con los dispensadores, que ceden mientras
+        // esté ocupada; lo que no entra cae al tacho
+        if (num_recirculan > 0) {
+            PosicionBanda *inicio = &sistema->banda.posiciones[banda->inicio];
+            int cupo = sistema->config.num_dispensadores;
+            if (cupo > MAX_PIEZAS_POS) cupo = MAX_PIEZAS_POS;
+            int reingresan = 0;
+            pthread_mutex_lock(&inicio->mutex);
+            for (int p = 0; p < num_recirculan; p++) {
+                if (inicio->num_piezas < cupo) {
+                    recirculan[p].vueltas++;
+                    if (sistema->config.reservas) {
+                        recirculan[p].reservada_para = reservar_pieza(recirculan[p].tipo, 0);
+                    }
+                    inicio->piezas[inicio->num_piezas++] = recirculan[p];
+                    trazar_pieza(EVT_RECIRCULADA, &recirculan[p], -1, -1);
+                    reingresan++;
+                } else {
+                    vuelo_sumar(UBIC_BANDA, recirculan[p].tipo, -1);
+                    pieza_al_tacho(&recirculan[p], -1, -1);
+                    al_tacho++;
+                    contar_banda(b, CONTADOR_TACHO, 1);
+                }
             }
-            anterior->num_piezas = 0;
-            
-            pthread_mutex_unlock(&anterior->mutex);
-            pthread_mutex_unlock(&actual->mutex);
+            piezas_pos[banda->inicio] = inicio->num_piezas;
+            piezas_en_banda += inicio->num_piezas;
+            posiciones_ocupadas += inicio->num_piezas > 0;
+            pthread_mutex_unlock(&inicio->mutex);
+
+            pthread_mutex_lock(&sistema->stats.mutex);
+            sistema->stats.recirculaciones += reingresan;
+            pthread_mutex_unlock(&sistema->stats.mutex);
+            vivo_sumar(&vivos.recirculaciones, reingresan);
         }
+        if (num_salen > 0) {
+            int desbordadas = pasar_a_destinos(b, salen, num_salen);
+            contar_banda(b, CONTADOR_TACHO, desbordadas);
+            al_tacho += desbordadas;
+        }
+        registrar_piezas_tacho(al_tacho);
+        vivo_sumar(&vivos.piezas_tacho, al_tacho);
+        bool cayeron = al_tacho > 0;
+        
+        fin_escritura();
+        pthread_mutex_unlock(mutex_global);
+        if (cayeron) avisar_progreso();
         
-        pthread_mutex_unlock(&sistema->banda.mutex_global);
+        // Los totales en vivo suman el último tick de cada banda
+        atomic_store_explicit(&estado->piezas, piezas_en_banda, memory_order_relaxed);
+        atomic_store_explicit(&estado->ocupadas, posiciones_ocupadas, memory_order_relaxed);
+        for (int otra = 0; otra < sistema->config.num_bandas; otra++) {
+            if (otra == b) continue;
+            piezas_en_banda += atomic_load_explicit(&estados[otra].piezas, memory_order_relaxed);
+            posiciones_ocupadas += atomic_load_explicit(&estados[otra].ocupadas, memory_order_relaxed);
+        }
+        vivo_fijar(&vivos.piezas_en_banda, piezas_en_banda);
+        vivo_fijar(&vivos.posiciones_ocupadas, posiciones_ocupadas);
+        for (int c = 0; c < sistema->config.num_celdas; c++) {
+            if (sistema->celdas[c].banda != b) continue;
+            int pos = sistema->celdas[c].posicion_banda;
+            int previas = 0;
+            for (int p = pos - POSICIONES_PREVIAS_CELDA; p <= pos; p++) {
+                if (p >= banda->inicio) previas += piezas_pos[p];
+            }
+            vivo_fijar(&vivos.ocupacion_previa[c], previas);
+            // En el pool, la llegada de piezas hace ejecutable a los brazos de la celda
+            if (piezas_pos[pos] > 0) despertar_brazos_celda(c, MOTIVO_CELDA);
+        }
+        if (linea_tiempo_activa) {
+            marcar_intervalo(PISTA_BANDA, "tick", inicio_tick, tiempo_monotonico_us());
+        }
     }
     
+    detener_tramos(estado);
+    
     // Mensaje de terminación eliminado para reducir ruido
     return NULL;
 }
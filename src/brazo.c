@@ -5,8 +5,21 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "brazo.h"
+#include "banda.h"
 #include "celda.h"
+#include "metricas.h"
 #include "operador.h"
+#include "temporizador.h"
+#include "traza.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "reservas.h"
+#include "pedidos.h"
+#include "vector_tipos.h"
+#include "topologia.h"
+#include "pool_brazos.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,6 +29,9 @@
 // Variable externa del sistema
 extern SistemaLego *sistema;
 
+#define TRASLADO_MS         30      // De la banda a la caja con la pieza en mano
+#define PERIODO_CICLO_MS    10      // Un paso sin pieza (un ciclo sin progreso)
+
 // Contar piezas de un tipo específico en el buffer (uso interno)
 static int contar_tipo_en_buffer(CeldaEmpaquetado *celda, int tipo) {
     int count = 0;
@@ -29,22 +45,17 @@ static int contar_tipo_en_buffer(CeldaEmpaquetado *celda, int tipo) {
 
 // Verificar si la celda necesita más piezas de este tipo
 static bool necesita_pieza_tipo_total(CeldaEmpaquetado *celda, int tipo) {
-    if (tipo < 1 || tipo > MAX_TIPOS_PIEZA) return false;
+    if (tipo < 1 || tipo > sistema->config.num_tipos) return false;
     
-    pthread_mutex_lock(&celda->caja.mutex);
-    if (celda->caja.completa) {
-        pthread_mutex_unlock(&celda->caja.mutex);
-        return false;
-    }
-    int en_caja = celda->caja.piezas_por_tipo[tipo - 1];
-    int necesarias = celda->caja.piezas_necesarias[tipo - 1];
-    pthread_mutex_unlock(&celda->caja.mutex);
+    // Los faltantes de la caja se leen sin caja.mutex
+    int faltan = caja_faltan(&celda->caja, tipo);
+    if (faltan == 0) return false;
     
     pthread_mutex_lock(&celda->buffer_mutex);
     int en_buffer = contar_tipo_en_buffer(celda, tipo);
     pthread_mutex_unlock(&celda->buffer_mutex);
     
-    return (en_caja + en_buffer) < necesarias;
+    return en_buffer < faltan;
 }
 
 // Agregar pieza al buffer de la celda
@@ -55,13 +66,15 @@ static bool agregar_a_buffer(CeldaEmpaquetado *celda, Pieza pieza) {
         return false;
     }
     celda->buffer[celda->buffer_count++] = pieza;
+    vuelo_sumar(UBIC_BUFFER, pieza.tipo, 1);
+    vivo_fijar(&vivos.buffer_celda[celda->id], celda->buffer_count);
     pthread_mutex_unlock(&celda->buffer_mutex);
     return true;
 }
 
 // Sacar pieza del buffer
 static Pieza sacar_del_buffer(CeldaEmpaquetado *celda, int tipo_necesario) {
-    Pieza resultado = {0, 0};
+    Pieza resultado = {0, 0, 0, 0, SIN_RESERVA};
     pthread_mutex_lock(&celda->buffer_mutex);
     
     for (int i = 0; i < celda->buffer_count; i++) {
@@ -71,6 +84,8 @@ static Pieza sacar_del_buffer(CeldaEmpaquetado *celda, int tipo_necesario) {
                 celda->buffer[j] = celda->buffer[j + 1];
             }
             celda->buffer_count--;
+            vuelo_sumar(UBIC_BUFFER, resultado.tipo, -1);
+            vivo_fijar(&vivos.buffer_celda[celda->id], celda->buffer_count);
             break;
         }
     }
@@ -83,351 +98,568 @@ static Pieza sacar_del_buffer(CeldaEmpaquetado *celda, int tipo_necesario) {
 static bool hay_pieza_en_buffer(CeldaEmpaquetado *celda, CajaEmpaquetado *caja) {
     bool encontrada = false;
     pthread_mutex_lock(&celda->buffer_mutex);
-    pthread_mutex_lock(&caja->mutex);
     
     for (int i = 0; i < celda->buffer_count && !encontrada; i++) {
         int tipo = celda->buffer[i].tipo;
-        if (tipo > 0 && tipo <= MAX_TIPOS_PIEZA) {
-            if (caja->piezas_por_tipo[tipo - 1] < caja->piezas_necesarias[tipo - 1]) {
-                encontrada = true;
-            }
+        if (tipo > 0 && tipo <= sistema->config.num_tipos) {
+            encontrada = caja_faltan(caja, tipo) > 0;
         }
     }
     
-    pthread_mutex_unlock(&caja->mutex);
     pthread_mutex_unlock(&celda->buffer_mutex);
     return encontrada;
 }
 
-void* thread_brazo(void* arg) {
-    ArgsBrazo *args = (ArgsBrazo*)arg;
-    int c = args->celda_id;
-    int b = args->brazo_id;
-    free(args);
+void cambiar_estado_brazo(BrazoRobotico *brazo, EstadoBrazo nuevo) {
+    // NOTA: El llamador debe tener el mutex del brazo
+    uint64_t ahora = tiempo_monotonico_us();
+    uint64_t transcurrido = ahora - brazo->ultimo_cambio_us;
     
-    CeldaEmpaquetado *celda = &sistema->celdas[c];
-    BrazoRobotico *brazo = &celda->brazos[b];
+    if (brazo->estado == BRAZO_RETIRANDO || brazo->estado == BRAZO_COLOCANDO) {
+        brazo->tiempo_ocupado_us += transcurrido;
+    } else if (brazo->estado == BRAZO_SUSPENDIDO) {
+        brazo->tiempo_suspendido_us += transcurrido;
+    }
+    marcar_intervalo(PISTA_BRAZO(brazo->celda_id, brazo->id), nombre_estado_brazo(brazo->estado),
+                     brazo->ultimo_cambio_us, ahora);
+    // El estado del brazo entra en la instantánea
+    inicio_escritura();
+    brazo->estado = nuevo;
+    fin_escritura();
+    brazo->ultimo_cambio_us = ahora;
+    vivo_fijar(&vivos.estado_brazo[brazo->celda_id][brazo->id], nuevo);
+}
+
+void tiempos_brazo(BrazoRobotico *brazo, uint64_t ahora, uint64_t *ocupado, uint64_t *suspendido) {
+    pthread_mutex_lock(&brazo->mutex);
+    *ocupado = brazo->tiempo_ocupado_us;
+    *suspendido = brazo->tiempo_suspendido_us;
+    uint64_t en_curso = ahora - brazo->ultimo_cambio_us;
+    if (brazo->estado == BRAZO_RETIRANDO || brazo->estado == BRAZO_COLOCANDO) {
+        *ocupado += en_curso;
+    } else if (brazo->estado == BRAZO_SUSPENDIDO) {
+        *suspendido += en_curso;
+    }
+    pthread_mutex_unlock(&brazo->mutex);
+}
+
+// Callback del temporizador: reanuda el brazo exactamente al vencer Δt2
+static void reanudar_brazo(void *arg) {
+    BrazoRobotico *brazo = (BrazoRobotico*)arg;
+    pthread_mutex_lock(&brazo->mutex);
+    if (brazo->estado == BRAZO_SUSPENDIDO) {
+        cambiar_estado_brazo(brazo, BRAZO_IDLE);
+    }
+    brazo->temporizador_id = -1;
+    pthread_cond_broadcast(&brazo->cond_reanudar);
+    pthread_mutex_unlock(&brazo->mutex);
+    despertar_brazo(brazo->celda_id, brazo->id, MOTIVO_REANUDAR);
+}
+
+bool suspender_brazo(BrazoRobotico *brazo, int delta_ms) {
+    pthread_mutex_lock(&brazo->mutex);
+    if (brazo->estado != BRAZO_IDLE) {
+        pthread_mutex_unlock(&brazo->mutex);
+        return false;
+    }
+    cambiar_estado_brazo(brazo, BRAZO_SUSPENDIDO);
+    brazo->tiempo_suspension = tiempo_monotonico_us();
+    brazo->temporizador_id = programar_temporizador((uint64_t)delta_ms * 1000ULL,
+                                                    reanudar_brazo, brazo);
+    if (brazo->temporizador_id < 0) {
+        // Sin temporizador disponible no se puede garantizar la reanudación
+        cambiar_estado_brazo(brazo, BRAZO_IDLE);
+        pthread_mutex_unlock(&brazo->mutex);
+        return false;
+    }
+    pthread_mutex_unlock(&brazo->mutex);
+    return true;
+}
+
+void despertar_brazos_suspendidos(void) {
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            BrazoRobotico *brazo = &sistema->celdas[c].brazos[b];
+            pthread_mutex_lock(&brazo->mutex);
+            pthread_cond_broadcast(&brazo->cond_reanudar);
+            pthread_mutex_unlock(&brazo->mutex);
+        }
+    }
+}
+
+// Cupos de la celda: semáforos con un hilo por brazo, cupos del pool con
+// --pool-brazos (donde una tarea sin cupo se estaciona en lugar de bloquear)
+static bool tomar_retiro(CeldaEmpaquetado *celda) {
+    if (pool_brazos_activo()) return pool_tomar_retiro(celda->id);
+    return sem_trywait(&celda->sem_brazos_retirando) == 0;
+}
+
+static void soltar_retiro(CeldaEmpaquetado *celda) {
+    if (pool_brazos_activo()) {
+        pool_soltar_retiro(celda->id);
+    } else {
+        sem_post(&celda->sem_brazos_retirando);
+    }
+}
+
+static bool tomar_colocador(CeldaEmpaquetado *celda) {
+    if (pool_brazos_activo()) return pool_tomar_colocador(celda->id);
+    sem_wait(&celda->caja.sem_acceso);
+    return true;
+}
+
+static void soltar_colocador(CeldaEmpaquetado *celda) {
+    if (pool_brazos_activo()) {
+        pool_soltar_colocador(celda->id);
+    } else {
+        sem_post(&celda->caja.sem_acceso);
+    }
+}
+
+static inline Espera espera(MotivoEspera motivo, int retardo_ms) {
+    return (Espera){motivo, retardo_ms};
+}
+
+// Caja completa: pasa la celda a revisión (requiere caja.mutex y el colocador,
+// que suelta)
+static void cerrar_caja_completa(CeldaEmpaquetado *celda, int c) {
+    celda->caja.completa = true;
+    printf("[CELDA %d] ★ SET COMPLETO - Esperando revisión\n", c+1);
     
-    while (!sistema->terminar) {
-        // Verificar si la celda está habilitada
-        pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
-        bool celda_activa = sistema->celdas_habilitadas[c];
-        pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
-        
-        if (!celda_activa) {
-            usleep(100000);
-            continue;
+    pthread_mutex_unlock(&celda->caja.mutex);
+    soltar_colocador(celda);
+    
+    pthread_mutex_lock(&celda->mutex);
+    cambiar_estado_celda(celda, CELDA_ESPERANDO_OP);
+    pthread_mutex_unlock(&celda->mutex);
+    
+    notificar_operador(celda);
+}
+
+// FASE 1: retirar de la banda una pieza que la celda necesite (con el cupo
+// de retiro tomado, que suelta). Retorna true si la pieza quedó en la mano
+static bool retirar_pieza(CeldaEmpaquetado *celda, BrazoRobotico *brazo, int c, int b,
+                          bool *ya_trabajando) {
+    PosicionBanda *pos = &sistema->banda.posiciones[celda->posicion_banda];
+    pthread_mutex_lock(&pos->mutex);
+    
+    int pieza_encontrada = -1;
+    for (int p = 0; p < pos->num_piezas; p++) {
+        int tipo = pos->piezas[p].tipo;
+        if (!pieza_disponible_para(&pos->piezas[p], c)) continue;
+        if (tipo > 0 && necesita_pieza_tipo_total(celda, tipo)) {
+            pieza_encontrada = p;
+            break;
         }
+    }
+    
+    if (pieza_encontrada >= 0 && !*ya_trabajando) {
+        pthread_mutex_lock(&sistema->mutex_sets);
+        pthread_mutex_lock(&celda->mutex);
         
-        // Verificar si está suspendido
-        pthread_mutex_lock(&brazo->mutex);
-        if (brazo->estado == BRAZO_SUSPENDIDO) {
-            if (time(NULL) - brazo->tiempo_suspension >= sistema->config.delta_t2 / 1000) {
-                brazo->estado = BRAZO_IDLE;
-            } else {
-                pthread_mutex_unlock(&brazo->mutex);
-                usleep(100000);
-                continue;
-            }
+        if (!celda->trabajando_en_set && 
+            sistema->sets_completados_total + sistema->sets_en_proceso < sistema->config.num_sets) {
+            inicio_escritura();
+            celda->trabajando_en_set = true;
+            celda->inicio_set_us = tiempo_monotonico_us();
+            sistema->sets_en_proceso++;
+            fin_escritura();
+            *ya_trabajando = true;
+            printf("[CELDA %d] Inició SET #%d\n", 
+                   c+1, sistema->sets_completados_total + sistema->sets_en_proceso);
         }
-        pthread_mutex_unlock(&brazo->mutex);
         
-        // Verificar estado de la celda
-        pthread_mutex_lock(&celda->mutex);
-        EstadoCelda estado_celda = celda->estado;
-        bool devolviendo = celda->devolviendo_piezas;
         pthread_mutex_unlock(&celda->mutex);
+        pthread_mutex_unlock(&sistema->mutex_sets);
+    }
+    
+    if (pieza_encontrada < 0 || !*ya_trabajando) {
+        pthread_mutex_unlock(&pos->mutex);
+        soltar_retiro(celda);
+        return false;
+    }
+    
+    Pieza pieza_tomada = pos->piezas[pieza_encontrada];
+    liberar_reserva(&pieza_tomada, true);
+    
+    // De la banda a la mano del brazo en una sola escritura
+    inicio_escritura();
+    for (int p = pieza_encontrada; p < pos->num_piezas - 1; p++) {
+        pos->piezas[p] = pos->piezas[p + 1];
+    }
+    pos->num_piezas--;
+    pthread_mutex_unlock(&pos->mutex);
+    
+    pthread_mutex_lock(&brazo->mutex);
+    cambiar_estado_brazo(brazo, BRAZO_RETIRANDO);
+    brazo->pieza_actual = pieza_tomada;
+    pthread_mutex_unlock(&brazo->mutex);
+    vuelo_mover(UBIC_BANDA, UBIC_MANO, pieza_tomada.tipo);
+    fin_escritura();
+    
+    soltar_retiro(celda);
+    trazar_pieza(EVT_RETIRADA, &pieza_tomada, c, b);
+    return true;
+}
+
+// FASE 2: colocar en la caja la pieza en mano (con el colocador tomado, que
+// suelta). Retorna true si completó el SET
+static bool colocar_pieza_en_mano(CeldaEmpaquetado *celda, BrazoRobotico *brazo, int c, int b) {
+    pthread_mutex_lock(&brazo->mutex);
+    cambiar_estado_brazo(brazo, BRAZO_COLOCANDO);
+    pthread_mutex_unlock(&brazo->mutex);
+    
+    pthread_mutex_lock(&celda->caja.mutex);
+    
+    Pieza pieza = brazo->pieza_actual;
+    int tipo = pieza.tipo;
+    bool a_caja = tipo > 0 && tipo <= sistema->config.num_tipos &&
+                  caja_tomar_faltante(&celda->caja, tipo);
+    
+    // De la mano a la caja (o al buffer) en una sola escritura
+    inicio_escritura();
+    bool al_tacho = false;
+    if (a_caja) {
+        caja_agregar_pieza(&celda->caja, pieza);
+    } else if (tipo > 0 && !agregar_a_buffer(celda, pieza)) {
+        // Buffer lleno: la pieza no puede volver a la banda, cae al tacho
+        pieza_al_tacho(&pieza, c, b);
+        al_tacho = true;
+    }
+    pthread_mutex_lock(&brazo->mutex);
+    brazo->pieza_actual.tipo = 0;
+    pthread_mutex_unlock(&brazo->mutex);
+    vuelo_sumar(UBIC_MANO, tipo, -1);
+    fin_escritura();
+    avisar_progreso();
+    
+    bool completa = false;
+    if (a_caja) {
+        trazar_pieza(EVT_EN_CAJA, &pieza, c, b);
+        brazo->piezas_movidas++;
+        vivo_sumar(&vivos.piezas_brazo[c][b], 1);
         
-        if (estado_celda == CELDA_INACTIVA) {
-            usleep(100000);
-            continue;
-        }
+        pthread_mutex_lock(&celda->mutex);
+        celda->ciclos_sin_progreso = 0;
+        pthread_mutex_unlock(&celda->mutex);
         
-        if (devolviendo) {
-            usleep(50000);
-            continue;
-        }
+        pthread_mutex_lock(&sistema->stats.mutex);
+        sistema->stats.piezas_por_brazo[c][b]++;
+        pthread_mutex_unlock(&sistema->stats.mutex);
         
-        if (estado_celda == CELDA_ESPERANDO_OP) {
-            usleep(50000);
-            continue;
-        }
+        printf("[CELDA %d][BRAZO %d] Colocó pieza tipo %s [%d/%d]\n",
+               c+1, b+1, nombre_tipo_pieza(tipo),
+               celda->caja.piezas_por_tipo[tipo - 1],
+               celda->caja.piezas_necesarias[tipo - 1]);
         
-        // Sistema de asignación de SETs
-        pthread_mutex_lock(&sistema->mutex_sets);
-        int sets_completados = sistema->sets_completados_total;
-        int sets_necesarios = sistema->config.num_sets;
-        pthread_mutex_unlock(&sistema->mutex_sets);
+        completa = verificar_caja_completa(&celda->caja);
+    } else if (al_tacho) {
+        registrar_piezas_tacho(1);
+        vivo_sumar(&vivos.piezas_tacho, 1);
+    } else if (tipo > 0) {
+        trazar_pieza(EVT_EN_BUFFER, &pieza, c, b);
+    }
+    
+    if (completa) {
+        cerrar_caja_completa(celda, c);
+    } else {
+        pthread_mutex_unlock(&celda->caja.mutex);
+        soltar_colocador(celda);
+    }
+    
+    pthread_mutex_lock(&brazo->mutex);
+    inicio_escritura();
+    cambiar_estado_brazo(brazo, BRAZO_IDLE);
+    brazo->pieza_actual.tipo = 0;
+    fin_escritura();
+    pthread_mutex_unlock(&brazo->mutex);
+    return completa;
+}
+
+// FASE 3: pasar del buffer a la caja una pieza que falte (con el colocador
+// tomado, que suelta). Retorna true si completó el SET
+static bool usar_buffer(CeldaEmpaquetado *celda, BrazoRobotico *brazo, int c, int b) {
+    pthread_mutex_lock(&celda->caja.mutex);
+    
+    for (int tipo = 1; tipo <= sistema->config.num_tipos; tipo++) {
+        if (caja_faltan(&celda->caja, tipo) == 0) continue;
         
-        if (sets_completados >= sets_necesarios) {
-            usleep(50000);
-            continue;
+        // Del buffer a la caja en una sola escritura
+        inicio_escritura();
+        Pieza p = sacar_del_buffer(celda, tipo);
+        if (p.tipo > 0) {
+            // Con caja.mutex tomado nadie más descuenta este faltante
+            caja_tomar_faltante(&celda->caja, tipo);
+            caja_agregar_pieza(&celda->caja, p);
         }
+        fin_escritura();
+        if (p.tipo == 0) continue;
+        avisar_progreso();
+        
+        trazar_pieza(EVT_EN_CAJA, &p, c, b);
+        brazo->piezas_movidas++;
+        vivo_sumar(&vivos.piezas_brazo[c][b], 1);
         
         pthread_mutex_lock(&celda->mutex);
-        bool ya_trabajando = celda->trabajando_en_set;
+        celda->ciclos_sin_progreso = 0;
         pthread_mutex_unlock(&celda->mutex);
         
-        // FASE 1: RETIRAR PIEZA DE LA BANDA
-        pthread_mutex_lock(&celda->buffer_mutex);
-        int buffer_actual = celda->buffer_count;
-        pthread_mutex_unlock(&celda->buffer_mutex);
+        pthread_mutex_lock(&sistema->stats.mutex);
+        sistema->stats.piezas_por_brazo[c][b]++;
+        pthread_mutex_unlock(&sistema->stats.mutex);
+        
+        printf("[CELDA %d][BRAZO %d] Del buffer: pieza tipo %s [%d/%d]\n",
+               c+1, b+1, nombre_tipo_pieza(tipo),
+               celda->caja.piezas_por_tipo[tipo - 1],
+               celda->caja.piezas_necesarias[tipo - 1]);
         
-        if (buffer_actual < MAX_BUFFER_CELDA - 2) {
-            if (sem_trywait(&celda->sem_brazos_retirando) == 0) {
-                PosicionBanda *pos = &sistema->banda.posiciones[celda->posicion_banda];
-                pthread_mutex_lock(&pos->mutex);
-                
-                int pieza_encontrada = -1;
-                for (int p = 0; p < pos->num_piezas; p++) {
-                    int tipo = pos->piezas[p].tipo;
-                    if (tipo > 0 && necesita_pieza_tipo_total(celda, tipo)) {
-                        pieza_encontrada = p;
-                        break;
-                    }
-                }
-                
-                if (pieza_encontrada >= 0) {
-                    if (!ya_trabajando) {
-                        pthread_mutex_lock(&sistema->mutex_sets);
-                        pthread_mutex_lock(&celda->mutex);
-                        
-                        if (!celda->trabajando_en_set && 
-                            sistema->sets_completados_total + sistema->sets_en_proceso < sistema->config.num_sets) {
-                            celda->trabajando_en_set = true;
-                            sistema->sets_en_proceso++;
-                            ya_trabajando = true;
-                            printf("[CELDA %d] Inició SET #%d\n", 
-                                   c+1, sistema->sets_completados_total + sistema->sets_en_proceso);
-                        }
-                        
-                        pthread_mutex_unlock(&celda->mutex);
-                        pthread_mutex_unlock(&sistema->mutex_sets);
-                    }
-                    
-                    if (ya_trabajando) {
-                        Pieza pieza_tomada = pos->piezas[pieza_encontrada];
-                        
-                        for (int p = pieza_encontrada; p < pos->num_piezas - 1; p++) {
-                            pos->piezas[p] = pos->piezas[p + 1];
-                        }
-                        pos->num_piezas--;
-                        pthread_mutex_unlock(&pos->mutex);
-                        sem_post(&celda->sem_brazos_retirando);
-                        
-                        pthread_mutex_lock(&brazo->mutex);
-                        brazo->estado = BRAZO_RETIRANDO;
-                        brazo->pieza_actual = pieza_tomada;
-                        pthread_mutex_unlock(&brazo->mutex);
-                        
-                        usleep(30000);
-                        
-                        // FASE 2: COLOCAR EN LA CAJA
-                        sem_wait(&celda->caja.sem_acceso);
-                        
-                        pthread_mutex_lock(&brazo->mutex);
-                        brazo->estado = BRAZO_COLOCANDO;
-                        pthread_mutex_unlock(&brazo->mutex);
-                        
-                        pthread_mutex_lock(&celda->caja.mutex);
-                        
-                        int tipo = brazo->pieza_actual.tipo;
-                        
-                        if (tipo > 0 && tipo <= MAX_TIPOS_PIEZA && 
-                            !celda->caja.completa &&
-                            celda->caja.piezas_por_tipo[tipo - 1] < celda->caja.piezas_necesarias[tipo - 1]) {
-                            
-                            celda->caja.piezas_por_tipo[tipo - 1]++;
-                            brazo->piezas_movidas++;
-                            
-                            pthread_mutex_lock(&celda->mutex);
-                            celda->ciclos_sin_progreso = 0;
-                            pthread_mutex_unlock(&celda->mutex);
-                            
-                            pthread_mutex_lock(&sistema->stats.mutex);
-                            sistema->stats.piezas_por_brazo[c][b]++;
-                            pthread_mutex_unlock(&sistema->stats.mutex);
-                            
-                            printf("[CELDA %d][BRAZO %d] Colocó pieza tipo %s [%d/%d]\n",
-                                   c+1, b+1, nombre_tipo_pieza(tipo),
-                                   celda->caja.piezas_por_tipo[tipo - 1],
-                                   celda->caja.piezas_necesarias[tipo - 1]);
-                            
-                            if (verificar_caja_completa(&celda->caja)) {
-                                celda->caja.completa = true;
-                                printf("[CELDA %d] ★ SET COMPLETO - Esperando revisión\n", c+1);
-                                
-                                pthread_mutex_unlock(&celda->caja.mutex);
-                                sem_post(&celda->caja.sem_acceso);
-                                
-                                pthread_mutex_lock(&celda->mutex);
-                                celda->estado = CELDA_ESPERANDO_OP;
-                                pthread_mutex_unlock(&celda->mutex);
-                                
-                                notificar_operador(celda);
-                                
-                                pthread_mutex_lock(&brazo->mutex);
-                                brazo->estado = BRAZO_IDLE;
-                                brazo->pieza_actual.tipo = 0;
-                                pthread_mutex_unlock(&brazo->mutex);
-                                
-                                continue;
-                            }
-                        } else if (tipo > 0) {
-                            agregar_a_buffer(celda, brazo->pieza_actual);
-                        }
-                        
-                        pthread_mutex_unlock(&celda->caja.mutex);
-                        sem_post(&celda->caja.sem_acceso);
-                        
-                        pthread_mutex_lock(&brazo->mutex);
-                        brazo->estado = BRAZO_IDLE;
-                        brazo->pieza_actual.tipo = 0;
-                        pthread_mutex_unlock(&brazo->mutex);
-                        
-                    } else {
-                        pthread_mutex_unlock(&pos->mutex);
-                        sem_post(&celda->sem_brazos_retirando);
-                    }
-                } else {
-                    pthread_mutex_unlock(&pos->mutex);
-                    sem_post(&celda->sem_brazos_retirando);
-                }
+        if (verificar_caja_completa(&celda->caja)) {
+            cerrar_caja_completa(celda, c);
+            return true;
+        }
+        break;
+    }
+    
+    pthread_mutex_unlock(&celda->caja.mutex);
+    soltar_colocador(celda);
+    return false;
+}
+
+// FASE 4: tras demasiados ciclos sin progreso, liberar las piezas si lo que
+// viene por la banda no alcanza para completar el SET
+static void revisar_progreso(CeldaEmpaquetado *celda, int c) {
+    pthread_mutex_lock(&celda->mutex);
+    celda->ciclos_sin_progreso++;
+    int ciclos = celda->ciclos_sin_progreso;
+    pthread_mutex_unlock(&celda->mutex);
+    
+    if (ciclos <= 200) return;
+    
+    int num_tipos = sistema->config.num_tipos;
+    int piezas_faltan_por_tipo[MAX_TIPOS_PIEZA];
+    
+    pthread_mutex_lock(&celda->caja.mutex);
+    int piezas_faltan_total = tipos_faltantes(celda->caja.piezas_por_tipo,
+                                              celda->caja.piezas_necesarias,
+                                              piezas_faltan_por_tipo, num_tipos);
+    pthread_mutex_unlock(&celda->caja.mutex);
+    
+    if (piezas_faltan_total == 0) {
+        pthread_mutex_lock(&celda->mutex);
+        celda->ciclos_sin_progreso = 0;
+        pthread_mutex_unlock(&celda->mutex);
+        return;
+    }
+    
+    int piezas_disponibles_por_tipo[MAX_TIPOS_PIEZA] = {0};
+    
+    pthread_mutex_lock(&celda->buffer_mutex);
+    for (int i = 0; i < celda->buffer_count; i++) {
+        int tipo = celda->buffer[i].tipo;
+        if (tipo >= 1 && tipo <= sistema->config.num_tipos) {
+            piezas_disponibles_por_tipo[tipo - 1]++;
+        }
+    }
+    pthread_mutex_unlock(&celda->buffer_mutex);
+    
+    // Lo que viene hacia la celda: su banda hasta su posición y,
+    // enteras, las bandas que desembocan en ella
+    for (int i = 0; i < sistema->banda.longitud; i++) {
+        int bi = banda_de_posicion(i);
+        bool llega = bi == celda->banda ? i <= celda->posicion_banda
+                                        : banda_alcanza(bi, celda->banda);
+        if (!llega) continue;
+        PosicionBanda *pos = &sistema->banda.posiciones[i];
+        pthread_mutex_lock(&pos->mutex);
+        for (int p = 0; p < pos->num_piezas; p++) {
+            int tipo = pos->piezas[p].tipo;
+            // Las reservadas para una celda de aquí en adelante no llegarán
+            int reservada = pos->piezas[p].reservada_para;
+            if (reservada != SIN_RESERVA && reservada != c &&
+                sistema->celdas[reservada].posicion_banda >= celda->posicion_banda) continue;
+            if (tipo >= 1 && tipo <= sistema->config.num_tipos) {
+                piezas_disponibles_por_tipo[tipo - 1]++;
             }
         }
+        pthread_mutex_unlock(&pos->mutex);
+    }
+    
+    bool puedo_completar = tipos_cubiertos(piezas_disponibles_por_tipo,
+                                           piezas_faltan_por_tipo, num_tipos);
+    
+    bool es_ultima_celda = celda_al_final(c);
+    
+    bool banda_vacia = tipos_total(piezas_disponibles_por_tipo, num_tipos) == 0;
+    
+    bool debo_liberar = !puedo_completar && (!es_ultima_celda || banda_vacia);
+    
+    if (debo_liberar) {
+        devolver_piezas_a_banda(celda);
+    } else {
+        pthread_mutex_lock(&celda->mutex);
+        celda->ciclos_sin_progreso = 0;
+        pthread_mutex_unlock(&celda->mutex);
+    }
+}
+
+// FASES 3 y 4, al final de cada paso que no terminó esperando
+static Espera cerrar_paso(CeldaEmpaquetado *celda, BrazoRobotico *brazo, int c, int b,
+                          EstadoCelda estado_celda, bool ya_trabajando, MotivoEspera sin_cupo) {
+    if (ya_trabajando && estado_celda == CELDA_ACTIVA && hay_pieza_en_buffer(celda, &celda->caja)) {
+        if (!tomar_colocador(celda)) {
+            sin_cupo = MOTIVO_COLOCADOR;
+        } else if (usar_buffer(celda, brazo, c, b)) {
+            return espera(MOTIVO_NINGUNO, 0);
+        }
+    }
+    
+    if (b == 0 && ya_trabajando && estado_celda == CELDA_ACTIVA) {
+        revisar_progreso(celda, c);
+        // Cada paso es un ciclo sin progreso: el brazo 0 vuelve por tiempo,
+        // no solo cuando llegan piezas
+        if (sin_cupo == MOTIVO_CELDA) sin_cupo = MOTIVO_TIEMPO;
+    }
+    
+    return espera(sin_cupo, PERIODO_CICLO_MS);
+}
+
+Espera paso_brazo(int c, int b) {
+    CeldaEmpaquetado *celda = &sistema->celdas[c];
+    BrazoRobotico *brazo = &celda->brazos[b];
+    
+    // FASE 2: la pieza en mano se coloca al terminar el traslado, aunque la
+    // simulación esté terminando (el pool puede retomar el paso antes de tiempo)
+    if (brazo->etapa == ETAPA_EN_MANO) {
+        uint64_t ahora = tiempo_monotonico_us();
+        if (ahora < brazo->listo_us) {
+            return espera(MOTIVO_TIEMPO, (int)((brazo->listo_us - ahora + 999) / 1000));
+        }
+        if (!tomar_colocador(celda)) {
+            return espera(MOTIVO_COLOCADOR, PERIODO_CICLO_MS);
+        }
+        brazo->etapa = ETAPA_BUSCAR;
+        if (colocar_pieza_en_mano(celda, brazo, c, b)) {
+            return espera(MOTIVO_NINGUNO, 0);
+        }
         
-        // FASE 3: USAR PIEZAS DEL BUFFER
-        if (ya_trabajando && estado_celda == CELDA_ACTIVA && hay_pieza_en_buffer(celda, &celda->caja)) {
-            sem_wait(&celda->caja.sem_acceso);
+        pthread_mutex_lock(&celda->mutex);
+        EstadoCelda estado_celda = celda->estado;
+        bool ya_trabajando = celda->trabajando_en_set;
+        pthread_mutex_unlock(&celda->mutex);
+        return cerrar_paso(celda, brazo, c, b, estado_celda, ya_trabajando, MOTIVO_CELDA);
+    }
+    
+    if (sistema->terminar) return espera(MOTIVO_FIN, 0);
+    
+    // Verificar si la celda está habilitada
+    pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+    bool celda_activa = sistema->celdas_habilitadas[c];
+    pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
+    
+    if (!celda_activa) {
+        return espera(MOTIVO_CELDA, 100);
+    }
+    
+    // Si está suspendido, esperar a que el temporizador lo reanude
+    pthread_mutex_lock(&brazo->mutex);
+    bool suspendido = brazo->estado == BRAZO_SUSPENDIDO;
+    pthread_mutex_unlock(&brazo->mutex);
+    
+    if (suspendido) {
+        return espera(MOTIVO_REANUDAR, 0);
+    }
+    
+    // Verificar estado de la celda
+    pthread_mutex_lock(&celda->mutex);
+    EstadoCelda estado_celda = celda->estado;
+    bool devolviendo = celda->devolviendo_piezas;
+    pthread_mutex_unlock(&celda->mutex);
+    
+    if (estado_celda == CELDA_INACTIVA) {
+        return espera(MOTIVO_CELDA, 100);
+    }
+    
+    if (devolviendo || estado_celda == CELDA_ESPERANDO_OP) {
+        return espera(MOTIVO_CELDA, 50);
+    }
+    
+    // Sin pedido (la cola estaba vacía o se devolvió uno): volver a mirar la cola
+    if (sistema->config.pedidos) {
+        pthread_mutex_lock(&celda->caja.mutex);
+        bool sin_pedido = celda->caja.receta < 0;
+        pthread_mutex_unlock(&celda->caja.mutex);
+        if (sin_pedido) {
+            inicio_escritura();
             pthread_mutex_lock(&celda->caja.mutex);
-            
-            for (int tipo = 1; tipo <= MAX_TIPOS_PIEZA; tipo++) {
-                if (celda->caja.piezas_por_tipo[tipo - 1] < celda->caja.piezas_necesarias[tipo - 1]) {
-                    Pieza p = sacar_del_buffer(celda, tipo);
-                    if (p.tipo > 0) {
-                        celda->caja.piezas_por_tipo[tipo - 1]++;
-                        brazo->piezas_movidas++;
-                        
-                        pthread_mutex_lock(&celda->mutex);
-                        celda->ciclos_sin_progreso = 0;
-                        pthread_mutex_unlock(&celda->mutex);
-                        
-                        pthread_mutex_lock(&sistema->stats.mutex);
-                        sistema->stats.piezas_por_brazo[c][b]++;
-                        pthread_mutex_unlock(&sistema->stats.mutex);
-                        
-                        printf("[CELDA %d][BRAZO %d] Del buffer: pieza tipo %s [%d/%d]\n",
-                               c+1, b+1, nombre_tipo_pieza(tipo),
-                               celda->caja.piezas_por_tipo[tipo - 1],
-                               celda->caja.piezas_necesarias[tipo - 1]);
-                        
-                        if (verificar_caja_completa(&celda->caja)) {
-                            celda->caja.completa = true;
-                            printf("[CELDA %d] ★ SET COMPLETO - Esperando revisión\n", c+1);
-                            
-                            pthread_mutex_unlock(&celda->caja.mutex);
-                            sem_post(&celda->caja.sem_acceso);
-                            
-                            pthread_mutex_lock(&celda->mutex);
-                            celda->estado = CELDA_ESPERANDO_OP;
-                            pthread_mutex_unlock(&celda->mutex);
-                            
-                            notificar_operador(celda);
-                            continue;
-                        }
-                        break;
-                    }
-                }
+            if (celda->caja.receta < 0) {
+                asignar_pedido(celda);
             }
-            
+            sin_pedido = celda->caja.receta < 0;
             pthread_mutex_unlock(&celda->caja.mutex);
-            sem_post(&celda->caja.sem_acceso);
+            fin_escritura();
+        }
+        if (sin_pedido) {
+            return espera(MOTIVO_CELDA, 100);
+        }
+    }
+    
+    // Sistema de asignación de SETs
+    pthread_mutex_lock(&sistema->mutex_sets);
+    int sets_completados = sistema->sets_completados_total;
+    int sets_necesarios = sistema->config.num_sets;
+    pthread_mutex_unlock(&sistema->mutex_sets);
+    
+    if (sets_completados >= sets_necesarios) {
+        return espera(MOTIVO_CELDA, 50);
+    }
+    
+    pthread_mutex_lock(&celda->mutex);
+    bool ya_trabajando = celda->trabajando_en_set;
+    pthread_mutex_unlock(&celda->mutex);
+    
+    // FASE 1: RETIRAR PIEZA DE LA BANDA
+    MotivoEspera sin_cupo = MOTIVO_CELDA;
+    pthread_mutex_lock(&celda->buffer_mutex);
+    int buffer_actual = celda->buffer_count;
+    pthread_mutex_unlock(&celda->buffer_mutex);
+    
+    if (buffer_actual < MAX_BUFFER_CELDA - 2) {
+        if (!tomar_retiro(celda)) {
+            sin_cupo = MOTIVO_RETIRO;
+        } else if (retirar_pieza(celda, brazo, c, b, &ya_trabajando)) {
+            // El traslado hasta la caja: la FASE 2 sigue en el paso siguiente
+            brazo->etapa = ETAPA_EN_MANO;
+            brazo->listo_us = tiempo_monotonico_us() + TRASLADO_MS * 1000ULL;
+            return espera(MOTIVO_TIEMPO, TRASLADO_MS);
         }
+    }
+    
+    return cerrar_paso(celda, brazo, c, b, estado_celda, ya_trabajando, sin_cupo);
+}
+
+void* thread_brazo(void* arg) {
+    ArgsBrazo *args = (ArgsBrazo*)arg;
+    int c = args->celda_id;
+    int b = args->brazo_id;
+    free(args);
+    
+    BrazoRobotico *brazo = &sistema->celdas[c].brazos[b];
+    
+    // Con un hilo por brazo, las esperas de la máquina de estados se duermen
+    for (;;) {
+        Espera e = paso_brazo(c, b);
+        if (e.motivo == MOTIVO_FIN) break;
         
-        // FASE 4: VERIFICAR SI DEBEMOS LIBERAR PIEZAS
-        if (b == 0 && ya_trabajando && estado_celda == CELDA_ACTIVA) {
-            pthread_mutex_lock(&celda->mutex);
-            celda->ciclos_sin_progreso++;
-            int ciclos = celda->ciclos_sin_progreso;
-            pthread_mutex_unlock(&celda->mutex);
-            
-            if (ciclos > 200) {
-                int piezas_faltan_por_tipo[MAX_TIPOS_PIEZA] = {0};
-                int piezas_faltan_total = 0;
-                
-                pthread_mutex_lock(&celda->caja.mutex);
-                for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                    int faltan = celda->caja.piezas_necesarias[t] - celda->caja.piezas_por_tipo[t];
-                    if (faltan > 0) {
-                        piezas_faltan_por_tipo[t] = faltan;
-                        piezas_faltan_total += faltan;
-                    }
-                }
-                pthread_mutex_unlock(&celda->caja.mutex);
-                
-                if (piezas_faltan_total == 0) {
-                    pthread_mutex_lock(&celda->mutex);
-                    celda->ciclos_sin_progreso = 0;
-                    pthread_mutex_unlock(&celda->mutex);
-                    usleep(10000);
-                    continue;
-                }
-                
-                int piezas_disponibles_por_tipo[MAX_TIPOS_PIEZA] = {0};
-                
-                pthread_mutex_lock(&celda->buffer_mutex);
-                for (int i = 0; i < celda->buffer_count; i++) {
-                    int tipo = celda->buffer[i].tipo;
-                    if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
-                        piezas_disponibles_por_tipo[tipo - 1]++;
-                    }
-                }
-                pthread_mutex_unlock(&celda->buffer_mutex);
-                
-                for (int i = 0; i <= celda->posicion_banda; i++) {
-                    PosicionBanda *pos = &sistema->banda.posiciones[i];
-                    pthread_mutex_lock(&pos->mutex);
-                    for (int p = 0; p < pos->num_piezas; p++) {
-                        int tipo = pos->piezas[p].tipo;
-                        if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
-                            piezas_disponibles_por_tipo[tipo - 1]++;
-                        }
-                    }
-                    pthread_mutex_unlock(&pos->mutex);
-                }
-                
-                bool puedo_completar = true;
-                for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                    if (piezas_faltan_por_tipo[t] > piezas_disponibles_por_tipo[t]) {
-                        puedo_completar = false;
-                        break;
-                    }
-                }
-                
-                bool es_ultima_celda = (c == sistema->config.num_celdas - 1);
-                
-                bool banda_vacia = true;
-                for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                    if (piezas_disponibles_por_tipo[t] > 0) {
-                        banda_vacia = false;
-                        break;
-                    }
-                }
-                
-                bool debo_liberar = !puedo_completar && (!es_ultima_celda || banda_vacia);
-                
-                if (debo_liberar) {
-                    devolver_piezas_a_banda(celda);
-                    ya_trabajando = false;
-                } else {
-                    pthread_mutex_lock(&celda->mutex);
-                    celda->ciclos_sin_progreso = 0;
-                    pthread_mutex_unlock(&celda->mutex);
-                }
+        if (e.motivo == MOTIVO_REANUDAR) {
+            // Dormir hasta que el temporizador lo reanude
+            pthread_mutex_lock(&brazo->mutex);
+            while (brazo->estado == BRAZO_SUSPENDIDO && !sistema->terminar) {
+                pthread_cond_wait(&brazo->cond_reanudar, &brazo->mutex);
             }
+            pthread_mutex_unlock(&brazo->mutex);
+        } else if (e.retardo_ms > 0) {
+            usleep((useconds_t)e.retardo_ms * 1000);
         }
-        
-        usleep(10000);
     }
     
     return NULL;
@@ -5,6 +5,19 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "celda.h"
+#include "banda.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "temporizador.h"
+#include "traza.h"
+#include "reservas.h"
+#include "vector_tipos.h"
+#include "topologia.h"
+#include "inyeccion.h"
+#include "pool_brazos.h"
+#include "metricas.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,7 +32,9 @@ void inicializar_celda(CeldaEmpaquetado *celda, int id, int posicion,
                        int piezas_por_tipo[MAX_TIPOS_PIEZA]) {
     celda->id = id;
     celda->posicion_banda = posicion;
+    celda->banda = banda_de_posicion(posicion);
     celda->estado = CELDA_ACTIVA;
+    celda->estado_desde_us = tiempo_monotonico_us();
     celda->cajas_completadas_ok = 0;
     celda->cajas_completadas_fail = 0;
     celda->trabajando_en_set = false;
@@ -32,15 +47,18 @@ void inicializar_celda(CeldaEmpaquetado *celda, int id, int posicion,
     // Inicializar caja
     pthread_mutex_init(&celda->caja.mutex, NULL);
     sem_init(&celda->caja.sem_acceso, 0, 1);  // solo 1 coloca a la vez
-    celda->caja.completa = false;
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        celda->caja.piezas_por_tipo[t] = 0;
-        celda->caja.piezas_necesarias[t] = piezas_por_tipo[t];
-    }
+    celda->caja.celda_id = id;
+    caja_vaciar(&celda->caja);
+    celda->caja.receta = -1;
+    memcpy(celda->caja.piezas_necesarias, piezas_por_tipo, sizeof(celda->caja.piezas_necesarias));
+    caja_recalcular_faltantes(&celda->caja);
+    vivo_fijar(&vivos.necesarias_caja[id], tipos_total(piezas_por_tipo, sistema->config.num_tipos));
     
     // Inicializar buffer de piezas
     celda->buffer_count = 0;
     pthread_mutex_init(&celda->buffer_mutex, NULL);
+    vivo_fijar(&vivos.buffer_celda[id], 0);
+    vivo_fijar(&vivos.estado_celda[id], CELDA_ACTIVA);
     
     // Inicializar control de progreso
     celda->ultimo_progreso = time(NULL);
@@ -51,12 +69,36 @@ void inicializar_celda(CeldaEmpaquetado *celda, int id, int posicion,
         celda->brazos[b].id = b;
         celda->brazos[b].celda_id = id;
         celda->brazos[b].estado = BRAZO_IDLE;
+        vivo_fijar(&vivos.estado_brazo[id][b], BRAZO_IDLE);
         celda->brazos[b].piezas_movidas = 0;
         celda->brazos[b].pieza_actual.tipo = 0;
+        celda->brazos[b].tiempo_suspension = 0;
+        celda->brazos[b].temporizador_id = -1;
+        celda->brazos[b].ultimo_cambio_us = tiempo_monotonico_us();
+        celda->brazos[b].tiempo_ocupado_us = 0;
+        celda->brazos[b].tiempo_suspendido_us = 0;
+        celda->brazos[b].etapa = ETAPA_BUSCAR;
+        celda->brazos[b].listo_us = 0;
         pthread_mutex_init(&celda->brazos[b].mutex, NULL);
+        pthread_cond_init(&celda->brazos[b].cond_reanudar, NULL);
     }
 }
 
+void cambiar_estado_celda(CeldaEmpaquetado *celda, EstadoCelda nuevo) {
+    // NOTA: El llamador debe tener el mutex de la celda
+    if (celda->estado == nuevo) return;
+    uint64_t ahora = tiempo_monotonico_us();
+    marcar_intervalo(PISTA_CELDA(celda->id), nombre_estado_celda(celda->estado),
+                     celda->estado_desde_us, ahora);
+    inicio_escritura();
+    celda->estado = nuevo;
+    fin_escritura();
+    celda->estado_desde_us = ahora;
+    vivo_fijar(&vivos.estado_celda[celda->id], nuevo);
+    avisar_progreso();
+    despertar_brazos_celda(celda->id, MOTIVO_CELDA);
+}
+
 void destruir_celda(CeldaEmpaquetado *celda) {
     pthread_mutex_destroy(&celda->mutex);
     pthread_mutex_destroy(&celda->caja.mutex);
@@ -66,22 +108,85 @@ void destruir_celda(CeldaEmpaquetado *celda) {
     
     for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
         pthread_mutex_destroy(&celda->brazos[b].mutex);
+        pthread_cond_destroy(&celda->brazos[b].cond_reanudar);
     }
 }
 
-bool verificar_caja_completa(CajaEmpaquetado *caja) {
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        if (caja->piezas_por_tipo[t] != caja->piezas_necesarias[t]) {
-            return false;
+bool caja_tomar_faltante(CajaEmpaquetado *caja, int tipo) {
+    int t = tipo - 1;
+    _Atomic uint64_t *palabra = &caja->faltan[t / TIPOS_POR_PALABRA];
+    int desplazamiento = t % TIPOS_POR_PALABRA * BITS_POR_TIPO;
+    uint64_t actual = atomic_load_explicit(palabra, memory_order_relaxed);
+    do {
+        if (((actual >> desplazamiento) & MASCARA_TIPO) == 0) return false;
+    } while (!atomic_compare_exchange_weak_explicit(palabra, &actual, actual - (1ull << desplazamiento),
+                                                    memory_order_acq_rel, memory_order_relaxed));
+    return true;
+}
+
+void caja_recalcular_faltantes(CajaEmpaquetado *caja) {
+    for (int w = 0; w < PALABRAS_FALTAN; w++) {
+        uint64_t palabra = 0;
+        for (int i = 0; i < TIPOS_POR_PALABRA; i++) {
+            int t = w * TIPOS_POR_PALABRA + i;
+            int faltan = caja->piezas_necesarias[t] - caja->piezas_por_tipo[t];
+            if (faltan > 0) palabra |= (uint64_t)faltan << (i * BITS_POR_TIPO);
+        }
+        atomic_store_explicit(&caja->faltan[w], palabra, memory_order_release);
+    }
+}
+
+void caja_agregar_pieza(CajaEmpaquetado *caja, Pieza pieza) {
+    if (caja->num_contenido < MAX_PIEZAS_CAJA) {
+        caja->contenido[caja->num_contenido++] = pieza;
+    }
+    caja->piezas_por_tipo[pieza.tipo - 1]++;
+    vuelo_sumar(UBIC_CAJA, pieza.tipo, 1);
+    vivo_fijar(&vivos.piezas_caja[caja->celda_id], caja->num_contenido);
+}
+
+bool caja_sacar_pieza(CajaEmpaquetado *caja, int tipo, Pieza *pieza) {
+    for (int i = caja->num_contenido - 1; i >= 0; i--) {
+        if (caja->contenido[i].tipo == tipo) {
+            *pieza = caja->contenido[i];
+            caja->contenido[i] = caja->contenido[--caja->num_contenido];
+            caja->piezas_por_tipo[tipo - 1]--;
+            if (caja->piezas_por_tipo[tipo - 1] < caja->piezas_necesarias[tipo - 1]) {
+                int t = tipo - 1;
+                atomic_fetch_add_explicit(&caja->faltan[t / TIPOS_POR_PALABRA],
+                                          1ull << (t % TIPOS_POR_PALABRA * BITS_POR_TIPO),
+                                          memory_order_release);
+            }
+            vuelo_sumar(UBIC_CAJA, tipo, -1);
+            vivo_fijar(&vivos.piezas_caja[caja->celda_id], caja->num_contenido);
+            return true;
         }
     }
+    return false;
+}
+
+void caja_vaciar(CajaEmpaquetado *caja) {
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
+        vuelo_sumar(UBIC_CAJA, t + 1, -caja->piezas_por_tipo[t]);
+        caja->piezas_por_tipo[t] = 0;
+    }
+    caja->num_contenido = 0;
+    caja->completa = false;
+    caja_recalcular_faltantes(caja);
+    vivo_fijar(&vivos.piezas_caja[caja->celda_id], 0);
+}
+
+bool verificar_caja_completa(CajaEmpaquetado *caja) {
+    int palabras = (sistema->config.num_tipos + TIPOS_POR_PALABRA - 1) / TIPOS_POR_PALABRA;
+    for (int w = 0; w < palabras; w++) {
+        if (atomic_load_explicit(&caja->faltan[w], memory_order_acquire) != 0) return false;
+    }
     return true;
 }
 
 bool necesita_pieza_tipo(CajaEmpaquetado *caja, int tipo) {
-    if (tipo < 1 || tipo > MAX_TIPOS_PIEZA) return false;
-    if (caja->completa) return false;
-    return caja->piezas_por_tipo[tipo - 1] < caja->piezas_necesarias[tipo - 1];
+    if (tipo < 1 || tipo > sistema->config.num_tipos) return false;
+    return caja_faltan(caja, tipo) > 0;
 }
 
 // Verifica si la celda está estancada (tiene piezas pero no puede completar el SET)
@@ -123,6 +228,8 @@ bool otra_celda_necesita_piezas(CeldaEmpaquetado *celda) {
         if (c == mi_id) continue;
         
         CeldaEmpaquetado *otra = &sistema->celdas[c];
+        // Lo devuelto solo llega a las bandas de más adelante en la planta
+        if (!banda_alcanza(celda->banda, otra->banda)) continue;
         
         pthread_mutex_lock(&otra->mutex);
         bool otra_trabajando = otra->trabajando_en_set;
@@ -131,113 +238,236 @@ bool otra_celda_necesita_piezas(CeldaEmpaquetado *celda) {
         
         if (otra_estado != CELDA_ACTIVA || !otra_trabajando) continue;
         
+        // Los faltantes de la otra caja se leen sin su mutex
         pthread_mutex_lock(&celda->caja.mutex);
-        pthread_mutex_lock(&otra->caja.mutex);
         
-        for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-            if (celda->caja.piezas_por_tipo[t] > 0 &&
-                otra->caja.piezas_por_tipo[t] < otra->caja.piezas_necesarias[t]) {
-                pthread_mutex_unlock(&otra->caja.mutex);
+        for (int t = 0; t < sistema->config.num_tipos; t++) {
+            if (celda->caja.piezas_por_tipo[t] > 0 && caja_faltan(&otra->caja, t + 1) > 0) {
                 pthread_mutex_unlock(&celda->caja.mutex);
                 return true;
             }
         }
         
-        pthread_mutex_unlock(&otra->caja.mutex);
         pthread_mutex_unlock(&celda->caja.mutex);
         
         pthread_mutex_lock(&celda->buffer_mutex);
-        pthread_mutex_lock(&otra->caja.mutex);
         
         for (int i = 0; i < celda->buffer_count; i++) {
             int tipo = celda->buffer[i].tipo;
-            if (tipo > 0 && tipo <= MAX_TIPOS_PIEZA &&
-                otra->caja.piezas_por_tipo[tipo - 1] < otra->caja.piezas_necesarias[tipo - 1]) {
-                pthread_mutex_unlock(&otra->caja.mutex);
+            if (tipo > 0 && tipo <= sistema->config.num_tipos && caja_faltan(&otra->caja, tipo) > 0) {
                 pthread_mutex_unlock(&celda->buffer_mutex);
                 return true;
             }
         }
         
-        pthread_mutex_unlock(&otra->caja.mutex);
         pthread_mutex_unlock(&celda->buffer_mutex);
     }
     
     return false;
 }
 
+// Lugar donde una celda puede devolver piezas: el de siempre, con el cupo
+// de los dispensadores, o un punto de inyección más adelante en su banda
+typedef struct {
+    int posicion;
+    int punto;                       // Índice del punto de inyección (-1 = el de siempre)
+} LugarDevolucion;
+
+static int lugares_devolucion(const CeldaEmpaquetado *celda, int posicion_devolucion, int fin_banda,
+                              LugarDevolucion lugares[]) {
+    int n = 0;
+    lugares[n++] = (LugarDevolucion){posicion_devolucion, -1};
+    for (int i = 0; i < sistema->config.num_puntos_inyeccion; i++) {
+        int posicion = sistema->config.puntos_inyeccion[i].posicion;
+        if (posicion > celda->posicion_banda && posicion <= fin_banda && posicion != posicion_devolucion) {
+            lugares[n++] = (LugarDevolucion){posicion, i};
+        }
+    }
+    return n;
+}
+
+// Detiene la banda de los lugares (todos en la de la celda) y toma el mutex
+// del primer lugar con espacio; retorna su índice (-1 si todos están llenos,
+// y entonces la banda sigue). Un lugar tomado se suelta con soltar_lugar
+static int tomar_lugar(const LugarDevolucion lugares[], int num_lugares) {
+    pthread_mutex_t *mutex_banda = &sistema->banda.mutex_global[banda_de_posicion(lugares[0].posicion)];
+    pthread_mutex_lock(mutex_banda);
+    for (int l = 0; l < num_lugares; l++) {
+        PosicionBanda *pos = &sistema->banda.posiciones[lugares[l].posicion];
+        pthread_mutex_lock(&pos->mutex);
+        bool admite = lugares[l].punto < 0
+            ? pos->num_piezas < sistema->config.num_dispensadores
+            : punto_admite(&sistema->config.puntos_inyeccion[lugares[l].punto],
+                           pos->num_piezas, pos->num_piezas);
+        if (admite) return l;
+        pthread_mutex_unlock(&pos->mutex);
+    }
+    pthread_mutex_unlock(mutex_banda);
+    return -1;
+}
+
+static void soltar_lugar(const LugarDevolucion *lugar) {
+    pthread_mutex_unlock(&sistema->banda.posiciones[lugar->posicion].mutex);
+    pthread_mutex_unlock(&sistema->banda.mutex_global[banda_de_posicion(lugar->posicion)]);
+}
+
 // Devuelve las piezas de la caja y buffer a la banda
 void devolver_piezas_a_banda(CeldaEmpaquetado *celda) {
+    // Brazos y dispensador pueden decidir liberar la misma celda: solo uno devuelve
     pthread_mutex_lock(&celda->mutex);
+    if (celda->devolviendo_piezas || !celda->trabajando_en_set) {
+        pthread_mutex_unlock(&celda->mutex);
+        return;
+    }
+    inicio_escritura();
     celda->devolviendo_piezas = true;
+    fin_escritura();
     pthread_mutex_unlock(&celda->mutex);
     
     int posicion_devolucion = celda->posicion_banda + 1;
+    const DescripcionBanda *banda = &sistema->config.bandas[celda->banda];
+    int fin_banda = banda->inicio + banda->longitud - 1;
     
-    bool es_ultima_celda = (celda->id == sistema->config.num_celdas - 1);
+    bool es_ultima_celda = celda_al_final(celda->id);
     if (es_ultima_celda) {
-        posicion_devolucion = sistema->banda.longitud - 1;
+        posicion_devolucion = fin_banda;
+    }
+    
+    if (posicion_devolucion > fin_banda) {
+        posicion_devolucion = fin_banda;
     }
     
-    if (posicion_devolucion >= sistema->banda.longitud) {
-        posicion_devolucion = sistema->banda.longitud - 1;
+    // Las piezas devueltas se reservan para las celdas de más adelante
+    if (sistema->config.reservas) {
+        actualizar_demanda_reservas();
     }
     
-    PosicionBanda *pos = &sistema->banda.posiciones[posicion_devolucion];
+    LugarDevolucion lugares[1 + MAX_PUNTOS_INYECCION];
+    int num_lugares = lugares_devolucion(celda, posicion_devolucion, fin_banda, lugares);
     
     int total_devolver = 0;
     
-    sem_wait(&celda->caja.sem_acceso);
+    // En el pool la caja es un cupo, no un semáforo (esto corre fuera de los pasos)
+    if (pool_brazos_activo()) {
+        pool_esperar_colocador(celda->id);
+    } else {
+        sem_wait(&celda->caja.sem_acceso);
+    }
     pthread_mutex_lock(&celda->caja.mutex);
     
-    int limite_piezas = sistema->config.num_dispensadores;
-    
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        while (celda->caja.piezas_por_tipo[t] > 0) {
-            pthread_mutex_lock(&pos->mutex);
-            if (pos->num_piezas < limite_piezas) {
-                Pieza p;
-                p.tipo = t + 1;
-                p.id_unico = -1;
-                pos->piezas[pos->num_piezas++] = p;
-                celda->caja.piezas_por_tipo[t]--;
-                total_devolver++;
-            }
-            pthread_mutex_unlock(&pos->mutex);
-            
-            if (celda->caja.piezas_por_tipo[t] > 0) {
+    // Si todos los lugares están llenos se espera a que la banda avance, sin
+    // retener caja.mutex (el colocador sigue tomado: nadie más toca la caja).
+    // Si la simulación termina la banda deja de avanzar: lo que quede se
+    // contabiliza al final en lugar de esperar un lugar que no se liberará
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
+        while (celda->caja.piezas_por_tipo[t] > 0 && !sistema->terminar) {
+            int l = tomar_lugar(lugares, num_lugares);
+            if (l < 0) {
+                pthread_mutex_unlock(&celda->caja.mutex);
                 usleep(50000);
+                pthread_mutex_lock(&celda->caja.mutex);
+                continue;
+            }
+            PosicionBanda *pos = &sistema->banda.posiciones[lugares[l].posicion];
+            // La pieza vuelve a la banda con su ID y sello originales
+            Pieza p;
+            inicio_escritura();
+            caja_sacar_pieza(&celda->caja, t + 1, &p);
+            if (sistema->config.reservas) {
+                p.reservada_para = reservar_pieza(p.tipo, lugares[l].posicion);
             }
+            pos->piezas[pos->num_piezas++] = p;
+            vuelo_sumar(UBIC_BANDA, p.tipo, 1);
+            fin_escritura();
+            soltar_lugar(&lugares[l]);
+            
+            trazar_pieza(EVT_DEVUELTA, &p, celda->id, -1);
+            if (lugares[l].punto >= 0) contar_inyeccion(lugares[l].punto, true);
+            total_devolver++;
         }
     }
     
-    celda->caja.completa = false;
+    if (celda->caja.num_contenido == 0) {
+        inicio_escritura();
+        caja_vaciar(&celda->caja);
+        fin_escritura();
+    }
     pthread_mutex_unlock(&celda->caja.mutex);
-    sem_post(&celda->caja.sem_acceso);
+    if (pool_brazos_activo()) {
+        pool_soltar_colocador(celda->id);
+    } else {
+        sem_post(&celda->caja.sem_acceso);
+    }
     
-    pthread_mutex_lock(&celda->buffer_mutex);
-    while (celda->buffer_count > 0) {
+    // Del buffer se saca una pieza por vez y se suelta buffer_mutex antes de
+    // buscarle lugar: los brazos toman posición → buffer y la banda
+    // mutex_global → posición. Si todos los lugares están llenos la pieza
+    // vuelve al buffer y se espera, sin locks, a que la banda avance
+    while (!sistema->terminar) {
+        inicio_escritura();
+        pthread_mutex_lock(&celda->buffer_mutex);
+        if (celda->buffer_count == 0) {
+            pthread_mutex_unlock(&celda->buffer_mutex);
+            fin_escritura();
+            break;
+        }
         Pieza p = celda->buffer[--celda->buffer_count];
-        pthread_mutex_lock(&pos->mutex);
-        if (pos->num_piezas < limite_piezas) {
-            pos->piezas[pos->num_piezas++] = p;
-            total_devolver++;
+        int quedan = celda->buffer_count;
+        pthread_mutex_unlock(&celda->buffer_mutex);
+        
+        int l = tomar_lugar(lugares, num_lugares);
+        if (l < 0) {
+            pthread_mutex_lock(&celda->buffer_mutex);
+            bool vuelve = celda->buffer_count < MAX_BUFFER_CELDA;
+            if (vuelve) celda->buffer[celda->buffer_count++] = p;
+            pthread_mutex_unlock(&celda->buffer_mutex);
+            if (!vuelve) {
+                // Un brazo llenó el buffer mientras tanto: la pieza cae al tacho
+                vuelo_sumar(UBIC_BUFFER, p.tipo, -1);
+                pieza_al_tacho(&p, celda->id, -1);
+            }
+            fin_escritura();
+            if (!vuelve) {
+                registrar_piezas_tacho(1);
+                vivo_sumar(&vivos.piezas_tacho, 1);
+                vivo_fijar(&vivos.buffer_celda[celda->id], quedan);
+            }
+            usleep(50000);
+            continue;
         }
-        pthread_mutex_unlock(&pos->mutex);
+        PosicionBanda *pos = &sistema->banda.posiciones[lugares[l].posicion];
+        if (sistema->config.reservas) {
+            p.reservada_para = reservar_pieza(p.tipo, lugares[l].posicion);
+        }
+        pos->piezas[pos->num_piezas++] = p;
+        vuelo_mover(UBIC_BUFFER, UBIC_BANDA, p.tipo);
+        fin_escritura();
+        soltar_lugar(&lugares[l]);
+        
+        vivo_fijar(&vivos.buffer_celda[celda->id], quedan);
+        trazar_pieza(EVT_DEVUELTA, &p, celda->id, -1);
+        if (lugares[l].punto >= 0) contar_inyeccion(lugares[l].punto, true);
+        total_devolver++;
     }
-    pthread_mutex_unlock(&celda->buffer_mutex);
     
+    inicio_escritura();
     pthread_mutex_lock(&celda->mutex);
     celda->trabajando_en_set = false;
     celda->ciclos_sin_progreso = 0;
     celda->devolviendo_piezas = false;
     pthread_mutex_unlock(&celda->mutex);
+    despertar_brazos_celda(celda->id, MOTIVO_CELDA);
     
     pthread_mutex_lock(&sistema->mutex_sets);
     if (sistema->sets_en_proceso > 0) {
         sistema->sets_en_proceso--;
     }
     pthread_mutex_unlock(&sistema->mutex_sets);
+    fin_escritura();
+    
+    pthread_mutex_lock(&sistema->stats.mutex);
+    sistema->stats.piezas_devueltas += total_devolver;
+    pthread_mutex_unlock(&sistema->stats.mutex);
     
     printf("[CELDA %d] Devolvió %d piezas a la banda (pos %d)\n", 
            celda->id + 1, total_devolver, posicion_devolucion);
@@ -0,0 +1,329 @@
+/**
+ * LEGO Master - Implementación de la Colocación de Celdas
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "colocacion.h"
+#include "vector_tipos.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Candidato de la búsqueda
+typedef struct {
+    int posiciones[MAX_CELDAS];
+    double puntaje;                  // Mayor es mejor
+    double sets;                     // SETs completados (promedio)
+    double tacho;                    // Piezas al tacho (promedio)
+} CandidatoColocacion;
+
+// Trabajo compartido por los hilos evaluadores
+typedef struct {
+    ConfiguracionSistema *config;
+    CandidatoColocacion *candidatos;
+    int num_candidatos;
+    int siguiente;
+    pthread_mutex_t mutex;
+} TrabajoColocacion;
+
+void colocacion_uniforme(ConfiguracionSistema *config) {
+    int intervalo = config->longitud_banda / (config->num_celdas + 1);
+    for (int i = 0; i < config->num_celdas; i++) {
+        config->posiciones_celdas[i] = (i + 1) * intervalo;
+    }
+}
+
+bool parsear_posiciones(const char* texto, int posiciones[MAX_CELDAS], int *num_posiciones) {
+    int n = 0;
+    const char *p = texto;
+    while (*p != '\0') {
+        char *fin;
+        long valor = strtol(p, &fin, 10);
+        if (fin == p || n >= MAX_CELDAS) return false;
+        posiciones[n++] = (int)valor;
+        if (*fin == ',') {
+            fin++;
+        } else if (*fin != '\0') {
+            return false;
+        }
+        p = fin;
+    }
+    *num_posiciones = n;
+    return n > 0;
+}
+
+bool validar_posiciones(ConfiguracionSistema *config, const char **error) {
+    for (int i = 0; i < config->num_celdas; i++) {
+        int pos = config->posiciones_celdas[i];
+        // La última posición queda para las devoluciones (como en la rejilla)
+        if (pos < 0 || pos >= config->longitud_banda - 1) {
+            *error = "las posiciones deben estar dentro de la banda, antes de la última";
+            return false;
+        }
+        if (i > 0 && pos <= config->posiciones_celdas[i - 1]) {
+            *error = "las posiciones deben ser estrictamente crecientes";
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// MODELO DE FLUJO SIMPLIFICADO
+// ============================================================================
+
+// Simula una corrida corta con un modelo discreto por tick de banda:
+// dispensado al inicio, avance de una posición por tick, celdas que
+// retiran lo que necesitan hasta su capacidad por tick y revisión del
+// operador. Retorna los SETs completados y las piezas al tacho.
+static void simular_modelo(ConfiguracionSistema *config, const int posiciones[MAX_CELDAS],
+                           unsigned int semilla, int *sets_ok, int *tacho) {
+    int longitud = config->longitud_banda;
+    int intervalo_ms = 1000 / config->velocidad_banda;
+    
+    // Capacidad de retiro por tick: cada brazo tarda ~40 ms por pieza
+    int capacidad = MAX_BRAZOS_ACTIVOS * intervalo_ms / 40;
+    if (capacidad < 1) capacidad = 1;
+    // Revisión media del operador en ticks
+    int ticks_operador = (config->delta_t1_max / 2) / (intervalo_ms > 0 ? intervalo_ms : 1);
+    // Una celda sin progreso (~200 ciclos de 10 ms) devuelve sus piezas
+    int ticks_estancada = 2000 / (intervalo_ms > 0 ? intervalo_ms : 1) + 1;
+    
+    static __thread int banda[MAX_POSICIONES][MAX_PIEZAS_POS];
+    static __thread int cuenta[MAX_POSICIONES];
+    int caja[MAX_CELDAS][MAX_TIPOS_PIEZA];
+    int espera_operador[MAX_CELDAS];
+    int sin_progreso[MAX_CELDAS];
+    bool trabajando[MAX_CELDAS];
+    int restantes[MAX_TIPOS_PIEZA];
+    int total_restante = 0;
+    
+    memset(cuenta, 0, sizeof(cuenta));
+    memset(caja, 0, sizeof(caja));
+    memset(trabajando, 0, sizeof(trabajando));
+    memset(sin_progreso, 0, sizeof(sin_progreso));
+    for (int c = 0; c < MAX_CELDAS; c++) espera_operador[c] = -1;
+    for (int t = 0; t < config->num_tipos; t++) {
+        restantes[t] = config->piezas_por_tipo[t] * config->num_sets;
+        total_restante += restantes[t];
+    }
+    
+    int completados = 0, en_proceso = 0, al_tacho = 0;
+    int ticks_max = (total_restante / config->num_dispensadores + 1) + 2 * longitud
+                    + config->num_sets * (ticks_operador + 2 * ticks_estancada + 1);
+    
+    for (int tick = 0; tick < ticks_max && completados < config->num_sets; tick++) {
+        // Avance de la banda (la última posición cae al tacho)
+        al_tacho += cuenta[longitud - 1];
+        for (int i = longitud - 1; i > 0; i--) {
+            cuenta[i] = cuenta[i - 1];
+            memcpy(banda[i], banda[i - 1], sizeof(int) * cuenta[i]);
+        }
+        cuenta[0] = 0;
+        
+        // Dispensado: dos rondas por tick, como el hilo dispensador
+        for (int ronda = 0; ronda < 2 && total_restante > 0; ronda++) {
+            for (int d = 0; d < config->num_dispensadores && total_restante > 0; d++) {
+                if (cuenta[0] >= config->num_dispensadores) break;
+                if (rand_r(&semilla) % 5 >= 4) continue;
+                int tipo = rand_r(&semilla) % config->num_tipos;
+                for (int k = 0; k < config->num_tipos && restantes[tipo] <= 0; k++) {
+                    tipo = (tipo + 1) % config->num_tipos;
+                }
+                banda[0][cuenta[0]++] = tipo;
+                restantes[tipo]--;
+                total_restante--;
+            }
+        }
+        
+        // Celdas: retirar piezas necesarias en su posición
+        for (int c = 0; c < config->num_celdas; c++) {
+            if (espera_operador[c] >= 0) {
+                if (--espera_operador[c] < 0) {
+                    completados++;
+                    en_proceso--;
+                    trabajando[c] = false;
+                    memset(caja[c], 0, sizeof(caja[c]));
+                }
+                continue;
+            }
+            
+            int pos = posiciones[c];
+            int tomadas = 0;
+            for (int p = 0; p < cuenta[pos] && tomadas < capacidad; ) {
+                int tipo = banda[pos][p];
+                if (caja[c][tipo] >= config->piezas_por_tipo[tipo]) {
+                    p++;
+                    continue;
+                }
+                if (!trabajando[c]) {
+                    if (completados + en_proceso >= config->num_sets) break;
+                    trabajando[c] = true;
+                    en_proceso++;
+                }
+                caja[c][tipo]++;
+                tomadas++;
+                banda[pos][p] = banda[pos][--cuenta[pos]];
+            }
+            
+            if (tomadas > 0) {
+                sin_progreso[c] = 0;
+            } else if (trabajando[c] && ++sin_progreso[c] > ticks_estancada) {
+                // Devolver la caja a la banda justo después de la celda
+                int destino = (c == config->num_celdas - 1) ? longitud - 1 : pos + 1;
+                if (destino >= longitud) destino = longitud - 1;
+                for (int t = 0; t < config->num_tipos; t++) {
+                    while (caja[c][t] > 0 && cuenta[destino] < MAX_PIEZAS_POS) {
+                        banda[destino][cuenta[destino]++] = t;
+                        caja[c][t]--;
+                    }
+                    al_tacho += caja[c][t];
+                    caja[c][t] = 0;
+                }
+                trabajando[c] = false;
+                en_proceso--;
+                sin_progreso[c] = 0;
+            }
+            
+            bool completa = trabajando[c] &&
+                            tipos_iguales(caja[c], config->piezas_por_tipo, config->num_tipos);
+            if (completa) {
+                espera_operador[c] = ticks_operador;
+            }
+        }
+    }
+    
+    *sets_ok = completados;
+    *tacho = al_tacho;
+}
+
+static void evaluar_candidato(ConfiguracionSistema *config, CandidatoColocacion *cand) {
+    int sets_total = 0, tacho_total = 0;
+    for (int r = 0; r < COLOCACION_REPETICIONES; r++) {
+        int sets, tacho;
+        // Mismas semillas para todos los candidatos (comparación justa)
+        simular_modelo(config, cand->posiciones, 7919u * (unsigned int)(r + 1), &sets, &tacho);
+        sets_total += sets;
+        tacho_total += tacho;
+    }
+    cand->sets = (double)sets_total / COLOCACION_REPETICIONES;
+    cand->tacho = (double)tacho_total / COLOCACION_REPETICIONES;
+    // Prioridad a los SETs; el tacho desempata
+    cand->puntaje = cand->sets * 1000.0 - cand->tacho;
+}
+
+static void* thread_evaluador(void* arg) {
+    TrabajoColocacion *trabajo = (TrabajoColocacion*)arg;
+    while (1) {
+        pthread_mutex_lock(&trabajo->mutex);
+        int i = trabajo->siguiente++;
+        pthread_mutex_unlock(&trabajo->mutex);
+        if (i >= trabajo->num_candidatos) break;
+        evaluar_candidato(trabajo->config, &trabajo->candidatos[i]);
+    }
+    return NULL;
+}
+
+// Enumera combinaciones crecientes de posiciones sobre la rejilla
+static int generar_candidatos(ConfiguracionSistema *config, CandidatoColocacion **salida) {
+    int n = config->num_celdas;
+    int longitud = config->longitud_banda;
+    int paso = (longitud - 2 + COLOCACION_REJILLA - 1) / COLOCACION_REJILLA;
+    if (paso < 1) paso = 1;
+    
+    int rejilla[MAX_POSICIONES];
+    int num_rejilla = 0;
+    for (int p = paso; p < longitud - 1 && num_rejilla < MAX_POSICIONES; p += paso) {
+        rejilla[num_rejilla++] = p;
+    }
+    
+    // Número de combinaciones C(num_rejilla, n) + el candidato uniforme
+    long total = 1;
+    for (int k = 0; k < n; k++) {
+        total = total * (num_rejilla - k) / (k + 1);
+    }
+    if (total < 0) total = 0;
+    total += 1;
+    
+    CandidatoColocacion *cands = calloc((size_t)total, sizeof(CandidatoColocacion));
+    if (!cands) return 0;
+    
+    colocacion_uniforme(config);
+    memcpy(cands[0].posiciones, config->posiciones_celdas, sizeof(cands[0].posiciones));
+    int num = 1;
+    
+    int idx[MAX_CELDAS];
+    for (int k = 0; k < n; k++) idx[k] = k;
+    while (n <= num_rejilla && num < total) {
+        for (int k = 0; k < n; k++) {
+            cands[num].posiciones[k] = rejilla[idx[k]];
+        }
+        num++;
+        
+        // Siguiente combinación en orden lexicográfico
+        int k = n - 1;
+        while (k >= 0 && idx[k] == num_rejilla - n + k) k--;
+        if (k < 0) break;
+        idx[k]++;
+        for (int j = k + 1; j < n; j++) idx[j] = idx[j - 1] + 1;
+    }
+    
+    *salida = cands;
+    return num;
+}
+
+void colocacion_optimizada(ConfiguracionSistema *config) {
+    CandidatoColocacion *candidatos = NULL;
+    int num = generar_candidatos(config, &candidatos);
+    if (num == 0) {
+        fprintf(stderr, "Advertencia: sin memoria para la búsqueda, usando colocación uniforme\n");
+        colocacion_uniforme(config);
+        return;
+    }
+    
+    TrabajoColocacion trabajo = {
+        .config = config,
+        .candidatos = candidatos,
+        .num_candidatos = num,
+        .siguiente = 0,
+    };
+    pthread_mutex_init(&trabajo.mutex, NULL);
+    
+    long num_hilos = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_hilos < 1) num_hilos = 1;
+    if (num_hilos > 64) num_hilos = 64;
+    
+    pthread_t hilos[64];
+    int creados = 0;
+    for (long h = 0; h < num_hilos; h++) {
+        if (pthread_create(&hilos[creados], NULL, thread_evaluador, &trabajo) == 0) {
+            creados++;
+        }
+    }
+    if (creados == 0) {
+        thread_evaluador(&trabajo);
+    }
+    for (int h = 0; h < creados; h++) {
+        pthread_join(hilos[h], NULL);
+    }
+    pthread_mutex_destroy(&trabajo.mutex);
+    
+    int mejor = 0;
+    for (int i = 1; i < num; i++) {
+        if (candidatos[i].puntaje > candidatos[mejor].puntaje) {
+            mejor = i;
+        }
+    }
+    
+    memcpy(config->posiciones_celdas, candidatos[mejor].posiciones, sizeof(config->posiciones_celdas));
+    
+    printf("[COLOCACIÓN] %d candidatos evaluados en %d hilos\n", num, creados > 0 ? creados : 1);
+    printf("[COLOCACIÓN] Uniforme: %.2f SETs, %.2f al tacho | Elegida: %.2f SETs, %.2f al tacho\n",
+           candidatos[0].sets, candidatos[0].tacho, candidatos[mejor].sets, candidatos[mejor].tacho);
+    
+    free(candidatos);
+}
@@ -0,0 +1,264 @@
+/**
+ * LEGO Master - Implementación del Control Adaptativo de Velocidad
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "control_velocidad.h"
+#include "instantanea.h"
+#include "linea_tiempo.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Señales muestreadas por el controlador en cada periodo
+typedef struct {
+    double densidad;                 // Piezas por posición antes de las celdas
+    double ociosos;                  // Fracción de brazos esperando piezas
+    double buffer;                   // Ocupación media de los buffers
+    double tasa_tacho;               // Piezas al tacho por segundo
+} MuestraVelocidad;
+
+static pthread_mutex_t mutex_control = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_control = PTHREAD_COND_INITIALIZER;
+static FILE *log_velocidad = NULL;
+
+// Resumen: velocidad integrada en el tiempo
+static uint64_t inicio_control_us = 0;
+static uint64_t ultimo_cambio_us = 0;
+static double pasos_acumulados = 0.0;        // ∫ v dt (pasos)
+static int cambios_velocidad = 0;
+static int velocidad_alcanzada_min = 0;
+static int velocidad_alcanzada_max = 0;
+
+bool parsear_rango_velocidad(const char *texto, int *minima, int *maxima) {
+    char *fin;
+    long a = strtol(texto, &fin, 10);
+    if (fin == texto || *fin != ',') return false;
+    const char *resto = fin + 1;
+    long b = strtol(resto, &fin, 10);
+    if (fin == resto || *fin != '\0') return false;
+    if (a <= 0 || b < a || b > 1000000) return false;
+    *minima = (int)a;
+    *maxima = (int)b;
+    return true;
+}
+
+int leer_velocidad_banda(void) {
+    return atomic_load_explicit(&sistema->banda.velocidad, memory_order_relaxed);
+}
+
+int velocidad_banda_minima(void) {
+    if (sistema->config.velocidad_adaptativa) {
+        return sistema->config.velocidad_min;
+    }
+    return leer_velocidad_banda();
+}
+
+void despertar_control_velocidad(void) {
+    pthread_mutex_lock(&mutex_control);
+    pthread_cond_broadcast(&cond_control);
+    pthread_mutex_unlock(&mutex_control);
+}
+
+// Espera un periodo o hasta que se pida terminar
+static void esperar_periodo(int periodo_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += periodo_ms / 1000;
+    ts.tv_nsec += (long)(periodo_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mutex_control);
+    if (!sistema->terminar) {
+        pthread_cond_timedwait(&cond_control, &mutex_control, &ts);
+    }
+    pthread_mutex_unlock(&mutex_control);
+}
+
+// Cambia la velocidad y acumula el tramo recorrido a la anterior
+static void fijar_velocidad(int velocidad, uint64_t ahora) {
+    int anterior = atomic_exchange(&sistema->banda.velocidad, velocidad);
+    pasos_acumulados += anterior * ((ahora - ultimo_cambio_us) / 1e6);
+    ultimo_cambio_us = ahora;
+    if (velocidad != anterior) cambios_velocidad++;
+    if (velocidad < velocidad_alcanzada_min) velocidad_alcanzada_min = velocidad;
+    if (velocidad > velocidad_alcanzada_max) velocidad_alcanzada_max = velocidad;
+}
+
+// Densidad, brazos ociosos y buffers de las celdas activas
+static void muestrear_celdas(const InstantaneaSistema *s, MuestraVelocidad *m) {
+    int posiciones = 0, piezas = 0;
+    int brazos = 0, ociosos = 0;
+    int celdas = 0, en_buffer = 0;
+
+    for (int c = 0; c < s->num_celdas; c++) {
+        const InstantaneaCelda *ic = &s->celdas[c];
+        if (ic->estado == CELDA_INACTIVA) continue;
+        celdas++;
+        en_buffer += ic->buffer_count;
+
+        // La ventana no cruza al final de otra banda de la planta
+        int inicio_banda = sistema->config.bandas[sistema->celdas[c].banda].inicio;
+        int desde = ic->posicion_banda - VELOCIDAD_VENTANA_CELDA;
+        if (desde < inicio_banda) desde = inicio_banda;
+        for (int p = desde; p <= ic->posicion_banda && p < s->longitud; p++) {
+            piezas += s->num_piezas_pos[p];
+            posiciones++;
+        }
+
+        // Solo espera piezas una celda que arma un SET
+        if (!ic->trabajando_en_set || ic->estado != CELDA_ACTIVA) continue;
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            if (ic->estado_brazo[b] == BRAZO_SUSPENDIDO) continue;
+            brazos++;
+            ociosos += ic->estado_brazo[b] == BRAZO_IDLE;
+        }
+    }
+
+    m->densidad = posiciones > 0 ? (double)piezas / posiciones : 0.0;
+    // Sin celdas armando SETs la velocidad no deja a nadie sin piezas
+    m->ociosos = brazos > 0 ? (double)ociosos / brazos : 1.0;
+    m->buffer = celdas > 0 ? (double)en_buffer / (celdas * MAX_BUFFER_CELDA) : 0.0;
+}
+
+// Registra una decisión con todas sus entradas
+static void registrar_decision(double t, const MuestraVelocidad *m, int velocidad,
+                               const char *accion) {
+    if (linea_tiempo_activa && strcmp(accion, "MANTENER") != 0) {
+        char detalle[LT_DETALLE];
+        snprintf(detalle, sizeof(detalle), "v=%d dens=%.2f ociosos=%.2f", velocidad,
+                 m->densidad, m->ociosos);
+        marcar_instante(PISTA_BANDA, accion, detalle);
+    }
+    if (log_velocidad) {
+        fprintf(log_velocidad, "%.3f,%d,%.4f,%.4f,%.4f,%.4f,%s\n",
+                t, velocidad, m->densidad, m->ociosos, m->buffer, m->tasa_tacho, accion);
+        fflush(log_velocidad);
+    }
+}
+
+// Hilo del controlador: reglas con histéresis sobre la velocidad de la banda
+void* thread_control_velocidad(void* arg) {
+    (void)arg;
+
+    ConfiguracionSistema *config = &sistema->config;
+
+    if (config->log_velocidad[0] != '\0') {
+        log_velocidad = fopen(config->log_velocidad, "w");
+        if (!log_velocidad) {
+            perror("Error abriendo el log de velocidad");
+        } else {
+            fprintf(log_velocidad, "t,velocidad,densidad,ociosos,buffer,tasa_tacho,accion\n");
+        }
+    }
+
+    uint64_t inicio = tiempo_monotonico_us();
+    uint64_t anterior = inicio;
+    inicio_control_us = inicio;
+    ultimo_cambio_us = inicio;
+    velocidad_alcanzada_min = velocidad_alcanzada_max = leer_velocidad_banda();
+
+    int tacho_anterior = 0;
+    MuestraVelocidad suave = {0};
+    bool primera = true;
+    int ciclos_desde_cambio = VELOCIDAD_CICLOS_ESPERA;
+    InstantaneaSistema inst;
+
+    if (log_velocidad) {
+        fprintf(log_velocidad, "0.000,%d,0,0,0,0,INICIO\n", leer_velocidad_banda());
+    }
+
+    while (!sistema->terminar) {
+        esperar_periodo(VELOCIDAD_PERIODO_MS);
+        if (sistema->terminar) break;
+
+        // MUESTREO sobre una instantánea consistente; sin ella se omite el periodo
+        if (!capturar_instantanea(&inst)) continue;
+        uint64_t ahora = tiempo_monotonico_us();
+        double dt = (ahora - anterior) / 1e6;
+        anterior = ahora;
+        if (dt <= 0.0) continue;
+
+        MuestraVelocidad m;
+        muestrear_celdas(&inst, &m);
+        m.tasa_tacho = (inst.total_piezas_tacho - tacho_anterior) / dt;
+        tacho_anterior = inst.total_piezas_tacho;
+
+        if (primera) {
+            suave = m;
+            primera = false;
+        } else {
+            suave.densidad += VELOCIDAD_ALFA * (m.densidad - suave.densidad);
+            suave.ociosos += VELOCIDAD_ALFA * (m.ociosos - suave.ociosos);
+            suave.buffer += VELOCIDAD_ALFA * (m.buffer - suave.buffer);
+            suave.tasa_tacho += VELOCIDAD_ALFA * (m.tasa_tacho - suave.tasa_tacho);
+        }
+
+        // DECISIÓN: frenar tiene prioridad sobre acelerar
+        int velocidad = leer_velocidad_banda();
+        int paso = (int)(velocidad * VELOCIDAD_PASO);
+        if (paso < 1) paso = 1;
+        int nueva = velocidad;
+        const char *accion = "MANTENER";
+        ciclos_desde_cambio++;
+
+        if (ciclos_desde_cambio > VELOCIDAD_CICLOS_ESPERA) {
+            if (suave.tasa_tacho > VELOCIDAD_TACHO_ALTO || suave.buffer > VELOCIDAD_BUFFER_ALTO) {
+                nueva = velocidad - paso;
+                if (nueva < config->velocidad_min) nueva = config->velocidad_min;
+                if (nueva != velocidad) accion = "FRENAR";
+            } else if (suave.densidad < VELOCIDAD_DENSIDAD_RALA &&
+                       suave.ociosos > VELOCIDAD_OCIOSOS_ALTO) {
+                nueva = velocidad + paso;
+                if (nueva > config->velocidad_max) nueva = config->velocidad_max;
+                if (nueva != velocidad) accion = "ACELERAR";
+            }
+            if (nueva != velocidad) {
+                fijar_velocidad(nueva, ahora);
+                ciclos_desde_cambio = 0;
+            }
+        }
+
+        registrar_decision((ahora - inicio) / 1e6, &suave, nueva, accion);
+    }
+
+    // Cerrar el último tramo
+    fijar_velocidad(leer_velocidad_banda(), tiempo_monotonico_us());
+
+    if (log_velocidad) {
+        fclose(log_velocidad);
+        log_velocidad = NULL;
+    }
+
+    return NULL;
+}
+
+void imprimir_resumen_velocidad(void) {
+    if (!sistema->config.velocidad_adaptativa) return;
+
+    double duracion = (ultimo_cambio_us - inicio_control_us) / 1e6;
+    double media = duracion > 0.0 ? pasos_acumulados / duracion : leer_velocidad_banda();
+
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                 VELOCIDAD ADAPTATIVA DE LA BANDA                  ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Rango permitido: %4d - %-4d pasos/s   Inicial: %4d pasos/s       ║\n",
+           sistema->config.velocidad_min, sistema->config.velocidad_max,
+           sistema->config.velocidad_banda);
+    printf("║ Alcanzada: %4d - %-4d pasos/s   Media: %7.2f pasos/s          ║\n",
+           velocidad_alcanzada_min, velocidad_alcanzada_max, media);
+    printf("║ Cambios de velocidad: %5d   Final: %4d pasos/s                  ║\n",
+           cambios_velocidad, leer_velocidad_banda());
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
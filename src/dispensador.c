@@ -4,9 +4,23 @@
 
 #include "dispensador.h"
 #include "celda.h"
+#include "balanceador.h"
+#include "temporizador.h"
+#include "traza.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "control_velocidad.h"
+#include "reservas.h"
+#include "pedidos.h"
+#include "vector_tipos.h"
+#include "topologia.h"
+#include "inyeccion.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <time.h>
@@ -18,6 +32,11 @@ extern SistemaLego *sistema;
 static int id_pieza_global = 0;
 static pthread_mutex_t mutex_id_pieza = PTHREAD_MUTEX_INITIALIZER;
 
+// Contrapresión (solo las escribe el hilo dispensador)
+static int max_cola = 0;
+static long ciclos_con_retencion = 0;
+static long ciclos_totales = 0;
+
 int generar_id_pieza(void) {
     pthread_mutex_lock(&mutex_id_pieza);
     int id = ++id_pieza_global;
@@ -25,104 +44,369 @@ int generar_id_pieza(void) {
     return id;
 }
 
+// Piezas por tipo que pide cualquier SET pendiente: con pedidos, el mínimo
+// entre las recetas sin confirmar (una cota necesaria para armar alguna)
+static void minimo_por_set(int minimo[MAX_TIPOS_PIEZA]) {
+    if (!sistema->config.pedidos || !pedidos_minimo_por_tipo(minimo)) {
+        memcpy(minimo, sistema->config.piezas_por_tipo, sizeof(sistema->config.piezas_por_tipo));
+    }
+}
+
+// Con los tipos disponibles (banda, manos, buffers y cajas) alcanza para un SET más
+static bool set_posible(const InstantaneaSistema *inst) {
+    int num_tipos = sistema->config.num_tipos;
+    int minimo[MAX_TIPOS_PIEZA];
+    int disponibles[MAX_TIPOS_PIEZA];
+    minimo_por_set(minimo);
+    memcpy(disponibles, inst->en_banda, sizeof(disponibles));
+    tipos_sumar(disponibles, inst->en_brazos, num_tipos);
+    tipos_sumar(disponibles, inst->en_buffers, num_tipos);
+    tipos_sumar(disponibles, inst->en_cajas, num_tipos);
+    return tipos_cubiertos(disponibles, minimo, num_tipos);
+}
+
+// Nada en movimiento ni pendiente: banda y manos vacías, ninguna celda esperando
+// al operador o devolviendo, y ninguna celda puede avanzar con su buffer
+static bool sistema_quieto(const InstantaneaSistema *inst) {
+    int num_tipos = sistema->config.num_tipos;
+    if (tipos_total(inst->en_banda, num_tipos) > 0 || tipos_total(inst->en_brazos, num_tipos) > 0) {
+        return false;
+    }
+    for (int c = 0; c < inst->num_celdas; c++) {
+        const InstantaneaCelda *ic = &inst->celdas[c];
+        if (ic->estado == CELDA_ESPERANDO_OP || ic->devolviendo_piezas) return false;
+        if (!ic->trabajando_en_set || ic->estado != CELDA_ACTIVA) continue;
+        
+        if (tipos_cubiertos(ic->caja, ic->necesarias, num_tipos)) return false;
+        for (int i = 0; i < ic->buffer_count; i++) {
+            int t = ic->buffer[i] - 1;
+            if (t >= 0 && t < num_tipos && ic->caja[t] < ic->necesarias[t]) return false;
+        }
+    }
+    return true;
+}
+
+// Devuelve a la banda las piezas de las celdas estancadas (salvo la última,
+// cuyas piezas irían directo al tacho). Retorna cuántas celdas se liberaron.
+static int liberar_celdas_estancadas(const InstantaneaSistema *inst) {
+    int liberadas = 0;
+    for (int c = 0; c < inst->num_celdas; c++) {
+        const InstantaneaCelda *ic = &inst->celdas[c];
+        if (celda_al_final(c)) continue;
+        if (!ic->trabajando_en_set || ic->estado != CELDA_ACTIVA) continue;
+        
+        int piezas_celda = ic->buffer_count + tipos_total(ic->caja, sistema->config.num_tipos);
+        if (piezas_celda > 0) {
+            devolver_piezas_a_banda(&sistema->celdas[c]);
+            liberadas++;
+        }
+    }
+    return liberadas;
+}
+
+// Decide si un dispensador suelta una pieza y de qué tipo (-1 si no suelta).
+// Las piezas en_espera se guardan para pedidos que ninguna celda tomó: así
+// se dispensa lo que piden las cajas que ya se están armando
+static int elegir_tipo(const int piezas_restantes[], const int en_espera[]) {
+    if (rand() % 5 >= 4) return -1;  // 80% probabilidad de dispensar
+    int num_tipos = sistema->config.num_tipos;
+    int tipo = rand() % num_tipos;
+    
+    // Buscar un tipo que aún tenga piezas
+    int intentos = 0;
+    while (piezas_restantes[tipo] <= en_espera[tipo] && intentos < num_tipos) {
+        tipo = (tipo + 1) % num_tipos;
+        intentos++;
+    }
+    return piezas_restantes[tipo] > en_espera[tipo] ? tipo : -1;
+}
+
+// Pone una pieza en la posición dada (con su mutex tomado) y la cuenta como dispensada
+static void soltar_pieza(PosicionBanda *pos, int posicion, const Pieza *pieza) {
+    Pieza *destino = &pos->piezas[pos->num_piezas++];
+    *destino = *pieza;
+    if (sistema->config.reservas) {
+        destino->reservada_para = reservar_pieza(pieza->tipo, posicion);
+    }
+    trazar_pieza(EVT_DISPENSADA, destino, -1, -1);
+    vuelo_sumar(UBIC_BANDA, pieza->tipo, 1);
+    
+    pthread_mutex_lock(&sistema->stats.mutex);
+    sistema->stats.total_piezas_dispensadas++;
+    pthread_mutex_unlock(&sistema->stats.mutex);
+    vivo_sumar(&vivos.piezas_dispensadas, 1);
+}
+
+// Cada punto de inyección suelta, hasta su cupo, los tipos que más les
+// faltan a las celdas de más adelante. Retorna las piezas soltadas
+static int inyectar_en_puntos(int piezas_restantes[], const int en_espera[], int *total_piezas) {
+    int soltadas = 0;
+    for (int i = 0; i < sistema->config.num_puntos_inyeccion && *total_piezas > 0; i++) {
+        const PuntoInyeccion *punto = &sistema->config.puntos_inyeccion[i];
+        int necesidad[MAX_TIPOS_PIEZA];
+        if (necesidad_aguas_abajo(punto->posicion, necesidad) == 0) continue;
+        
+        PosicionBanda *pos = &sistema->banda.posiciones[punto->posicion];
+        int banda = banda_de_posicion(punto->posicion);
+        int en_punto = 0;
+        // A mitad de banda se escribe con la banda detenida, como en el tick
+        pthread_mutex_lock(&sistema->banda.mutex_global[banda]);
+        inicio_escritura();
+        pthread_mutex_lock(&pos->mutex);
+        int al_llegar = pos->num_piezas;
+        for (int d = 0; d < punto->cupo && *total_piezas > 0; d++) {
+            if (!punto_admite(punto, al_llegar, pos->num_piezas)) break;
+            
+            int tipo = -1;
+            for (int t = 0; t < sistema->config.num_tipos; t++) {
+                if (necesidad[t] == 0 || piezas_restantes[t] <= en_espera[t]) continue;
+                if (tipo < 0 || necesidad[t] > necesidad[tipo]) tipo = t;
+            }
+            if (tipo < 0) break;
+            Pieza pieza = {tipo + 1, generar_id_pieza(), tiempo_monotonico_us(), 0, SIN_RESERVA};
+            soltar_pieza(pos, punto->posicion, &pieza);
+            contar_inyeccion(i, false);
+            necesidad[tipo]--;
+            piezas_restantes[tipo]--;
+            (*total_piezas)--;
+            en_punto++;
+        }
+        pthread_mutex_unlock(&pos->mutex);
+        fin_escritura();
+        pthread_mutex_unlock(&sistema->banda.mutex_global[banda]);
+        contar_banda(banda, CONTADOR_DISPENSADAS, en_punto);
+        soltadas += en_punto;
+    }
+    return soltadas;
+}
+
+// Presión de las celdas: la menor entre las habilitadas, porque basta una
+// celda con lugar para que una pieza nueva pueda empaquetarse. Cada celda
+// aporta 1 si espera al operador, o la mayor entre la ocupación de las
+// posiciones previas, la de su buffer y la fracción de brazos ocupados.
+static double presion_aguas_abajo(void) {
+    double capacidad_previa = (POSICIONES_PREVIAS_CELDA + 1) * sistema->config.num_dispensadores;
+    double presion = 1.0;
+    bool alguna = false;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        int estado = atomic_load_explicit(&vivos.estado_celda[c], memory_order_relaxed);
+        if (estado == CELDA_INACTIVA) continue;
+        alguna = true;
+        
+        double p = 1.0;
+        if (estado != CELDA_ESPERANDO_OP) {
+            double previa = atomic_load_explicit(&vivos.ocupacion_previa[c], memory_order_relaxed) /
+                            capacidad_previa;
+            double buffer = (double)atomic_load_explicit(&vivos.buffer_celda[c], memory_order_relaxed) /
+                            MAX_BUFFER_CELDA;
+            int brazos = 0, ocupados = 0;
+            for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+                int eb = atomic_load_explicit(&vivos.estado_brazo[c][b], memory_order_relaxed);
+                if (eb == BRAZO_SUSPENDIDO) continue;
+                brazos++;
+                ocupados += eb != BRAZO_IDLE;
+            }
+            double manos = brazos > 0 ? (double)ocupados / brazos : 1.0;
+            p = previa > buffer ? previa : buffer;
+            if (manos > p) p = manos;
+        }
+        if (p < presion) presion = p;
+    }
+    // Sin celdas habilitadas retener no ayuda a nadie
+    return alguna ? presion : 0.0;
+}
+
 void* thread_dispensador(void* arg) {
     (void)arg;
     
     int total_piezas = 0;
     int piezas_restantes[MAX_TIPOS_PIEZA];
+    int en_espera[MAX_TIPOS_PIEZA] = {0};
+    int ciclos_en_espera = 0;
     
-    // Calcular total de piezas a dispensar
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
+    // Calcular total de piezas a dispensar (con pedidos, la demanda agregada)
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
         piezas_restantes[t] = sistema->config.piezas_por_tipo[t] * sistema->config.num_sets;
+    }
+    if (sistema->config.pedidos) {
+        pedidos_demanda_total(piezas_restantes);
+    }
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
         total_piezas += piezas_restantes[t];
     }
     
     // Mensajes de inicio eliminados para reducir ruido
     
-    int intervalo_us = 1000000 / sistema->banda.velocidad / 2;
+    // Cola de espera del alimentador (solo con contrapresión)
+    Pieza cola[COLA_ALIMENTADOR_MAX];
+    int cola_inicio = 0;
+    int en_cola = 0;
+    int ciclos_retenido = 0;
+    
+    // Dispensadores de toda la planta (con --topologia, la suma de las bandas)
+    int dispensadores_planta = 0;
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        dispensadores_planta += sistema->config.bandas[b].dispensadores;
+    }
     
-    while (total_piezas > 0 && !sistema->terminar) {
-        usleep(intervalo_us);
+    while ((total_piezas > 0 || en_cola > 0 || sistema->config.modo_continuo) && !sistema->terminar) {
+        // Dos ciclos por paso de la banda, a la velocidad vigente
+        usleep(1000000 / leer_velocidad_banda() / 2);
+        ciclos_totales++;
         
-        PosicionBanda *inicio = &sistema->banda.posiciones[0];
-        pthread_mutex_lock(&inicio->mutex);
+        // En modo continuo se dispensa un SET más cada vez que se agota el anterior
+        if (total_piezas == 0 && sistema->config.modo_continuo) {
+            for (int t = 0; t < sistema->config.num_tipos; t++) {
+                piezas_restantes[t] = sistema->config.piezas_por_tipo[t];
+                total_piezas += piezas_restantes[t];
+            }
+        }
         
-        // Cada dispensador puede soltar una pieza (o no)
-        // Límite por ciclo = número de dispensadores (no más piezas de las que pueden dispensar)
-        int limite_piezas_ciclo = sistema->config.num_dispensadores;
-        for (int d = 0; d < sistema->config.num_dispensadores && total_piezas > 0; d++) {
-            if (inicio->num_piezas >= limite_piezas_ciclo) break;
+        // Piezas que aguardan a los pedidos que ninguna celda tomó aún. Si en
+        // una vuelta de la banda ninguna celda toma un pedido se sueltan igual
+        if (sistema->config.pedidos) {
+            pedidos_demanda_en_cola(en_espera);
+            bool retenido = true;
+            for (int t = 0; t < sistema->config.num_tipos; t++) {
+                if (piezas_restantes[t] > en_espera[t]) retenido = false;
+            }
+            ciclos_en_espera = retenido ? ciclos_en_espera + 1 : 0;
+            if (ciclos_en_espera > 2 * sistema->config.longitud_banda) {
+                memset(en_espera, 0, sizeof(en_espera));
+            }
+        }
+        
+        // Déficits de las celdas para reservar las piezas de este ciclo
+        if (sistema->config.reservas) {
+            actualizar_demanda_reservas();
+        }
+        
+        // Los puntos de inyección van primero: cubren lo que les falta a las
+        // celdas de más adelante y el inicio reparte lo que queda
+        int dispensadas_ciclo = inyectar_en_puntos(piezas_restantes, en_espera, &total_piezas);
+        
+        if (sistema->config.contrapresion) {
+            // Los dispensadores llenan la cola de espera; la banda recibe solo sin presión
+            for (int d = 0; d < dispensadores_planta && total_piezas > 0; d++) {
+                if (en_cola == COLA_ALIMENTADOR_MAX) break;
+                int tipo = elegir_tipo(piezas_restantes, en_espera);
+                if (tipo < 0) continue;
+                Pieza *p = &cola[(cola_inicio + en_cola) % COLA_ALIMENTADOR_MAX];
+                p->tipo = tipo + 1;
+                p->id_unico = generar_id_pieza();
+                p->dispensada_us = tiempo_monotonico_us();
+                p->vueltas = 0;
+                p->reservada_para = SIN_RESERVA;
+                en_cola++;
+                piezas_restantes[tipo]--;
+                total_piezas--;
+            }
+            if (en_cola > max_cola) max_cola = en_cola;
+            vivo_fijar(&vivos.cola_alimentador, en_cola);
             
-            // Decidir aleatoriamente si dispensar y qué tipo
-            if (rand() % 5 < 4) {  // 80% probabilidad de dispensar
-                int tipo = rand() % MAX_TIPOS_PIEZA;
-                
-                // Buscar un tipo que aún tenga piezas
-                int intentos = 0;
-                while (piezas_restantes[tipo] <= 0 && intentos < MAX_TIPOS_PIEZA) {
-                    tipo = (tipo + 1) % MAX_TIPOS_PIEZA;
-                    intentos++;
+            // Tras CONTRAPRESION_MAX_CICLOS retenido se inyecta igual: una celda
+            // puede estar esperando justo un tipo que quedó en la cola
+            if (presion_aguas_abajo() >= sistema->config.umbral_contrapresion &&
+                ciclos_retenido < CONTRAPRESION_MAX_CICLOS) {
+                if (ciclos_retenido++ == 0 && linea_tiempo_activa) {
+                    char detalle[LT_DETALLE];
+                    snprintf(detalle, sizeof(detalle), "%d en cola", en_cola);
+                    marcar_instante(PISTA_DISPENSADOR, "retiene", detalle);
+                }
+                ciclos_con_retencion++;
+            } else {
+                ciclos_retenido = 0;
+                inicio_escritura();
+                for (int b = 0; b < sistema->config.num_bandas && en_cola > 0; b++) {
+                    const DescripcionBanda *banda = &sistema->config.bandas[b];
+                    if (banda->dispensadores == 0) continue;
+                    PosicionBanda *inicio = &sistema->banda.posiciones[banda->inicio];
+                    int soltadas = 0;
+                    pthread_mutex_lock(&inicio->mutex);
+                    while (en_cola > 0 && inicio->num_piezas < banda->dispensadores) {
+                        soltar_pieza(inicio, banda->inicio, &cola[cola_inicio]);
+                        cola_inicio = (cola_inicio + 1) % COLA_ALIMENTADOR_MAX;
+                        en_cola--;
+                        soltadas++;
+                    }
+                    pthread_mutex_unlock(&inicio->mutex);
+                    contar_banda(b, CONTADOR_DISPENSADAS, soltadas);
+                    dispensadas_ciclo += soltadas;
                 }
+                fin_escritura();
+                vivo_fijar(&vivos.cola_alimentador, en_cola);
+            }
+        } else {
+            inicio_escritura();
+            
+            // Cada dispensador de cada banda puede soltar una pieza (o no) en
+            // el inicio de su banda; todos comparten las piezas restantes
+            for (int b = 0; b < sistema->config.num_bandas && total_piezas > 0; b++) {
+                const DescripcionBanda *banda = &sistema->config.bandas[b];
+                if (banda->dispensadores == 0) continue;
+                PosicionBanda *inicio = &sistema->banda.posiciones[banda->inicio];
+                int soltadas = 0;
+                pthread_mutex_lock(&inicio->mutex);
                 
-                if (piezas_restantes[tipo] > 0) {
-                    int idx = inicio->num_piezas;
-                    inicio->piezas[idx].tipo = tipo + 1;
-                    inicio->piezas[idx].id_unico = generar_id_pieza();
-                    inicio->num_piezas++;
+                for (int d = 0; d < banda->dispensadores && total_piezas > 0; d++) {
+                    // Límite por ciclo = dispensadores de la banda
+                    if (inicio->num_piezas >= banda->dispensadores) break;
+                    
+                    int tipo = elegir_tipo(piezas_restantes, en_espera);
+                    if (tipo < 0) continue;
+                    Pieza pieza = {tipo + 1, generar_id_pieza(), tiempo_monotonico_us(), 0, SIN_RESERVA};
+                    soltar_pieza(inicio, banda->inicio, &pieza);
                     piezas_restantes[tipo]--;
                     total_piezas--;
-                    
-                    pthread_mutex_lock(&sistema->stats.mutex);
-                    sistema->stats.total_piezas_dispensadas++;
-                    pthread_mutex_unlock(&sistema->stats.mutex);
-                    
-                    sistema->piezas_dispensadas_ciclo++;
+                    soltadas++;
                 }
+                
+                pthread_mutex_unlock(&inicio->mutex);
+                contar_banda(b, CONTADOR_DISPENSADAS, soltadas);
+                dispensadas_ciclo += soltadas;
             }
+            fin_escritura();
         }
+
         
-        pthread_mutex_unlock(&inicio->mutex);
+        // Con las piezas del ciclo ya en la banda, repartir de nuevo las reservas
+        optimizar_asignacion();
         
-        // Verificar si hay que suspender algún brazo (cada Y piezas)
-        if (sistema->piezas_dispensadas_ciclo >= sistema->config.Y) {
-            sistema->piezas_dispensadas_ciclo = 0;
-            
-            for (int c = 0; c < sistema->config.num_celdas; c++) {
-                int brazo_max = encontrar_brazo_max_piezas(&sistema->celdas[c]);
-                if (brazo_max >= 0) {
-                    BrazoRobotico *brazo = &sistema->celdas[c].brazos[brazo_max];
-                    pthread_mutex_lock(&brazo->mutex);
-                    if (brazo->estado == BRAZO_IDLE) {
-                        brazo->estado = BRAZO_SUSPENDIDO;
-                        brazo->tiempo_suspension = time(NULL);
-                        // Mensaje de balanceo eliminado para reducir ruido en consola
-                    }
-                    pthread_mutex_unlock(&brazo->mutex);
-                }
-            }
+        if (linea_tiempo_activa && dispensadas_ciclo > 0) {
+            char detalle[LT_DETALLE];
+            snprintf(detalle, sizeof(detalle), "%d piezas", dispensadas_ciclo);
+            marcar_instante(PISTA_DISPENSADOR, "dispensa", detalle);
         }
+        
+        // El balanceo de brazos corre en su propio hilo (cada Y piezas)
+        notificar_piezas_dispensadas(dispensadas_ciclo);
     }
     
-    printf("[SISTEMA] Todas las piezas dispensadas (%d). Esperando que la banda se vacíe...\n",
-           sistema->stats.total_piezas_dispensadas);
-    
-    // Esperar a que la banda se vacíe
-    int tiempo_espera = (sistema->banda.longitud / sistema->banda.velocidad) + 3;
-    sleep(tiempo_espera);
+    // En modo continuo no hay vaciado: se corta al cumplirse la duración o con una señal
+    if (sistema->config.modo_continuo) {
+        sistema->terminar = true;
+        return NULL;
+    }
     
-    // Esperar a que todos los SETs sean confirmados por el operador (con timeout)
+    printf("[SISTEMA] Todas las piezas dispensadas (%d). Esperando que se completen los SETs...\n",
+           sistema->stats.total_piezas_dispensadas);
     
-    // Calcular timeout basado en el número de SETs y tiempo máximo del operador
-    int timeout_confirmacion = sistema->config.num_sets * 
-                               (sistema->config.delta_t1_max / 1000 + 2) + 15;
-    int tiempo_esperado = 0;
+    // Límite de seguridad: el mismo plazo que daban la espera fija y el sondeo anteriores
+    int timeout_s = sistema->banda.longitud / velocidad_banda_minima() + 3 +
+                    (sistema->config.num_sets * (sistema->config.delta_t1_max / 1000 + 2) + 15) / 2;
+    uint64_t limite_us = tiempo_monotonico_us() + (uint64_t)timeout_s * 1000000ULL;
     int ultimo_completado = 0;
-    int ciclos_sin_progreso = 0;
+    int liberaciones = 0;
+    bool vencido = false;
+    
+    InstantaneaSistema inst;
     
-    while (!sistema->terminar && tiempo_esperado < timeout_confirmacion) {
+    while (!sistema->terminar) {
+        // Leer la generación antes de evaluar: un aviso posterior despierta la espera
+        unsigned long generacion = leer_generacion_progreso();
+        
         pthread_mutex_lock(&sistema->mutex_sets);
         int completados = sistema->sets_completados_total;
-        int en_proceso = sistema->sets_en_proceso;
         pthread_mutex_unlock(&sistema->mutex_sets);
         
         // Si ya se completaron todos los SETs esperados, terminar
@@ -132,165 +416,71 @@ void* thread_dispensador(void* arg) {
             break;
         }
         
-        // Verificar si hay progreso
         if (completados > ultimo_completado) {
             ultimo_completado = completados;
-            ciclos_sin_progreso = 0;
-        } else {
-            ciclos_sin_progreso++;
-        }
-        
-        // Contar piezas totales disponibles (banda + buffers + cajas)
-        int piezas_disponibles = 0;
-        
-        // Piezas en la banda
-        for (int i = 0; i < sistema->banda.longitud; i++) {
-            PosicionBanda *pos = &sistema->banda.posiciones[i];
-            pthread_mutex_lock(&pos->mutex);
-            piezas_disponibles += pos->num_piezas;
-            pthread_mutex_unlock(&pos->mutex);
+            liberaciones = 0;
         }
         
-        // Piezas en buffers y cajas de las celdas
-        for (int c = 0; c < sistema->config.num_celdas; c++) {
-            CeldaEmpaquetado *celda = &sistema->celdas[c];
-            pthread_mutex_lock(&celda->buffer_mutex);
-            piezas_disponibles += celda->buffer_count;
-            pthread_mutex_unlock(&celda->buffer_mutex);
-            
-            pthread_mutex_lock(&celda->caja.mutex);
-            for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                piezas_disponibles += celda->caja.piezas_por_tipo[t];
+        // Los contadores en vuelo descartan el caso común sin recorrer nada;
+        // banda y manos vacías o piezas insuficientes se confirman con una instantánea
+        bool en_movimiento = false;
+        bool posible = true;
+        int minimo[MAX_TIPOS_PIEZA];
+        minimo_por_set(minimo);
+        for (int t = 0; t < sistema->config.num_tipos; t++) {
+            int total = 0;
+            for (int u = 0; u < NUM_UBICACIONES; u++) {
+                int n = vuelo_leer(u, t + 1);
+                total += n;
+                if ((u == UBIC_BANDA || u == UBIC_MANO) && n > 0) en_movimiento = true;
             }
-            pthread_mutex_unlock(&celda->caja.mutex);
+            if (total < minimo[t]) posible = false;
         }
         
-        // Calcular piezas necesarias para completar los SETs restantes
-        int sets_restantes = sistema->config.num_sets - completados;
-        int piezas_por_set = 0;
-        for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-            piezas_por_set += sistema->config.piezas_por_tipo[t];
-        }
-        int piezas_necesarias = sets_restantes * piezas_por_set;
-        
-        // Si no hay suficientes piezas para completar más SETs, terminar
-        // NOTA: Aunque haya SETs en proceso, si no hay piezas suficientes,
-        // las celdas deberían liberar sus piezas para que otras las usen
-        if (piezas_disponibles < piezas_necesarias && en_proceso == 0) {
-            printf("\n[SISTEMA] ✗ Piezas insuficientes. Completados: %d/%d\n",
-                   completados, sistema->config.num_sets);
-            break;
-        }
-        
-        // Forzar liberación de piezas si hay celdas estancadas con SETs en proceso
-        // pero sin progreso durante mucho tiempo
-        if (en_proceso > 0 && ciclos_sin_progreso > 10) {  // 5 segundos sin progreso con SETs en proceso
-            // Buscar celdas estancadas y forzar liberación de piezas (silencioso)
-            for (int c = 0; c < sistema->config.num_celdas; c++) {
-                CeldaEmpaquetado *celda = &sistema->celdas[c];
-                
-                pthread_mutex_lock(&celda->mutex);
-                bool trabajando = celda->trabajando_en_set;
-                EstadoCelda estado = celda->estado;
-                bool devolviendo = celda->devolviendo_piezas;
-                pthread_mutex_unlock(&celda->mutex);
-                
-                // Si la celda está trabajando pero no esperando al operador ni devolviendo
-                if (trabajando && estado == CELDA_ACTIVA && !devolviendo) {
-                    // Verificar si esta celda puede completar su SET por tipo
-                    int piezas_faltan_por_tipo[MAX_TIPOS_PIEZA] = {0};
-                    int piezas_celda = 0;
-                    int faltan_celda = 0;
-                    
-                    pthread_mutex_lock(&celda->caja.mutex);
-                    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                        piezas_celda += celda->caja.piezas_por_tipo[t];
-                        int faltan = celda->caja.piezas_necesarias[t] - celda->caja.piezas_por_tipo[t];
-                        if (faltan > 0) {
-                            piezas_faltan_por_tipo[t] = faltan;
-                            faltan_celda += faltan;
-                        }
-                    }
-                    pthread_mutex_unlock(&celda->caja.mutex);
-                    
-                    // Si no le falta nada, no hacer nada
-                    if (faltan_celda == 0) continue;
-                    
-                    // Contar piezas disponibles por tipo (banda + buffer)
-                    int piezas_disponibles_por_tipo[MAX_TIPOS_PIEZA] = {0};
-                    
-                    // Piezas en buffer
-                    pthread_mutex_lock(&celda->buffer_mutex);
-                    for (int i = 0; i < celda->buffer_count; i++) {
-                        int tipo = celda->buffer[i].tipo;
-                        if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
-                            piezas_disponibles_por_tipo[tipo - 1]++;
-                        }
-                    }
-                    pthread_mutex_unlock(&celda->buffer_mutex);
-                    
-                    // Piezas en banda antes de esta celda
-                    for (int i = 0; i <= celda->posicion_banda; i++) {
-                        PosicionBanda *pos = &sistema->banda.posiciones[i];
-                        pthread_mutex_lock(&pos->mutex);
-                        for (int p = 0; p < pos->num_piezas; p++) {
-                            int tipo = pos->piezas[p].tipo;
-                            if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
-                                piezas_disponibles_por_tipo[tipo - 1]++;
-                            }
-                        }
-                        pthread_mutex_unlock(&pos->mutex);
-                    }
-                    
-                    // Verificar si puede completar
-                    bool puede_completar = true;
-                    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                        if (piezas_faltan_por_tipo[t] > piezas_disponibles_por_tipo[t]) {
-                            puede_completar = false;
-                            break;
-                        }
-                    }
-                    
-                    // Solo forzar liberación si NO puede completar y NO es la última celda
-                    bool es_ultima_celda = (c == sistema->config.num_celdas - 1);
-                    if (!puede_completar && !es_ultima_celda && piezas_celda > 0) {
-                        devolver_piezas_a_banda(celda);
-                    }
-                }
+        // Sin instantánea consistente se confirma en la próxima vuelta
+        if ((!posible || !en_movimiento) && capturar_instantanea(&inst)) {
+            
+            // Si no hay piezas suficientes de algún tipo, ningún SET más puede completarse
+            if (!set_posible(&inst)) {
+                printf("\n[SISTEMA] ✗ Piezas insuficientes. Completados: %d/%d\n",
+                       completados, sistema->config.num_sets);
+                break;
             }
             
-            // Resetear contador para dar tiempo a que el sistema se recupere
-            ciclos_sin_progreso = 0;
-        }
-        
-        // Verificar si hay alguna celda esperando al operador
-        bool hay_celda_esperando_operador = false;
-        for (int c = 0; c < sistema->config.num_celdas; c++) {
-            pthread_mutex_lock(&sistema->celdas[c].mutex);
-            if (sistema->celdas[c].estado == CELDA_ESPERANDO_OP) {
-                hay_celda_esperando_operador = true;
+            if (sistema_quieto(&inst)) {
+                // Solo liberar piezas puede cambiar el estado; sin celdas que liberar no hay progreso
+                if (liberaciones >= MAX_LIBERACIONES_SIN_PROGRESO ||
+                    liberar_celdas_estancadas(&inst) == 0) {
+                    printf("\n[SISTEMA] Sin progreso. Completados: %d/%d\n",
+                           completados, sistema->config.num_sets);
+                    break;
+                }
+                liberaciones++;
+                continue;
             }
-            pthread_mutex_unlock(&sistema->celdas[c].mutex);
-            if (hay_celda_esperando_operador) break;
         }
         
-        // Si no hay progreso después de varios ciclos Y no hay celda esperando al operador
-        if (ciclos_sin_progreso > 20 && !hay_celda_esperando_operador) {  // 10 segundos sin progreso
-            printf("\n[SISTEMA] Sin progreso. Completados: %d/%d\n",
-                   completados, sistema->config.num_sets);
+        uint64_t ahora = tiempo_monotonico_us();
+        if (ahora >= limite_us) {
+            vencido = true;
             break;
         }
-        
-        // Si hay una celda esperando al operador, resetear timeout parcialmente
-        if (hay_celda_esperando_operador && ciclos_sin_progreso > 10) {
-            ciclos_sin_progreso = 10;  // No dejar que crezca demasiado mientras espera operador
+        uint64_t restante_ms = (limite_us - ahora) / 1000 + 1;
+        int espera_ms = restante_ms < ESPERA_MAX_PROGRESO_MS ? (int)restante_ms : ESPERA_MAX_PROGRESO_MS;
+        // Las piezas aún en la banda se siguen repartiendo a cada paso
+        if (sistema->config.asignacion_optima) {
+            int paso_ms = 1000 / leer_velocidad_banda();
+            if (paso_ms < espera_ms) espera_ms = paso_ms;
         }
+        esperar_progreso(generacion, espera_ms);
         
-        usleep(500000);  // Revisar cada 0.5 segundos
-        tiempo_esperado++;
+        if (sistema->config.asignacion_optima) {
+            actualizar_demanda_reservas();
+            optimizar_asignacion();
+        }
     }
     
-    if (tiempo_esperado >= timeout_confirmacion) {
+    if (vencido) {
         printf("\n[SISTEMA] Timeout. Terminando simulación.\n");
     }
     
@@ -298,3 +488,18 @@ void* thread_dispensador(void* arg) {
     
     return NULL;
 }
+
+void imprimir_resumen_contrapresion(void) {
+    if (!sistema->config.contrapresion) return;
+    
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                 CONTRAPRESIÓN DEL DISPENSADOR                     ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Umbral de presión: %4.2f   Cola máxima: %3d de %3d piezas         ║\n",
+           sistema->config.umbral_contrapresion, max_cola, COLA_ALIMENTADOR_MAX);
+    printf("║ Ciclos retenidos: %6ld de %6ld (%5.1f%%)                        ║\n",
+           ciclos_con_retencion, ciclos_totales,
+           ciclos_totales > 0 ? 100.0 * ciclos_con_retencion / ciclos_totales : 0.0);
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
@@ -2,13 +2,23 @@
  * LEGO Master - Implementación del Gestor Dinámico de Celdas
  */
 
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200809L
 
 #include "gestor_celdas.h"
+#include "celda.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "temporizador.h"
+#include "pedidos.h"
+#include "vector_tipos.h"
+#include "pool_brazos.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 // Variable externa del sistema
 extern SistemaLego *sistema;
@@ -35,13 +45,9 @@ bool celda_puede_quitarse(CeldaEmpaquetado *celda) {
     pthread_mutex_unlock(&celda->mutex);
     
     pthread_mutex_lock(&celda->caja.mutex);
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        if (celda->caja.piezas_por_tipo[t] > 0) {
-            pthread_mutex_unlock(&celda->caja.mutex);
-            return false;
-        }
-    }
+    int en_caja = tipos_total(celda->caja.piezas_por_tipo, sistema->config.num_tipos);
     pthread_mutex_unlock(&celda->caja.mutex);
+    if (en_caja > 0) return false;
     
     pthread_mutex_lock(&celda->buffer_mutex);
     if (celda->buffer_count > 0) {
@@ -83,9 +89,18 @@ bool quitar_celda_dinamica(int celda_id) {
         return false;
     }
     
+    inicio_escritura();
     pthread_mutex_lock(&celda->mutex);
-    celda->estado = CELDA_INACTIVA;
+    cambiar_estado_celda(celda, CELDA_INACTIVA);
+    bool trabajando = celda->trabajando_en_set;
     pthread_mutex_unlock(&celda->mutex);
+    // Su pedido vuelve a la cola para otra celda (salvo que un brazo ya lo empezara)
+    if (sistema->config.pedidos && !trabajando) {
+        pthread_mutex_lock(&celda->caja.mutex);
+        devolver_pedido(celda);
+        pthread_mutex_unlock(&celda->caja.mutex);
+    }
+    fin_escritura();
     
     sistema->celdas_habilitadas[celda_id] = false;
     sistema->num_celdas_activas--;
@@ -116,23 +131,23 @@ bool agregar_celda_dinamica(int celda_id) {
     
     CeldaEmpaquetado *celda = &sistema->celdas[celda_id];
     
+    inicio_escritura();
     pthread_mutex_lock(&celda->mutex);
-    celda->estado = CELDA_ACTIVA;
+    cambiar_estado_celda(celda, CELDA_ACTIVA);
     celda->trabajando_en_set = false;
     celda->devolviendo_piezas = false;
     celda->ciclos_sin_progreso = 0;
     pthread_mutex_unlock(&celda->mutex);
     
+    // quitar_celda_dinamica exige caja y buffer vacíos: no hay piezas que descartar
     pthread_mutex_lock(&celda->caja.mutex);
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        celda->caja.piezas_por_tipo[t] = 0;
+    caja_vaciar(&celda->caja);
+    if (sistema->config.pedidos) {
+        asignar_pedido(celda);
     }
-    celda->caja.completa = false;
     pthread_mutex_unlock(&celda->caja.mutex);
     
-    pthread_mutex_lock(&celda->buffer_mutex);
-    celda->buffer_count = 0;
-    pthread_mutex_unlock(&celda->buffer_mutex);
+    fin_escritura();
     
     sistema->celdas_habilitadas[celda_id] = true;
     sistema->num_celdas_activas++;
@@ -142,106 +157,240 @@ bool agregar_celda_dinamica(int celda_id) {
            celda_id + 1, celda->posicion_banda, sistema->num_celdas_activas);
     
     pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
+    despertar_brazos_celda(celda_id, MOTIVO_CELDA);
     return true;
 }
 
-// Hilo gestor que monitorea y gestiona celdas dinámicamente
+// Señales muestreadas por el controlador en cada intervalo
+typedef struct {
+    double throughput;               // SETs completados por segundo
+    double tasa_tacho;               // Piezas al tacho por segundo
+    int sets_pendientes;             // SETs que aún no inició ninguna celda
+    int celdas_activas;
+    int celdas_ociosas;              // Activas sin SET en curso
+} MuestraGestor;
+
+static pthread_mutex_t mutex_gestor = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_gestor = PTHREAD_COND_INITIALIZER;
+static FILE *log_gestor = NULL;
+
+void despertar_gestor_celdas(void) {
+    pthread_mutex_lock(&mutex_gestor);
+    pthread_cond_broadcast(&cond_gestor);
+    pthread_mutex_unlock(&mutex_gestor);
+}
+
+// Espera un intervalo o hasta que se pida terminar
+static void esperar_intervalo(int intervalo_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += intervalo_ms / 1000;
+    ts.tv_nsec += (long)(intervalo_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    
+    pthread_mutex_lock(&mutex_gestor);
+    if (!sistema->terminar) {
+        pthread_cond_timedwait(&cond_gestor, &mutex_gestor, &ts);
+    }
+    pthread_mutex_unlock(&mutex_gestor);
+}
+
+// Celda habilitada con más ciclos ociosa (-1 si ninguna puede quitarse)
+static int elegir_celda_a_quitar(void) {
+    int elegida = -1;
+    int max_ciclos = 0;
+    
+    pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+    if (sistema->num_celdas_activas > 1) {
+        for (int c = sistema->config.num_celdas - 1; c >= 0; c--) {
+            if (sistema->celdas_habilitadas[c] && sistema->ciclos_inactiva[c] > max_ciclos) {
+                elegida = c;
+                max_ciclos = sistema->ciclos_inactiva[c];
+            }
+        }
+    }
+    pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
+    return elegida;
+}
+
+// Primera celda deshabilitada (-1 si todas están activas)
+static int elegir_celda_a_agregar(void) {
+    int elegida = -1;
+    pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+    for (int c = 0; c < sistema->config.num_celdas && elegida < 0; c++) {
+        if (!sistema->celdas_habilitadas[c]) {
+            elegida = c;
+        }
+    }
+    pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
+    return elegida;
+}
+
+// Registra una decisión con todas sus entradas
+static void registrar_decision(double t, const MuestraGestor *m, double error,
+                               double salida, const char *accion, int celda) {
+    if (linea_tiempo_activa) {
+        char detalle[LT_DETALLE];
+        if (celda >= 0) {
+            snprintf(detalle, sizeof(detalle), "celda %d e=%.2f u=%.2f", celda + 1, error, salida);
+        } else {
+            snprintf(detalle, sizeof(detalle), "e=%.2f u=%.2f", error, salida);
+        }
+        marcar_instante(PISTA_GESTOR, accion, detalle);
+    }
+    if (log_gestor) {
+        fprintf(log_gestor, "%.3f,%.4f,%.4f,%d,%d,%d,%.4f,%.4f,%s,%d\n",
+                t, m->throughput, m->tasa_tacho, m->sets_pendientes,
+                m->celdas_activas, m->celdas_ociosas, error, salida, accion, celda + 1);
+        fflush(log_gestor);
+    }
+    if (celda >= 0) {
+        printf("[GESTOR] %s celda %d (thr=%.3f sets/s, tacho=%.2f/s, pendientes=%d, "
+               "ociosas=%d/%d, e=%.2f, u=%.2f)\n",
+               accion, celda + 1, m->throughput, m->tasa_tacho, m->sets_pendientes,
+               m->celdas_ociosas, m->celdas_activas, error, salida);
+    }
+}
+
+// Hilo gestor: controlador PI con histéresis sobre el número de celdas activas
 void* thread_gestor_celdas(void* arg) {
     (void)arg;
     
-    int ultimo_tacho = 0;
-    int ciclos_sin_cambios = 0;
+    ConfiguracionSistema *config = &sistema->config;
+    
+    if (config->log_gestor[0] != '\0') {
+        log_gestor = fopen(config->log_gestor, "w");
+        if (!log_gestor) {
+            perror("Error abriendo el log del gestor");
+        } else {
+            fprintf(log_gestor, "t,throughput,tasa_tacho,sets_pendientes,activas,ociosas,"
+                                "error,salida,accion,celda\n");
+        }
+    }
     
-    sleep(3);
+    uint64_t inicio = tiempo_monotonico_us();
+    uint64_t anterior = inicio;
+    int tacho_anterior = 0;
+    int sets_anterior = 0;
+    double throughput_suave = 0.0;
+    double tacho_suave = 0.0;
+    double integral = 0.0;
+    int ciclos_desde_cambio = GESTOR_CICLOS_ESPERA;
     
     while (!sistema->terminar) {
-        sleep(2);
-        
+        esperar_intervalo(config->intervalo_gestor_ms);
         if (sistema->terminar) break;
         
-        pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+        uint64_t ahora = tiempo_monotonico_us();
+        double dt = (ahora - anterior) / 1e6;
+        anterior = ahora;
+        if (dt <= 0.0) continue;
+        
+        // MUESTREO: throughput, tacho y backlog
+        MuestraGestor m = {0};
         
         pthread_mutex_lock(&sistema->stats.mutex);
-        int piezas_tacho_actual = sistema->stats.total_piezas_tacho;
+        int tacho_actual = sistema->stats.total_piezas_tacho;
         pthread_mutex_unlock(&sistema->stats.mutex);
         
         pthread_mutex_lock(&sistema->mutex_sets);
         int sets_completados = sistema->sets_completados_total;
-        int sets_en_proceso = sistema->sets_en_proceso;
-        int sets_pendientes = sistema->config.num_sets - sets_completados - sets_en_proceso;
+        m.sets_pendientes = config->num_sets - sets_completados - sistema->sets_en_proceso;
         pthread_mutex_unlock(&sistema->mutex_sets);
+        if (config->modo_continuo) {
+            // Demanda ilimitada: a lo sumo un SET nuevo por celda
+            m.sets_pendientes = config->num_celdas;
+        }
         
-        int piezas_tacho_recientes = piezas_tacho_actual - ultimo_tacho;
-        ultimo_tacho = piezas_tacho_actual;
+        double throughput = (sets_completados - sets_anterior) / dt;
+        double tasa_tacho = (tacho_actual - tacho_anterior) / dt;
+        sets_anterior = sets_completados;
+        tacho_anterior = tacho_actual;
         
-        int celdas_trabajando = 0;
-        int celdas_ociosas = 0;
+        throughput_suave += GESTOR_ALFA * (throughput - throughput_suave);
+        tacho_suave += GESTOR_ALFA * (tasa_tacho - tacho_suave);
+        m.throughput = throughput_suave;
+        m.tasa_tacho = tacho_suave;
         
-        for (int c = 0; c < sistema->config.num_celdas; c++) {
+        pthread_mutex_lock(&sistema->mutex_celdas_dinamicas);
+        for (int c = 0; c < config->num_celdas; c++) {
             if (!sistema->celdas_habilitadas[c]) continue;
             
             CeldaEmpaquetado *celda = &sistema->celdas[c];
             pthread_mutex_lock(&celda->mutex);
-            bool trabajando = celda->trabajando_en_set;
-            EstadoCelda estado = celda->estado;
+            bool ocupada = celda->trabajando_en_set || celda->estado == CELDA_ESPERANDO_OP;
             pthread_mutex_unlock(&celda->mutex);
             
-            if (trabajando || estado == CELDA_ESPERANDO_OP) {
-                celdas_trabajando++;
+            m.celdas_activas++;
+            if (ocupada) {
                 sistema->ciclos_inactiva[c] = 0;
             } else {
                 sistema->ciclos_inactiva[c]++;
-                if (sistema->ciclos_inactiva[c] > 5) {
-                    celdas_ociosas++;
-                }
+                m.celdas_ociosas++;
             }
         }
-        
         pthread_mutex_unlock(&sistema->mutex_celdas_dinamicas);
         
-        // DECISIÓN: QUITAR CELDA
-        if (celdas_ociosas > 0 && sets_pendientes <= sistema->num_celdas_activas / 2) {
-            int celda_mas_ociosa = -1;
-            int max_ciclos_ociosa = 0;
-            
-            for (int c = sistema->config.num_celdas - 1; c >= 0; c--) {
-                if (sistema->celdas_habilitadas[c] && 
-                    sistema->ciclos_inactiva[c] > max_ciclos_ociosa &&
-                    sistema->num_celdas_activas > 1) {
-                    celda_mas_ociosa = c;
-                    max_ciclos_ociosa = sistema->ciclos_inactiva[c];
-                }
-            }
-            
-            if (celda_mas_ociosa >= 0 && max_ciclos_ociosa > 8) {
-                quitar_celda_dinamica(celda_mas_ociosa);
-                ciclos_sin_cambios = 0;
-            }
+        // CONTROL: error positivo pide capacidad, negativo la libera
+        double error = 0.0;
+        if (config->objetivo_sets_min > 0) {
+            double objetivo = config->objetivo_sets_min / 60.0;
+            error += (objetivo - m.throughput) / objetivo;
         }
-        
-        // DECISIÓN: AGREGAR CELDA
-        if (piezas_tacho_recientes > 2 && sets_pendientes > 0) {
-            for (int c = 0; c < sistema->config.num_celdas; c++) {
-                if (!sistema->celdas_habilitadas[c]) {
-                    agregar_celda_dinamica(c);
-                    ciclos_sin_cambios = 0;
-                    break;
-                }
+        if (m.sets_pendientes > 0) {
+            // Piezas al tacho con trabajo pendiente = capacidad insuficiente
+            error += GESTOR_K_TACHO * m.tasa_tacho;
+            if (m.celdas_ociosas == 0 && m.celdas_activas > 0) {
+                // Todas ocupadas y aún hay SETs sin empezar
+                error += GESTOR_K_BACKLOG * m.sets_pendientes / m.celdas_activas;
             }
         }
+        int sobrantes = m.celdas_ociosas - (m.sets_pendientes > 0 ? m.sets_pendientes : 0);
+        if (sobrantes > 0 && m.celdas_activas > 0) {
+            // Más celdas ociosas que SETs por empezar
+            error -= (double)sobrantes / m.celdas_activas;
+        }
+        
+        integral += error * dt;
+        if (integral > GESTOR_INTEGRAL_MAX) integral = GESTOR_INTEGRAL_MAX;
+        if (integral < -GESTOR_INTEGRAL_MAX) integral = -GESTOR_INTEGRAL_MAX;
+        double salida = GESTOR_KP * error + GESTOR_KI * integral;
         
-        if (celdas_trabajando == sistema->num_celdas_activas && 
-            sets_pendientes > sistema->num_celdas_activas) {
-            for (int c = 0; c < sistema->config.num_celdas; c++) {
-                if (!sistema->celdas_habilitadas[c]) {
-                    agregar_celda_dinamica(c);
-                    ciclos_sin_cambios = 0;
-                    break;
+        // DECISIÓN con banda muerta y tiempo mínimo entre cambios
+        const char *accion = "MANTENER";
+        int celda = -1;
+        ciclos_desde_cambio++;
+        
+        if (ciclos_desde_cambio > GESTOR_CICLOS_ESPERA) {
+            if (salida > GESTOR_UMBRAL && m.sets_pendientes > 0) {
+                int c = elegir_celda_a_agregar();
+                if (c >= 0 && agregar_celda_dinamica(c)) {
+                    accion = "AGREGAR";
+                    celda = c;
+                }
+            } else if (salida < -GESTOR_UMBRAL) {
+                int c = elegir_celda_a_quitar();
+                if (c >= 0 && quitar_celda_dinamica(c)) {
+                    accion = "QUITAR";
+                    celda = c;
                 }
             }
+            if (celda >= 0) {
+                // El efecto del cambio se mide desde cero
+                integral = 0.0;
+                ciclos_desde_cambio = 0;
+            }
         }
         
-        ciclos_sin_cambios++;
+        registrar_decision((ahora - inicio) / 1e6, &m, error, salida, accion, celda);
+    }
+    
+    if (log_gestor) {
+        fclose(log_gestor);
+        log_gestor = NULL;
     }
     
     return NULL;
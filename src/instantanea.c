@@ -0,0 +1,182 @@
+/**
+ * LEGO Master - Implementación de las Instantáneas Consistentes
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "instantanea.h"
+#include "vector_tipos.h"
+#include "temporizador.h"
+#include "common.h"
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+atomic_ulong escrituras_iniciadas = 0;
+atomic_ulong escrituras_terminadas = 0;
+atomic_bool compuerta_escrituras = false;
+__thread int profundidad_escritura = 0;
+
+static pthread_mutex_t mutex_compuerta = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_compuerta = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t mutex_lectores = PTHREAD_MUTEX_INITIALIZER;
+
+void esperar_compuerta(void) {
+    struct timespec limite;
+    clock_gettime(CLOCK_REALTIME, &limite);
+    limite.tv_nsec += INST_ESPERA_COMPUERTA_US * 1000L;
+    if (limite.tv_nsec >= 1000000000L) {
+        limite.tv_sec++;
+        limite.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mutex_compuerta);
+    while (atomic_load(&compuerta_escrituras)) {
+        if (pthread_cond_timedwait(&cond_compuerta, &mutex_compuerta, &limite) != 0) break;
+    }
+    pthread_mutex_unlock(&mutex_compuerta);
+}
+
+static inline int acotar(int v, int max) {
+    return v < 0 ? 0 : (v > max ? max : v);
+}
+
+// Lectura de un campo que otro hilo puede estar escribiendo
+#define LEER(campo) __atomic_load_n(&(campo), __ATOMIC_RELAXED)
+
+// Copia sin locks; con escritores activos puede leer valores a medio escribir,
+// por eso se acotan los índices y el llamador valida la época
+static void copiar_estado(InstantaneaSistema *s) {
+    s->longitud = acotar(LEER(sistema->banda.longitud), MAX_POSICIONES);
+    for (int i = 0; i < s->longitud; i++) {
+        PosicionBanda *pos = &sistema->banda.posiciones[i];
+        int n = acotar(LEER(pos->num_piezas), MAX_PIEZAS_POS);
+        s->num_piezas_pos[i] = (int8_t)n;
+        for (int p = 0; p < n; p++) {
+            s->tipos_pos[i][p] = (int8_t)LEER(pos->piezas[p].tipo);
+        }
+    }
+
+    s->num_celdas = acotar(sistema->config.num_celdas, MAX_CELDAS);
+    for (int c = 0; c < s->num_celdas; c++) {
+        CeldaEmpaquetado *celda = &sistema->celdas[c];
+        InstantaneaCelda *ic = &s->celdas[c];
+        ic->estado = LEER(celda->estado);
+        ic->trabajando_en_set = LEER(celda->trabajando_en_set);
+        ic->devolviendo_piezas = LEER(celda->devolviendo_piezas);
+        ic->posicion_banda = LEER(celda->posicion_banda);
+        for (int t = 0; t < sistema->config.num_tipos; t++) {
+            ic->caja[t] = LEER(celda->caja.piezas_por_tipo[t]);
+            ic->necesarias[t] = LEER(celda->caja.piezas_necesarias[t]);
+        }
+        ic->buffer_count = acotar(LEER(celda->buffer_count), MAX_BUFFER_CELDA);
+        for (int i = 0; i < ic->buffer_count; i++) {
+            ic->buffer[i] = (int8_t)LEER(celda->buffer[i].tipo);
+        }
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            ic->estado_brazo[b] = LEER(celda->brazos[b].estado);
+            ic->en_mano[b] = (int8_t)LEER(celda->brazos[b].pieza_actual.tipo);
+        }
+    }
+
+    s->sets_completados = LEER(sistema->sets_completados_total);
+    s->sets_en_proceso = LEER(sistema->sets_en_proceso);
+    s->total_piezas_dispensadas = LEER(sistema->stats.total_piezas_dispensadas);
+    s->total_piezas_tacho = LEER(sistema->stats.total_piezas_tacho);
+    s->cajas_ok = LEER(sistema->stats.cajas_ok);
+    s->cajas_fail = LEER(sistema->stats.cajas_fail);
+    s->piezas_confirmadas = LEER(sistema->stats.piezas_confirmadas);
+    s->piezas_rechazadas = LEER(sistema->stats.piezas_rechazadas);
+    s->piezas_pedidas_ok = LEER(sistema->stats.piezas_pedidas_ok);
+}
+
+static void calcular_derivados(InstantaneaSistema *s) {
+    memset(s->en_banda, 0, sizeof(s->en_banda));
+    memset(s->en_buffers, 0, sizeof(s->en_buffers));
+    memset(s->en_cajas, 0, sizeof(s->en_cajas));
+    memset(s->en_brazos, 0, sizeof(s->en_brazos));
+
+    for (int i = 0; i < s->longitud; i++) {
+        for (int p = 0; p < s->num_piezas_pos[i]; p++) {
+            int t = s->tipos_pos[i][p];
+            if (t >= 1 && t <= sistema->config.num_tipos) s->en_banda[t - 1]++;
+        }
+    }
+    for (int c = 0; c < s->num_celdas; c++) {
+        InstantaneaCelda *ic = &s->celdas[c];
+        tipos_sumar(s->en_cajas, ic->caja, sistema->config.num_tipos);
+        for (int i = 0; i < ic->buffer_count; i++) {
+            int t = ic->buffer[i];
+            if (t >= 1 && t <= sistema->config.num_tipos) s->en_buffers[t - 1]++;
+        }
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            int t = ic->en_mano[b];
+            if (t >= 1 && t <= sistema->config.num_tipos) s->en_brazos[t - 1]++;
+        }
+    }
+}
+
+bool capturar_instantanea(InstantaneaSistema *s) {
+    s->con_compuerta = false;
+
+    for (int intento = 1; intento <= INST_MAX_INTENTOS; intento++) {
+        unsigned long inicio = atomic_load(&escrituras_iniciadas);
+        unsigned long terminadas = atomic_load(&escrituras_terminadas);
+        if (inicio == terminadas) {
+            copiar_estado(s);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load(&escrituras_iniciadas) == inicio) {
+                s->epoca = terminadas;
+                s->intentos = intento;
+                calcular_derivados(s);
+                return true;
+            }
+        }
+        sched_yield();
+    }
+
+    // Demasiada competencia: detener las escrituras nuevas y esperar las en curso.
+    // Un escritor que agotó su espera puede entrar igual, así que se sigue
+    // validando, hasta INST_LIMITE_COMPUERTA_US
+    pthread_mutex_lock(&mutex_lectores);
+    atomic_store(&compuerta_escrituras, true);
+    uint64_t limite_us = tiempo_monotonico_us() + INST_LIMITE_COMPUERTA_US;
+    bool valida = false;
+    do {
+        unsigned long inicio = atomic_load(&escrituras_iniciadas);
+        if (inicio == atomic_load(&escrituras_terminadas)) {
+            copiar_estado(s);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load(&escrituras_iniciadas) == inicio) {
+                s->epoca = inicio;
+                valida = true;
+                break;
+            }
+        }
+        sched_yield();
+    } while (tiempo_monotonico_us() < limite_us);
+
+    pthread_mutex_lock(&mutex_compuerta);
+    atomic_store(&compuerta_escrituras, false);
+    pthread_cond_broadcast(&cond_compuerta);
+    pthread_mutex_unlock(&mutex_compuerta);
+    pthread_mutex_unlock(&mutex_lectores);
+
+    s->con_compuerta = true;
+    if (!valida) {
+        s->intentos = 0;
+        return false;
+    }
+    s->intentos = INST_MAX_INTENTOS + 1;
+    calcular_derivados(s);
+    return true;
+}
+
+int instantanea_piezas_disponibles(const InstantaneaSistema *s) {
+    int num_tipos = sistema->config.num_tipos;
+    return tipos_total(s->en_banda, num_tipos) + tipos_total(s->en_buffers, num_tipos) +
+           tipos_total(s->en_cajas, num_tipos) + tipos_total(s->en_brazos, num_tipos);
+}
@@ -0,0 +1,163 @@
+/**
+ * LEGO Master - Implementación de la Verificación de Invariantes
+ */
+
+#include "invariantes.h"
+#include "instantanea.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+static pthread_t hilo_verificador;
+static bool verificador_activo = false;
+static bool detener_verificador = false;
+static pthread_mutex_t mutex_verificador = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_verificador = PTHREAD_COND_INITIALIZER;
+
+static int periodo_verificacion_ms = PERIODO_INVARIANTES_MS;
+static uint64_t inicio_verificacion_us = 0;
+static long verificaciones = 0;
+static long omitidas = 0;                // Rondas sin instantánea consistente
+static int violaciones = 0;
+
+static void violacion(const char *formato, ...) {
+    violaciones++;
+    if (violaciones > MAX_VIOLACIONES_IMPRESAS) return;
+
+    double t = (tiempo_monotonico_us() - inicio_verificacion_us) / 1e6;
+    fprintf(stderr, "[INVARIANTE] t=%.3fs ", t);
+    va_list args;
+    va_start(args, formato);
+    vfprintf(stderr, formato, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    if (violaciones == MAX_VIOLACIONES_IMPRESAS) {
+        fprintf(stderr, "[INVARIANTE] Demasiadas violaciones; solo se contarán las siguientes\n");
+    }
+}
+
+static void verificar_instantanea(const InstantaneaSistema *s) {
+    ConfiguracionSistema *config = &sistema->config;
+    verificaciones++;
+
+    // Conservación de piezas
+    int en_juego = instantanea_piezas_disponibles(s);
+    int contabilizadas = en_juego + s->total_piezas_tacho + s->piezas_confirmadas + s->piezas_rechazadas;
+    if (contabilizadas != s->total_piezas_dispensadas) {
+        violacion("época %lu: dispensadas %d != en juego %d + tacho %d + confirmadas %d + rechazadas %d",
+                  s->epoca, s->total_piezas_dispensadas, en_juego, s->total_piezas_tacho,
+                  s->piezas_confirmadas, s->piezas_rechazadas);
+    }
+
+    // Conteo de SETs
+    if (s->sets_completados != s->cajas_ok) {
+        violacion("época %lu: SETs completados %d != cajas OK %d",
+                  s->epoca, s->sets_completados, s->cajas_ok);
+    }
+    // Cada caja OK aporta exactamente las piezas de su receta
+    if (s->piezas_confirmadas != s->piezas_pedidas_ok) {
+        violacion("época %lu: piezas confirmadas %d != %d pedidas por %d cajas OK",
+                  s->epoca, s->piezas_confirmadas, s->piezas_pedidas_ok, s->cajas_ok);
+    }
+
+    int trabajando = 0;
+    for (int c = 0; c < s->num_celdas; c++) {
+        const InstantaneaCelda *ic = &s->celdas[c];
+        if (ic->trabajando_en_set) trabajando++;
+        for (int t = 0; t < config->num_tipos; t++) {
+            if (ic->caja[t] < 0 || ic->caja[t] > ic->necesarias[t]) {
+                violacion("época %lu: celda %d tiene %d piezas %s (necesita %d)",
+                          s->epoca, c + 1, ic->caja[t], nombre_tipo_pieza(t + 1), ic->necesarias[t]);
+            }
+        }
+    }
+    if (s->sets_en_proceso != trabajando) {
+        violacion("época %lu: SETs en proceso %d != celdas trabajando %d",
+                  s->epoca, s->sets_en_proceso, trabajando);
+    }
+    if (!config->modo_continuo && s->sets_completados + s->sets_en_proceso > config->num_sets) {
+        violacion("época %lu: completados %d + en proceso %d superan los %d SETs",
+                  s->epoca, s->sets_completados, s->sets_en_proceso, config->num_sets);
+    }
+}
+
+static void* thread_verificador(void* arg) {
+    (void)arg;
+    InstantaneaSistema inst;
+
+    pthread_mutex_lock(&mutex_verificador);
+    while (!detener_verificador) {
+        struct timespec limite;
+        clock_gettime(CLOCK_REALTIME, &limite);
+        limite.tv_sec += periodo_verificacion_ms / 1000;
+        limite.tv_nsec += (long)(periodo_verificacion_ms % 1000) * 1000000L;
+        if (limite.tv_nsec >= 1000000000L) {
+            limite.tv_sec++;
+            limite.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&cond_verificador, &mutex_verificador, &limite);
+        if (detener_verificador) break;
+        pthread_mutex_unlock(&mutex_verificador);
+
+        // Una instantánea inválida (escritores sin pausa) se omite: se verifica en la próxima ronda
+        if (capturar_instantanea(&inst)) {
+            verificar_instantanea(&inst);
+        } else {
+            omitidas++;
+        }
+
+        pthread_mutex_lock(&mutex_verificador);
+    }
+    pthread_mutex_unlock(&mutex_verificador);
+    return NULL;
+}
+
+void iniciar_verificador_invariantes(int periodo_ms) {
+    periodo_verificacion_ms = periodo_ms;
+    inicio_verificacion_us = tiempo_monotonico_us();
+    detener_verificador = false;
+    if (pthread_create(&hilo_verificador, NULL, thread_verificador, NULL) != 0) {
+        perror("Error creando hilo verificador de invariantes");
+        return;
+    }
+    verificador_activo = true;
+}
+
+void terminar_verificador_invariantes(void) {
+    if (!verificador_activo) return;
+    pthread_mutex_lock(&mutex_verificador);
+    detener_verificador = true;
+    pthread_cond_signal(&cond_verificador);
+    pthread_mutex_unlock(&mutex_verificador);
+    pthread_join(hilo_verificador, NULL);
+    verificador_activo = false;
+}
+
+int verificar_invariantes_final(void) {
+    // Sin hilos activos la instantánea es exacta; se verifica una vez más
+    InstantaneaSistema inst;
+    while (!capturar_instantanea(&inst)) {}
+    verificar_instantanea(&inst);
+
+    // Tras contabilizar lo restante no debe quedar ninguna pieza en juego
+    int fuera = inst.total_piezas_tacho + inst.piezas_confirmadas + inst.piezas_rechazadas;
+    int en_juego = inst.total_piezas_dispensadas - fuera;
+    if (en_juego != 0) {
+        violacion("cierre: %d piezas dispensadas sin destino final (dispensadas %d, tacho %d, "
+                  "confirmadas %d, rechazadas %d)", en_juego, inst.total_piezas_dispensadas,
+                  inst.total_piezas_tacho, inst.piezas_confirmadas, inst.piezas_rechazadas);
+    }
+
+    printf("[INVARIANTES] Semilla %u: %ld verificaciones, %d violaciones%s\n",
+           sistema->config.semilla, verificaciones, violaciones,
+           violaciones == 0 ? " ✓" : " ✗");
+    if (omitidas > 0) {
+        printf("[INVARIANTES] %ld rondas omitidas sin instantánea consistente\n", omitidas);
+    }
+    return violaciones;
+}
@@ -0,0 +1,199 @@
+/**
+ * LEGO Master - Implementación de los Puntos de Inyección
+ */
+
+#include "inyeccion.h"
+#include "celda.h"
+#include "topologia.h"
+#include "common.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+static atomic_int dispensadas[MAX_PUNTOS_INYECCION];
+static atomic_int devueltas[MAX_PUNTOS_INYECCION];
+
+static const char *nombre_politica(PoliticaMezcla politica) {
+    return politica == MEZCLA_CEDE ? "cede" : "completa";
+}
+
+// Un punto "POS[:CUPO[:POLITICA]]"; avanza *texto hasta la coma siguiente
+static bool parsear_punto(const char **texto, PuntoInyeccion *punto, int cupo_defecto) {
+    char *fin;
+    long posicion = strtol(*texto, &fin, 10);
+    if (fin == *texto) return false;
+    punto->posicion = (int)posicion;
+    punto->cupo = cupo_defecto;
+    punto->politica = MEZCLA_COMPLETA;
+
+    if (*fin == ':') {
+        const char *p = fin + 1;
+        long cupo = strtol(p, &fin, 10);
+        if (fin == p || cupo < 1 || cupo > MAX_PIEZAS_POS) return false;
+        punto->cupo = (int)cupo;
+    }
+    if (*fin == ':') {
+        const char *p = fin + 1;
+        size_t largo = strcspn(p, ",");
+        if (largo == 4 && strncmp(p, "cede", 4) == 0) {
+            punto->politica = MEZCLA_CEDE;
+        } else if (largo != 8 || strncmp(p, "completa", 8) != 0) {
+            return false;
+        }
+        fin = (char *)p + largo;
+    }
+    if (*fin == ',') {
+        fin++;
+    } else if (*fin != '\0') {
+        return false;
+    }
+    *texto = fin;
+    return true;
+}
+
+bool parsear_inyeccion(const char *texto, ConfiguracionSistema *config) {
+    PuntoInyeccion puntos[MAX_PUNTOS_INYECCION];
+    int n = 0;
+    while (*texto != '\0') {
+        if (n == MAX_PUNTOS_INYECCION) return false;
+        if (!parsear_punto(&texto, &puntos[n], config->num_dispensadores)) return false;
+        n++;
+    }
+    if (n == 0) return false;
+
+    // Ordenados por posición: las devoluciones prueban primero el más cercano
+    for (int i = 1; i < n; i++) {
+        PuntoInyeccion p = puntos[i];
+        int j = i - 1;
+        while (j >= 0 && puntos[j].posicion > p.posicion) {
+            puntos[j + 1] = puntos[j];
+            j--;
+        }
+        puntos[j + 1] = p;
+    }
+    memcpy(config->puntos_inyeccion, puntos, sizeof(puntos));
+    config->num_puntos_inyeccion = n;
+    return true;
+}
+
+const char *validar_inyeccion(const ConfiguracionSistema *config) {
+    for (int i = 0; i < config->num_puntos_inyeccion; i++) {
+        int posicion = config->puntos_inyeccion[i].posicion;
+        if (posicion <= 0 || posicion >= config->longitud_banda) {
+            return "las posiciones deben estar dentro de la banda, después del inicio";
+        }
+        for (int b = 0; b < config->num_bandas; b++) {
+            if (posicion == config->bandas[b].inicio) {
+                return "el inicio de una banda ya tiene sus dispensadores";
+            }
+        }
+        if (i > 0 && posicion == config->puntos_inyeccion[i - 1].posicion) {
+            return "las posiciones no pueden repetirse";
+        }
+    }
+    return NULL;
+}
+
+bool punto_admite(const PuntoInyeccion *punto, int piezas_al_llegar, int piezas_ahora) {
+    if (punto->politica == MEZCLA_CEDE && piezas_al_llegar > 0) return false;
+    return piezas_ahora < punto->cupo;
+}
+
+int necesidad_aguas_abajo(int posicion, int necesidad[MAX_TIPOS_PIEZA]) {
+    const ConfiguracionSistema *config = &sistema->config;
+    int num_tipos = config->num_tipos;
+    int banda_punto = banda_de_posicion(posicion);
+    memset(necesidad, 0, MAX_TIPOS_PIEZA * sizeof(int));
+
+    // Última celda con faltantes en cada banda alcanzable desde el punto:
+    // lo que circula hasta ahí puede terminar en alguna de ellas
+    int hasta[MAX_BANDAS];
+    for (int b = 0; b < MAX_BANDAS; b++) hasta[b] = -1;
+    for (int c = 0; c < config->num_celdas; c++) {
+        CeldaEmpaquetado *celda = &sistema->celdas[c];
+        if (celda->banda == banda_punto ? celda->posicion_banda < posicion
+                                        : !banda_alcanza(banda_punto, celda->banda)) continue;
+
+        // Una celda activa sin SET en curso necesita uno entero
+        pthread_mutex_lock(&celda->mutex);
+        bool activa = celda->estado == CELDA_ACTIVA && !celda->devolviendo_piezas;
+        pthread_mutex_unlock(&celda->mutex);
+        if (!activa) continue;
+
+        // Los faltantes se leen sin el mutex de la caja
+        bool falta_alguno = false;
+        for (int t = 0; t < num_tipos; t++) {
+            int faltan = caja_faltan(&celda->caja, t + 1);
+            necesidad[t] += faltan;
+            falta_alguno |= faltan > 0;
+        }
+        if (falta_alguno) hasta[celda->banda] = celda->posicion_banda;
+    }
+
+    // Descontar lo que ya viaja hacia esas celdas, en su banda o más atrás
+    for (int q = 0; q < sistema->banda.longitud; q++) {
+        int bq = banda_de_posicion(q);
+        bool llega = false;
+        for (int b = 0; b < config->num_bandas && !llega; b++) {
+            if (hasta[b] < 0) continue;
+            llega = bq == b ? q <= hasta[b] : banda_alcanza(bq, b);
+        }
+        if (!llega) continue;
+
+        PosicionBanda *pos = &sistema->banda.posiciones[q];
+        pthread_mutex_lock(&pos->mutex);
+        for (int p = 0; p < pos->num_piezas; p++) {
+            int tipo = pos->piezas[p].tipo;
+            if (tipo >= 1 && tipo <= num_tipos) necesidad[tipo - 1]--;
+        }
+        pthread_mutex_unlock(&pos->mutex);
+    }
+
+    int total = 0;
+    for (int t = 0; t < num_tipos; t++) {
+        if (necesidad[t] < 0) necesidad[t] = 0;
+        total += necesidad[t];
+    }
+    return total;
+}
+
+void contar_inyeccion(int punto, bool devuelta) {
+    atomic_fetch_add_explicit(devuelta ? &devueltas[punto] : &dispensadas[punto], 1,
+                              memory_order_relaxed);
+}
+
+void imprimir_resumen_inyeccion(void) {
+    if (sistema->config.num_puntos_inyeccion == 0) return;
+
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    PUNTOS DE INYECCIÓN                            ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Posición  Banda          Cupo  Política   Dispensadas  Devueltas  ║\n");
+    for (int i = 0; i < sistema->config.num_puntos_inyeccion; i++) {
+        const PuntoInyeccion *punto = &sistema->config.puntos_inyeccion[i];
+        printf("║ %8d  %-13s %5d  %-9s %12d %10d  ║\n",
+               punto->posicion, sistema->config.bandas[banda_de_posicion(punto->posicion)].nombre,
+               punto->cupo, nombre_politica(punto->politica),
+               atomic_load_explicit(&dispensadas[i], memory_order_relaxed),
+               atomic_load_explicit(&devueltas[i], memory_order_relaxed));
+    }
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
+
+void escribir_inyeccion_json(FILE *f) {
+    fprintf(f, "  \"inyeccion\": [");
+    for (int i = 0; i < sistema->config.num_puntos_inyeccion; i++) {
+        const PuntoInyeccion *punto = &sistema->config.puntos_inyeccion[i];
+        fprintf(f, "%s\n    {\"posicion\": %d, \"cupo\": %d, \"politica\": \"%s\", "
+                   "\"dispensadas\": %d, \"devueltas\": %d}",
+                i ? "," : "", punto->posicion, punto->cupo, nombre_politica(punto->politica),
+                atomic_load_explicit(&dispensadas[i], memory_order_relaxed),
+                atomic_load_explicit(&devueltas[i], memory_order_relaxed));
+    }
+    fprintf(f, "\n  ]");
+}
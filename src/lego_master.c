@@ -26,21 +26,41 @@
 #include "brazo.h"
 #include "operador.h"
 #include "gestor_celdas.h"
+#include "temporizador.h"
+#include "balanceador.h"
+#include "colocacion.h"
+#include "metricas.h"
+#include "traza.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "reporte.h"
+#include "quiescencia.h"
+#include "invariantes.h"
+#include "control_velocidad.h"
+#include "reservas.h"
+#include "pedidos.h"
+#include "vector_tipos.h"
+#include "topologia.h"
+#include "inyeccion.h"
+#include "pool_brazos.h"
 
 // Sistema global (accesible desde otros módulos)
 SistemaLego *sistema = NULL;
 
 // Hilos
-static pthread_t hilo_banda;
+static pthread_t hilos_banda[MAX_BANDAS];
 static pthread_t hilo_dispensadores;
 static pthread_t hilos_brazos[MAX_CELDAS][BRAZOS_POR_CELDA];
 static pthread_t hilo_gestor_celdas;
+static pthread_t hilo_balanceador;
+static pthread_t hilo_control_velocidad;
 
 // Prototipos locales
 static void inicializar_sistema(int argc, char* argv[]);
 static void limpiar_recursos(void);
 static void manejador_senal(int sig);
 static void mostrar_ayuda(const char* programa);
+static void procesar_opcion(const char* programa, const char* opcion);
 
 // ============================================================================
 // AYUDA Y USO
@@ -66,7 +86,7 @@ static void mostrar_ayuda(const char* programa) {
     printf("  -v, --version  Muestra la versión del programa\n\n");
     
     printf("PARÁMETROS:\n");
-    printf("  celdas         Número de celdas de empaquetado (1-%d)\n", MAX_CELDAS);
+    printf("  celdas         Número de celdas de empaquetado (1-%d)\n", MAX_CELDAS_PARAMETRO);
     printf("  sets           Número de SETs/cajas a completar (entero > 0)\n");
     printf("  pA             Piezas de tipo A por cada SET (entero >= 0)\n");
     printf("  pB             Piezas de tipo B por cada SET (entero >= 0)\n");
@@ -75,6 +95,57 @@ static void mostrar_ayuda(const char* programa) {
     printf("  velocidad      Velocidad de la banda en pasos/segundo (entero > 0)\n");
     printf("  longitud       Longitud de la banda en posiciones (1-%d)\n\n", MAX_POSICIONES);
     
+    printf("OPCIONES ADICIONALES (después de los parámetros):\n");
+    printf("  --delta-t2=MS  Tiempo de suspensión de un brazo por balanceo (ms, def. 1000)\n");
+    printf("  --balanceo=P   Política de balanceo: max, ventana o turno (def. max)\n");
+    printf("  --balanceo-y=N Piezas dispensadas entre balanceos (def. 10)\n");
+    printf("  --ventana-balanceo=MS  Ventana de la política 'ventana' (def. 2000)\n");
+    printf("  --gestor-intervalo=MS  Periodo de muestreo del gestor de celdas (def. 2000)\n");
+    printf("  --objetivo-sets=X      Throughput objetivo en SETs/minuto (def. sin objetivo)\n");
+    printf("  --log-gestor=ARCHIVO   CSV con cada decisión del gestor y sus entradas\n");
+    printf("  --velocidad-adaptativa[=MIN,MAX]  Ajusta la velocidad en marcha según la densidad\n");
+    printf("                         de la banda, brazos ociosos, buffers y tacho (def. v/2,2v)\n");
+    printf("  --log-velocidad=ARCHIVO  CSV con la velocidad en el tiempo y sus entradas\n");
+    printf("  --contrapresion[=U]    Retiene piezas en una cola del alimentador mientras todas las\n");
+    printf("                         celdas tengan presión >= U (def. %.2f): posiciones previas,\n",
+           UMBRAL_CONTRAPRESION_DEFECTO);
+    printf("                         buffer y espera del operador\n");
+    printf("  --reservas             Reserva cada pieza que entra a la banda para la celda cuyo\n");
+    printf("                         déficit mejor cubre; las demás celdas no la toman\n");
+    printf("  --asignacion=P         Reservas voraz (= --reservas) u optima: cada ciclo reparte\n");
+    printf("                         las piezas de la banda para completar la mayor cantidad de SETs\n");
+    printf("  --tipos=C1,C2,...,CN   N tipos de pieza (hasta %d) y sus piezas por SET (ignora pA..pD)\n",
+           MAX_TIPOS_PIEZA);
+    printf("  --pedidos=ARCHIVO      Cola de pedidos con recetas distintas (ignora <sets> y Ci);\n");
+    printf("                         cada línea: receta cantidad prioridad y una cantidad por tipo\n");
+    printf("  --posiciones=X1,X2,..  Posiciones explícitas de las celdas en la banda\n");
+    printf("  --colocacion=MODO      uniforme (def.) u optimizada (busca la mejor distribución)\n");
+    printf("  --continuo             Producción continua sin límite de SETs (ignora <sets>)\n");
+    printf("  --duracion=S           Duración del modo continuo en segundos (def. hasta Ctrl+C)\n");
+    printf("  --ventana-metricas=S   Reporta sets/s, tacho/s y latencia de caja cada S segundos\n");
+    printf("  --traza-piezas         Traza el ciclo de vida de cada pieza y reporta latencias\n");
+    printf("  --traza-chrome=ARCHIVO Línea de tiempo de brazos, celdas, banda, operador y gestor\n");
+    printf("                         en JSON de eventos de traza (chrome://tracing, Perfetto)\n");
+    printf("  --metricas=SOCKET      Sirve métricas en vivo (Prometheus o JSON) por un socket Unix\n");
+    printf("  --report=json|csv      Escribe el reporte final legible por máquina\n");
+    printf("  --report-archivo=RUTA  Destino del reporte (def. reporte.json / reporte.csv)\n");
+    printf("  --tramos-banda=N       Divide la banda en N tramos, cada uno avanzado por su propio\n");
+    printf("                         hilo en cada paso (def. 1, máx. %d)\n", MAX_TRAMOS_BANDA);
+    printf("  --inyeccion=P[:C[:M]],..  Puntos de inyección a mitad de banda: C dispensadores\n");
+    printf("                         (def. 3) sueltan lo que piden las celdas de más adelante\n");
+    printf("                         y reciben devoluciones; mezcla M completa (def.) o cede\n");
+    printf("  --topologia=ARCHIVO    Planta de varias bandas con sus dispensadores, celdas y\n");
+    printf("                         enlaces (divisiones y uniones); ignora <celdas> y <longitud>\n");
+    printf("  --pool-brazos[=N]      Los brazos son tareas de un pool de N hilos con robo de\n");
+    printf("                         trabajo (def. un hilo por núcleo) en vez de un hilo cada uno\n");
+    printf("  --banda-circular[=N]   Las piezas no recogidas vuelven al inicio de la banda\n");
+    printf("                         hasta N veces (def. %d, máx. %d) antes de caer al tacho\n",
+           VUELTAS_DEFECTO, MAX_VUELTAS);
+    printf("  --semilla=N            Semilla de las decisiones aleatorias (def. la hora actual)\n");
+    printf("  --verificar-invariantes[=MS]  Verifica conservación de piezas y conteo de SETs\n");
+    printf("                         cada MS ms (def. %d) y al final; código de salida 1 si fallan\n\n",
+           PERIODO_INVARIANTES_MS);
+    
     printf("NOTA: El sistema usa 3 dispensadores fijos.\n\n");
     
     printf("FUNCIONAMIENTO:\n");
@@ -116,6 +187,239 @@ static void mostrar_uso(const char* programa) {
     fprintf(stderr, "  %s 2 3 3 2 2 1 3 25\n", programa);
 }
 
+// ============================================================================
+// OPCIONES ADICIONALES
+// ============================================================================
+
+// Devuelve el valor de "--clave=valor" si la opción coincide con la clave
+static const char* valor_opcion(const char* opcion, const char* clave) {
+    size_t n = strlen(clave);
+    if (strncmp(opcion, clave, n) == 0 && opcion[n] == '=') {
+        return opcion + n + 1;
+    }
+    return NULL;
+}
+
+// Lista "C1,C2,...,CN" de piezas por tipo; fija N como cantidad de tipos
+static bool parsear_tipos(const char* texto, ConfiguracionSistema *config) {
+    int piezas[MAX_TIPOS_PIEZA] = {0};
+    int n = 0;
+    const char *p = texto;
+    while (*p != '\0') {
+        char *fin;
+        long valor = strtol(p, &fin, 10);
+        if (fin == p || n >= MAX_TIPOS_PIEZA) return false;
+        piezas[n++] = (int)valor;
+        if (*fin == ',') {
+            fin++;
+        } else if (*fin != '\0') {
+            return false;
+        }
+        p = fin;
+    }
+    if (n == 0) return false;
+    memcpy(config->piezas_por_tipo, piezas, sizeof(piezas));
+    config->num_tipos = n;
+    return true;
+}
+
+static void procesar_opcion(const char* programa, const char* opcion) {
+    const char* valor;
+    
+    if ((valor = valor_opcion(opcion, "--delta-t2")) != NULL) {
+        sistema->config.delta_t2 = atoi(valor);
+        if (sistema->config.delta_t2 < 0) {
+            fprintf(stderr, "Error: --delta-t2 debe ser >= 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--balanceo")) != NULL) {
+        if (!parsear_politica_balanceo(valor, &sistema->config.politica_balanceo)) {
+            fprintf(stderr, "Error: --balanceo debe ser max, ventana o turno\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--balanceo-y")) != NULL) {
+        sistema->config.Y = atoi(valor);
+        if (sistema->config.Y <= 0) {
+            fprintf(stderr, "Error: --balanceo-y debe ser > 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--ventana-balanceo")) != NULL) {
+        sistema->config.ventana_balanceo_ms = atoi(valor);
+        if (sistema->config.ventana_balanceo_ms <= 0) {
+            fprintf(stderr, "Error: --ventana-balanceo debe ser > 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--gestor-intervalo")) != NULL) {
+        sistema->config.intervalo_gestor_ms = atoi(valor);
+        if (sistema->config.intervalo_gestor_ms <= 0) {
+            fprintf(stderr, "Error: --gestor-intervalo debe ser > 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--objetivo-sets")) != NULL) {
+        sistema->config.objetivo_sets_min = atof(valor);
+        if (sistema->config.objetivo_sets_min < 0) {
+            fprintf(stderr, "Error: --objetivo-sets debe ser >= 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--log-gestor")) != NULL) {
+        snprintf(sistema->config.log_gestor, sizeof(sistema->config.log_gestor), "%s", valor);
+    } else if (strcmp(opcion, "--velocidad-adaptativa") == 0) {
+        sistema->config.velocidad_adaptativa = true;
+    } else if ((valor = valor_opcion(opcion, "--velocidad-adaptativa")) != NULL) {
+        if (!parsear_rango_velocidad(valor, &sistema->config.velocidad_min,
+                                     &sistema->config.velocidad_max)) {
+            fprintf(stderr, "Error: --velocidad-adaptativa debe ser MIN,MAX con 0 < MIN <= MAX\n");
+            exit(1);
+        }
+        sistema->config.velocidad_adaptativa = true;
+    } else if ((valor = valor_opcion(opcion, "--log-velocidad")) != NULL) {
+        snprintf(sistema->config.log_velocidad, sizeof(sistema->config.log_velocidad), "%s", valor);
+    } else if (strcmp(opcion, "--contrapresion") == 0) {
+        sistema->config.contrapresion = true;
+    } else if ((valor = valor_opcion(opcion, "--contrapresion")) != NULL) {
+        sistema->config.contrapresion = true;
+        sistema->config.umbral_contrapresion = atof(valor);
+        if (sistema->config.umbral_contrapresion <= 0 || sistema->config.umbral_contrapresion > 1) {
+            fprintf(stderr, "Error: --contrapresion debe estar en (0, 1]\n");
+            exit(1);
+        }
+    } else if (strcmp(opcion, "--reservas") == 0) {
+        sistema->config.reservas = true;
+    } else if ((valor = valor_opcion(opcion, "--asignacion")) != NULL) {
+        if (strcmp(valor, "voraz") != 0 && strcmp(valor, "optima") != 0) {
+            fprintf(stderr, "Error: --asignacion debe ser voraz u optima\n");
+            exit(1);
+        }
+        sistema->config.reservas = true;
+        sistema->config.asignacion_optima = strcmp(valor, "optima") == 0;
+    } else if ((valor = valor_opcion(opcion, "--tipos")) != NULL) {
+        if (!parsear_tipos(valor, &sistema->config)) {
+            fprintf(stderr, "Error: --tipos debe listar entre 1 y %d cantidades separadas por comas\n",
+                    MAX_TIPOS_PIEZA);
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--pedidos")) != NULL) {
+        sistema->config.pedidos = true;
+        snprintf(sistema->config.archivo_pedidos, sizeof(sistema->config.archivo_pedidos), "%s", valor);
+    } else if ((valor = valor_opcion(opcion, "--posiciones")) != NULL) {
+        int num_posiciones = 0;
+        if (!parsear_posiciones(valor, sistema->config.posiciones_celdas, &num_posiciones) ||
+            num_posiciones != sistema->config.num_celdas) {
+            fprintf(stderr, "Error: --posiciones debe listar %d posiciones separadas por comas\n",
+                    sistema->config.num_celdas);
+            exit(1);
+        }
+        sistema->config.modo_colocacion = COLOCACION_EXPLICITA;
+    } else if ((valor = valor_opcion(opcion, "--colocacion")) != NULL) {
+        if (strcmp(valor, "uniforme") == 0) {
+            sistema->config.modo_colocacion = COLOCACION_UNIFORME;
+        } else if (strcmp(valor, "optimizada") == 0) {
+            sistema->config.modo_colocacion = COLOCACION_OPTIMIZADA;
+        } else {
+            fprintf(stderr, "Error: --colocacion debe ser uniforme u optimizada\n");
+            exit(1);
+        }
+    } else if (strcmp(opcion, "--traza-piezas") == 0) {
+        iniciar_traza_piezas();
+    } else if ((valor = valor_opcion(opcion, "--traza-chrome")) != NULL) {
+        if (valor[0] == '\0') {
+            fprintf(stderr, "Error: --traza-chrome requiere un archivo\n");
+            exit(1);
+        }
+        iniciar_linea_tiempo(valor);
+    } else if ((valor = valor_opcion(opcion, "--report")) != NULL) {
+        sistema->config.formato_reporte = parsear_formato_reporte(valor);
+        if (sistema->config.formato_reporte == REPORTE_NINGUNO) {
+            fprintf(stderr, "Error: --report debe ser json o csv\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--report-archivo")) != NULL) {
+        if (valor[0] == '\0') {
+            fprintf(stderr, "Error: --report-archivo requiere una ruta\n");
+            exit(1);
+        }
+        snprintf(sistema->config.archivo_reporte, sizeof(sistema->config.archivo_reporte), "%s", valor);
+    } else if ((valor = valor_opcion(opcion, "--metricas")) != NULL) {
+        if (valor[0] == '\0' || strlen(valor) >= sizeof(sistema->config.socket_metricas)) {
+            fprintf(stderr, "Error: --metricas requiere una ruta de socket válida\n");
+            exit(1);
+        }
+        snprintf(sistema->config.socket_metricas, sizeof(sistema->config.socket_metricas), "%s", valor);
+    } else if ((valor = valor_opcion(opcion, "--inyeccion")) != NULL) {
+        if (!parsear_inyeccion(valor, &sistema->config)) {
+            fprintf(stderr, "Error: --inyeccion debe listar hasta %d puntos POS[:CUPO[:completa|cede]] "
+                            "(cupo entre 1 y %d) separados por comas\n",
+                    MAX_PUNTOS_INYECCION, MAX_PIEZAS_POS);
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--topologia")) != NULL) {
+        sistema->config.topologia = true;
+        snprintf(sistema->config.archivo_topologia, sizeof(sistema->config.archivo_topologia), "%s", valor);
+    } else if ((valor = valor_opcion(opcion, "--tramos-banda")) != NULL) {
+        sistema->config.tramos_banda = atoi(valor);
+        if (sistema->config.tramos_banda < 1 || sistema->config.tramos_banda > MAX_TRAMOS_BANDA) {
+            fprintf(stderr, "Error: --tramos-banda debe estar entre 1 y %d\n", MAX_TRAMOS_BANDA);
+            exit(1);
+        }
+    } else if (strcmp(opcion, "--pool-brazos") == 0) {
+        long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+        sistema->config.hilos_pool_brazos = nucleos < 1 ? 1
+                                          : nucleos > MAX_HILOS_POOL ? MAX_HILOS_POOL : (int)nucleos;
+    } else if ((valor = valor_opcion(opcion, "--pool-brazos")) != NULL) {
+        sistema->config.hilos_pool_brazos = atoi(valor);
+        if (sistema->config.hilos_pool_brazos < 1 || sistema->config.hilos_pool_brazos > MAX_HILOS_POOL) {
+            fprintf(stderr, "Error: --pool-brazos debe estar entre 1 y %d hilos\n", MAX_HILOS_POOL);
+            exit(1);
+        }
+    } else if (strcmp(opcion, "--banda-circular") == 0) {
+        sistema->config.banda_circular = true;
+        sistema->config.max_vueltas = VUELTAS_DEFECTO;
+    } else if ((valor = valor_opcion(opcion, "--banda-circular")) != NULL) {
+        sistema->config.banda_circular = true;
+        sistema->config.max_vueltas = atoi(valor);
+        if (sistema->config.max_vueltas < 1 || sistema->config.max_vueltas > MAX_VUELTAS) {
+            fprintf(stderr, "Error: --banda-circular debe estar entre 1 y %d vueltas\n", MAX_VUELTAS);
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--semilla")) != NULL) {
+        char *fin;
+        unsigned long semilla = strtoul(valor, &fin, 10);
+        if (valor[0] == '\0' || *fin != '\0') {
+            fprintf(stderr, "Error: --semilla debe ser un entero >= 0\n");
+            exit(1);
+        }
+        sistema->config.semilla = (unsigned int)semilla;
+    } else if (strcmp(opcion, "--verificar-invariantes") == 0) {
+        sistema->config.verificar_invariantes_ms = PERIODO_INVARIANTES_MS;
+    } else if ((valor = valor_opcion(opcion, "--verificar-invariantes")) != NULL) {
+        sistema->config.verificar_invariantes_ms = atoi(valor);
+        if (sistema->config.verificar_invariantes_ms <= 0) {
+            fprintf(stderr, "Error: --verificar-invariantes debe ser > 0 ms\n");
+            exit(1);
+        }
+    } else if (strcmp(opcion, "--continuo") == 0) {
+        sistema->config.modo_continuo = true;
+    } else if ((valor = valor_opcion(opcion, "--duracion")) != NULL) {
+        sistema->config.duracion_s = atoi(valor);
+        if (sistema->config.duracion_s < 0) {
+            fprintf(stderr, "Error: --duracion debe ser >= 0\n");
+            exit(1);
+        }
+    } else if ((valor = valor_opcion(opcion, "--ventana-metricas")) != NULL) {
+        sistema->config.ventana_metricas_s = atoi(valor);
+        if (sistema->config.ventana_metricas_s <= 0 ||
+            sistema->config.ventana_metricas_s > MAX_SEGUNDOS_VENTANA) {
+            fprintf(stderr, "Error: --ventana-metricas debe estar entre 1 y %d\n",
+                    MAX_SEGUNDOS_VENTANA);
+            exit(1);
+        }
+    } else {
+        fprintf(stderr, "Opción desconocida: %s\n", opcion);
+        mostrar_uso(programa);
+        exit(1);
+    }
+}
+
 // ============================================================================
 // INICIALIZACIÓN DEL SISTEMA
 // ============================================================================
@@ -155,6 +459,7 @@ static void inicializar_sistema(int argc, char* argv[]) {
     sistema->config.piezas_por_tipo[1] = atoi(argv[4]);
     sistema->config.piezas_por_tipo[2] = atoi(argv[5]);
     sistema->config.piezas_por_tipo[3] = atoi(argv[6]);
+    sistema->config.num_tipos = TIPOS_PIEZA_DEFECTO;
     sistema->config.velocidad_banda = atoi(argv[7]);
     sistema->config.longitud_banda = atoi(argv[8]);
     
@@ -162,12 +467,44 @@ static void inicializar_sistema(int argc, char* argv[]) {
     sistema->config.delta_t1_max = 2000;  // máx 2 segundos para operador
     sistema->config.delta_t2 = 1000;       // 1 segundo suspensión brazo
     sistema->config.Y = 10;                // balanceo cada 10 piezas
+    sistema->config.politica_balanceo = BALANCEO_MAX_HISTORICO;
+    sistema->config.ventana_balanceo_ms = 2000;
+    sistema->config.intervalo_gestor_ms = 2000;
+    sistema->config.objetivo_sets_min = 0;
+    sistema->config.log_gestor[0] = '\0';
+    sistema->config.socket_metricas[0] = '\0';
+    sistema->config.formato_reporte = REPORTE_NINGUNO;
+    sistema->config.archivo_reporte[0] = '\0';
+    sistema->config.modo_colocacion = COLOCACION_UNIFORME;
+    sistema->config.modo_continuo = false;
+    sistema->config.duracion_s = 0;
+    sistema->config.ventana_metricas_s = 0;
+    sistema->config.velocidad_adaptativa = false;
+    sistema->config.velocidad_min = 0;
+    sistema->config.velocidad_max = 0;
+    sistema->config.log_velocidad[0] = '\0';
+    sistema->config.contrapresion = false;
+    sistema->config.umbral_contrapresion = UMBRAL_CONTRAPRESION_DEFECTO;
+    sistema->config.reservas = false;
+    sistema->config.asignacion_optima = false;
+    sistema->config.pedidos = false;
+    sistema->config.archivo_pedidos[0] = '\0';
+    sistema->config.banda_circular = false;
+    sistema->config.max_vueltas = 0;
+    sistema->config.tramos_banda = 1;
+    sistema->config.hilos_pool_brazos = 0;
+    sistema->config.topologia = false;
+    sistema->config.archivo_topologia[0] = '\0';
+    sistema->config.num_puntos_inyeccion = 0;
+    sistema->config.semilla = (unsigned int)time(NULL);
+    sistema->config.verificar_invariantes_ms = 0;
     sistema->config.sistema_activo = true;
+    
 
     // Validaciones
-    if (sistema->config.num_celdas > MAX_CELDAS) {
-        fprintf(stderr, "Advertencia: Máximo %d celdas, ajustando...\n", MAX_CELDAS);
-        sistema->config.num_celdas = MAX_CELDAS;
+    if (sistema->config.num_celdas > MAX_CELDAS_PARAMETRO) {
+        fprintf(stderr, "Advertencia: Máximo %d celdas, ajustando...\n", MAX_CELDAS_PARAMETRO);
+        sistema->config.num_celdas = MAX_CELDAS_PARAMETRO;
     }
     if (sistema->config.num_celdas <= 0) {
         fprintf(stderr, "Error: Número de celdas debe ser > 0\n");
@@ -182,10 +519,114 @@ static void inicializar_sistema(int argc, char* argv[]) {
         exit(1);
     }
 
-    // Calcular posiciones de las celdas (distribuidas uniformemente)
-    int intervalo = sistema->config.longitud_banda / (sistema->config.num_celdas + 1);
-    for (int i = 0; i < sistema->config.num_celdas; i++) {
-        sistema->config.posiciones_celdas[i] = (i + 1) * intervalo;
+    if (sistema->config.velocidad_banda <= 0) {
+        fprintf(stderr, "Error: La velocidad debe ser > 0\n");
+        exit(1);
+    }
+    if (sistema->config.longitud_banda < 2) {
+        fprintf(stderr, "Error: La banda debe tener al menos 2 posiciones\n");
+        exit(1);
+    }
+    
+    // Opciones adicionales tras los parámetros posicionales
+    for (int i = 9; i < argc; i++) {
+        procesar_opcion(argv[0], argv[i]);
+    }
+
+    // La topología reemplaza <celdas>, <longitud> y la colocación de las celdas
+    if (sistema->config.topologia) {
+        if (sistema->config.reservas) {
+            fprintf(stderr, "Error: --topologia no se combina con --reservas ni --asignacion\n");
+            exit(1);
+        }
+        if (sistema->config.modo_colocacion != COLOCACION_UNIFORME) {
+            fprintf(stderr, "Error: --topologia no se combina con --posiciones ni --colocacion\n");
+            exit(1);
+        }
+        if (!cargar_topologia(sistema->config.archivo_topologia, &sistema->config)) {
+            exit(1);
+        }
+    } else {
+        topologia_unica(&sistema->config);
+    }
+    const char *error_inyeccion = validar_inyeccion(&sistema->config);
+    if (error_inyeccion) {
+        fprintf(stderr, "Error: --inyeccion inválida: %s\n", error_inyeccion);
+        exit(1);
+    }
+
+    if (sistema->config.tramos_banda > sistema->config.longitud_banda) {
+        fprintf(stderr, "Error: --tramos-banda no puede superar la longitud de la banda (%d)\n",
+                sistema->config.longitud_banda);
+        exit(1);
+    }
+
+    // Piezas por tipo (posicionales o --tipos)
+    int piezas_set = 0;
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
+        if (sistema->config.piezas_por_tipo[t] < 0) {
+            fprintf(stderr, "Error: Las piezas por tipo deben ser >= 0\n");
+            exit(1);
+        }
+        piezas_set += sistema->config.piezas_por_tipo[t];
+    }
+    if (piezas_set <= 0 || piezas_set > MAX_PIEZAS_CAJA) {
+        fprintf(stderr, "Error: Un SET debe tener entre 1 y %d piezas\n", MAX_PIEZAS_CAJA);
+        exit(1);
+    }
+
+    // Los pedidos reemplazan <sets> y la receta única de los parámetros
+    if (sistema->config.pedidos) {
+        if (sistema->config.modo_continuo) {
+            fprintf(stderr, "Error: --pedidos no se combina con --continuo\n");
+            exit(1);
+        }
+        if (!cargar_pedidos(sistema->config.archivo_pedidos, &sistema->config)) {
+            exit(1);
+        }
+    }
+
+    // Rango del control de velocidad: por defecto la mitad y el doble de v
+    if (sistema->config.velocidad_adaptativa) {
+        if (sistema->config.velocidad_max == 0) {
+            sistema->config.velocidad_min = sistema->config.velocidad_banda / 2;
+            if (sistema->config.velocidad_min < 1) sistema->config.velocidad_min = 1;
+            sistema->config.velocidad_max = sistema->config.velocidad_banda * 2;
+        }
+        if (sistema->config.velocidad_banda < sistema->config.velocidad_min ||
+            sistema->config.velocidad_banda > sistema->config.velocidad_max) {
+            fprintf(stderr, "Error: La velocidad inicial %d debe estar entre %d y %d\n",
+                    sistema->config.velocidad_banda, sistema->config.velocidad_min,
+                    sistema->config.velocidad_max);
+            exit(1);
+        }
+    }
+
+    // Calcular posiciones de las celdas
+    switch (sistema->config.modo_colocacion) {
+        case COLOCACION_UNIFORME:
+            colocacion_uniforme(&sistema->config);
+            break;
+        case COLOCACION_EXPLICITA: {
+            const char *error = NULL;
+            if (!validar_posiciones(&sistema->config, &error)) {
+                fprintf(stderr, "Error: --posiciones inválidas: %s\n", error);
+                exit(1);
+            }
+            break;
+        }
+        case COLOCACION_OPTIMIZADA:
+            // En modo continuo, <sets> sirve como horizonte de la búsqueda
+            colocacion_optimizada(&sistema->config);
+            break;
+    }
+    
+    // En modo continuo no hay un número fijo de SETs
+    if (sistema->config.modo_continuo) {
+        sistema->config.num_sets = SETS_ILIMITADOS;
+        if (sistema->config.ventana_metricas_s == 0) {
+            sistema->config.ventana_metricas_s = 10;
+        }
     }
 
     // Inicializar banda transportadora
@@ -199,6 +640,11 @@ static void inicializar_sistema(int argc, char* argv[]) {
                           sistema->config.posiciones_celdas[c],
                           sistema->config.piezas_por_tipo);
     }
+    if (sistema->config.pedidos) {
+        for (int c = 0; c < sistema->config.num_celdas; c++) {
+            asignar_pedido(&sistema->celdas[c]);
+        }
+    }
 
     // Inicializar estadísticas
     pthread_mutex_init(&sistema->stats.mutex, NULL);
@@ -206,6 +652,13 @@ static void inicializar_sistema(int argc, char* argv[]) {
     sistema->stats.total_piezas_tacho = 0;
     sistema->stats.cajas_ok = 0;
     sistema->stats.cajas_fail = 0;
+    sistema->stats.piezas_confirmadas = 0;
+    sistema->stats.piezas_rechazadas = 0;
+    sistema->stats.piezas_pedidas_ok = 0;
+    sistema->stats.recirculaciones = 0;
+    sistema->stats.piezas_devueltas = 0;
+    memset(sistema->stats.vueltas_confirmadas, 0, sizeof(sistema->stats.vueltas_confirmadas));
+    memset(sistema->stats.vueltas_tacho, 0, sizeof(sistema->stats.vueltas_tacho));
     for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
         sistema->stats.piezas_en_tacho[t] = 0;
     }
@@ -230,32 +683,86 @@ static void inicializar_sistema(int argc, char* argv[]) {
     pthread_mutex_init(&sistema->mutex_celdas_dinamicas, NULL);
     sistema->num_celdas_activas = sistema->config.num_celdas;
     sistema->stats.piezas_tacho_ultimo_ciclo = 0;
+    reiniciar_piezas_en_vuelo();
+    reiniciar_reservas();
     for (int c = 0; c < MAX_CELDAS; c++) {
         sistema->celdas_habilitadas[c] = (c < sistema->config.num_celdas);
         sistema->ciclos_inactiva[c] = 0;
     }
 
     // Mostrar configuración
-    int total_piezas_set = sistema->config.piezas_por_tipo[0] +
-                           sistema->config.piezas_por_tipo[1] +
-                           sistema->config.piezas_por_tipo[2] +
-                           sistema->config.piezas_por_tipo[3];
+    int total_piezas_set = tipos_total(sistema->config.piezas_por_tipo, sistema->config.num_tipos);
 
     printf("\n");
     printf("╔═══════════════════════════════════════════════════════════════════╗\n");
     printf("║                    LEGO MASTER - SIMULACIÓN                       ║\n");
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     printf("║ Configuración:                                                    ║\n");
-    printf("║   Dispensadores: %d                                               ║\n", sistema->config.num_dispensadores);
+    int dispensadores_planta = 0;
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        dispensadores_planta += sistema->config.bandas[b].dispensadores;
+    }
+    printf("║   Dispensadores: %d                                               ║\n", dispensadores_planta);
     printf("║   Celdas de empaquetado: %d                                       ║\n", sistema->config.num_celdas);
-    printf("║   SETs a completar: %d                                            ║\n", sistema->config.num_sets);
-    printf("║   Piezas por SET: A=%d, B=%d, C=%d, D=%d (total=%d)               ║\n",
-           sistema->config.piezas_por_tipo[0], sistema->config.piezas_por_tipo[1],
-           sistema->config.piezas_por_tipo[2], sistema->config.piezas_por_tipo[3],
-           total_piezas_set);
-    printf("║   Total piezas a dispensar: %d                                    ║\n", 
-           total_piezas_set * sistema->config.num_sets);
-    printf("║   Longitud banda: %d posiciones                                   ║\n", sistema->config.longitud_banda);
+    if (sistema->config.modo_continuo) {
+        printf("║   SETs a completar: ilimitados (modo continuo)                    ║\n");
+    } else {
+        printf("║   SETs a completar: %d                                            ║\n", sistema->config.num_sets);
+    }
+    if (sistema->config.pedidos) {
+        printf("║   Pedidos: %s                                                     ║\n",
+               sistema->config.archivo_pedidos);
+        printf("║   Total piezas a dispensar: %d                                    ║\n",
+               pedidos_piezas_totales());
+    } else {
+        if (sistema->config.num_tipos == TIPOS_PIEZA_DEFECTO) {
+            printf("║   Piezas por SET: A=%d, B=%d, C=%d, D=%d (total=%d)               ║\n",
+                   sistema->config.piezas_por_tipo[0], sistema->config.piezas_por_tipo[1],
+                   sistema->config.piezas_por_tipo[2], sistema->config.piezas_por_tipo[3],
+                   total_piezas_set);
+        } else {
+            printf("║   Piezas por SET: %d tipos (total=%d)                             ║\n",
+                   sistema->config.num_tipos, total_piezas_set);
+        }
+        if (!sistema->config.modo_continuo) {
+            printf("║   Total piezas a dispensar: %d                                    ║\n", 
+                   total_piezas_set * sistema->config.num_sets);
+        }
+    }
+    if (sistema->config.topologia) {
+        printf("║   Topología: %s, %d bandas, %d posiciones                         ║\n",
+               sistema->config.archivo_topologia, sistema->config.num_bandas,
+               sistema->config.longitud_banda);
+        for (int b = 0; b < sistema->config.num_bandas; b++) {
+            const DescripcionBanda *banda = &sistema->config.bandas[b];
+            char linea[128];
+            int n = snprintf(linea, sizeof(linea), "%s: %d pos. desde %d, %d disp.",
+                             banda->nombre, banda->longitud, banda->inicio, banda->dispensadores);
+            for (int d = 0; d < banda->num_destinos && n < (int)sizeof(linea); d++) {
+                n += snprintf(linea + n, sizeof(linea) - n, "%s%s", d ? "," : " -> ",
+                              sistema->config.bandas[banda->destinos[d]].nombre);
+            }
+            printf("║     %-62s║\n", linea);
+        }
+    } else if (sistema->config.tramos_banda > 1) {
+        printf("║   Longitud banda: %d posiciones en %d tramos                       ║\n",
+               sistema->config.longitud_banda, sistema->config.tramos_banda);
+    } else {
+        printf("║   Longitud banda: %d posiciones                                   ║\n", sistema->config.longitud_banda);
+    }
+    if (sistema->config.num_puntos_inyeccion > 0) {
+        printf("║   Puntos de inyección: ");
+        for (int i = 0; i < sistema->config.num_puntos_inyeccion; i++) {
+            const PuntoInyeccion *punto = &sistema->config.puntos_inyeccion[i];
+            printf("%d:%d%s ", punto->posicion, punto->cupo,
+                   punto->politica == MEZCLA_CEDE ? ":cede" : "");
+        }
+        printf("                                  ║\n");
+    }
+    if (sistema->config.hilos_pool_brazos > 0) {
+        printf("║   Brazos: %2d tareas en un pool de %2d hilos                        ║\n",
+               sistema->config.num_celdas * BRAZOS_POR_CELDA, sistema->config.hilos_pool_brazos);
+    }
     printf("║   Velocidad: %d pasos/segundo                                     ║\n", sistema->config.velocidad_banda);
     printf("║   Posiciones celdas: ");
     for (int i = 0; i < sistema->config.num_celdas; i++) {
@@ -284,6 +791,14 @@ static void limpiar_recursos(void) {
     }
 }
 
+// Callback del temporizador al cumplirse --duracion
+static void fin_duracion(void *arg) {
+    (void)arg;
+    printf("\n[SISTEMA] Duración cumplida. Terminando simulación...\n");
+    sistema->terminar = true;
+    avisar_progreso();
+}
+
 static void manejador_senal(int sig) {
     (void)sig;
     printf("\n\n⚠ Señal recibida. Terminando simulación...\n");
@@ -292,12 +807,46 @@ static void manejador_senal(int sig) {
     }
 }
 
+// Con los hilos ya detenidos, las piezas que siguen en la banda, en la mano de
+// un brazo, en buffers o en cajas sin confirmar caen al tacho
+static void contabilizar_piezas_restantes(void) {
+    for (int i = 0; i < sistema->banda.longitud; i++) {
+        PosicionBanda *pos = &sistema->banda.posiciones[i];
+        for (int p = 0; p < pos->num_piezas; p++) {
+            if (pos->piezas[p].tipo > 0) pieza_al_tacho(&pos->piezas[p], -1, -1);
+        }
+        pos->num_piezas = 0;
+    }
+    
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        CeldaEmpaquetado *celda = &sistema->celdas[c];
+        
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            Pieza *en_mano = &celda->brazos[b].pieza_actual;
+            if (en_mano->tipo > 0) {
+                pieza_al_tacho(en_mano, c, b);
+                en_mano->tipo = 0;
+            }
+        }
+        
+        for (int i = 0; i < celda->buffer_count; i++) {
+            if (celda->buffer[i].tipo > 0) pieza_al_tacho(&celda->buffer[i], c, -1);
+        }
+        celda->buffer_count = 0;
+        
+        for (int i = 0; i < celda->caja.num_contenido; i++) {
+            pieza_al_tacho(&celda->caja.contenido[i], c, -1);
+        }
+        caja_vaciar(&celda->caja);
+    }
+}
+
 // ============================================================================
 // FUNCIÓN PRINCIPAL
 // ============================================================================
 
 int main(int argc, char *argv[]) {
-    srand(time(NULL));
+    int codigo_salida = 0;
     
     // Configurar manejadores de señales
     signal(SIGINT, manejador_senal);
@@ -305,36 +854,70 @@ int main(int argc, char *argv[]) {
     
     // Inicializar sistema
     inicializar_sistema(argc, argv);
+    srand(sistema->config.semilla);
     
     printf("Iniciando simulación...\n\n");
     
+    // Rueda de temporización compartida (reanudación de brazos, etc.)
+    iniciar_temporizador();
+    uint64_t inicio_us = tiempo_monotonico_us();
+    
+    // Métricas por ventana y duración del modo continuo
+    iniciar_metricas();
+    if (sistema->config.ventana_metricas_s > 0) {
+        iniciar_reporte_periodico(sistema->config.ventana_metricas_s);
+    }
+    if (sistema->config.modo_continuo && sistema->config.duracion_s > 0) {
+        programar_temporizador((uint64_t)sistema->config.duracion_s * 1000000ULL,
+                               fin_duracion, NULL);
+    }
+    
+    // Métricas en vivo por socket Unix
+    if (sistema->config.socket_metricas[0] != '\0') {
+        iniciar_servidor_metricas(sistema->config.socket_metricas);
+    }
+    
+    // Verificación continua de conservación de piezas y conteo de SETs
+    if (sistema->config.verificar_invariantes_ms > 0) {
+        printf("[INVARIANTES] Verificando cada %d ms (semilla %u)\n",
+               sistema->config.verificar_invariantes_ms, sistema->config.semilla);
+        iniciar_verificador_invariantes(sistema->config.verificar_invariantes_ms);
+    }
+    
     // Iniciar hilo del operador (maneja entrada de usuario de forma no bloqueante)
     iniciar_hilo_operador();
     
     // Crear hilo de la banda transportadora
-    if (pthread_create(&hilo_banda, NULL, thread_banda, NULL) != 0) {
-        perror("Error creando hilo de banda");
-        limpiar_recursos();
-        exit(1);
+    // Crear un hilo por banda de la planta
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        if (pthread_create(&hilos_banda[b], NULL, thread_banda, (void*)(intptr_t)b) != 0) {
+            perror("Error creando hilo de banda");
+            limpiar_recursos();
+            exit(1);
+        }
     }
     
-    // Crear hilos de brazos robóticos
-    for (int c = 0; c < sistema->config.num_celdas; c++) {
-        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
-            ArgsBrazo *args = malloc(sizeof(ArgsBrazo));
-            if (!args) {
-                perror("Error asignando memoria para args de brazo");
-                sistema->terminar = true;
-                break;
-            }
-            args->celda_id = c;
-            args->brazo_id = b;
+    // Crear hilos de brazos robóticos (o el pool que ejecuta sus pasos)
+    if (sistema->config.hilos_pool_brazos > 0) {
+        iniciar_pool_brazos(sistema->config.hilos_pool_brazos, paso_brazo);
+    } else {
+        for (int c = 0; c < sistema->config.num_celdas; c++) {
+            for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+                ArgsBrazo *args = malloc(sizeof(ArgsBrazo));
+                if (!args) {
+                    perror("Error asignando memoria para args de brazo");
+                    sistema->terminar = true;
+                    break;
+                }
+                args->celda_id = c;
+                args->brazo_id = b;
             
-            if (pthread_create(&hilos_brazos[c][b], NULL, thread_brazo, args) != 0) {
-                perror("Error creando hilo de brazo");
-                free(args);
-                sistema->terminar = true;
-                break;
+                if (pthread_create(&hilos_brazos[c][b], NULL, thread_brazo, args) != 0) {
+                    perror("Error creando hilo de brazo");
+                    free(args);
+                    sistema->terminar = true;
+                    break;
+                }
             }
         }
     }
@@ -345,64 +928,103 @@ int main(int argc, char *argv[]) {
         sistema->terminar = true;
     }
     
+    // Crear hilo de balanceo de carga (fuera del ciclo del dispensador)
+    if (pthread_create(&hilo_balanceador, NULL, thread_balanceador, NULL) != 0) {
+        perror("Error creando hilo balanceador");
+        sistema->terminar = true;
+    }
+    
     // Crear hilo gestor de celdas dinámicas
     if (pthread_create(&hilo_gestor_celdas, NULL, thread_gestor_celdas, NULL) != 0) {
         perror("Error creando hilo gestor de celdas");
         // No es crítico, continuar sin gestor dinámico
     }
     
+    // Crear hilo del control adaptativo de velocidad
+    if (sistema->config.velocidad_adaptativa &&
+        pthread_create(&hilo_control_velocidad, NULL, thread_control_velocidad, NULL) != 0) {
+        perror("Error creando hilo de control de velocidad");
+        // No es crítico, la banda sigue a velocidad fija
+        sistema->config.velocidad_adaptativa = false;
+    }
+    
     // Esperar a que termine el dispensador (controla el fin de la simulación)
     pthread_join(hilo_dispensadores, NULL);
     
     // Asegurar que terminar está en true
     sistema->terminar = true;
+    despertar_brazos_suspendidos();
+    despertar_balanceador();
+    despertar_gestor_celdas();
+    despertar_control_velocidad();
     
     // Terminar hilo del operador
     terminar_hilo_operador();
     
     // Esperar a los demás hilos
-    pthread_join(hilo_banda, NULL);
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        pthread_join(hilos_banda[b], NULL);
+    }
     
-    for (int c = 0; c < sistema->config.num_celdas; c++) {
-        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
-            pthread_join(hilos_brazos[c][b], NULL);
+    if (sistema->config.hilos_pool_brazos > 0) {
+        terminar_pool_brazos();
+    } else {
+        for (int c = 0; c < sistema->config.num_celdas; c++) {
+            for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+                pthread_join(hilos_brazos[c][b], NULL);
+            }
         }
     }
     
-    // Esperar al hilo gestor
+    // Esperar al hilo gestor y al balanceador
     pthread_join(hilo_gestor_celdas, NULL);
+    pthread_join(hilo_balanceador, NULL);
+    if (sistema->config.velocidad_adaptativa) {
+        pthread_join(hilo_control_velocidad, NULL);
+    }
+    uint64_t duracion_us = tiempo_monotonico_us() - inicio_us;
     
-    // Contabilizar piezas restantes en buffers de celdas (van al tacho)
-    for (int c = 0; c < sistema->config.num_celdas; c++) {
-        pthread_mutex_lock(&sistema->celdas[c].buffer_mutex);
-        for (int i = 0; i < sistema->celdas[c].buffer_count; i++) {
-            int tipo = sistema->celdas[c].buffer[i].tipo;
-            if (tipo > 0 && tipo <= MAX_TIPOS_PIEZA) {
-                sistema->stats.piezas_en_tacho[tipo - 1]++;
-                sistema->stats.total_piezas_tacho++;
-            }
-        }
-        pthread_mutex_unlock(&sistema->celdas[c].buffer_mutex);
-        
-        // También contar piezas en cajas incompletas
-        pthread_mutex_lock(&sistema->celdas[c].caja.mutex);
-        if (!sistema->celdas[c].caja.completa) {
-            for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-                int en_caja = sistema->celdas[c].caja.piezas_por_tipo[t];
-                if (en_caja > 0) {
-                    sistema->stats.piezas_en_tacho[t] += en_caja;
-                    sistema->stats.total_piezas_tacho += en_caja;
-                }
-            }
-        }
-        pthread_mutex_unlock(&sistema->celdas[c].caja.mutex);
+    // Ya no quedan hilos que programen temporizadores
+    terminar_temporizador();
+    terminar_servidor_metricas();
+    terminar_verificador_invariantes();
+    
+    // Todo lo que quedó en juego cae al tacho
+    contabilizar_piezas_restantes();
+    if (sistema->config.verificar_invariantes_ms > 0 && verificar_invariantes_final() > 0) {
+        codigo_salida = 1;
     }
     
     // Imprimir estadísticas finales
-    imprimir_estadisticas(&sistema->stats, &sistema->config);
+    ResumenOperacion resumen;
+    tomar_resumen(&resumen, duracion_us);
+    imprimir_estadisticas(&resumen, &sistema->config);
+    imprimir_utilizacion_brazos(duracion_us);
+    imprimir_resumen_velocidad();
+    imprimir_resumen_contrapresion();
+    imprimir_resumen_reservas();
+    imprimir_resumen_pedidos(duracion_us / 1e6);
+    imprimir_resumen_bandas();
+    imprimir_resumen_inyeccion();
+    imprimir_resumen_pool_brazos();
+    liberar_pool_brazos();
+    if (sistema->config.ventana_metricas_s > 0) {
+        imprimir_resumen_ventana("Régimen final", sistema->config.ventana_metricas_s);
+    }
+    imprimir_latencias_piezas();
+    liberar_traza_piezas();
+    escribir_linea_tiempo();
+    if (sistema->config.formato_reporte != REPORTE_NINGUNO) {
+        const char *ruta = sistema->config.archivo_reporte;
+        if (ruta[0] == '\0') {
+            ruta = sistema->config.formato_reporte == REPORTE_JSON ? "reporte.json" : "reporte.csv";
+        }
+        escribir_reporte(&resumen, sistema->config.formato_reporte, ruta);
+    }
+    imprimir_perfil_locks();
     
     // Limpiar recursos
     limpiar_recursos();
     
-    return 0;
+    return codigo_salida;
 }
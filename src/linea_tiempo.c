@@ -0,0 +1,188 @@
+/**
+ * LEGO Master - Implementación de la Línea de Tiempo
+ */
+
+#include "linea_tiempo.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Evento de la línea de tiempo
+typedef struct {
+    uint64_t inicio_us;
+    uint64_t duracion_us;            // 0 en los eventos instantáneos
+    const char *nombre;              // Literal, no se copia
+    int pista;
+    bool instantaneo;
+    char detalle[LT_DETALLE];
+} EventoLinea;
+
+// Bloque de eventos de un hilo
+typedef struct BloqueLinea {
+    EventoLinea eventos[LT_EVENTOS_BLOQUE];
+    int usados;
+    struct BloqueLinea *siguiente;   // Lista global de bloques
+} BloqueLinea;
+
+bool linea_tiempo_activa = false;
+
+static char ruta_salida[256];
+static uint64_t origen_us = 0;
+static __thread BloqueLinea *bloque_hilo = NULL;
+static BloqueLinea *bloques = NULL;
+static pthread_mutex_t mutex_bloques = PTHREAD_MUTEX_INITIALIZER;
+
+void iniciar_linea_tiempo(const char *ruta) {
+    snprintf(ruta_salida, sizeof(ruta_salida), "%s", ruta);
+    origen_us = tiempo_monotonico_us();
+    linea_tiempo_activa = true;
+}
+
+const char* nombre_estado_brazo(EstadoBrazo estado) {
+    switch (estado) {
+        case BRAZO_IDLE:       return "IDLE";
+        case BRAZO_RETIRANDO:  return "RETIRANDO";
+        case BRAZO_COLOCANDO:  return "COLOCANDO";
+        case BRAZO_SUSPENDIDO: return "SUSPENDIDO";
+    }
+    return "?";
+}
+
+const char* nombre_estado_celda(EstadoCelda estado) {
+    switch (estado) {
+        case CELDA_ACTIVA:       return "ACTIVA";
+        case CELDA_ESPERANDO_OP: return "ESPERANDO_OP";
+        case CELDA_INACTIVA:     return "INACTIVA";
+    }
+    return "?";
+}
+
+// Solo se toma el mutex al estrenar un bloque
+static EventoLinea* nuevo_evento(void) {
+    if (bloque_hilo == NULL || bloque_hilo->usados == LT_EVENTOS_BLOQUE) {
+        BloqueLinea *bloque = malloc(sizeof(BloqueLinea));
+        if (!bloque) return NULL;
+        bloque->usados = 0;
+        pthread_mutex_lock(&mutex_bloques);
+        bloque->siguiente = bloques;
+        bloques = bloque;
+        pthread_mutex_unlock(&mutex_bloques);
+        bloque_hilo = bloque;
+    }
+    return &bloque_hilo->eventos[bloque_hilo->usados++];
+}
+
+void registrar_intervalo(int pista, const char *nombre, uint64_t inicio_us, uint64_t fin_us) {
+    EventoLinea *e = nuevo_evento();
+    if (!e) return;
+    e->inicio_us = inicio_us;
+    e->duracion_us = fin_us > inicio_us ? fin_us - inicio_us : 0;
+    e->nombre = nombre;
+    e->pista = pista;
+    e->instantaneo = false;
+    e->detalle[0] = '\0';
+}
+
+void registrar_instante(int pista, const char *nombre, const char *detalle) {
+    EventoLinea *e = nuevo_evento();
+    if (!e) return;
+    e->inicio_us = tiempo_monotonico_us();
+    e->duracion_us = 0;
+    e->nombre = nombre;
+    e->pista = pista;
+    e->instantaneo = true;
+    snprintf(e->detalle, sizeof(e->detalle), "%s", detalle ? detalle : "");
+}
+
+// Marca de tiempo relativa al inicio (los eventos previos quedan en 0)
+static uint64_t relativo(uint64_t instante_us) {
+    return instante_us > origen_us ? instante_us - origen_us : 0;
+}
+
+static void escribir_nombre_pista(FILE *f, int pista, const char *nombre, bool *primero) {
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+               "\"args\":{\"name\":\"%s\"}},"
+               "\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+               "\"args\":{\"sort_index\":%d}}",
+            *primero ? "" : ",", pista, nombre, pista, pista);
+    *primero = false;
+}
+
+void escribir_linea_tiempo(void) {
+    if (!linea_tiempo_activa) return;
+
+    // Cerrar los estados que siguen abiertos al terminar
+    uint64_t fin = tiempo_monotonico_us();
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        CeldaEmpaquetado *celda = &sistema->celdas[c];
+        registrar_intervalo(PISTA_CELDA(c), nombre_estado_celda(celda->estado),
+                            celda->estado_desde_us, fin);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            BrazoRobotico *brazo = &celda->brazos[b];
+            registrar_intervalo(PISTA_BRAZO(c, b), nombre_estado_brazo(brazo->estado),
+                                brazo->ultimo_cambio_us, fin);
+        }
+    }
+
+    FILE *f = fopen(ruta_salida, "w");
+    if (!f) {
+        perror("Error abriendo el archivo de la línea de tiempo");
+        return;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    bool primero = true;
+    char nombre[48];             // "Celda %d / Brazo %d" en el peor caso
+    escribir_nombre_pista(f, PISTA_BANDA, "Banda", &primero);
+    escribir_nombre_pista(f, PISTA_DISPENSADOR, "Dispensador", &primero);
+    escribir_nombre_pista(f, PISTA_OPERADOR, "Operador", &primero);
+    escribir_nombre_pista(f, PISTA_GESTOR, "Gestor de celdas", &primero);
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        snprintf(nombre, sizeof(nombre), "Celda %d", c + 1);
+        escribir_nombre_pista(f, PISTA_CELDA(c), nombre, &primero);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            snprintf(nombre, sizeof(nombre), "Celda %d / Brazo %d", c + 1, b + 1);
+            escribir_nombre_pista(f, PISTA_BRAZO(c, b), nombre, &primero);
+        }
+    }
+
+    long total = 0;
+    pthread_mutex_lock(&mutex_bloques);
+    for (BloqueLinea *bloque = bloques; bloque; bloque = bloque->siguiente) {
+        for (int i = 0; i < bloque->usados; i++) {
+            EventoLinea *e = &bloque->eventos[i];
+            if (e->instantaneo) {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,"
+                           "\"ts\":%llu,\"args\":{\"detalle\":\"%s\"}}",
+                        e->nombre, e->pista, (unsigned long long)relativo(e->inicio_us),
+                        e->detalle);
+            } else {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                           "\"ts\":%llu,\"dur\":%llu}",
+                        e->nombre, e->pista, (unsigned long long)relativo(e->inicio_us),
+                        (unsigned long long)e->duracion_us);
+            }
+            total++;
+        }
+    }
+
+    // Los bloques ya no se necesitan
+    while (bloques) {
+        BloqueLinea *sig = bloques->siguiente;
+        free(bloques);
+        bloques = sig;
+    }
+    pthread_mutex_unlock(&mutex_bloques);
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    linea_tiempo_activa = false;
+
+    printf("Línea de tiempo: %ld eventos escritos en %s\n", total, ruta_salida);
+}
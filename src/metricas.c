@@ -0,0 +1,152 @@
+/**
+ * LEGO Master - Implementación de Métricas por Ventana Deslizante
+ */
+
+#include "metricas.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Cubeta de un segundo
+typedef struct {
+    int64_t segundo;                 // Segundo absoluto que contiene (-1 = vacía)
+    int sets;
+    int tacho;
+} CubetaMetricas;
+
+// Latencia de una caja y cuándo se confirmó
+typedef struct {
+    uint64_t instante_us;
+    uint64_t latencia_us;
+} MuestraLatencia;
+
+static CubetaMetricas cubetas[MAX_SEGUNDOS_VENTANA];
+static MuestraLatencia latencias[MAX_MUESTRAS_LATENCIA];
+static int latencias_fin = 0;
+static int latencias_count = 0;
+static uint64_t inicio_us = 0;
+static int ventana_reporte_s = 0;
+static pthread_mutex_t mutex_metricas = PTHREAD_MUTEX_INITIALIZER;
+
+void iniciar_metricas(void) {
+    pthread_mutex_lock(&mutex_metricas);
+    for (int i = 0; i < MAX_SEGUNDOS_VENTANA; i++) {
+        cubetas[i].segundo = -1;
+        cubetas[i].sets = 0;
+        cubetas[i].tacho = 0;
+    }
+    latencias_fin = 0;
+    latencias_count = 0;
+    inicio_us = tiempo_monotonico_us();
+    pthread_mutex_unlock(&mutex_metricas);
+}
+
+// Cubeta del segundo actual, reciclándola si es de otra vuelta (requiere mutex)
+static CubetaMetricas* cubeta_actual(uint64_t ahora) {
+    int64_t segundo = (int64_t)((ahora - inicio_us) / 1000000ULL);
+    CubetaMetricas *cubeta = &cubetas[segundo % MAX_SEGUNDOS_VENTANA];
+    if (cubeta->segundo != segundo) {
+        cubeta->segundo = segundo;
+        cubeta->sets = 0;
+        cubeta->tacho = 0;
+    }
+    return cubeta;
+}
+
+void registrar_set_completado(uint64_t latencia_us) {
+    uint64_t ahora = tiempo_monotonico_us();
+    pthread_mutex_lock(&mutex_metricas);
+    cubeta_actual(ahora)->sets++;
+    latencias[latencias_fin].instante_us = ahora;
+    latencias[latencias_fin].latencia_us = latencia_us;
+    latencias_fin = (latencias_fin + 1) % MAX_MUESTRAS_LATENCIA;
+    if (latencias_count < MAX_MUESTRAS_LATENCIA) latencias_count++;
+    pthread_mutex_unlock(&mutex_metricas);
+}
+
+void registrar_piezas_tacho(int n) {
+    if (n <= 0) return;
+    uint64_t ahora = tiempo_monotonico_us();
+    pthread_mutex_lock(&mutex_metricas);
+    cubeta_actual(ahora)->tacho += n;
+    pthread_mutex_unlock(&mutex_metricas);
+}
+
+static int comparar_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+void resumir_ventana(int ventana_s, ResumenVentana *resumen) {
+    static uint64_t ordenadas[MAX_MUESTRAS_LATENCIA];
+    
+    if (ventana_s > MAX_SEGUNDOS_VENTANA) ventana_s = MAX_SEGUNDOS_VENTANA;
+    if (ventana_s < 1) ventana_s = 1;
+    memset(resumen, 0, sizeof(*resumen));
+    
+    uint64_t ahora = tiempo_monotonico_us();
+    
+    pthread_mutex_lock(&mutex_metricas);
+    int64_t segundo_actual = (int64_t)((ahora - inicio_us) / 1000000ULL);
+    int64_t desde = segundo_actual - ventana_s + 1;
+    if (desde < 0) desde = 0;
+    
+    for (int i = 0; i < MAX_SEGUNDOS_VENTANA; i++) {
+        if (cubetas[i].segundo >= desde && cubetas[i].segundo <= segundo_actual) {
+            resumen->sets += cubetas[i].sets;
+            resumen->tacho += cubetas[i].tacho;
+        }
+    }
+    
+    uint64_t limite = (uint64_t)ventana_s * 1000000ULL;
+    int n = 0;
+    for (int i = 0; i < latencias_count; i++) {
+        int idx = (latencias_fin - 1 - i + MAX_MUESTRAS_LATENCIA) % MAX_MUESTRAS_LATENCIA;
+        if (ahora - latencias[idx].instante_us > limite) break;
+        ordenadas[n++] = latencias[idx].latencia_us;
+    }
+    pthread_mutex_unlock(&mutex_metricas);
+    
+    // El ancho efectivo excluye lo que aún no transcurrió al inicio
+    double transcurrido = (ahora - inicio_us) / 1e6;
+    resumen->segundos = transcurrido < ventana_s ? transcurrido : ventana_s;
+    if (resumen->segundos <= 0.0) resumen->segundos = 1e-6;
+    resumen->sets_por_s = resumen->sets / resumen->segundos;
+    resumen->tacho_por_s = resumen->tacho / resumen->segundos;
+    
+    resumen->muestras_latencia = n;
+    if (n > 0) {
+        qsort(ordenadas, (size_t)n, sizeof(uint64_t), comparar_u64);
+        resumen->latencia_p50_ms = ordenadas[(n - 1) * 50 / 100] / 1000.0;
+        resumen->latencia_p95_ms = ordenadas[(n - 1) * 95 / 100] / 1000.0;
+        resumen->latencia_max_ms = ordenadas[n - 1] / 1000.0;
+    }
+}
+
+void imprimir_resumen_ventana(const char *etiqueta, int ventana_s) {
+    ResumenVentana r;
+    resumir_ventana(ventana_s, &r);
+    printf("[MÉTRICAS] %s (%.0fs): %.3f sets/s, %.3f tacho/s, latencia caja "
+           "p50=%.0fms p95=%.0fms max=%.0fms (n=%d)\n",
+           etiqueta, r.segundos, r.sets_por_s, r.tacho_por_s,
+           r.latencia_p50_ms, r.latencia_p95_ms, r.latencia_max_ms, r.muestras_latencia);
+}
+
+// Callback periódico: reporta y se vuelve a programar
+static void reporte_periodico(void *arg) {
+    (void)arg;
+    if (sistema->terminar) return;
+    imprimir_resumen_ventana("Ventana", ventana_reporte_s);
+    programar_temporizador((uint64_t)ventana_reporte_s * 1000000ULL, reporte_periodico, NULL);
+}
+
+void iniciar_reporte_periodico(int ventana_s) {
+    ventana_reporte_s = ventana_s;
+    programar_temporizador((uint64_t)ventana_s * 1000000ULL, reporte_periodico, NULL);
+}
@@ -5,6 +5,16 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "operador.h"
+#include "metricas.h"
+#include "celda.h"
+#include "traza.h"
+#include "linea_tiempo.h"
+#include "servidor_metricas.h"
+#include "instantanea.h"
+#include "quiescencia.h"
+#include "temporizador.h"
+#include "pedidos.h"
+#include "vector_tipos.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,6 +47,7 @@ static void encolar_celda_operador(int celda_id) {
         cola_celdas_esperando[cola_fin] = celda_id;
         cola_fin = (cola_fin + 1) % MAX_COLA_OPERADOR;
         cola_count++;
+        vivo_fijar(&vivos.cola_operador, cola_count);
         pthread_cond_signal(&cond_cola);
     }
     pthread_mutex_unlock(&mutex_cola);
@@ -46,11 +57,19 @@ static void encolar_celda_operador(int celda_id) {
 static void procesar_respuesta_operador(int celda_id, const char* respuesta) {
     CeldaEmpaquetado *celda = &sistema->celdas[celda_id];
     
+    // Contadores, caja y estado de la celda cambian juntos para las instantáneas
+    inicio_escritura();
+    
     if (strcasecmp(respuesta, "ok") == 0) {
         pthread_mutex_lock(&sistema->stats.mutex);
         sistema->stats.cajas_ok++;
         celda->cajas_completadas_ok++;
         pthread_mutex_unlock(&sistema->stats.mutex);
+        vivo_sumar(&vivos.sets_ok, 1);
+        
+        uint64_t latencia_us = tiempo_monotonico_us() - celda->inicio_set_us;
+        registrar_set_completado(latencia_us);
+        registrar_pedido_terminado(celda, true, latencia_us);
         
         pthread_mutex_lock(&sistema->mutex_sets);
         sistema->sets_completados_total++;
@@ -63,22 +82,43 @@ static void procesar_respuesta_operador(int celda_id, const char* respuesta) {
         pthread_mutex_lock(&sistema->stats.mutex);
         sistema->stats.cajas_fail++;
         celda->cajas_completadas_fail++;
+        vivo_sumar(&vivos.sets_fail, 1);
         printf("[CELDA %d] ✗ SET marcado FAIL\n", celda_id + 1);
         pthread_mutex_unlock(&sistema->stats.mutex);
+        registrar_pedido_terminado(celda, false, 0);
     }
     
     // Reiniciar la caja para el siguiente SET
+    bool ok = strcasecmp(respuesta, "ok") == 0;
     pthread_mutex_lock(&celda->caja.mutex);
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        celda->caja.piezas_por_tipo[t] = 0;
+    for (int i = 0; i < celda->caja.num_contenido; i++) {
+        trazar_pieza(ok ? EVT_CONFIRMADA : EVT_RECHAZADA, &celda->caja.contenido[i], celda_id, -1);
+    }
+    int num_tipos = sistema->config.num_tipos;
+    int piezas_caja = tipos_total(celda->caja.piezas_por_tipo, num_tipos);
+    pthread_mutex_lock(&sistema->stats.mutex);
+    if (ok) {
+        sistema->stats.piezas_confirmadas += piezas_caja;
+        sistema->stats.piezas_pedidas_ok += tipos_total(celda->caja.piezas_necesarias, num_tipos);
+        for (int i = 0; i < celda->caja.num_contenido; i++) {
+            int v = celda->caja.contenido[i].vueltas;
+            sistema->stats.vueltas_confirmadas[v < MAX_VUELTAS ? v : MAX_VUELTAS]++;
+        }
+    } else {
+        sistema->stats.piezas_rechazadas += piezas_caja;
+    }
+    pthread_mutex_unlock(&sistema->stats.mutex);
+    caja_vaciar(&celda->caja);
+    // Con pedidos, una caja OK da paso al siguiente; una FAIL repite la receta
+    if (ok && sistema->config.pedidos) {
+        asignar_pedido(celda);
     }
-    celda->caja.completa = false;
     pthread_mutex_unlock(&celda->caja.mutex);
     
     // Marcar que esta celda ya no está trabajando en un SET
     pthread_mutex_lock(&celda->mutex);
     celda->trabajando_en_set = false;
-    celda->estado = CELDA_ACTIVA;
+    cambiar_estado_celda(celda, CELDA_ACTIVA);
     pthread_mutex_unlock(&celda->mutex);
     
     // Decrementar contador de SETs en proceso
@@ -87,6 +127,9 @@ static void procesar_respuesta_operador(int celda_id, const char* respuesta) {
         sistema->sets_en_proceso--;
     }
     pthread_mutex_unlock(&sistema->mutex_sets);
+    
+    fin_escritura();
+    avisar_progreso();
 }
 
 // Hilo dedicado del operador - AUTOMÁTICO con tiempo aleatorio
@@ -124,6 +167,7 @@ static void* thread_operador(void* arg) {
             celda_id = cola_celdas_esperando[cola_inicio];
             cola_inicio = (cola_inicio + 1) % MAX_COLA_OPERADOR;
             cola_count--;
+            vivo_fijar(&vivos.cola_operador, cola_count);
         }
         pthread_mutex_unlock(&mutex_cola);
         
@@ -132,18 +176,17 @@ static void* thread_operador(void* arg) {
         CeldaEmpaquetado *celda = &sistema->celdas[celda_id];
         
         pthread_mutex_lock(&celda->caja.mutex);
-        bool caja_correcta = true;
-        for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-            if (celda->caja.piezas_por_tipo[t] != celda->caja.piezas_necesarias[t]) {
-                caja_correcta = false;
-            }
-        }
+        bool caja_correcta = tipos_iguales(celda->caja.piezas_por_tipo, celda->caja.piezas_necesarias,
+                                           sistema->config.num_tipos);
         pthread_mutex_unlock(&celda->caja.mutex);
         
         int tiempo_revision_ms = rand() % (sistema->config.delta_t1_max + 1);
+        uint64_t inicio_revision = tiempo_monotonico_us();
         usleep(tiempo_revision_ms * 1000);
         
         const char* resultado = caja_correcta ? "ok" : "fail";
+        marcar_intervalo(PISTA_OPERADOR, caja_correcta ? "revisión OK" : "revisión FAIL",
+                         inicio_revision, tiempo_monotonico_us());
         procesar_respuesta_operador(celda_id, resultado);
     }
     
@@ -175,6 +218,7 @@ void terminar_hilo_operador(void) {
             int celda_id = cola_celdas_esperando[cola_inicio];
             cola_inicio = (cola_inicio + 1) % MAX_COLA_OPERADOR;
             cola_count--;
+            vivo_fijar(&vivos.cola_operador, cola_count);
             pthread_mutex_unlock(&mutex_cola);
             
             printf("[OPERADOR] Procesando celda %d pendiente (cierre del sistema)\n", celda_id + 1);
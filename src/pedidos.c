@@ -0,0 +1,270 @@
+/**
+ * LEGO Master - Implementación de la Cola de Pedidos
+ */
+
+#include "pedidos.h"
+#include "celda.h"
+#include "servidor_metricas.h"
+#include "vector_tipos.h"
+#include "common.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+typedef struct {
+    char nombre[MAX_NOMBRE_RECETA];
+    int piezas[MAX_TIPOS_PIEZA];
+    int cantidad;
+    int prioridad;
+    int en_cola;                     // Pedidos que ninguna celda tomó
+    int confirmados;                 // Cajas OK
+    int fallidos;                    // Cajas FAIL (se vuelven a armar)
+    uint64_t latencia_total_us;      // Suma de latencias de las cajas OK
+} Receta;
+
+// Recetas en orden de atención (prioridad descendente, estable)
+static Receta recetas[MAX_RECETAS];
+static int num_recetas = 0;
+static pthread_mutex_t mutex_pedidos = PTHREAD_MUTEX_INITIALIZER;
+
+bool cargar_pedidos(const char *archivo, ConfiguracionSistema *config) {
+    FILE *f = fopen(archivo, "r");
+    if (!f) {
+        fprintf(stderr, "Error: no se pudo abrir %s: %s\n", archivo, strerror(errno));
+        return false;
+    }
+
+    char linea[256];
+    int num_linea = 0;
+    num_recetas = 0;
+    while (fgets(linea, sizeof(linea), f)) {
+        num_linea++;
+        char *comentario = strchr(linea, '#');
+        if (comentario) *comentario = '\0';
+
+        char nombre[MAX_NOMBRE_RECETA];
+        int consumidos = 0;
+        Receta r;
+        memset(&r, 0, sizeof(r));
+        int leidos = sscanf(linea, "%31s %d %d %n", nombre, &r.cantidad, &r.prioridad, &consumidos);
+        if (leidos <= 0) continue;   // Línea vacía o solo comentario
+
+        // Una cantidad por cada tipo en uso, ni más ni menos
+        const char *p = linea + consumidos;
+        int tipos = 0;
+        while (leidos == 3 && tipos < config->num_tipos) {
+            char *fin;
+            long valor = strtol(p, &fin, 10);
+            if (fin == p) break;
+            r.piezas[tipos++] = (int)valor;
+            p = fin;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        if (leidos != 3 || tipos != config->num_tipos || *p != '\0') {
+            fprintf(stderr, "Error: %s:%d: se esperaba 'receta cantidad prioridad' y %d cantidades por tipo\n",
+                    archivo, num_linea, config->num_tipos);
+            fclose(f);
+            return false;
+        }
+
+        int total = 0;
+        bool valida = r.cantidad > 0;
+        for (int t = 0; t < config->num_tipos; t++) {
+            valida = valida && r.piezas[t] >= 0;
+            total += r.piezas[t];
+        }
+        if (!valida || total <= 0 || total > MAX_PIEZAS_CAJA) {
+            fprintf(stderr, "Error: %s:%d: la cantidad debe ser > 0 y la receta tener entre 1 y %d piezas\n",
+                    archivo, num_linea, MAX_PIEZAS_CAJA);
+            fclose(f);
+            return false;
+        }
+        if (num_recetas == MAX_RECETAS) {
+            fprintf(stderr, "Error: %s: máximo %d recetas\n", archivo, MAX_RECETAS);
+            fclose(f);
+            return false;
+        }
+
+        for (const char *c = nombre; *c; c++) {
+            if (!isalnum((unsigned char)*c) && *c != '_' && *c != '-') {
+                fprintf(stderr, "Error: %s:%d: el nombre de la receta solo admite letras, dígitos, '_' y '-'\n",
+                        archivo, num_linea);
+                fclose(f);
+                return false;
+            }
+        }
+        snprintf(r.nombre, sizeof(r.nombre), "%s", nombre);
+        r.en_cola = r.cantidad;
+
+        // Inserción estable por prioridad descendente
+        int i = num_recetas++;
+        while (i > 0 && recetas[i - 1].prioridad < r.prioridad) {
+            recetas[i] = recetas[i - 1];
+            i--;
+        }
+        recetas[i] = r;
+    }
+    fclose(f);
+
+    if (num_recetas == 0) {
+        fprintf(stderr, "Error: %s no contiene pedidos\n", archivo);
+        return false;
+    }
+
+    // El primer pedido hace de SET de referencia (colocación optimizada)
+    config->num_sets = 0;
+    for (int r = 0; r < num_recetas; r++) {
+        config->num_sets += recetas[r].cantidad;
+    }
+    memcpy(config->piezas_por_tipo, recetas[0].piezas, sizeof(config->piezas_por_tipo));
+    return true;
+}
+
+// Fija la receta de la caja (-1 deja la caja sin pedido)
+static void fijar_receta(CeldaEmpaquetado *celda, int receta) {
+    celda->caja.receta = receta;
+    if (receta >= 0) {
+        memcpy(celda->caja.piezas_necesarias, recetas[receta].piezas, sizeof(celda->caja.piezas_necesarias));
+    } else {
+        memset(celda->caja.piezas_necesarias, 0, sizeof(celda->caja.piezas_necesarias));
+    }
+    caja_recalcular_faltantes(&celda->caja);
+    vivo_fijar(&vivos.necesarias_caja[celda->id],
+               tipos_total(celda->caja.piezas_necesarias, sistema->config.num_tipos));
+}
+
+void asignar_pedido(CeldaEmpaquetado *celda) {
+    pthread_mutex_lock(&mutex_pedidos);
+    int elegida = -1;
+    for (int r = 0; r < num_recetas && elegida < 0; r++) {
+        if (recetas[r].en_cola > 0) elegida = r;
+    }
+    if (elegida >= 0) recetas[elegida].en_cola--;
+    pthread_mutex_unlock(&mutex_pedidos);
+
+    fijar_receta(celda, elegida);
+    if (elegida >= 0) {
+        printf("[CELDA %d] Tomó pedido '%s'\n", celda->id + 1, recetas[elegida].nombre);
+    }
+}
+
+void devolver_pedido(CeldaEmpaquetado *celda) {
+    int receta = celda->caja.receta;
+    if (receta < 0) return;
+    pthread_mutex_lock(&mutex_pedidos);
+    recetas[receta].en_cola++;
+    pthread_mutex_unlock(&mutex_pedidos);
+    fijar_receta(celda, -1);
+}
+
+void registrar_pedido_terminado(CeldaEmpaquetado *celda, bool ok, uint64_t latencia_us) {
+    int receta = celda->caja.receta;
+    if (receta < 0) return;
+    pthread_mutex_lock(&mutex_pedidos);
+    if (ok) {
+        recetas[receta].confirmados++;
+        recetas[receta].latencia_total_us += latencia_us;
+    } else {
+        recetas[receta].fallidos++;
+    }
+    pthread_mutex_unlock(&mutex_pedidos);
+}
+
+void pedidos_demanda_total(int piezas[MAX_TIPOS_PIEZA]) {
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
+        piezas[t] = 0;
+        for (int r = 0; r < num_recetas; r++) {
+            piezas[t] += recetas[r].piezas[t] * recetas[r].cantidad;
+        }
+    }
+}
+
+void pedidos_demanda_en_cola(int piezas[MAX_TIPOS_PIEZA]) {
+    pthread_mutex_lock(&mutex_pedidos);
+    for (int t = 0; t < sistema->config.num_tipos; t++) {
+        piezas[t] = 0;
+        for (int r = 0; r < num_recetas; r++) {
+            piezas[t] += recetas[r].piezas[t] * recetas[r].en_cola;
+        }
+    }
+    pthread_mutex_unlock(&mutex_pedidos);
+}
+
+bool pedidos_minimo_por_tipo(int minimo[MAX_TIPOS_PIEZA]) {
+    bool alguna = false;
+    pthread_mutex_lock(&mutex_pedidos);
+    for (int r = 0; r < num_recetas; r++) {
+        if (recetas[r].confirmados >= recetas[r].cantidad) continue;
+        for (int t = 0; t < sistema->config.num_tipos; t++) {
+            if (!alguna || recetas[r].piezas[t] < minimo[t]) minimo[t] = recetas[r].piezas[t];
+        }
+        alguna = true;
+    }
+    pthread_mutex_unlock(&mutex_pedidos);
+    return alguna;
+}
+
+int pedidos_piezas_totales(void) {
+    int demanda[MAX_TIPOS_PIEZA];
+    pedidos_demanda_total(demanda);
+    return tipos_total(demanda, sistema->config.num_tipos);
+}
+
+// Piezas por tipo "2-1-1-0"; si no entran en el ancho, solo el total
+static void describir_receta(const Receta *rc, char *texto, size_t ancho) {
+    size_t usado = 0;
+    for (int t = 0; t < sistema->config.num_tipos && usado < ancho; t++) {
+        usado += snprintf(texto + usado, ancho - usado, "%s%d", t ? "-" : "", rc->piezas[t]);
+    }
+    if (usado >= ancho) {
+        snprintf(texto, ancho, "%d piezas", tipos_total(rc->piezas, sistema->config.num_tipos));
+    }
+}
+
+void imprimir_resumen_pedidos(double duracion_s) {
+    if (num_recetas == 0) return;
+
+    pthread_mutex_lock(&mutex_pedidos);
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    PEDIDOS POR RECETA                             ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Receta          Prio  Piezas           OK   FAIL  Lat.(s) SET/min ║\n");
+    for (int r = 0; r < num_recetas; r++) {
+        const Receta *rc = &recetas[r];
+        char receta[14];
+        describir_receta(rc, receta, sizeof(receta));
+        double latencia = rc->confirmados > 0 ? rc->latencia_total_us / 1e6 / rc->confirmados : 0.0;
+        double por_minuto = duracion_s > 0 ? rc->confirmados * 60.0 / duracion_s : 0.0;
+        printf("║ %-15.15s %4d  %-13s %3d/%-3d %4d  %7.2f %7.2f ║\n",
+               rc->nombre, rc->prioridad, receta, rc->confirmados, rc->cantidad,
+               rc->fallidos, latencia, por_minuto);
+    }
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+    pthread_mutex_unlock(&mutex_pedidos);
+}
+
+void escribir_pedidos_json(FILE *f, double duracion_s) {
+    pthread_mutex_lock(&mutex_pedidos);
+    fprintf(f, "  \"pedidos\": [");
+    for (int r = 0; r < num_recetas; r++) {
+        const Receta *rc = &recetas[r];
+        fprintf(f, "%s\n    {\"receta\": \"%s\", \"prioridad\": %d, \"piezas\": [",
+                r ? "," : "", rc->nombre, rc->prioridad);
+        for (int t = 0; t < sistema->config.num_tipos; t++) {
+            fprintf(f, "%s%d", t ? ", " : "", rc->piezas[t]);
+        }
+        fprintf(f, "], \"cantidad\": %d, \"ok\": %d, \"fail\": %d, \"latencia_media_s\": %.6f, "
+                   "\"sets_por_minuto\": %.6f}",
+                rc->cantidad, rc->confirmados, rc->fallidos,
+                rc->confirmados > 0 ? rc->latencia_total_us / 1e6 / rc->confirmados : 0.0,
+                duracion_s > 0 ? rc->confirmados * 60.0 / duracion_s : 0.0);
+    }
+    fprintf(f, "\n  ]");
+    pthread_mutex_unlock(&mutex_pedidos);
+}
@@ -0,0 +1,417 @@
+/**
+ * LEGO Master - Implementación del Perfilador de Contención de Locks
+ */
+
+#define PERFIL_LOCKS_INTERNO
+
+#include "perfil_locks.h"
+
+#ifdef PERFIL_LOCKS
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Estadísticas de un sitio de llamada sobre una clase de lock
+typedef struct {
+    const char *archivo;
+    const char *expr;
+    int linea;
+    int clase;
+    atomic_bool en_uso;
+    atomic_ulong adquisiciones;
+    atomic_ulong con_espera;         // El intento sin bloqueo falló
+    atomic_ulong fallidos;           // trylock/trywait que no obtuvieron el lock
+    atomic_ullong espera_total_ns;
+    atomic_ullong espera_max_ns;
+    atomic_ullong retencion_total_ns;
+    atomic_ullong retencion_max_ns;
+    atomic_ulong hist_espera[PL_BUCKETS];
+    atomic_ulong hist_retencion[PL_BUCKETS];
+} SitioLock;
+
+// Dirección de un lock -> clase
+typedef struct {
+    _Atomic(const void*) dir;
+    atomic_int clase;
+} EntradaLock;
+
+// Lock retenido por el hilo actual
+typedef struct {
+    const void *lock;
+    uint64_t desde_ns;
+    SitioLock *sitio;
+} Retenido;
+
+static char clases[PL_MAX_CLASES][96];
+static int num_clases = 0;
+static EntradaLock locks[PL_MAX_LOCKS];
+static SitioLock sitios[PL_MAX_SITIOS];
+static pthread_mutex_t mutex_registro = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread Retenido retenidos[PL_MAX_RETENIDOS];
+static __thread int num_retenidos = 0;
+
+static uint64_t ahora_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline int bucket_de(uint64_t ns) {
+    int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    return b < PL_BUCKETS ? b : PL_BUCKETS - 1;
+}
+
+static inline void maximo_atomico(atomic_ullong *max, uint64_t v) {
+    unsigned long long actual = atomic_load_explicit(max, memory_order_relaxed);
+    while (v > actual &&
+           !atomic_compare_exchange_weak_explicit(max, &actual, v,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static const char* base_archivo(const char *ruta) {
+    const char *barra = strrchr(ruta, '/');
+    return barra ? barra + 1 : ruta;
+}
+
+// Busca o crea la clase con ese nombre (llamador tiene mutex_registro)
+static int clase_por_nombre(const char *expr, const char *archivo, bool estatico) {
+    char nombre[96];
+    if (expr[0] == '&') expr++;
+    if (estatico) {
+        snprintf(nombre, sizeof(nombre), "%s [%s]", expr, base_archivo(archivo));
+    } else {
+        snprintf(nombre, sizeof(nombre), "%s", expr);
+    }
+    for (int i = 0; i < num_clases; i++) {
+        if (strcmp(clases[i], nombre) == 0) return i;
+    }
+    if (num_clases == PL_MAX_CLASES) return PL_MAX_CLASES - 1;
+    snprintf(clases[num_clases], sizeof(clases[0]), "%s", nombre);
+    return num_clases++;
+}
+
+static inline unsigned hash_puntero(const void *p) {
+    return (unsigned)(((uintptr_t)p >> 3) * 2654435761u);
+}
+
+// Asocia una dirección a una clase (llamador tiene mutex_registro)
+static void registrar_lock(const void *lock, int clase) {
+    unsigned h = hash_puntero(lock) % PL_MAX_LOCKS;
+    for (int i = 0; i < PL_MAX_LOCKS; i++) {
+        EntradaLock *e = &locks[(h + i) % PL_MAX_LOCKS];
+        const void *dir = atomic_load_explicit(&e->dir, memory_order_acquire);
+        if (dir == lock || dir == NULL) {
+            atomic_store_explicit(&e->clase, clase, memory_order_relaxed);
+            atomic_store_explicit(&e->dir, lock, memory_order_release);
+            return;
+        }
+    }
+}
+
+// Clase de un lock; los no inicializados con *_init se registran al primer uso
+static int clase_de(const void *lock, const char *expr, const char *archivo) {
+    unsigned h = hash_puntero(lock) % PL_MAX_LOCKS;
+    for (int i = 0; i < PL_MAX_LOCKS; i++) {
+        EntradaLock *e = &locks[(h + i) % PL_MAX_LOCKS];
+        const void *dir = atomic_load_explicit(&e->dir, memory_order_acquire);
+        if (dir == lock) return atomic_load_explicit(&e->clase, memory_order_relaxed);
+        if (dir == NULL) break;
+    }
+    pthread_mutex_lock(&mutex_registro);
+    int clase = clase_por_nombre(expr, archivo, true);
+    registrar_lock(lock, clase);
+    pthread_mutex_unlock(&mutex_registro);
+    return clase;
+}
+
+static SitioLock* sitio_de(const void *lock, const char *expr, const char *archivo, int linea) {
+    int clase = clase_de(lock, expr, archivo);
+    unsigned h = (hash_puntero(archivo) ^ (unsigned)linea * 31u ^ (unsigned)clase) % PL_MAX_SITIOS;
+
+    for (int intento = 0; intento < 2; intento++) {
+        for (int i = 0; i < PL_MAX_SITIOS; i++) {
+            SitioLock *s = &sitios[(h + i) % PL_MAX_SITIOS];
+            if (!atomic_load_explicit(&s->en_uso, memory_order_acquire)) {
+                if (intento == 0) break;
+                // Segunda pasada con el registro tomado: crear el sitio
+                s->archivo = archivo;
+                s->expr = expr;
+                s->linea = linea;
+                s->clase = clase;
+                atomic_store_explicit(&s->en_uso, true, memory_order_release);
+                pthread_mutex_unlock(&mutex_registro);
+                return s;
+            }
+            if (s->linea == linea && s->clase == clase && s->archivo == archivo) {
+                if (intento == 1) pthread_mutex_unlock(&mutex_registro);
+                return s;
+            }
+        }
+        if (intento == 0) pthread_mutex_lock(&mutex_registro);
+    }
+    // Tabla llena: se acumula en el último sitio
+    pthread_mutex_unlock(&mutex_registro);
+    return &sitios[PL_MAX_SITIOS - 1];
+}
+
+static void adquirido(const void *lock, SitioLock *s, uint64_t espera_ns, bool contendido) {
+    atomic_fetch_add_explicit(&s->adquisiciones, 1, memory_order_relaxed);
+    if (contendido) {
+        atomic_fetch_add_explicit(&s->con_espera, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&s->espera_total_ns, espera_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->hist_espera[bucket_de(espera_ns)], 1, memory_order_relaxed);
+    maximo_atomico(&s->espera_max_ns, espera_ns);
+
+    if (num_retenidos < PL_MAX_RETENIDOS) {
+        retenidos[num_retenidos].lock = lock;
+        retenidos[num_retenidos].desde_ns = ahora_ns();
+        retenidos[num_retenidos].sitio = s;
+        num_retenidos++;
+    }
+}
+
+// Cierra la retención del lock; retorna el sitio que lo adquirió (NULL si no lo tiene este hilo)
+static SitioLock* liberado(const void *lock) {
+    for (int i = num_retenidos - 1; i >= 0; i--) {
+        if (retenidos[i].lock != lock) continue;
+
+        SitioLock *s = retenidos[i].sitio;
+        uint64_t retencion = ahora_ns() - retenidos[i].desde_ns;
+        atomic_fetch_add_explicit(&s->retencion_total_ns, retencion, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->hist_retencion[bucket_de(retencion)], 1, memory_order_relaxed);
+        maximo_atomico(&s->retencion_max_ns, retencion);
+
+        for (int j = i; j < num_retenidos - 1; j++) {
+            retenidos[j] = retenidos[j + 1];
+        }
+        num_retenidos--;
+        return s;
+    }
+    return NULL;
+}
+
+// Vuelve a marcar como retenido un mutex recuperado tras una espera de condición
+static void recuperado(const void *lock, SitioLock *s) {
+    if (s && num_retenidos < PL_MAX_RETENIDOS) {
+        retenidos[num_retenidos].lock = lock;
+        retenidos[num_retenidos].desde_ns = ahora_ns();
+        retenidos[num_retenidos].sitio = s;
+        num_retenidos++;
+    }
+}
+
+int perfil_mutex_init(pthread_mutex_t *m, const pthread_mutexattr_t *attr,
+                      const char *expr, const char *archivo) {
+    pthread_mutex_lock(&mutex_registro);
+    registrar_lock(m, clase_por_nombre(expr, archivo, false));
+    pthread_mutex_unlock(&mutex_registro);
+    return pthread_mutex_init(m, attr);
+}
+
+int perfil_mutex_lock(pthread_mutex_t *m, const char *expr, const char *archivo, int linea) {
+    SitioLock *s = sitio_de(m, expr, archivo, linea);
+    uint64_t espera = 0;
+    bool contendido = false;
+
+    int r = pthread_mutex_trylock(m);
+    if (r == EBUSY) {
+        uint64_t t0 = ahora_ns();
+        r = pthread_mutex_lock(m);
+        espera = ahora_ns() - t0;
+        contendido = true;
+    }
+    if (r == 0) adquirido(m, s, espera, contendido);
+    return r;
+}
+
+int perfil_mutex_trylock(pthread_mutex_t *m, const char *expr, const char *archivo, int linea) {
+    SitioLock *s = sitio_de(m, expr, archivo, linea);
+    int r = pthread_mutex_trylock(m);
+    if (r == 0) {
+        adquirido(m, s, 0, false);
+    } else {
+        atomic_fetch_add_explicit(&s->fallidos, 1, memory_order_relaxed);
+    }
+    return r;
+}
+
+int perfil_mutex_unlock(pthread_mutex_t *m) {
+    liberado(m);
+    return pthread_mutex_unlock(m);
+}
+
+int perfil_cond_wait(pthread_cond_t *c, pthread_mutex_t *m) {
+    // El tiempo dormido en la condición no es retención
+    SitioLock *s = liberado(m);
+    int r = pthread_cond_wait(c, m);
+    recuperado(m, s);
+    return r;
+}
+
+int perfil_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m, const struct timespec *ts) {
+    SitioLock *s = liberado(m);
+    int r = pthread_cond_timedwait(c, m, ts);
+    recuperado(m, s);
+    return r;
+}
+
+int perfil_sem_init(sem_t *sem, int compartido, unsigned int valor,
+                    const char *expr, const char *archivo) {
+    pthread_mutex_lock(&mutex_registro);
+    registrar_lock(sem, clase_por_nombre(expr, archivo, false));
+    pthread_mutex_unlock(&mutex_registro);
+    return sem_init(sem, compartido, valor);
+}
+
+int perfil_sem_wait(sem_t *sem, const char *expr, const char *archivo, int linea) {
+    SitioLock *s = sitio_de(sem, expr, archivo, linea);
+    uint64_t espera = 0;
+    bool contendido = false;
+
+    int r = sem_trywait(sem);
+    if (r != 0 && errno == EAGAIN) {
+        uint64_t t0 = ahora_ns();
+        r = sem_wait(sem);
+        espera = ahora_ns() - t0;
+        contendido = true;
+    }
+    if (r == 0) adquirido(sem, s, espera, contendido);
+    return r;
+}
+
+int perfil_sem_trywait(sem_t *sem, const char *expr, const char *archivo, int linea) {
+    SitioLock *s = sitio_de(sem, expr, archivo, linea);
+    int r = sem_trywait(sem);
+    if (r == 0) {
+        adquirido(sem, s, 0, false);
+    } else {
+        atomic_fetch_add_explicit(&s->fallidos, 1, memory_order_relaxed);
+    }
+    return r;
+}
+
+int perfil_sem_post(sem_t *sem) {
+    // Un post desde otro hilo no cierra ninguna retención
+    liberado(sem);
+    return sem_post(sem);
+}
+
+// ============================================================================
+// REPORTE
+// ============================================================================
+
+// Totales de una clase (o de un sitio)
+typedef struct {
+    int indice;
+    unsigned long adquisiciones;
+    unsigned long con_espera;
+    unsigned long fallidos;
+    uint64_t espera_total_ns;
+    uint64_t espera_max_ns;
+    uint64_t retencion_total_ns;
+    uint64_t retencion_max_ns;
+    unsigned long hist_espera[PL_BUCKETS];
+    unsigned long hist_retencion[PL_BUCKETS];
+} TotalesLock;
+
+static void acumular(TotalesLock *t, SitioLock *s) {
+    t->adquisiciones += atomic_load(&s->adquisiciones);
+    t->con_espera += atomic_load(&s->con_espera);
+    t->fallidos += atomic_load(&s->fallidos);
+    t->espera_total_ns += atomic_load(&s->espera_total_ns);
+    t->retencion_total_ns += atomic_load(&s->retencion_total_ns);
+    uint64_t em = atomic_load(&s->espera_max_ns), rm = atomic_load(&s->retencion_max_ns);
+    if (em > t->espera_max_ns) t->espera_max_ns = em;
+    if (rm > t->retencion_max_ns) t->retencion_max_ns = rm;
+    for (int b = 0; b < PL_BUCKETS; b++) {
+        t->hist_espera[b] += atomic_load(&s->hist_espera[b]);
+        t->hist_retencion[b] += atomic_load(&s->hist_retencion[b]);
+    }
+}
+
+// Cota superior (µs) del bucket donde cae el percentil p del histograma
+static double percentil_hist_us(const unsigned long *hist, int p) {
+    unsigned long total = 0;
+    for (int b = 0; b < PL_BUCKETS; b++) total += hist[b];
+    if (total == 0) return 0.0;
+
+    unsigned long objetivo = (total * (unsigned long)p + 99) / 100;
+    unsigned long acumulado = 0;
+    for (int b = 0; b < PL_BUCKETS; b++) {
+        acumulado += hist[b];
+        if (acumulado >= objetivo) {
+            return b == 0 ? 0.0 : (double)(1ULL << b) / 1000.0;
+        }
+    }
+    return (double)(1ULL << (PL_BUCKETS - 1)) / 1000.0;
+}
+
+static int comparar_espera(const void *a, const void *b) {
+    const TotalesLock *x = a, *y = b;
+    if (x->espera_total_ns != y->espera_total_ns) {
+        return x->espera_total_ns < y->espera_total_ns ? 1 : -1;
+    }
+    return (x->adquisiciones < y->adquisiciones) - (x->adquisiciones > y->adquisiciones);
+}
+
+void imprimir_perfil_locks(void) {
+    static TotalesLock por_clase[PL_MAX_CLASES];
+    static TotalesLock por_sitio[PL_MAX_SITIOS];
+    memset(por_clase, 0, sizeof(por_clase));
+    memset(por_sitio, 0, sizeof(por_sitio));
+
+    int n_sitios = 0;
+    for (int i = 0; i < PL_MAX_SITIOS; i++) {
+        if (!atomic_load(&sitios[i].en_uso)) continue;
+        acumular(&por_clase[sitios[i].clase], &sitios[i]);
+        por_sitio[n_sitios].indice = i;
+        acumular(&por_sitio[n_sitios], &sitios[i]);
+        n_sitios++;
+    }
+    for (int c = 0; c < num_clases; c++) por_clase[c].indice = c;
+    qsort(por_clase, (size_t)num_clases, sizeof(TotalesLock), comparar_espera);
+    qsort(por_sitio, (size_t)n_sitios, sizeof(TotalesLock), comparar_espera);
+
+    printf("\n╔════════════════════════════════════════════════════════════════════════════════════════════╗\n");
+    printf("║                            CONTENCIÓN DE LOCKS POR CLASE                                   ║\n");
+    printf("╠════════════════════════════════════════════════════════════════════════════════════════════╣\n");
+    printf("║ %-34s %9s %6s %9s %8s │ %9s %8s ║\n",
+           "clase", "adq", "espera", "t.esp ms", "p99 µs", "t.ret ms", "p99 µs");
+    printf("╠════════════════════════════════════════════════════════════════════════════════════════════╣\n");
+    for (int i = 0; i < num_clases; i++) {
+        TotalesLock *t = &por_clase[i];
+        if (t->adquisiciones == 0 && t->fallidos == 0) continue;
+        printf("║ %-34.34s %9lu %5.1f%% %9.2f %8.1f │ %9.2f %8.1f ║\n",
+               clases[t->indice], t->adquisiciones,
+               t->adquisiciones ? 100.0 * t->con_espera / t->adquisiciones : 0.0,
+               t->espera_total_ns / 1e6, percentil_hist_us(t->hist_espera, 99),
+               t->retencion_total_ns / 1e6, percentil_hist_us(t->hist_retencion, 99));
+    }
+    printf("╚════════════════════════════════════════════════════════════════════════════════════════════╝\n");
+
+    int top = n_sitios < 15 ? n_sitios : 15;
+    printf("\nSitios de llamada con más tiempo de espera:\n");
+    printf("  %-24s %-36s %9s %6s %9s %9s %8s\n",
+           "sitio", "lock", "adq", "espera", "t.esp ms", "máx µs", "fallidos");
+    for (int i = 0; i < top; i++) {
+        TotalesLock *t = &por_sitio[i];
+        SitioLock *s = &sitios[t->indice];
+        char sitio[64];
+        snprintf(sitio, sizeof(sitio), "%s:%d", base_archivo(s->archivo), s->linea);
+        printf("  %-24s %-36.36s %9lu %5.1f%% %9.2f %9.1f %8lu\n",
+               sitio, s->expr, t->adquisiciones,
+               t->adquisiciones ? 100.0 * t->con_espera / t->adquisiciones : 0.0,
+               t->espera_total_ns / 1e6, t->espera_max_ns / 1000.0, t->fallidos);
+    }
+}
+
+#endif // PERFIL_LOCKS
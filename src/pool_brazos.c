@@ -0,0 +1,407 @@
+/**
+ * LEGO Master - Implementación del Pool de Brazos
+ */
+
+#include "pool_brazos.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+#define ESPERA_OCIOSO_MS        100     // Un hilo sin tareas revisa la terminación
+
+// Tarea de un brazo. Está en exactamente un lugar: en una cola, corriendo
+// en un hilo o estacionada esperando su motivo
+typedef struct {
+    int celda_id;
+    int brazo_id;
+    pthread_mutex_t mutex;
+    MotivoEspera motivo;             // Lo que espera (MOTIVO_NINGUNO si no está estacionada)
+    unsigned generacion;             // Invalida los temporizadores de esperas anteriores
+    int temporizador_id;
+    bool corriendo;
+    bool pendiente;                  // Hubo un aviso mientras corría
+} TareaBrazo;
+
+// Cola de un hilo: el dueño encola y saca por la punta, los demás roban de la
+// base. Es circular, con lugar para todas las tareas
+typedef struct {
+    pthread_mutex_t mutex;
+    TareaBrazo **tareas;
+    int base;
+    int cantidad;
+    pthread_t hilo;
+} ColaTrabajo;
+
+// Cupos de una celda
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_colocador;   // Para las devoluciones que esperan la caja
+    int retirando;
+    bool colocando;
+} CuposCelda;
+
+static bool activo = false;
+static PasoBrazo paso_tarea = NULL;
+// Dimensionados al iniciar según las celdas configuradas y los hilos pedidos
+static TareaBrazo *tareas = NULL;
+static int num_tareas = 0;
+static ColaTrabajo *colas = NULL;
+static int num_hilos = 0;
+static CuposCelda *cupos = NULL;
+static int num_cupos = 0;
+static atomic_bool detener = false;
+
+// Los hilos ociosos duermen mientras no haya tareas encoladas
+static pthread_mutex_t mutex_ociosos = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_ociosos = PTHREAD_COND_INITIALIZER;
+static atomic_int encoladas = 0;
+static atomic_int ociosos = 0;
+static atomic_uint siguiente_cola = 0;
+
+static __thread int cola_propia = -1;
+static __thread TareaBrazo *tarea_actual = NULL;
+
+// Estadísticas
+static atomic_long pasos_ejecutados = 0;
+static atomic_long tareas_robadas = 0;
+static atomic_long despertares[NUM_MOTIVOS];
+
+static void encolar(TareaBrazo *tarea) {
+    // Desde un hilo del pool, a su propia cola; desde fuera, por turnos
+    int c = cola_propia >= 0 ? cola_propia
+                             : (int)(atomic_fetch_add(&siguiente_cola, 1) % (unsigned)num_hilos);
+    ColaTrabajo *cola = &colas[c];
+    pthread_mutex_lock(&cola->mutex);
+    cola->tareas[(cola->base + cola->cantidad) % num_tareas] = tarea;
+    cola->cantidad++;
+    pthread_mutex_unlock(&cola->mutex);
+
+    atomic_fetch_add(&encoladas, 1);
+    if (atomic_load(&ociosos) > 0) {
+        pthread_mutex_lock(&mutex_ociosos);
+        pthread_cond_signal(&cond_ociosos);
+        pthread_mutex_unlock(&mutex_ociosos);
+    }
+}
+
+static TareaBrazo *sacar_propia(ColaTrabajo *cola) {
+    TareaBrazo *tarea = NULL;
+    pthread_mutex_lock(&cola->mutex);
+    if (cola->cantidad > 0) {
+        cola->cantidad--;
+        tarea = cola->tareas[(cola->base + cola->cantidad) % num_tareas];
+    }
+    pthread_mutex_unlock(&cola->mutex);
+    return tarea;
+}
+
+static TareaBrazo *robar(ColaTrabajo *cola) {
+    TareaBrazo *tarea = NULL;
+    pthread_mutex_lock(&cola->mutex);
+    if (cola->cantidad > 0) {
+        tarea = cola->tareas[cola->base];
+        cola->base = (cola->base + 1) % num_tareas;
+        cola->cantidad--;
+    }
+    pthread_mutex_unlock(&cola->mutex);
+    return tarea;
+}
+
+static TareaBrazo *siguiente_tarea(int propia) {
+    TareaBrazo *tarea = sacar_propia(&colas[propia]);
+    for (int i = 1; i < num_hilos && !tarea; i++) {
+        tarea = robar(&colas[(propia + i) % num_hilos]);
+        if (tarea) atomic_fetch_add_explicit(&tareas_robadas, 1, memory_order_relaxed);
+    }
+    if (tarea) atomic_fetch_sub(&encoladas, 1);
+    return tarea;
+}
+
+// Pasa una tarea estacionada a la cola (requiere tarea->mutex)
+static void reanudar_tarea(TareaBrazo *tarea, MotivoEspera motivo) {
+    tarea->motivo = MOTIVO_NINGUNO;
+    tarea->generacion++;
+    atomic_fetch_add_explicit(&despertares[motivo], 1, memory_order_relaxed);
+    encolar(tarea);
+}
+
+// Callback del temporizador: el argumento lleva la tarea y la generación de su espera
+static void vencer_espera(void *arg) {
+    uintptr_t valor = (uintptr_t)arg;
+    TareaBrazo *tarea = &tareas[valor % (uintptr_t)num_tareas];
+    unsigned generacion = (unsigned)(valor / (uintptr_t)num_tareas);
+
+    pthread_mutex_lock(&tarea->mutex);
+    if (tarea->generacion == generacion && tarea->motivo != MOTIVO_NINGUNO &&
+        tarea->motivo != MOTIVO_FIN) {
+        tarea->temporizador_id = -1;
+        reanudar_tarea(tarea, MOTIVO_TIEMPO);
+    }
+    pthread_mutex_unlock(&tarea->mutex);
+}
+
+// Tras un paso: volver a la cola o estacionarse hasta el motivo
+static void estacionar(TareaBrazo *tarea, Espera espera) {
+    pthread_mutex_lock(&tarea->mutex);
+    tarea->corriendo = false;
+    if (espera.motivo == MOTIVO_FIN) {
+        tarea->motivo = MOTIVO_FIN;
+    } else if (espera.motivo == MOTIVO_NINGUNO || tarea->pendiente) {
+        // Un aviso durante el paso pudo llegar después de que el paso mirara
+        reanudar_tarea(tarea, MOTIVO_NINGUNO);
+    } else {
+        tarea->motivo = espera.motivo;
+        tarea->generacion++;
+        int retardo_ms = espera.motivo == MOTIVO_CELDA ? RESPALDO_POOL_MS : espera.retardo_ms;
+        if (espera.motivo == MOTIVO_CELDA || espera.motivo == MOTIVO_TIEMPO) {
+            uintptr_t n = (uintptr_t)num_tareas;
+            uintptr_t arg = (uintptr_t)(tarea - tareas) + (uintptr_t)(tarea->generacion % (UINTPTR_MAX / n)) * n;
+            tarea->temporizador_id = programar_temporizador((uint64_t)retardo_ms * 1000ULL,
+                                                            vencer_espera, (void*)arg);
+            if (tarea->temporizador_id < 0) {
+                // Sin temporizador libre se reintenta enseguida
+                reanudar_tarea(tarea, MOTIVO_NINGUNO);
+            }
+        }
+    }
+    pthread_mutex_unlock(&tarea->mutex);
+}
+
+static void despertar_tarea(TareaBrazo *tarea, MotivoEspera motivo) {
+    // Los avisos de la propia tarea (al soltar sus cupos) no la vuelven a encolar
+    if (tarea == tarea_actual) return;
+    pthread_mutex_lock(&tarea->mutex);
+    if (tarea->corriendo) {
+        tarea->pendiente = true;
+    } else if (tarea->motivo == motivo) {
+        if (tarea->temporizador_id >= 0) {
+            cancelar_temporizador(tarea->temporizador_id);
+            tarea->temporizador_id = -1;
+        }
+        reanudar_tarea(tarea, motivo);
+    }
+    pthread_mutex_unlock(&tarea->mutex);
+}
+
+static void* hilo_pool(void *arg) {
+    cola_propia = (int)(intptr_t)arg;
+    while (!atomic_load(&detener)) {
+        TareaBrazo *tarea = siguiente_tarea(cola_propia);
+        if (!tarea) {
+            pthread_mutex_lock(&mutex_ociosos);
+            atomic_fetch_add(&ociosos, 1);
+            if (atomic_load(&encoladas) == 0 && !atomic_load(&detener)) {
+                struct timespec limite;
+                clock_gettime(CLOCK_REALTIME, &limite);
+                limite.tv_nsec += ESPERA_OCIOSO_MS * 1000000L;
+                if (limite.tv_nsec >= 1000000000L) {
+                    limite.tv_sec++;
+                    limite.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&cond_ociosos, &mutex_ociosos, &limite);
+            }
+            atomic_fetch_sub(&ociosos, 1);
+            pthread_mutex_unlock(&mutex_ociosos);
+            continue;
+        }
+
+        pthread_mutex_lock(&tarea->mutex);
+        tarea->corriendo = true;
+        tarea->pendiente = false;
+        pthread_mutex_unlock(&tarea->mutex);
+
+        tarea_actual = tarea;
+        Espera espera = paso_tarea(tarea->celda_id, tarea->brazo_id);
+        tarea_actual = NULL;
+        atomic_fetch_add_explicit(&pasos_ejecutados, 1, memory_order_relaxed);
+        estacionar(tarea, espera);
+    }
+    return NULL;
+}
+
+bool pool_brazos_activo(void) {
+    return activo;
+}
+
+void iniciar_pool_brazos(int hilos, PasoBrazo paso) {
+    paso_tarea = paso;
+    num_hilos = hilos;
+    num_cupos = sistema->config.num_celdas;
+    num_tareas = num_cupos * BRAZOS_POR_CELDA;
+    atomic_store(&detener, false);
+
+    tareas = calloc((size_t)num_tareas, sizeof(TareaBrazo));
+    colas = calloc((size_t)num_hilos, sizeof(ColaTrabajo));
+    cupos = calloc((size_t)num_cupos, sizeof(CuposCelda));
+    if (!tareas || !colas || !cupos) {
+        perror("Error asignando memoria para el pool de brazos");
+        exit(1);
+    }
+    for (int c = 0; c < num_cupos; c++) {
+        pthread_mutex_init(&cupos[c].mutex, NULL);
+        pthread_cond_init(&cupos[c].cond_colocador, NULL);
+        cupos[c].retirando = 0;
+        cupos[c].colocando = false;
+    }
+    for (int h = 0; h < num_hilos; h++) {
+        pthread_mutex_init(&colas[h].mutex, NULL);
+        colas[h].tareas = calloc((size_t)num_tareas, sizeof(TareaBrazo*));
+        if (!colas[h].tareas) {
+            perror("Error asignando memoria para el pool de brazos");
+            exit(1);
+        }
+        colas[h].base = 0;
+        colas[h].cantidad = 0;
+    }
+
+    for (int t = 0; t < num_tareas; t++) {
+        TareaBrazo *tarea = &tareas[t];
+        tarea->celda_id = t / BRAZOS_POR_CELDA;
+        tarea->brazo_id = t % BRAZOS_POR_CELDA;
+        pthread_mutex_init(&tarea->mutex, NULL);
+        tarea->motivo = MOTIVO_NINGUNO;
+        tarea->generacion = 0;
+        tarea->temporizador_id = -1;
+        tarea->corriendo = false;
+        tarea->pendiente = false;
+        // Repartidas de entrada entre las colas
+        ColaTrabajo *cola = &colas[t % num_hilos];
+        cola->tareas[cola->cantidad++] = tarea;
+        atomic_fetch_add(&encoladas, 1);
+    }
+    activo = true;
+
+    for (int h = 0; h < num_hilos; h++) {
+        if (pthread_create(&colas[h].hilo, NULL, hilo_pool, (void*)(intptr_t)h) != 0) {
+            perror("Error creando hilo del pool de brazos");
+            exit(1);
+        }
+    }
+}
+
+void terminar_pool_brazos(void) {
+    if (!activo) return;
+    atomic_store(&detener, true);
+    pthread_mutex_lock(&mutex_ociosos);
+    pthread_cond_broadcast(&cond_ociosos);
+    pthread_mutex_unlock(&mutex_ociosos);
+    for (int c = 0; c < num_cupos; c++) {
+        pthread_mutex_lock(&cupos[c].mutex);
+        pthread_cond_broadcast(&cupos[c].cond_colocador);
+        pthread_mutex_unlock(&cupos[c].mutex);
+    }
+    for (int h = 0; h < num_hilos; h++) {
+        pthread_join(colas[h].hilo, NULL);
+    }
+
+    // Como sus hilos, los brazos con una pieza en la mano terminan de colocarla
+    for (int t = 0; t < num_tareas; t++) {
+        Espera espera;
+        while ((espera = paso_tarea(tareas[t].celda_id, tareas[t].brazo_id)).motivo != MOTIVO_FIN) {
+            usleep((useconds_t)espera.retardo_ms * 1000);
+        }
+    }
+}
+
+void liberar_pool_brazos(void) {
+    if (!activo) return;
+    activo = false;
+    for (int t = 0; t < num_tareas; t++) {
+        pthread_mutex_destroy(&tareas[t].mutex);
+    }
+    for (int h = 0; h < num_hilos; h++) {
+        pthread_mutex_destroy(&colas[h].mutex);
+        free(colas[h].tareas);
+    }
+    for (int c = 0; c < num_cupos; c++) {
+        pthread_mutex_destroy(&cupos[c].mutex);
+        pthread_cond_destroy(&cupos[c].cond_colocador);
+    }
+    free(tareas);
+    free(colas);
+    free(cupos);
+    tareas = NULL;
+    colas = NULL;
+    cupos = NULL;
+}
+
+void despertar_brazos_celda(int celda_id, MotivoEspera motivo) {
+    if (!activo) return;
+    for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+        despertar_tarea(&tareas[celda_id * BRAZOS_POR_CELDA + b], motivo);
+    }
+}
+
+void despertar_brazo(int celda_id, int brazo_id, MotivoEspera motivo) {
+    if (!activo) return;
+    despertar_tarea(&tareas[celda_id * BRAZOS_POR_CELDA + brazo_id], motivo);
+}
+
+bool pool_tomar_retiro(int celda_id) {
+    CuposCelda *cupo = &cupos[celda_id];
+    pthread_mutex_lock(&cupo->mutex);
+    bool tomado = cupo->retirando < MAX_BRAZOS_ACTIVOS;
+    if (tomado) cupo->retirando++;
+    pthread_mutex_unlock(&cupo->mutex);
+    return tomado;
+}
+
+void pool_soltar_retiro(int celda_id) {
+    CuposCelda *cupo = &cupos[celda_id];
+    pthread_mutex_lock(&cupo->mutex);
+    cupo->retirando--;
+    pthread_mutex_unlock(&cupo->mutex);
+    despertar_brazos_celda(celda_id, MOTIVO_RETIRO);
+}
+
+bool pool_tomar_colocador(int celda_id) {
+    CuposCelda *cupo = &cupos[celda_id];
+    pthread_mutex_lock(&cupo->mutex);
+    bool tomado = !cupo->colocando;
+    cupo->colocando = true;
+    pthread_mutex_unlock(&cupo->mutex);
+    return tomado;
+}
+
+void pool_esperar_colocador(int celda_id) {
+    CuposCelda *cupo = &cupos[celda_id];
+    pthread_mutex_lock(&cupo->mutex);
+    while (cupo->colocando) {
+        pthread_cond_wait(&cupo->cond_colocador, &cupo->mutex);
+    }
+    cupo->colocando = true;
+    pthread_mutex_unlock(&cupo->mutex);
+}
+
+void pool_soltar_colocador(int celda_id) {
+    CuposCelda *cupo = &cupos[celda_id];
+    pthread_mutex_lock(&cupo->mutex);
+    cupo->colocando = false;
+    pthread_cond_signal(&cupo->cond_colocador);
+    pthread_mutex_unlock(&cupo->mutex);
+    despertar_brazos_celda(celda_id, MOTIVO_COLOCADOR);
+}
+
+void imprimir_resumen_pool_brazos(void) {
+    if (!activo) return;
+
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    POOL DE BRAZOS                                 ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Hilos: %-4d Tareas: %-4d Pasos: %-10ld Robadas: %-13ld ║\n",
+           num_hilos, num_tareas, atomic_load(&pasos_ejecutados), atomic_load(&tareas_robadas));
+    printf("║ Despertares: celda %-6ld tiempo %-6ld cupos %-5ld reanudar %-4ld ║\n",
+           atomic_load(&despertares[MOTIVO_CELDA]), atomic_load(&despertares[MOTIVO_TIEMPO]),
+           atomic_load(&despertares[MOTIVO_RETIRO]) + atomic_load(&despertares[MOTIVO_COLOCADOR]),
+           atomic_load(&despertares[MOTIVO_REANUDAR]));
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
@@ -0,0 +1,55 @@
+/**
+ * LEGO Master - Implementación de la Detección de Quiescencia
+ */
+
+#include "quiescencia.h"
+#include "common.h"
+#include <time.h>
+
+atomic_int piezas_en_vuelo[NUM_UBICACIONES][MAX_TIPOS_PIEZA];
+atomic_ulong generacion_progreso = 0;
+atomic_int esperando_progreso = 0;
+
+static pthread_mutex_t mutex_progreso = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_progreso = PTHREAD_COND_INITIALIZER;
+
+void reiniciar_piezas_en_vuelo(void) {
+    for (int u = 0; u < NUM_UBICACIONES; u++) {
+        for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
+            atomic_store(&piezas_en_vuelo[u][t], 0);
+        }
+    }
+    atomic_store(&generacion_progreso, 0);
+}
+
+void avisar_progreso_lento(void) {
+    pthread_mutex_lock(&mutex_progreso);
+    pthread_cond_broadcast(&cond_progreso);
+    pthread_mutex_unlock(&mutex_progreso);
+}
+
+bool esperar_progreso(unsigned long generacion, int espera_ms) {
+    struct timespec limite;
+    clock_gettime(CLOCK_REALTIME, &limite);
+    limite.tv_sec += espera_ms / 1000;
+    limite.tv_nsec += (long)(espera_ms % 1000) * 1000000L;
+    if (limite.tv_nsec >= 1000000000L) {
+        limite.tv_sec++;
+        limite.tv_nsec -= 1000000000L;
+    }
+
+    bool hubo_progreso = true;
+    pthread_mutex_lock(&mutex_progreso);
+    atomic_fetch_add(&esperando_progreso, 1);
+    // El avisador incrementa la generación antes de mirar esperando_progreso:
+    // si cambió antes de registrarse, se ve aquí y no se duerme
+    while (atomic_load(&generacion_progreso) == generacion) {
+        if (pthread_cond_timedwait(&cond_progreso, &mutex_progreso, &limite) != 0) {
+            hubo_progreso = atomic_load(&generacion_progreso) != generacion;
+            break;
+        }
+    }
+    atomic_fetch_sub(&esperando_progreso, 1);
+    pthread_mutex_unlock(&mutex_progreso);
+    return hubo_progreso;
+}
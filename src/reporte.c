@@ -0,0 +1,238 @@
+/**
+ * LEGO Master - Implementación del Reporte Final
+ */
+
+#include "reporte.h"
+#include "balanceador.h"
+#include "brazo.h"
+#include "temporizador.h"
+#include "pedidos.h"
+#include "topologia.h"
+#include "inyeccion.h"
+#include "common.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+void tomar_resumen(ResumenOperacion *r, uint64_t duracion_us) {
+    ConfiguracionSistema *config = &sistema->config;
+    Estadisticas *stats = &sistema->stats;
+    memset(r, 0, sizeof(*r));
+
+    pthread_mutex_lock(&stats->mutex);
+    r->total_piezas_dispensadas = stats->total_piezas_dispensadas;
+    memcpy(r->piezas_en_tacho, stats->piezas_en_tacho, sizeof(r->piezas_en_tacho));
+    r->total_piezas_tacho = stats->total_piezas_tacho;
+    r->cajas_ok = stats->cajas_ok;
+    r->cajas_fail = stats->cajas_fail;
+    r->piezas_confirmadas = stats->piezas_confirmadas;
+    r->piezas_rechazadas = stats->piezas_rechazadas;
+    r->recirculaciones = stats->recirculaciones;
+    r->piezas_devueltas = stats->piezas_devueltas;
+    memcpy(r->vueltas_confirmadas, stats->vueltas_confirmadas, sizeof(r->vueltas_confirmadas));
+    memcpy(r->vueltas_tacho, stats->vueltas_tacho, sizeof(r->vueltas_tacho));
+    memcpy(r->piezas_por_brazo, stats->piezas_por_brazo, sizeof(r->piezas_por_brazo));
+    r->piezas_tacho_ultimo_ciclo = stats->piezas_tacho_ultimo_ciclo;
+    for (int c = 0; c < config->num_celdas; c++) {
+        r->cajas_ok_celda[c] = sistema->celdas[c].cajas_completadas_ok;
+        r->cajas_fail_celda[c] = sistema->celdas[c].cajas_completadas_fail;
+    }
+    pthread_mutex_unlock(&stats->mutex);
+
+    if (duracion_us == 0) duracion_us = 1;
+    uint64_t ahora = tiempo_monotonico_us();
+    for (int c = 0; c < config->num_celdas; c++) {
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            BrazoRobotico *brazo = &sistema->celdas[c].brazos[b];
+            uint64_t ocupado, suspendido;
+            tiempos_brazo(brazo, ahora, &ocupado, &suspendido);
+            r->piezas_movidas[c][b] = brazo->piezas_movidas;
+            r->ocupacion_brazo[c][b] = (double)ocupado / duracion_us;
+            r->suspension_brazo[c][b] = (double)suspendido / duracion_us;
+        }
+    }
+
+    // Balance de piezas (con pedidos no hay un SET único: se suman las recetas)
+    if (config->pedidos) {
+        r->piezas_esperadas = pedidos_piezas_totales();
+    } else {
+        for (int t = 0; t < config->num_tipos; t++) {
+            r->piezas_por_set += config->piezas_por_tipo[t];
+        }
+        r->piezas_esperadas = config->modo_continuo ? 0 : r->piezas_por_set * config->num_sets;
+    }
+    r->piezas_en_cajas = r->piezas_confirmadas;
+    r->piezas_perdidas = r->total_piezas_dispensadas - r->piezas_en_cajas -
+                         r->piezas_rechazadas - r->total_piezas_tacho;
+
+    // Tiempos y tasas
+    struct rusage uso;
+    if (getrusage(RUSAGE_SELF, &uso) == 0) {
+        r->tiempo_cpu_usuario_s = uso.ru_utime.tv_sec + uso.ru_utime.tv_usec / 1e6;
+        r->tiempo_cpu_sistema_s = uso.ru_stime.tv_sec + uso.ru_stime.tv_usec / 1e6;
+    }
+    r->tiempo_pared_s = duracion_us / 1e6;
+    r->sets_por_segundo = r->cajas_ok / r->tiempo_pared_s;
+    r->piezas_por_segundo = r->total_piezas_dispensadas / r->tiempo_pared_s;
+    r->tacho_por_segundo = r->total_piezas_tacho / r->tiempo_pared_s;
+    r->fraccion_tacho = r->total_piezas_dispensadas > 0
+                        ? (double)r->total_piezas_tacho / r->total_piezas_dispensadas : 0.0;
+}
+
+FormatoReporte parsear_formato_reporte(const char *texto) {
+    if (strcmp(texto, "json") == 0) return REPORTE_JSON;
+    if (strcmp(texto, "csv") == 0) return REPORTE_CSV;
+    return REPORTE_NINGUNO;
+}
+
+static void escribir_json(FILE *f, const ResumenOperacion *r, const ConfiguracionSistema *config) {
+    fprintf(f, "{\n  \"config\": {\"celdas\": %d, \"sets\": %d, \"piezas_por_tipo\": [",
+            config->num_celdas, config->modo_continuo ? 0 : config->num_sets);
+    for (int t = 0; t < config->num_tipos; t++) {
+        fprintf(f, "%s%d", t ? ", " : "", config->piezas_por_tipo[t]);
+    }
+    fprintf(f, "], \"velocidad\": %d, \"longitud\": %d, \"modo_continuo\": %s, "
+               "\"balanceo\": \"%s\"},\n",
+            config->velocidad_banda, config->longitud_banda,
+            config->modo_continuo ? "true" : "false",
+            nombre_politica_balanceo(config->politica_balanceo));
+
+    fprintf(f, "  \"tiempo\": {\"pared_s\": %.6f, \"cpu_usuario_s\": %.6f, \"cpu_sistema_s\": %.6f},\n",
+            r->tiempo_pared_s, r->tiempo_cpu_usuario_s, r->tiempo_cpu_sistema_s);
+
+    fprintf(f, "  \"estadisticas\": {\"total_piezas_dispensadas\": %d, \"total_piezas_tacho\": %d, "
+               "\"cajas_ok\": %d, \"cajas_fail\": %d, \"piezas_tacho_ultimo_ciclo\": %d, "
+               "\"piezas_en_tacho\": {",
+            r->total_piezas_dispensadas, r->total_piezas_tacho, r->cajas_ok, r->cajas_fail,
+            r->piezas_tacho_ultimo_ciclo);
+    for (int t = 0; t < config->num_tipos; t++) {
+        fprintf(f, "%s\"%s\": %d", t ? ", " : "", nombre_tipo_pieza(t + 1), r->piezas_en_tacho[t]);
+    }
+    fprintf(f, "}},\n");
+
+    fprintf(f, "  \"balance\": {\"piezas_por_set\": %d, \"piezas_esperadas\": %d, "
+               "\"piezas_en_cajas\": %d, \"piezas_rechazadas\": %d, \"piezas_perdidas\": %d, "
+               "\"piezas_devueltas\": %d},\n",
+            r->piezas_por_set, r->piezas_esperadas, r->piezas_en_cajas, r->piezas_rechazadas,
+            r->piezas_perdidas, r->piezas_devueltas);
+
+    if (config->banda_circular) {
+        fprintf(f, "  \"recirculacion\": {\"max_vueltas\": %d, \"recirculaciones\": %d, "
+                   "\"vueltas_confirmadas\": [",
+                config->max_vueltas, r->recirculaciones);
+        for (int v = 0; v <= config->max_vueltas; v++) {
+            fprintf(f, "%s%d", v ? ", " : "", r->vueltas_confirmadas[v]);
+        }
+        fprintf(f, "], \"vueltas_tacho\": [");
+        for (int v = 0; v <= config->max_vueltas; v++) {
+            fprintf(f, "%s%d", v ? ", " : "", r->vueltas_tacho[v]);
+        }
+        fprintf(f, "]},\n");
+    }
+
+    fprintf(f, "  \"tasas\": {\"sets_por_segundo\": %.6f, \"piezas_por_segundo\": %.6f, "
+               "\"tacho_por_segundo\": %.6f, \"fraccion_tacho\": %.6f},\n",
+            r->sets_por_segundo, r->piezas_por_segundo, r->tacho_por_segundo, r->fraccion_tacho);
+
+    if (config->pedidos) {
+        escribir_pedidos_json(f, r->tiempo_pared_s);
+        fprintf(f, ",\n");
+    }
+    if (config->topologia) {
+        escribir_bandas_json(f);
+        fprintf(f, ",\n");
+    }
+    if (config->num_puntos_inyeccion > 0) {
+        escribir_inyeccion_json(f);
+        fprintf(f, ",\n");
+    }
+
+    fprintf(f, "  \"celdas\": [");
+    for (int c = 0; c < config->num_celdas; c++) {
+        fprintf(f, "%s\n    {\"celda\": %d, \"cajas_ok\": %d, \"cajas_fail\": %d, \"brazos\": [",
+                c ? "," : "", c + 1, r->cajas_ok_celda[c], r->cajas_fail_celda[c]);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            fprintf(f, "%s\n      {\"brazo\": %d, \"piezas_movidas\": %d, \"piezas_por_brazo\": %d, "
+                       "\"ocupacion\": %.6f, \"suspension\": %.6f}",
+                    b ? "," : "", b + 1, r->piezas_movidas[c][b], r->piezas_por_brazo[c][b],
+                    r->ocupacion_brazo[c][b], r->suspension_brazo[c][b]);
+        }
+        fprintf(f, "]}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+// Una fila de encabezado y una de valores: los reportes de varias corridas se concatenan
+static void escribir_csv(FILE *f, const ResumenOperacion *r, const ConfiguracionSistema *config) {
+    fprintf(f, "celdas,sets,velocidad,longitud,modo_continuo,pared_s,cpu_usuario_s,cpu_sistema_s,"
+               "total_piezas_dispensadas,total_piezas_tacho,cajas_ok,cajas_fail,piezas_tacho_ultimo_ciclo");
+    for (int t = 0; t < config->num_tipos; t++) {
+        fprintf(f, ",tacho_%s", nombre_tipo_pieza(t + 1));
+    }
+    fprintf(f, ",piezas_por_set,piezas_esperadas,piezas_en_cajas,piezas_rechazadas,piezas_perdidas,"
+               "recirculaciones,piezas_devueltas,sets_por_segundo,piezas_por_segundo,tacho_por_segundo,fraccion_tacho");
+    for (int c = 0; c < config->num_celdas; c++) {
+        fprintf(f, ",celda%d_ok,celda%d_fail", c + 1, c + 1);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            fprintf(f, ",celda%d_brazo%d_piezas_movidas,celda%d_brazo%d_piezas_por_brazo,"
+                       "celda%d_brazo%d_ocupacion,celda%d_brazo%d_suspension",
+                    c + 1, b + 1, c + 1, b + 1, c + 1, b + 1, c + 1, b + 1);
+        }
+    }
+    fprintf(f, "\n");
+
+    fprintf(f, "%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%d,%d,%d,%d,%d",
+            config->num_celdas, config->modo_continuo ? 0 : config->num_sets,
+            config->velocidad_banda, config->longitud_banda, config->modo_continuo,
+            r->tiempo_pared_s, r->tiempo_cpu_usuario_s, r->tiempo_cpu_sistema_s,
+            r->total_piezas_dispensadas, r->total_piezas_tacho, r->cajas_ok, r->cajas_fail,
+            r->piezas_tacho_ultimo_ciclo);
+    for (int t = 0; t < config->num_tipos; t++) {
+        fprintf(f, ",%d", r->piezas_en_tacho[t]);
+    }
+    fprintf(f, ",%d,%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f",
+            r->piezas_por_set, r->piezas_esperadas, r->piezas_en_cajas, r->piezas_rechazadas,
+            r->piezas_perdidas, r->recirculaciones, r->piezas_devueltas,
+            r->sets_por_segundo, r->piezas_por_segundo, r->tacho_por_segundo, r->fraccion_tacho);
+    for (int c = 0; c < config->num_celdas; c++) {
+        fprintf(f, ",%d,%d", r->cajas_ok_celda[c], r->cajas_fail_celda[c]);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            fprintf(f, ",%d,%d,%.6f,%.6f", r->piezas_movidas[c][b], r->piezas_por_brazo[c][b],
+                    r->ocupacion_brazo[c][b], r->suspension_brazo[c][b]);
+        }
+    }
+    fprintf(f, "\n");
+}
+
+bool escribir_reporte(const ResumenOperacion *r, FormatoReporte formato, const char *ruta) {
+    if (formato == REPORTE_NINGUNO) return true;
+
+    char temporal[300];
+    snprintf(temporal, sizeof(temporal), "%s.tmp.%d", ruta, (int)getpid());
+
+    FILE *f = fopen(temporal, "w");
+    if (!f) {
+        perror("Error creando el reporte");
+        return false;
+    }
+    if (formato == REPORTE_JSON) {
+        escribir_json(f, r, &sistema->config);
+    } else {
+        escribir_csv(f, r, &sistema->config);
+    }
+
+    // El reporte aparece completo o no aparece
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(temporal, ruta) != 0) {
+        perror("Error escribiendo el reporte");
+        unlink(temporal);
+        return false;
+    }
+    printf("Reporte %s escrito en %s\n", formato == REPORTE_JSON ? "JSON" : "CSV", ruta);
+    return true;
+}
@@ -0,0 +1,379 @@
+/**
+ * LEGO Master - Implementación de las Reservas de Piezas
+ */
+
+#include "reservas.h"
+#include "instantanea.h"
+#include "vector_tipos.h"
+#include "common.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Todo bajo mutex_reservas; se toma como último lock (con posiciones de la banda tomadas)
+static pthread_mutex_t mutex_reservas = PTHREAD_MUTEX_INITIALIZER;
+static int faltan[MAX_CELDAS][MAX_TIPOS_PIEZA];      // Déficit según la última instantánea
+static bool arma_set[MAX_CELDAS];                    // Trabajando en un SET
+static bool habilitada[MAX_CELDAS];                  // Activa y sin devolver piezas
+static int sets_libres = 0;                          // SETs que nadie inició
+static int reservadas[MAX_CELDAS][MAX_TIPOS_PIEZA];  // Piezas en la banda reservadas
+
+static long reservas_hechas = 0;
+static long reservas_cumplidas = 0;
+static long reservas_vencidas = 0;
+static long piezas_sin_destino = 0;
+
+// Optimizador global (solo lo usa el hilo del dispensador)
+typedef struct {
+    int posicion;
+    int id_unico;
+    int tipo;                        // 1..num_tipos
+    int asignada;                    // Celda elegida por el optimizador
+} PiezaAsignable;
+
+static PiezaAsignable asignables[MAX_POSICIONES * MAX_PIEZAS_POS];
+static long ticks_optimizados = 0;
+static long ticks_mejor_que_voraz = 0;
+static long ticks_peor_que_voraz = 0;
+static long piezas_reasignadas = 0;          // Cambiaron de celda
+static long reservas_anuladas = 0;           // El optimizador las dejó libres
+
+void reiniciar_reservas(void) {
+    pthread_mutex_lock(&mutex_reservas);
+    memset(faltan, 0, sizeof(faltan));
+    memset(arma_set, 0, sizeof(arma_set));
+    memset(habilitada, 0, sizeof(habilitada));
+    memset(reservadas, 0, sizeof(reservadas));
+    sets_libres = 0;
+    reservas_hechas = reservas_cumplidas = reservas_vencidas = piezas_sin_destino = 0;
+    ticks_optimizados = ticks_mejor_que_voraz = ticks_peor_que_voraz = 0;
+    piezas_reasignadas = reservas_anuladas = 0;
+    pthread_mutex_unlock(&mutex_reservas);
+}
+
+void actualizar_demanda_reservas(void) {
+    InstantaneaSistema inst;
+    // Sin instantánea consistente se conserva la demanda anterior
+    if (!capturar_instantanea(&inst)) return;
+    int num_tipos = sistema->config.num_tipos;
+
+    pthread_mutex_lock(&mutex_reservas);
+    for (int c = 0; c < inst.num_celdas; c++) {
+        const InstantaneaCelda *ic = &inst.celdas[c];
+        habilitada[c] = ic->estado == CELDA_ACTIVA && !ic->devolviendo_piezas;
+        arma_set[c] = ic->trabajando_en_set;
+        int tiene[MAX_TIPOS_PIEZA] = {0};
+        if (ic->trabajando_en_set) {
+            memcpy(tiene, ic->caja, sizeof(int) * num_tipos);
+            for (int i = 0; i < ic->buffer_count; i++) {
+                if (ic->buffer[i] >= 1 && ic->buffer[i] <= num_tipos) tiene[ic->buffer[i] - 1]++;
+            }
+            for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+                if (ic->en_mano[b] >= 1 && ic->en_mano[b] <= num_tipos) tiene[ic->en_mano[b] - 1]++;
+            }
+        }
+        for (int t = 0; t < num_tipos; t++) {
+            faltan[c][t] = habilitada[c] ? ic->necesarias[t] - tiene[t] : 0;
+        }
+    }
+    sets_libres = sistema->config.modo_continuo ? INT_MAX
+                : sistema->config.num_sets - inst.sets_completados - inst.sets_en_proceso;
+    pthread_mutex_unlock(&mutex_reservas);
+}
+
+// Piezas que aún faltan a la celda descontando las ya reservadas
+static int deficit_libre(int c, int cuenta[][MAX_TIPOS_PIEZA]) {
+    return tipos_faltantes(cuenta[c], faltan[c], NULL, sistema->config.num_tipos);
+}
+
+static int total_reservadas(int c, int cuenta[][MAX_TIPOS_PIEZA]) {
+    return tipos_total(cuenta[c], sistema->config.num_tipos);
+}
+
+// Déficit positivo de la celda (lo que faltan[c] tiene por encima de cero)
+static int deficit_celda(int c, int *positivos) {
+    static const int sin_piezas[MAX_TIPOS_PIEZA] = {0};
+    return tipos_faltantes(sin_piezas, faltan[c], positivos, sistema->config.num_tipos);
+}
+
+// Regla voraz (con mutex_reservas): celda para una pieza de tipo t que
+// entra en desde_posicion, dadas las reservas ya contadas en cuenta
+static int elegir_celda_voraz(int t, int desde_posicion, int cuenta[][MAX_TIPOS_PIEZA]) {
+    int elegida = SIN_RESERVA;
+
+    // Primero las celdas que arman un SET: la que menos piezas tiene por cubrir
+    int mejor_deficit = INT_MAX;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (!habilitada[c] || !arma_set[c]) continue;
+        if (sistema->celdas[c].posicion_banda < desde_posicion) continue;
+        if (faltan[c][t] - cuenta[c][t] <= 0) continue;
+        int deficit = deficit_libre(c, cuenta);
+        if (deficit < mejor_deficit) {
+            mejor_deficit = deficit;
+            elegida = c;
+        }
+    }
+    if (elegida != SIN_RESERVA) return elegida;
+
+    // Si no, una celda ociosa que pueda iniciar un SET: preferir la que ya
+    // acumula reservas para no repartir un mismo SET entre varias
+    int iniciando = 0;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (habilitada[c] && !arma_set[c] && total_reservadas(c, cuenta) > 0) iniciando++;
+    }
+    int mas_reservas = -1;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (!habilitada[c] || arma_set[c]) continue;
+        if (sistema->celdas[c].posicion_banda < desde_posicion) continue;
+        if (faltan[c][t] - cuenta[c][t] <= 0) continue;
+        int ya = total_reservadas(c, cuenta);
+        if (ya == 0 && iniciando >= sets_libres) continue;
+        if (ya > mas_reservas) {
+            mas_reservas = ya;
+            elegida = c;
+        }
+    }
+    return elegida;
+}
+
+int reservar_pieza(int tipo, int desde_posicion) {
+    if (tipo < 1 || tipo > sistema->config.num_tipos) return SIN_RESERVA;
+
+    pthread_mutex_lock(&mutex_reservas);
+    int elegida = elegir_celda_voraz(tipo - 1, desde_posicion, reservadas);
+    if (elegida != SIN_RESERVA) {
+        reservadas[elegida][tipo - 1]++;
+        reservas_hechas++;
+    } else {
+        piezas_sin_destino++;
+    }
+    pthread_mutex_unlock(&mutex_reservas);
+    return elegida;
+}
+
+void liberar_reserva(Pieza *pieza, bool cumplida) {
+    int c = pieza->reservada_para;
+    if (c == SIN_RESERVA) return;
+    pieza->reservada_para = SIN_RESERVA;
+
+    pthread_mutex_lock(&mutex_reservas);
+    if (reservadas[c][pieza->tipo - 1] > 0) {
+        reservadas[c][pieza->tipo - 1]--;
+    }
+    if (cumplida) {
+        reservas_cumplidas++;
+    } else {
+        reservas_vencidas++;
+    }
+    pthread_mutex_unlock(&mutex_reservas);
+}
+
+// Una celda queda cubierta si lo reservado alcanza todo su déficit
+static int celdas_cubiertas(int cuenta[][MAX_TIPOS_PIEZA], const bool *candidata) {
+    int cubiertas = 0;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (!candidata[c]) continue;
+        cubiertas += tipos_cubiertos(cuenta[c], faltan[c], sistema->config.num_tipos);
+    }
+    return cubiertas;
+}
+
+// Las celdas están ordenadas por posición y una pieza en p alcanza a toda
+// celda en p o después: los conjuntos de piezas alcanzables están anidados,
+// así que basta comparar la demanda acumulada con las piezas alcanzables
+static bool conjunto_factible(unsigned mascara, int alcanzables[][MAX_TIPOS_PIEZA]) {
+    int num_tipos = sistema->config.num_tipos;
+    int demanda[MAX_TIPOS_PIEZA] = {0};
+    int deficit[MAX_TIPOS_PIEZA];
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (!(mascara & (1u << c))) continue;
+        deficit_celda(c, deficit);
+        tipos_sumar(demanda, deficit, num_tipos);
+        if (!tipos_cubiertos(alcanzables[c], demanda, num_tipos)) return false;
+    }
+    return true;
+}
+
+void optimizar_asignacion(void) {
+    if (!sistema->config.asignacion_optima) return;
+
+    int num_celdas = sistema->config.num_celdas;
+    int ultima_posicion = 0;
+    for (int c = 0; c < num_celdas; c++) {
+        if (sistema->celdas[c].posicion_banda > ultima_posicion) {
+            ultima_posicion = sistema->celdas[c].posicion_banda;
+        }
+    }
+
+    // Con mutex_global la banda no avanza: las posiciones no cambian hasta aplicar
+    pthread_mutex_lock(&sistema->banda.mutex_global[0]);
+
+    int num_piezas = 0;
+    for (int i = 0; i <= ultima_posicion && i < sistema->banda.longitud; i++) {
+        PosicionBanda *pos = &sistema->banda.posiciones[i];
+        pthread_mutex_lock(&pos->mutex);
+        for (int p = 0; p < pos->num_piezas; p++) {
+            int tipo = pos->piezas[p].tipo;
+            if (tipo < 1 || tipo > sistema->config.num_tipos) continue;
+            asignables[num_piezas++] = (PiezaAsignable){i, pos->piezas[p].id_unico, tipo, SIN_RESERVA};
+        }
+        pthread_mutex_unlock(&pos->mutex);
+    }
+
+    pthread_mutex_lock(&mutex_reservas);
+
+    // Candidatas: celdas que arman un SET y ociosas que podrían iniciar uno
+    bool candidata[MAX_CELDAS] = {false};
+    bool ociosa[MAX_CELDAS] = {false};
+    int alcanzables[MAX_CELDAS][MAX_TIPOS_PIEZA] = {{0}};
+    for (int c = 0; c < num_celdas; c++) {
+        if (!habilitada[c]) continue;
+        candidata[c] = deficit_celda(c, NULL) > 0;
+        if (!candidata[c]) continue;
+        ociosa[c] = !arma_set[c];
+        for (int k = 0; k < num_piezas; k++) {
+            if (asignables[k].posicion <= sistema->celdas[c].posicion_banda) {
+                alcanzables[c][asignables[k].tipo - 1]++;
+            }
+        }
+    }
+
+    // Línea base: la regla voraz repartiendo las mismas piezas en orden de llegada
+    int voraz[MAX_CELDAS][MAX_TIPOS_PIEZA] = {{0}};
+    for (int k = num_piezas - 1; k >= 0; k--) {
+        int c = elegir_celda_voraz(asignables[k].tipo - 1, asignables[k].posicion, voraz);
+        if (c != SIN_RESERVA) voraz[c][asignables[k].tipo - 1]++;
+    }
+    int cubiertas_voraz = celdas_cubiertas(voraz, candidata);
+
+    // Óptimo exacto (MAX_CELDAS es chico): el conjunto factible con más celdas
+    // cubiertas, sin iniciar más SETs de los que quedan; a igualdad, el de
+    // menor déficit total (termina antes)
+    unsigned mejor = 0;
+    int mejor_cubiertas = 0, mejor_deficit = 0;
+    for (unsigned mascara = 1; mascara < (1u << num_celdas); mascara++) {
+        int cubiertas = 0, iniciadas = 0, deficit = 0;
+        bool valida = true;
+        for (int c = 0; c < num_celdas && valida; c++) {
+            if (!(mascara & (1u << c))) continue;
+            valida = candidata[c];
+            cubiertas++;
+            iniciadas += ociosa[c];
+            deficit += deficit_celda(c, NULL);
+        }
+        if (!valida || iniciadas > sets_libres) continue;
+        if (cubiertas < mejor_cubiertas ||
+            (cubiertas == mejor_cubiertas && deficit >= mejor_deficit)) continue;
+        if (!conjunto_factible(mascara, alcanzables)) continue;
+        mejor = mascara;
+        mejor_cubiertas = cubiertas;
+        mejor_deficit = deficit;
+    }
+
+    // Cada celda elegida (de la primera a la última) toma las piezas
+    // alcanzables más adelantadas: llegan antes y las más atrasadas, que
+    // alcanzan a más celdas, quedan para las siguientes
+    int nueva[MAX_CELDAS][MAX_TIPOS_PIEZA] = {{0}};
+    for (int c = 0; c < num_celdas; c++) {
+        if (!(mejor & (1u << c))) continue;
+        for (int k = num_piezas - 1; k >= 0; k--) {
+            PiezaAsignable *a = &asignables[k];
+            int t = a->tipo - 1;
+            if (a->asignada != SIN_RESERVA || a->posicion > sistema->celdas[c].posicion_banda) continue;
+            if (nueva[c][t] >= faltan[c][t]) continue;
+            a->asignada = c;
+            nueva[c][t]++;
+        }
+    }
+
+    // El resto con la regla voraz, para que las celdas no cubiertas avancen
+    for (int k = num_piezas - 1; k >= 0; k--) {
+        PiezaAsignable *a = &asignables[k];
+        if (a->asignada != SIN_RESERVA) continue;
+        a->asignada = elegir_celda_voraz(a->tipo - 1, a->posicion, nueva);
+        if (a->asignada != SIN_RESERVA) nueva[a->asignada][a->tipo - 1]++;
+    }
+
+    ticks_optimizados++;
+    if (mejor_cubiertas > cubiertas_voraz) ticks_mejor_que_voraz++;
+    if (mejor_cubiertas < cubiertas_voraz) ticks_peor_que_voraz++;
+    pthread_mutex_unlock(&mutex_reservas);
+
+    // Aplicar: un brazo pudo tomar piezas mientras tanto, se busca por ID
+    int k = 0;
+    for (int i = 0; i <= ultima_posicion && i < sistema->banda.longitud && k < num_piezas; i++) {
+        if (asignables[k].posicion != i) continue;
+        PosicionBanda *pos = &sistema->banda.posiciones[i];
+        pthread_mutex_lock(&pos->mutex);
+        int desde = k;
+        while (k < num_piezas && asignables[k].posicion == i) k++;
+        for (int p = 0; p < pos->num_piezas; p++) {
+            Pieza *pieza = &pos->piezas[p];
+            for (int j = desde; j < k; j++) {
+                if (asignables[j].id_unico != pieza->id_unico) continue;
+                int destino = asignables[j].asignada;
+                if (pieza->reservada_para != destino) {
+                    pthread_mutex_lock(&mutex_reservas);
+                    if (pieza->reservada_para != SIN_RESERVA &&
+                        reservadas[pieza->reservada_para][pieza->tipo - 1] > 0) {
+                        reservadas[pieza->reservada_para][pieza->tipo - 1]--;
+                    }
+                    if (destino != SIN_RESERVA) {
+                        reservadas[destino][pieza->tipo - 1]++;
+                    }
+                    if (pieza->reservada_para == SIN_RESERVA) {
+                        reservas_hechas++;
+                    } else if (destino == SIN_RESERVA) {
+                        reservas_anuladas++;
+                    } else {
+                        piezas_reasignadas++;
+                    }
+                    pthread_mutex_unlock(&mutex_reservas);
+                    pieza->reservada_para = destino;
+                }
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pos->mutex);
+    }
+
+    pthread_mutex_unlock(&sistema->banda.mutex_global[0]);
+}
+
+void imprimir_resumen_reservas(void) {
+    if (!sistema->config.reservas) return;
+
+    pthread_mutex_lock(&sistema->stats.mutex);
+    int devueltas = sistema->stats.piezas_devueltas;
+    pthread_mutex_unlock(&sistema->stats.mutex);
+
+    pthread_mutex_lock(&mutex_reservas);
+    long pendientes = reservas_hechas - reservas_cumplidas - reservas_vencidas - reservas_anuladas;
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    RESERVAS DE PIEZAS                             ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Reservas hechas:      %6ld   Sin celda destino:   %6ld        ║\n",
+           reservas_hechas, piezas_sin_destino);
+    printf("║ Cumplidas:            %6ld   Vencidas:            %6ld        ║\n",
+           reservas_cumplidas, reservas_vencidas);
+    printf("║ Pendientes al final:  %6ld   Piezas devueltas:    %6d        ║\n",
+           pendientes, devueltas);
+    if (sistema->config.asignacion_optima) {
+        long iguales = ticks_optimizados - ticks_mejor_que_voraz - ticks_peor_que_voraz;
+        printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+        printf("║ Asignación óptima: %7ld ticks (celdas cubiertas vs. voraz)     ║\n",
+               ticks_optimizados);
+        printf("║ Mejor:    %7ld (%5.1f%%)   Igual: %7ld   Peor: %7ld       ║\n",
+               ticks_mejor_que_voraz,
+               ticks_optimizados > 0 ? 100.0 * ticks_mejor_que_voraz / ticks_optimizados : 0.0,
+               iguales, ticks_peor_que_voraz);
+        printf("║ Piezas reasignadas:   %6ld   Reservas anuladas:   %6ld        ║\n",
+               piezas_reasignadas, reservas_anuladas);
+    }
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+    pthread_mutex_unlock(&mutex_reservas);
+}
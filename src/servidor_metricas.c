@@ -0,0 +1,303 @@
+/**
+ * LEGO Master - Implementación del Servidor de Métricas
+ */
+
+#include "servidor_metricas.h"
+#include "linea_tiempo.h"
+#include "temporizador.h"
+#include "control_velocidad.h"
+#include "common.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+#define ESPERA_POLL_MS      200     // Cada cuánto revisa si debe terminar
+#define ESPERA_PEDIDO_MS    100     // Tiempo máximo para leer el pedido
+
+ContadoresVivos vivos;
+
+static pthread_t hilo_servidor;
+static atomic_bool servidor_activo = false;
+static int socket_escucha = -1;
+static char ruta_socket[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static uint64_t inicio_servidor_us = 0;
+
+// Instantánea leída de los contadores
+typedef struct {
+    double uptime_s;
+    long piezas_dispensadas, piezas_tacho, recirculaciones, sets_ok, sets_fail;
+    int piezas_en_banda, posiciones_ocupadas, longitud_banda, velocidad_banda;
+    long ticks_banda;
+    long long retraso_total_us, retraso_max_us;
+    int cola_operador, cola_alimentador;
+    int num_celdas;
+    int piezas_caja[MAX_CELDAS], necesarias_caja[MAX_CELDAS];
+    int buffer_celda[MAX_CELDAS], estado_celda[MAX_CELDAS];
+    int estado_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+    long piezas_brazo[MAX_CELDAS][BRAZOS_POR_CELDA];
+} InstantaneaVivos;
+
+void vivo_registrar_tick(int64_t retraso_us) {
+    if (retraso_us < 0) retraso_us = 0;
+    atomic_fetch_add_explicit(&vivos.ticks_banda, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&vivos.retraso_tick_total_us, retraso_us, memory_order_relaxed);
+    long long max = atomic_load_explicit(&vivos.retraso_tick_max_us, memory_order_relaxed);
+    while (retraso_us > max &&
+           !atomic_compare_exchange_weak_explicit(&vivos.retraso_tick_max_us, &max, retraso_us,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void tomar_instantanea(InstantaneaVivos *s) {
+    memset(s, 0, sizeof(*s));
+    s->uptime_s = (tiempo_monotonico_us() - inicio_servidor_us) / 1e6;
+    s->piezas_dispensadas = atomic_load_explicit(&vivos.piezas_dispensadas, memory_order_relaxed);
+    s->piezas_tacho = atomic_load_explicit(&vivos.piezas_tacho, memory_order_relaxed);
+    s->recirculaciones = atomic_load_explicit(&vivos.recirculaciones, memory_order_relaxed);
+    s->sets_ok = atomic_load_explicit(&vivos.sets_ok, memory_order_relaxed);
+    s->sets_fail = atomic_load_explicit(&vivos.sets_fail, memory_order_relaxed);
+    s->piezas_en_banda = atomic_load_explicit(&vivos.piezas_en_banda, memory_order_relaxed);
+    s->posiciones_ocupadas = atomic_load_explicit(&vivos.posiciones_ocupadas, memory_order_relaxed);
+    s->longitud_banda = sistema->banda.longitud;
+    s->velocidad_banda = leer_velocidad_banda();
+    s->ticks_banda = atomic_load_explicit(&vivos.ticks_banda, memory_order_relaxed);
+    s->retraso_total_us = atomic_load_explicit(&vivos.retraso_tick_total_us, memory_order_relaxed);
+    s->retraso_max_us = atomic_load_explicit(&vivos.retraso_tick_max_us, memory_order_relaxed);
+    s->cola_operador = atomic_load_explicit(&vivos.cola_operador, memory_order_relaxed);
+    s->cola_alimentador = atomic_load_explicit(&vivos.cola_alimentador, memory_order_relaxed);
+
+    // La configuración no cambia una vez iniciados los hilos
+    s->num_celdas = sistema->config.num_celdas;
+    for (int c = 0; c < s->num_celdas; c++) {
+        s->piezas_caja[c] = atomic_load_explicit(&vivos.piezas_caja[c], memory_order_relaxed);
+        s->necesarias_caja[c] = atomic_load_explicit(&vivos.necesarias_caja[c], memory_order_relaxed);
+        s->buffer_celda[c] = atomic_load_explicit(&vivos.buffer_celda[c], memory_order_relaxed);
+        s->estado_celda[c] = atomic_load_explicit(&vivos.estado_celda[c], memory_order_relaxed);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            s->estado_brazo[c][b] = atomic_load_explicit(&vivos.estado_brazo[c][b], memory_order_relaxed);
+            s->piezas_brazo[c][b] = atomic_load_explicit(&vivos.piezas_brazo[c][b], memory_order_relaxed);
+        }
+    }
+}
+
+static void metrica(FILE *f, const char *nombre, const char *tipo, const char *ayuda) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", nombre, ayuda, nombre, tipo);
+}
+
+static void escribir_prometheus(FILE *f, const InstantaneaVivos *s) {
+    static const EstadoCelda estados_celda[] = { CELDA_ACTIVA, CELDA_ESPERANDO_OP, CELDA_INACTIVA };
+    static const EstadoBrazo estados_brazo[] = { BRAZO_IDLE, BRAZO_RETIRANDO, BRAZO_COLOCANDO, BRAZO_SUSPENDIDO };
+
+    metrica(f, "lego_uptime_segundos", "gauge", "Segundos desde que se inició el servidor");
+    fprintf(f, "lego_uptime_segundos %.3f\n", s->uptime_s);
+    metrica(f, "lego_piezas_dispensadas_total", "counter", "Piezas dispensadas a la banda");
+    fprintf(f, "lego_piezas_dispensadas_total %ld\n", s->piezas_dispensadas);
+    metrica(f, "lego_piezas_tacho_total", "counter", "Piezas caídas al tacho");
+    fprintf(f, "lego_piezas_tacho_total %ld\n", s->piezas_tacho);
+    metrica(f, "lego_recirculaciones_total", "counter", "Piezas que volvieron al inicio de la banda circular");
+    fprintf(f, "lego_recirculaciones_total %ld\n", s->recirculaciones);
+    metrica(f, "lego_sets_total", "counter", "SETs revisados por el operador");
+    fprintf(f, "lego_sets_total{resultado=\"ok\"} %ld\n", s->sets_ok);
+    fprintf(f, "lego_sets_total{resultado=\"fail\"} %ld\n", s->sets_fail);
+
+    metrica(f, "lego_banda_piezas", "gauge", "Piezas sobre la banda");
+    fprintf(f, "lego_banda_piezas %d\n", s->piezas_en_banda);
+    metrica(f, "lego_banda_ocupacion", "gauge", "Fracción de posiciones de la banda con piezas");
+    fprintf(f, "lego_banda_ocupacion %.4f\n",
+            s->longitud_banda > 0 ? (double)s->posiciones_ocupadas / s->longitud_banda : 0.0);
+    metrica(f, "lego_banda_velocidad", "gauge", "Pasos por segundo de la banda");
+    fprintf(f, "lego_banda_velocidad %d\n", s->velocidad_banda);
+    metrica(f, "lego_banda_ticks_total", "counter", "Ticks de la banda");
+    fprintf(f, "lego_banda_ticks_total %ld\n", s->ticks_banda);
+    metrica(f, "lego_banda_retraso_tick_us_total", "counter", "Retraso acumulado de los ticks sobre el periodo nominal");
+    fprintf(f, "lego_banda_retraso_tick_us_total %lld\n", s->retraso_total_us);
+    metrica(f, "lego_banda_retraso_tick_us_max", "gauge", "Mayor retraso de un tick");
+    fprintf(f, "lego_banda_retraso_tick_us_max %lld\n", s->retraso_max_us);
+
+    metrica(f, "lego_operador_cola", "gauge", "Celdas esperando al operador");
+    fprintf(f, "lego_operador_cola %d\n", s->cola_operador);
+    metrica(f, "lego_alimentador_cola", "gauge", "Piezas retenidas por contrapresión antes de la banda");
+    fprintf(f, "lego_alimentador_cola %d\n", s->cola_alimentador);
+
+    metrica(f, "lego_caja_piezas", "gauge", "Piezas en la caja de cada celda");
+    for (int c = 0; c < s->num_celdas; c++) {
+        fprintf(f, "lego_caja_piezas{celda=\"%d\"} %d\n", c + 1, s->piezas_caja[c]);
+    }
+    metrica(f, "lego_caja_piezas_necesarias", "gauge", "Piezas de la receta en curso de la caja");
+    for (int c = 0; c < s->num_celdas; c++) {
+        fprintf(f, "lego_caja_piezas_necesarias{celda=\"%d\"} %d\n", c + 1, s->necesarias_caja[c]);
+    }
+    metrica(f, "lego_buffer_piezas", "gauge", "Piezas en el buffer de cada celda");
+    for (int c = 0; c < s->num_celdas; c++) {
+        fprintf(f, "lego_buffer_piezas{celda=\"%d\"} %d\n", c + 1, s->buffer_celda[c]);
+    }
+    metrica(f, "lego_celda_estado", "gauge", "Estado actual de cada celda (1 = en ese estado)");
+    for (int c = 0; c < s->num_celdas; c++) {
+        for (size_t e = 0; e < sizeof(estados_celda) / sizeof(estados_celda[0]); e++) {
+            fprintf(f, "lego_celda_estado{celda=\"%d\",estado=\"%s\"} %d\n", c + 1,
+                    nombre_estado_celda(estados_celda[e]), s->estado_celda[c] == (int)estados_celda[e]);
+        }
+    }
+    metrica(f, "lego_brazo_estado", "gauge", "Estado actual de cada brazo (1 = en ese estado)");
+    for (int c = 0; c < s->num_celdas; c++) {
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            for (size_t e = 0; e < sizeof(estados_brazo) / sizeof(estados_brazo[0]); e++) {
+                fprintf(f, "lego_brazo_estado{celda=\"%d\",brazo=\"%d\",estado=\"%s\"} %d\n",
+                        c + 1, b + 1, nombre_estado_brazo(estados_brazo[e]),
+                        s->estado_brazo[c][b] == (int)estados_brazo[e]);
+            }
+        }
+    }
+    metrica(f, "lego_brazo_piezas_total", "counter", "Piezas colocadas por cada brazo");
+    for (int c = 0; c < s->num_celdas; c++) {
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            fprintf(f, "lego_brazo_piezas_total{celda=\"%d\",brazo=\"%d\"} %ld\n",
+                    c + 1, b + 1, s->piezas_brazo[c][b]);
+        }
+    }
+}
+
+static void escribir_json(FILE *f, const InstantaneaVivos *s) {
+    fprintf(f, "{\"uptime_s\":%.3f,\"piezas_dispensadas\":%ld,\"piezas_tacho\":%ld,"
+               "\"recirculaciones\":%ld,\"sets_ok\":%ld,\"sets_fail\":%ld,\"operador_cola\":%d,"
+               "\"alimentador_cola\":%d,",
+            s->uptime_s, s->piezas_dispensadas, s->piezas_tacho, s->recirculaciones,
+            s->sets_ok, s->sets_fail, s->cola_operador, s->cola_alimentador);
+    fprintf(f, "\"banda\":{\"longitud\":%d,\"velocidad\":%d,\"piezas\":%d,\"posiciones_ocupadas\":%d,"
+               "\"ticks\":%ld,\"retraso_tick_us_total\":%lld,\"retraso_tick_us_max\":%lld},",
+            s->longitud_banda, s->velocidad_banda, s->piezas_en_banda, s->posiciones_ocupadas,
+            s->ticks_banda, s->retraso_total_us, s->retraso_max_us);
+    fprintf(f, "\"celdas\":[");
+    for (int c = 0; c < s->num_celdas; c++) {
+        fprintf(f, "%s{\"celda\":%d,\"estado\":\"%s\",\"caja\":%d,\"necesarias\":%d,"
+                   "\"buffer\":%d,\"brazos\":[",
+                c ? "," : "", c + 1, nombre_estado_celda((EstadoCelda)s->estado_celda[c]),
+                s->piezas_caja[c], s->necesarias_caja[c], s->buffer_celda[c]);
+        for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
+            fprintf(f, "%s{\"brazo\":%d,\"estado\":\"%s\",\"piezas\":%ld}",
+                    b ? "," : "", b + 1, nombre_estado_brazo((EstadoBrazo)s->estado_brazo[c][b]),
+                    s->piezas_brazo[c][b]);
+        }
+        fprintf(f, "]}");
+    }
+    fprintf(f, "]}\n");
+}
+
+static void escribir_todo(int fd, const char *datos, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, datos, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        datos += w;
+        n -= (size_t)w;
+    }
+}
+
+static void atender_cliente(int cliente) {
+    // El pedido es opcional: si el cliente no envía nada se responde Prometheus
+    char pedido[256] = "";
+    struct pollfd pfd = { .fd = cliente, .events = POLLIN };
+    if (poll(&pfd, 1, ESPERA_PEDIDO_MS) > 0) {
+        ssize_t n = read(cliente, pedido, sizeof(pedido) - 1);
+        pedido[n > 0 ? n : 0] = '\0';
+    }
+    bool http = strncmp(pedido, "GET ", 4) == 0;
+    bool json = strstr(pedido, "json") != NULL;
+
+    InstantaneaVivos s;
+    tomar_instantanea(&s);
+
+    char *cuerpo = NULL;
+    size_t largo = 0;
+    FILE *f = open_memstream(&cuerpo, &largo);
+    if (!f) return;
+    if (json) {
+        escribir_json(f, &s);
+    } else {
+        escribir_prometheus(f, &s);
+    }
+    fclose(f);
+
+    if (http) {
+        char encabezado[160];
+        int n = snprintf(encabezado, sizeof(encabezado),
+                         "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                         json ? "application/json" : "text/plain; version=0.0.4", largo);
+        escribir_todo(cliente, encabezado, (size_t)n);
+    }
+    escribir_todo(cliente, cuerpo, largo);
+    free(cuerpo);
+}
+
+static void* thread_servidor_metricas(void* arg) {
+    (void)arg;
+
+    struct pollfd pfd = { .fd = socket_escucha, .events = POLLIN };
+    while (atomic_load(&servidor_activo)) {
+        if (poll(&pfd, 1, ESPERA_POLL_MS) <= 0) continue;
+
+        int cliente = accept(socket_escucha, NULL, NULL);
+        if (cliente < 0) continue;
+        atender_cliente(cliente);
+        close(cliente);
+    }
+    return NULL;
+}
+
+bool iniciar_servidor_metricas(const char *ruta) {
+    struct sockaddr_un dir;
+    memset(&dir, 0, sizeof(dir));
+    dir.sun_family = AF_UNIX;
+    if (strlen(ruta) >= sizeof(dir.sun_path)) {
+        fprintf(stderr, "Error: ruta de socket demasiado larga: %s\n", ruta);
+        return false;
+    }
+    memcpy(dir.sun_path, ruta, strlen(ruta) + 1);
+    memcpy(ruta_socket, ruta, strlen(ruta) + 1);
+
+    socket_escucha = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_escucha < 0) {
+        perror("Error creando el socket de métricas");
+        return false;
+    }
+    unlink(ruta);  // Un socket viejo de una corrida anterior
+    if (bind(socket_escucha, (struct sockaddr*)&dir, sizeof(dir)) < 0 ||
+        listen(socket_escucha, 8) < 0) {
+        perror("Error publicando el socket de métricas");
+        close(socket_escucha);
+        socket_escucha = -1;
+        return false;
+    }
+
+    inicio_servidor_us = tiempo_monotonico_us();
+    atomic_store(&servidor_activo, true);
+    if (pthread_create(&hilo_servidor, NULL, thread_servidor_metricas, NULL) != 0) {
+        perror("Error creando hilo del servidor de métricas");
+        atomic_store(&servidor_activo, false);
+        close(socket_escucha);
+        unlink(ruta);
+        socket_escucha = -1;
+        return false;
+    }
+    printf("[MÉTRICAS] Sirviendo en %s\n", ruta);
+    return true;
+}
+
+void terminar_servidor_metricas(void) {
+    if (!atomic_exchange(&servidor_activo, false)) return;
+
+    pthread_join(hilo_servidor, NULL);
+    close(socket_escucha);
+    socket_escucha = -1;
+    unlink(ruta_socket);
+}
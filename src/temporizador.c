@@ -0,0 +1,230 @@
+/**
+ * LEGO Master - Implementación de la Rueda de Temporización
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "temporizador.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+// Entrada de la rueda
+typedef struct {
+    uint64_t vence_us;               // Instante absoluto de vencimiento
+    CallbackTemporizador cb;
+    void *arg;
+    int siguiente;                   // Siguiente entrada en la ranura (-1 = fin)
+    int generacion;                  // Invalida identificadores reutilizados
+    bool en_uso;
+} EntradaTemporizador;
+
+static EntradaTemporizador entradas[MAX_TEMPORIZADORES];
+static int ranuras[TW_RANURAS];      // Cabeza de la lista de cada ranura
+static int libres = -1;              // Lista de entradas libres
+static int pendientes = 0;
+
+static pthread_t hilo_temporizador;
+static pthread_mutex_t mutex_rueda = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_rueda;
+static bool rueda_activa = false;
+
+uint64_t tiempo_monotonico_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static inline int ranura_de(uint64_t instante_us) {
+    return (int)((instante_us / TW_RESOLUCION_US) % TW_RANURAS);
+}
+
+// Quita una entrada de su ranura (llamador tiene mutex_rueda)
+static void desenlazar(int idx) {
+    int r = ranura_de(entradas[idx].vence_us);
+    int *enlace = &ranuras[r];
+    while (*enlace != -1 && *enlace != idx) {
+        enlace = &entradas[*enlace].siguiente;
+    }
+    if (*enlace == idx) {
+        *enlace = entradas[idx].siguiente;
+    }
+    entradas[idx].en_uso = false;
+    entradas[idx].generacion = (entradas[idx].generacion + 1) % (INT32_MAX / MAX_TEMPORIZADORES);
+    entradas[idx].siguiente = libres;
+    libres = idx;
+    pendientes--;
+}
+
+// Busca el vencimiento más cercano recorriendo a lo sumo una vuelta de la rueda
+static uint64_t proximo_vencimiento(uint64_t ahora_us) {
+    uint64_t minimo = UINT64_MAX;
+    uint64_t tick = ahora_us / TW_RESOLUCION_US;
+
+    for (int i = 0; i < TW_RANURAS && pendientes > 0; i++) {
+        int r = (int)((tick + i) % TW_RANURAS);
+        for (int e = ranuras[r]; e != -1; e = entradas[e].siguiente) {
+            if (entradas[e].vence_us < minimo) {
+                minimo = entradas[e].vence_us;
+            }
+        }
+        // Una entrada de esta vuelta ya es la más próxima posible
+        if (minimo != UINT64_MAX && minimo / TW_RESOLUCION_US <= tick + i) {
+            break;
+        }
+    }
+    return minimo;
+}
+
+static void* thread_temporizador(void* arg) {
+    (void)arg;
+
+    CallbackTemporizador cbs[MAX_TEMPORIZADORES];
+    void *args[MAX_TEMPORIZADORES];
+
+    pthread_mutex_lock(&mutex_rueda);
+    uint64_t tick_procesado = tiempo_monotonico_us() / TW_RESOLUCION_US;
+
+    while (rueda_activa) {
+        uint64_t ahora = tiempo_monotonico_us();
+        uint64_t tick_ahora = ahora / TW_RESOLUCION_US;
+        int vencidos = 0;
+
+        // Recorrer las ranuras desde el último tick procesado hasta ahora
+        if (tick_ahora - tick_procesado >= TW_RANURAS) {
+            tick_procesado = tick_ahora - TW_RANURAS + 1;
+        }
+        for (uint64_t t = tick_procesado; t <= tick_ahora; t++) {
+            int e = ranuras[t % TW_RANURAS];
+            while (e != -1) {
+                int sig = entradas[e].siguiente;
+                if (entradas[e].vence_us <= ahora) {
+                    cbs[vencidos] = entradas[e].cb;
+                    args[vencidos] = entradas[e].arg;
+                    vencidos++;
+                    desenlazar(e);
+                }
+                e = sig;
+            }
+        }
+        tick_procesado = tick_ahora;
+
+        if (vencidos > 0) {
+            // Ejecutar callbacks sin el mutex (pueden reprogramar)
+            pthread_mutex_unlock(&mutex_rueda);
+            for (int i = 0; i < vencidos; i++) {
+                cbs[i](args[i]);
+            }
+            pthread_mutex_lock(&mutex_rueda);
+            continue;
+        }
+
+        uint64_t proximo = proximo_vencimiento(ahora);
+        if (proximo == UINT64_MAX) {
+            // Rueda vacía: esperar a que se programe algo
+            pthread_cond_wait(&cond_rueda, &mutex_rueda);
+        } else {
+            // Si ninguna entrada vence en esta vuelta, despertar al dar la vuelta
+            uint64_t limite = ahora + (uint64_t)TW_RANURAS * TW_RESOLUCION_US;
+            uint64_t despertar = proximo < limite ? proximo : limite;
+            struct timespec ts;
+            ts.tv_sec = (time_t)(despertar / 1000000ULL);
+            ts.tv_nsec = (long)(despertar % 1000000ULL) * 1000L;
+            pthread_cond_timedwait(&cond_rueda, &mutex_rueda, &ts);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_rueda);
+    return NULL;
+}
+
+void iniciar_temporizador(void) {
+    pthread_mutex_lock(&mutex_rueda);
+    if (rueda_activa) {
+        pthread_mutex_unlock(&mutex_rueda);
+        return;
+    }
+
+    for (int r = 0; r < TW_RANURAS; r++) {
+        ranuras[r] = -1;
+    }
+    for (int i = 0; i < MAX_TEMPORIZADORES; i++) {
+        entradas[i].en_uso = false;
+        entradas[i].generacion = 0;
+        entradas[i].siguiente = (i + 1 < MAX_TEMPORIZADORES) ? i + 1 : -1;
+    }
+    libres = 0;
+    pendientes = 0;
+
+    // La condición usa el reloj monotónico para los timedwait
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond_rueda, &attr);
+    pthread_condattr_destroy(&attr);
+
+    rueda_activa = true;
+    if (pthread_create(&hilo_temporizador, NULL, thread_temporizador, NULL) != 0) {
+        perror("Error creando hilo del temporizador");
+        rueda_activa = false;
+    }
+    pthread_mutex_unlock(&mutex_rueda);
+}
+
+void terminar_temporizador(void) {
+    pthread_mutex_lock(&mutex_rueda);
+    if (!rueda_activa) {
+        pthread_mutex_unlock(&mutex_rueda);
+        return;
+    }
+    rueda_activa = false;
+    pthread_cond_signal(&cond_rueda);
+    pthread_mutex_unlock(&mutex_rueda);
+
+    pthread_join(hilo_temporizador, NULL);
+    pthread_cond_destroy(&cond_rueda);
+}
+
+int programar_temporizador(uint64_t retardo_us, CallbackTemporizador cb, void *arg) {
+    pthread_mutex_lock(&mutex_rueda);
+    if (!rueda_activa || libres == -1) {
+        pthread_mutex_unlock(&mutex_rueda);
+        return -1;
+    }
+
+    int idx = libres;
+    libres = entradas[idx].siguiente;
+
+    entradas[idx].vence_us = tiempo_monotonico_us() + retardo_us;
+    entradas[idx].cb = cb;
+    entradas[idx].arg = arg;
+    entradas[idx].en_uso = true;
+
+    int r = ranura_de(entradas[idx].vence_us);
+    entradas[idx].siguiente = ranuras[r];
+    ranuras[r] = idx;
+    pendientes++;
+
+    // El nuevo vencimiento puede ser anterior al que espera el hilo
+    pthread_cond_signal(&cond_rueda);
+
+    int id = entradas[idx].generacion * MAX_TEMPORIZADORES + idx;
+    pthread_mutex_unlock(&mutex_rueda);
+    return id;
+}
+
+bool cancelar_temporizador(int id) {
+    if (id < 0) return false;
+
+    int idx = id % MAX_TEMPORIZADORES;
+    int generacion = id / MAX_TEMPORIZADORES;
+    bool cancelado = false;
+
+    pthread_mutex_lock(&mutex_rueda);
+    if (entradas[idx].en_uso && entradas[idx].generacion == generacion) {
+        desenlazar(idx);
+        cancelado = true;
+    }
+    pthread_mutex_unlock(&mutex_rueda);
+    return cancelado;
+}
@@ -0,0 +1,327 @@
+/**
+ * LEGO Master - Implementación de la Topología de la Planta
+ */
+
+#include "topologia.h"
+#include "common.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+#define MAX_TOKENS_LINEA    8
+
+// Enlace leído del archivo; los destinos se resuelven al final (pueden
+// nombrar bandas declaradas más abajo)
+typedef struct {
+    char origen[MAX_NOMBRE_BANDA];
+    char destinos[128];
+    int linea;
+} EnlaceLeido;
+
+static bool alcanza[MAX_BANDAS][MAX_BANDAS];
+static atomic_int contadores[MAX_BANDAS][NUM_CONTADORES_BANDA];
+
+static bool leer_entero(const char *texto, int *valor) {
+    char *fin;
+    errno = 0;
+    long v = strtol(texto, &fin, 10);
+    if (fin == texto || *fin != '\0' || errno != 0) return false;
+    *valor = (int)v;
+    return true;
+}
+
+static bool nombre_valido(const char *nombre) {
+    if (strlen(nombre) >= MAX_NOMBRE_BANDA) return false;
+    for (const char *c = nombre; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_' && *c != '-') return false;
+    }
+    return true;
+}
+
+static int buscar_banda(const ConfiguracionSistema *config, const char *nombre) {
+    for (int b = 0; b < config->num_bandas; b++) {
+        if (strcmp(config->bandas[b].nombre, nombre) == 0) return b;
+    }
+    return -1;
+}
+
+// Línea "banda nombre longitud dispensadores celdas"; NULL si es válida
+static const char *leer_banda(char **tokens, int num_tokens, ConfiguracionSistema *config) {
+    if (num_tokens != 5) return "se esperaba 'banda nombre longitud dispensadores celdas'";
+    if (config->num_bandas == MAX_BANDAS) return "demasiadas bandas";
+    if (!nombre_valido(tokens[1])) {
+        return "el nombre de la banda admite hasta 15 letras, dígitos, '_' o '-'";
+    }
+    if (buscar_banda(config, tokens[1]) >= 0) return "banda repetida";
+
+    DescripcionBanda *banda = &config->bandas[config->num_bandas];
+    memset(banda, 0, sizeof(*banda));
+    snprintf(banda->nombre, sizeof(banda->nombre), "%s", tokens[1]);
+    banda->inicio = config->longitud_banda;
+    if (!leer_entero(tokens[2], &banda->longitud) || banda->longitud < 2) {
+        return "la longitud debe ser un entero >= 2";
+    }
+    if (banda->inicio + banda->longitud > MAX_POSICIONES) {
+        return "las bandas superan el máximo de posiciones de la planta";
+    }
+    if (!leer_entero(tokens[3], &banda->dispensadores) ||
+        banda->dispensadores < 0 || banda->dispensadores > MAX_PIEZAS_POS) {
+        return "los dispensadores deben estar entre 0 y el cupo por posición";
+    }
+
+    if (strcmp(tokens[4], "-") != 0) {
+        int anterior = -1;
+        char *resto = NULL;
+        for (char *celda = strtok_r(tokens[4], ",", &resto); celda; celda = strtok_r(NULL, ",", &resto)) {
+            int posicion;
+            // La última posición de la banda queda para las devoluciones
+            if (!leer_entero(celda, &posicion) || posicion < 0 || posicion >= banda->longitud - 1) {
+                return "las celdas deben estar dentro de la banda, antes de la última posición";
+            }
+            if (posicion <= anterior) return "las celdas deben estar en posiciones crecientes";
+            if (config->num_celdas == MAX_CELDAS) return "demasiadas celdas";
+            config->posiciones_celdas[config->num_celdas++] = banda->inicio + posicion;
+            anterior = posicion;
+        }
+    }
+
+    config->longitud_banda += banda->longitud;
+    config->num_bandas++;
+    return NULL;
+}
+
+// Resuelve los enlaces, calcula el cierre de alcanzabilidad y valida el grafo
+static const char *resolver_enlaces(EnlaceLeido *enlaces, int num_enlaces,
+                                    ConfiguracionSistema *config, int *linea_error) {
+    memset(alcanza, 0, sizeof(alcanza));
+    for (int e = 0; e < num_enlaces; e++) {
+        *linea_error = enlaces[e].linea;
+        int origen = buscar_banda(config, enlaces[e].origen);
+        if (origen < 0) return "el origen del enlace no es una banda";
+        DescripcionBanda *banda = &config->bandas[origen];
+        if (banda->num_destinos > 0) return "la banda ya tiene un enlace";
+
+        char *resto = NULL;
+        for (char *nombre = strtok_r(enlaces[e].destinos, ",", &resto); nombre;
+             nombre = strtok_r(NULL, ",", &resto)) {
+            int destino = buscar_banda(config, nombre);
+            if (destino < 0) return "un destino del enlace no es una banda";
+            if (destino == origen || alcanza[origen][destino]) {
+                return "los destinos deben ser bandas distintas del origen y entre sí";
+            }
+            alcanza[origen][destino] = true;
+            banda->destinos[banda->num_destinos++] = destino;
+        }
+    }
+    *linea_error = 0;
+
+    // Cierre transitivo (Floyd-Warshall sobre a lo sumo MAX_BANDAS nodos)
+    for (int b = 0; b < config->num_bandas; b++) alcanza[b][b] = true;
+    for (int k = 0; k < config->num_bandas; k++) {
+        for (int i = 0; i < config->num_bandas; i++) {
+            for (int j = 0; j < config->num_bandas; j++) {
+                if (alcanza[i][k] && alcanza[k][j]) alcanza[i][j] = true;
+            }
+        }
+    }
+    for (int i = 0; i < config->num_bandas; i++) {
+        for (int j = 0; j < config->num_bandas; j++) {
+            if (i != j && alcanza[i][j] && alcanza[j][i]) return "los enlaces forman un ciclo";
+        }
+    }
+
+    // Toda banda debe recibir piezas de algún dispensador
+    for (int j = 0; j < config->num_bandas; j++) {
+        bool alimentada = false;
+        for (int i = 0; i < config->num_bandas && !alimentada; i++) {
+            alimentada = config->bandas[i].dispensadores > 0 && alcanza[i][j];
+        }
+        if (!alimentada) return "hay una banda a la que no llega ninguna pieza";
+    }
+    return NULL;
+}
+
+bool cargar_topologia(const char *archivo, ConfiguracionSistema *config) {
+    FILE *f = fopen(archivo, "r");
+    if (!f) {
+        fprintf(stderr, "Error: no se pudo abrir %s: %s\n", archivo, strerror(errno));
+        return false;
+    }
+
+    EnlaceLeido enlaces[MAX_BANDAS];
+    int num_enlaces = 0;
+    config->num_bandas = 0;
+    config->num_celdas = 0;
+    config->longitud_banda = 0;
+
+    char linea[512];
+    int num_linea = 0;
+    const char *error = NULL;
+    while (!error && fgets(linea, sizeof(linea), f)) {
+        num_linea++;
+        char *comentario = strchr(linea, '#');
+        if (comentario) *comentario = '\0';
+
+        char *tokens[MAX_TOKENS_LINEA];
+        int num_tokens = 0;
+        char *resto = NULL;
+        for (char *t = strtok_r(linea, " \t\r\n", &resto); t && num_tokens < MAX_TOKENS_LINEA;
+             t = strtok_r(NULL, " \t\r\n", &resto)) {
+            tokens[num_tokens++] = t;
+        }
+        if (num_tokens == 0) continue;   // Línea vacía o solo comentario
+
+        if (strcmp(tokens[0], "banda") == 0) {
+            error = leer_banda(tokens, num_tokens, config);
+        } else if (strcmp(tokens[0], "enlace") == 0) {
+            if (num_tokens != 3) {
+                error = "se esperaba 'enlace origen destino[,destino...]'";
+            } else if (num_enlaces == MAX_BANDAS || strlen(tokens[1]) >= MAX_NOMBRE_BANDA ||
+                       strlen(tokens[2]) >= sizeof(enlaces[0].destinos)) {
+                error = "enlace demasiado largo o demasiados enlaces";
+            } else {
+                snprintf(enlaces[num_enlaces].origen, MAX_NOMBRE_BANDA, "%s", tokens[1]);
+                snprintf(enlaces[num_enlaces].destinos, sizeof(enlaces[0].destinos), "%s", tokens[2]);
+                enlaces[num_enlaces].linea = num_linea;
+                num_enlaces++;
+            }
+        } else {
+            error = "cada línea debe empezar con 'banda' o 'enlace'";
+        }
+    }
+    fclose(f);
+    if (error) {
+        fprintf(stderr, "Error: %s:%d: %s\n", archivo, num_linea, error);
+        return false;
+    }
+
+    if (config->num_bandas == 0 || config->num_celdas == 0) {
+        fprintf(stderr, "Error: %s debe describir al menos una banda y una celda\n", archivo);
+        return false;
+    }
+    int linea_error = 0;
+    error = resolver_enlaces(enlaces, num_enlaces, config, &linea_error);
+    if (error) {
+        if (linea_error > 0) {
+            fprintf(stderr, "Error: %s:%d: %s\n", archivo, linea_error, error);
+        } else {
+            fprintf(stderr, "Error: %s: %s\n", archivo, error);
+        }
+        return false;
+    }
+
+    // Cupo por posición de reingresos y devoluciones: el de la banda más alimentada
+    config->num_dispensadores = 1;
+    for (int b = 0; b < config->num_bandas; b++) {
+        if (config->bandas[b].dispensadores > config->num_dispensadores) {
+            config->num_dispensadores = config->bandas[b].dispensadores;
+        }
+    }
+    config->modo_colocacion = COLOCACION_EXPLICITA;
+    return true;
+}
+
+void topologia_unica(ConfiguracionSistema *config) {
+    DescripcionBanda *banda = &config->bandas[0];
+    memset(banda, 0, sizeof(*banda));
+    snprintf(banda->nombre, sizeof(banda->nombre), "principal");
+    banda->inicio = 0;
+    banda->longitud = config->longitud_banda;
+    banda->dispensadores = config->num_dispensadores;
+    config->num_bandas = 1;
+    memset(alcanza, 0, sizeof(alcanza));
+    alcanza[0][0] = true;
+}
+
+int banda_de_posicion(int posicion) {
+    const ConfiguracionSistema *config = &sistema->config;
+    for (int b = config->num_bandas - 1; b > 0; b--) {
+        if (posicion >= config->bandas[b].inicio) return b;
+    }
+    return 0;
+}
+
+bool banda_alcanza(int origen, int destino) {
+    return alcanza[origen][destino];
+}
+
+bool celda_al_final(int celda_id) {
+    int banda = sistema->celdas[celda_id].banda;
+    if (sistema->config.bandas[banda].num_destinos > 0) return false;
+    return celda_id == sistema->config.num_celdas - 1 || sistema->celdas[celda_id + 1].banda != banda;
+}
+
+void contar_banda(int banda, ContadorBanda contador, int n) {
+    if (n != 0) atomic_fetch_add_explicit(&contadores[banda][contador], n, memory_order_relaxed);
+}
+
+static int leer_contador(int banda, ContadorBanda contador) {
+    return atomic_load_explicit(&contadores[banda][contador], memory_order_relaxed);
+}
+
+// Celdas de la banda "3-5" (numeradas desde 1) o "-" si no tiene
+static void describir_celdas(int banda, char *texto, size_t ancho) {
+    int primera = -1, ultima = -1;
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        if (sistema->celdas[c].banda != banda) continue;
+        if (primera < 0) primera = c;
+        ultima = c;
+    }
+    if (primera < 0) {
+        snprintf(texto, ancho, "-");
+    } else if (primera == ultima) {
+        snprintf(texto, ancho, "%d", primera + 1);
+    } else {
+        snprintf(texto, ancho, "%d-%d", primera + 1, ultima + 1);
+    }
+}
+
+void imprimir_resumen_bandas(void) {
+    if (!sistema->config.topologia) return;
+
+    printf("\n");
+    printf("╔═══════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    BANDAS DE LA PLANTA                            ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Banda         Long Disp Celdas Dispens. Recibidas Enviadas  Tacho ║\n");
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        const DescripcionBanda *banda = &sistema->config.bandas[b];
+        char celdas[24];             // "%d-%d" en el peor caso
+        describir_celdas(b, celdas, sizeof(celdas));
+        printf("║ %-13s %4d %4d %-6s %8d %9d %8d %6d ║\n",
+               banda->nombre, banda->longitud, banda->dispensadores, celdas,
+               leer_contador(b, CONTADOR_DISPENSADAS), leer_contador(b, CONTADOR_RECIBIDAS),
+               leer_contador(b, CONTADOR_ENVIADAS), leer_contador(b, CONTADOR_TACHO));
+    }
+    printf("╚═══════════════════════════════════════════════════════════════════╝\n");
+}
+
+void escribir_bandas_json(FILE *f) {
+    fprintf(f, "  \"bandas\": [");
+    for (int b = 0; b < sistema->config.num_bandas; b++) {
+        const DescripcionBanda *banda = &sistema->config.bandas[b];
+        fprintf(f, "%s\n    {\"banda\": \"%s\", \"inicio\": %d, \"longitud\": %d, \"dispensadores\": %d, "
+                   "\"destinos\": [",
+                b ? "," : "", banda->nombre, banda->inicio, banda->longitud, banda->dispensadores);
+        for (int d = 0; d < banda->num_destinos; d++) {
+            fprintf(f, "%s\"%s\"", d ? ", " : "", sistema->config.bandas[banda->destinos[d]].nombre);
+        }
+        fprintf(f, "], \"celdas\": [");
+        bool primera = true;
+        for (int c = 0; c < sistema->config.num_celdas; c++) {
+            if (sistema->celdas[c].banda != b) continue;
+            fprintf(f, "%s%d", primera ? "" : ", ", c + 1);
+            primera = false;
+        }
+        fprintf(f, "], \"dispensadas\": %d, \"recibidas\": %d, \"enviadas\": %d, \"tacho\": %d}",
+                leer_contador(b, CONTADOR_DISPENSADAS), leer_contador(b, CONTADOR_RECIBIDAS),
+                leer_contador(b, CONTADOR_ENVIADAS), leer_contador(b, CONTADOR_TACHO));
+    }
+    fprintf(f, "\n  ]");
+}
@@ -0,0 +1,230 @@
+/**
+ * LEGO Master - Implementación de las Trazas de Piezas
+ */
+
+#include "traza.h"
+#include "temporizador.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Bloque de registros de un hilo
+typedef struct BloqueTraza {
+    RegistroTraza registros[TRAZA_REGISTROS_BLOQUE];
+    int usados;
+    struct BloqueTraza *siguiente;   // Lista global de bloques
+} BloqueTraza;
+
+bool traza_piezas_activa = false;
+
+static __thread BloqueTraza *bloque_hilo = NULL;
+static BloqueTraza *bloques = NULL;
+static pthread_mutex_t mutex_bloques = PTHREAD_MUTEX_INITIALIZER;
+
+void iniciar_traza_piezas(void) {
+    traza_piezas_activa = true;
+}
+
+// Solo se toma el mutex al estrenar un bloque
+static BloqueTraza* nuevo_bloque(void) {
+    BloqueTraza *bloque = malloc(sizeof(BloqueTraza));
+    if (!bloque) return NULL;
+    bloque->usados = 0;
+    pthread_mutex_lock(&mutex_bloques);
+    bloque->siguiente = bloques;
+    bloques = bloque;
+    pthread_mutex_unlock(&mutex_bloques);
+    return bloque;
+}
+
+void registrar_evento_pieza(EventoPieza evento, const Pieza *pieza, int celda, int brazo) {
+    if (bloque_hilo == NULL || bloque_hilo->usados == TRAZA_REGISTROS_BLOQUE) {
+        bloque_hilo = nuevo_bloque();
+        if (!bloque_hilo) return;
+    }
+    RegistroTraza *r = &bloque_hilo->registros[bloque_hilo->usados++];
+    r->instante_us = tiempo_monotonico_us();
+    r->dispensada_us = pieza->dispensada_us;
+    r->id = pieza->id_unico;
+    r->evento = (uint8_t)evento;
+    r->tipo = (int8_t)pieza->tipo;
+    r->celda = (int8_t)celda;
+    r->brazo = (int8_t)brazo;
+}
+
+void liberar_traza_piezas(void) {
+    pthread_mutex_lock(&mutex_bloques);
+    while (bloques) {
+        BloqueTraza *sig = bloques->siguiente;
+        free(bloques);
+        bloques = sig;
+    }
+    pthread_mutex_unlock(&mutex_bloques);
+    traza_piezas_activa = false;
+}
+
+// ============================================================================
+// ANÁLISIS DE LATENCIAS
+// ============================================================================
+
+// Tramos medidos por pieza (en µs, 0 = no aplica)
+typedef struct {
+    int tipo;
+    int celda;
+    uint64_t viaje;                  // Dispensada -> primera retirada
+    uint64_t buffer;                 // En buffer -> en caja
+    uint64_t revision;               // En caja -> confirmada
+    uint64_t total;                  // Dispensada -> confirmada
+} LatenciaPieza;
+
+static int comparar_registros(const void *a, const void *b) {
+    const RegistroTraza *x = a, *y = b;
+    if (x->id != y->id) return (x->id > y->id) - (x->id < y->id);
+    return (x->instante_us > y->instante_us) - (x->instante_us < y->instante_us);
+}
+
+static int comparar_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Percentil p (0-100) de valores ya ordenados, en ms. Rango más cercano:
+// el menor valor con al menos p% de las muestras a su izquierda o en él,
+// de modo que con pocas muestras p99 es el máximo y no lo subestima
+static double percentil_ms(const uint64_t *v, int n, int p) {
+    if (n == 0) return 0.0;
+    long rango = ((long)n * p + 99) / 100;    // ceil(p/100 * n)
+    if (rango < 1) rango = 1;
+    if (rango > n) rango = n;
+    return v[rango - 1] / 1000.0;
+}
+
+// Imprime una fila con p50/p95/p99/máx del tramo elegido entre las piezas filtradas
+static void imprimir_fila(const char *etiqueta, LatenciaPieza *lat, int n,
+                          int tipo, int celda, uint64_t *tmp) {
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        if (lat[i].total == 0) continue;
+        if (tipo > 0 && lat[i].tipo != tipo) continue;
+        if (celda >= 0 && lat[i].celda != celda) continue;
+        tmp[k++] = lat[i].total;
+    }
+    if (k == 0) return;
+    qsort(tmp, (size_t)k, sizeof(uint64_t), comparar_u64);
+    
+    // Medianas de los tramos para ubicar de dónde viene la latencia
+    uint64_t *tramo = tmp + k;
+    double med[3];
+    for (int t = 0; t < 3; t++) {
+        int m = 0;
+        for (int i = 0; i < n; i++) {
+            if (lat[i].total == 0) continue;
+            if (tipo > 0 && lat[i].tipo != tipo) continue;
+            if (celda >= 0 && lat[i].celda != celda) continue;
+            uint64_t v = (t == 0) ? lat[i].viaje : (t == 1) ? lat[i].buffer : lat[i].revision;
+            tramo[m++] = v;
+        }
+        qsort(tramo, (size_t)m, sizeof(uint64_t), comparar_u64);
+        med[t] = percentil_ms(tramo, m, 50);
+    }
+    
+    printf("║ %-9s %5d %7.0f %7.0f %7.0f %7.0f │ %6.0f %6.0f %6.0f ║\n",
+           etiqueta, k, percentil_ms(tmp, k, 50), percentil_ms(tmp, k, 95),
+           percentil_ms(tmp, k, 99), percentil_ms(tmp, k, 100), med[0], med[1], med[2]);
+}
+
+void imprimir_latencias_piezas(void) {
+    if (!traza_piezas_activa) return;
+    
+    // Juntar los registros de todos los hilos
+    size_t total = 0;
+    for (BloqueTraza *b = bloques; b; b = b->siguiente) total += (size_t)b->usados;
+    if (total == 0) return;
+    
+    RegistroTraza *regs = malloc(total * sizeof(RegistroTraza));
+    LatenciaPieza *lat = calloc(total, sizeof(LatenciaPieza));
+    uint64_t *tmp = malloc(2 * total * sizeof(uint64_t));
+    if (!regs || !lat || !tmp) {
+        free(regs); free(lat); free(tmp);
+        fprintf(stderr, "Advertencia: sin memoria para analizar la traza\n");
+        return;
+    }
+    size_t k = 0;
+    for (BloqueTraza *b = bloques; b; b = b->siguiente) {
+        memcpy(&regs[k], b->registros, (size_t)b->usados * sizeof(RegistroTraza));
+        k += (size_t)b->usados;
+    }
+    qsort(regs, total, sizeof(RegistroTraza), comparar_registros);
+    
+    // Recorrer el historial de cada pieza en orden temporal
+    int n = 0;
+    size_t i = 0;
+    while (i < total) {
+        int32_t id = regs[i].id;
+        uint64_t t_disp = regs[i].dispensada_us;
+        uint64_t t_retirada = 0, t_buffer = 0, t_caja = 0, t_confirmada = 0;
+        int celda = -1, tipo = regs[i].tipo;
+        
+        for (; i < total && regs[i].id == id; i++) {
+            RegistroTraza *r = &regs[i];
+            switch (r->evento) {
+                case EVT_RETIRADA:
+                    if (t_retirada == 0) t_retirada = r->instante_us;
+                    break;
+                case EVT_EN_BUFFER:
+                    t_buffer = r->instante_us;
+                    break;
+                case EVT_EN_CAJA:
+                    t_caja = r->instante_us;
+                    celda = r->celda;
+                    break;
+                case EVT_DEVUELTA:
+                    t_buffer = 0;
+                    t_caja = 0;
+                    break;
+                case EVT_CONFIRMADA:
+                    t_confirmada = r->instante_us;
+                    break;
+                default:
+                    break;
+            }
+        }
+        
+        if (id <= 0 || t_confirmada == 0 || t_caja == 0) continue;
+        
+        LatenciaPieza *l = &lat[n++];
+        l->tipo = tipo;
+        l->celda = celda;
+        l->viaje = t_retirada ? t_retirada - t_disp : 0;
+        l->buffer = (t_buffer && t_caja > t_buffer) ? t_caja - t_buffer : 0;
+        l->revision = t_confirmada - t_caja;
+        l->total = t_confirmada - t_disp;
+    }
+    
+    printf("\n");
+    printf("╔════════════════════════════════════════════════════════════════════════╗\n");
+    printf("║       LATENCIA DISPENSADO -> CAJA CONFIRMADA (ms)                      ║\n");
+    printf("╠════════════════════════════════════════════════════════════════════════╣\n");
+    printf("║           piezas     p50     p95     p99     máx │  viaje buffer  revis ║\n");
+    printf("╠════════════════════════════════════════════════════════════════════════╣\n");
+    imprimir_fila("Todas", lat, n, 0, -1, tmp);
+    for (int t = 1; t <= sistema->config.num_tipos; t++) {
+        char etiqueta[24];
+        snprintf(etiqueta, sizeof(etiqueta), "Tipo %s", nombre_tipo_pieza(t));
+        imprimir_fila(etiqueta, lat, n, t, -1, tmp);
+    }
+    for (int c = 0; c < sistema->config.num_celdas; c++) {
+        char etiqueta[24];
+        snprintf(etiqueta, sizeof(etiqueta), "Celda %d", c + 1);
+        imprimir_fila(etiqueta, lat, n, 0, c, tmp);
+    }
+    printf("╚════════════════════════════════════════════════════════════════════════╝\n");
+    
+    free(regs);
+    free(lat);
+    free(tmp);
+}
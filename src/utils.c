@@ -6,55 +6,85 @@
 #include <stdio.h>
 #include <string.h>
 
+// Variable externa del sistema
+extern SistemaLego *sistema;
+
+// Nombres como columnas de planilla: A..Z, AA..AZ, BA..
+static char nombres_tipo[MAX_TIPOS_PIEZA + 1][3];
+static pthread_once_t nombres_tipo_listos = PTHREAD_ONCE_INIT;
+
+static void generar_nombres_tipo(void) {
+    for (int t = 1; t <= MAX_TIPOS_PIEZA; t++) {
+        int i = t - 1;
+        if (i < 26) {
+            snprintf(nombres_tipo[t], sizeof(nombres_tipo[t]), "%c", 'A' + i);
+        } else {
+            snprintf(nombres_tipo[t], sizeof(nombres_tipo[t]), "%c%c", 'A' + i / 26 - 1, 'A' + i % 26);
+        }
+    }
+}
+
 const char* nombre_tipo_pieza(int tipo) {
-    static const char* nombres[] = {"VACIO", "A", "B", "C", "D"};
-    if (tipo >= 0 && tipo <= MAX_TIPOS_PIEZA) {
-        return nombres[tipo];
+    pthread_once(&nombres_tipo_listos, generar_nombres_tipo);
+    if (tipo == 0) return "VACIO";
+    if (tipo >= 1 && tipo <= MAX_TIPOS_PIEZA) {
+        return nombres_tipo[tipo];
     }
     return "?";
 }
 
-void imprimir_estadisticas(Estadisticas *stats, ConfiguracionSistema *config) {
-    pthread_mutex_lock(&stats->mutex);
-    
-    // Calcular piezas esperadas vs usadas
-    int piezas_esperadas = 0;
-    for (int t = 0; t < MAX_TIPOS_PIEZA; t++) {
-        piezas_esperadas += config->piezas_por_tipo[t] * config->num_sets;
-    }
-    int piezas_por_set = config->piezas_por_tipo[0] + 
-                         config->piezas_por_tipo[1] +
-                         config->piezas_por_tipo[2] +
-                         config->piezas_por_tipo[3];
-    int piezas_en_cajas = stats->cajas_ok * piezas_por_set;
-    
-    // Calcular piezas perdidas
-    int piezas_contabilizadas = piezas_en_cajas + stats->total_piezas_tacho;
-    int piezas_perdidas = stats->total_piezas_dispensadas - piezas_contabilizadas;
-    
+void imprimir_estadisticas(const ResumenOperacion *r, const ConfiguracionSistema *config) {
+    // Vista de la instantánea: no toma ningún lock
     printf("\n");
     printf("╔═══════════════════════════════════════════════════════════════════╗\n");
     printf("║                   RESUMEN FINAL DE OPERACIÓN                      ║\n");
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
-    printf("║ Cajas completadas correctamente (OK):     %4d                     ║\n", stats->cajas_ok);
-    printf("║ Cajas completadas incorrectamente (FAIL): %4d                     ║\n", stats->cajas_fail);
-    printf("║ SETs esperados:                           %4d                     ║\n", config->num_sets);
+    printf("║ Cajas completadas correctamente (OK):     %4d                     ║\n", r->cajas_ok);
+    printf("║ Cajas completadas incorrectamente (FAIL): %4d                     ║\n", r->cajas_fail);
+    if (config->modo_continuo) {
+        printf("║ SETs esperados:                   (modo continuo)                 ║\n");
+    } else {
+        printf("║ SETs esperados:                           %4d                     ║\n", config->num_sets);
+    }
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     printf("║                    BALANCE DE PIEZAS                              ║\n");
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
-    printf("║ Total piezas dispensadas:                 %4d                     ║\n", stats->total_piezas_dispensadas);
-    printf("║ Piezas en cajas OK:                       %4d                     ║\n", piezas_en_cajas);
-    printf("║ Piezas en tacho (sobrantes):              %4d                     ║\n", stats->total_piezas_tacho);
-    if (piezas_perdidas > 0) {
-        printf("║ ⚠ Piezas no contabilizadas:               %4d                     ║\n", piezas_perdidas);
+    printf("║ Total piezas dispensadas:                 %4d                     ║\n", r->total_piezas_dispensadas);
+    printf("║ Piezas en cajas OK:                       %4d                     ║\n", r->piezas_en_cajas);
+    if (r->piezas_rechazadas > 0) {
+        printf("║ Piezas en cajas FAIL:                     %4d                     ║\n", r->piezas_rechazadas);
+    }
+    printf("║ Piezas en tacho (sobrantes):              %4d                     ║\n", r->total_piezas_tacho);
+    if (r->piezas_perdidas > 0) {
+        printf("║ ⚠ Piezas no contabilizadas:               %4d                     ║\n", r->piezas_perdidas);
+    }
+    if (r->piezas_devueltas > 0) {
+        printf("║ Piezas devueltas a la banda:              %4d                     ║\n", r->piezas_devueltas);
     }
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     printf("║                  PIEZAS SOBRANTES POR TIPO                        ║\n");
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     
-    for (int i = 0; i < MAX_TIPOS_PIEZA; i++) {
-        printf("║   Tipo %s: %4d piezas                                            ║\n", 
-               nombre_tipo_pieza(i+1), stats->piezas_en_tacho[i]);
+    for (int i = 0; i < config->num_tipos; i++) {
+        char etiqueta[8];
+        snprintf(etiqueta, sizeof(etiqueta), "%s:", nombre_tipo_pieza(i+1));
+        printf("║   Tipo %-3s%4d piezas                                            ║\n", 
+               etiqueta, r->piezas_en_tacho[i]);
+    }
+    
+    if (config->banda_circular) {
+        printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+        printf("║                  RECIRCULACIÓN (máx. %2d vueltas)                  ║\n",
+               config->max_vueltas);
+        printf("╠═══════════════════════════════════════════════════════════════════╣\n");
+        printf("║ Reingresos al inicio de la banda:         %4d                     ║\n",
+               r->recirculaciones);
+        printf("║   Vueltas   Confirmadas   Tacho                                   ║\n");
+        for (int v = 0; v <= config->max_vueltas; v++) {
+            if (r->vueltas_confirmadas[v] == 0 && r->vueltas_tacho[v] == 0) continue;
+            printf("║   %6d   %11d   %5d                                    ║\n",
+                   v, r->vueltas_confirmadas[v], r->vueltas_tacho[v]);
+        }
     }
     
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
@@ -65,7 +95,7 @@ void imprimir_estadisticas(Estadisticas *stats, ConfiguracionSistema *config) {
         printf("║ Celda %d:                                                          ║\n", c+1);
         for (int b = 0; b < BRAZOS_POR_CELDA; b++) {
             printf("║   Brazo %d: %4d piezas                                            ║\n", 
-                   b+1, stats->piezas_por_brazo[c][b]);
+                   b+1, r->piezas_por_brazo[c][b]);
         }
     }
     
@@ -73,29 +103,29 @@ void imprimir_estadisticas(Estadisticas *stats, ConfiguracionSistema *config) {
     printf("║                       CONCLUSIÓN                                  ║\n");
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     
-    if (stats->cajas_ok == config->num_sets && stats->total_piezas_tacho == 0) {
+    if (config->modo_continuo) {
+        printf("║ Producción continua: ver métricas de régimen por ventana         ║\n");
+    } else if (r->cajas_ok == config->num_sets && r->total_piezas_tacho == 0) {
         printf("║ ✓ ÉXITO TOTAL: Todos los SETs completados sin piezas sobrantes   ║\n");
-    } else if (stats->cajas_ok == config->num_sets && stats->total_piezas_tacho > 0) {
+    } else if (r->cajas_ok == config->num_sets && r->total_piezas_tacho > 0) {
         printf("║ ⚠ ADVERTENCIA: SETs completados pero hay piezas sobrantes        ║\n");
         printf("║   Esto indica que se dispensaron piezas de más o                 ║\n");
         printf("║   los brazos no alcanzaron a retirar todas las piezas.           ║\n");
-    } else if (stats->cajas_ok < config->num_sets) {
+    } else if (r->cajas_ok < config->num_sets) {
         printf("║ ✗ INCOMPLETO: No se completaron todos los SETs esperados         ║\n");
         printf("║   Completados: %d de %d                                           ║\n",
-               stats->cajas_ok, config->num_sets);
-        if (stats->total_piezas_tacho > 0) {
+               r->cajas_ok, config->num_sets);
+        if (r->total_piezas_tacho > 0) {
             printf("║   Las piezas sobrantes no llegaron a tiempo a las celdas        ║\n");
         }
     }
     
-    if (stats->cajas_fail > 0) {
+    if (r->cajas_fail > 0) {
         printf("║ ✗ ERRORES: %d cajas tuvieron contenido incorrecto                 ║\n",
-               stats->cajas_fail);
+               r->cajas_fail);
     }
     
     printf("╚═══════════════════════════════════════════════════════════════════╝\n");
-    
-    pthread_mutex_unlock(&stats->mutex);
 }
 
 void imprimir_estado_banda(BandaTransportadora *banda, int desde, int hasta) {
@@ -132,7 +162,7 @@ void imprimir_estado_celda(CeldaEmpaquetado *celda) {
     
     pthread_mutex_lock(&celda->caja.mutex);
     printf("Caja: ");
-    for (int i = 0; i < MAX_TIPOS_PIEZA; i++) {
+    for (int i = 0; i < sistema->config.num_tipos; i++) {
         printf("%s:%d/%d ", nombre_tipo_pieza(i+1), 
                celda->caja.piezas_por_tipo[i],
                celda->caja.piezas_necesarias[i]);